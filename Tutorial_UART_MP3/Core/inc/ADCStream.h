@@ -0,0 +1,36 @@
+#ifndef __ADCSTREAM_H
+#define __ADCSTREAM_H
+#include "ti_msp_dl_config.h"
+
+//ADC12_0 (PA27) sampled on TIMG0 zero events, moved by DMA_CH0 into two half-buffers;
+#define ADC_STREAM_BLOCK 256			//Samples per half-buffer (block), at most 512;
+#define ADC_STREAM_DECIM 4				//Boxcar decimation of ADCBlock.decimated, divides ADC_STREAM_BLOCK;
+#define ADC_STREAM_TIMER TIMG0
+#define ADC_STREAM_TIMER_CLK 1000000	//40MHz BUSCLK / 40, Hz;
+#define ADC_STREAM_EVENT_CHAN 1			//Event fabric channel TIMG0 -> ADC0;
+#define ADC_STREAM_RATE_MIN 16			//Hz, 16-bit timer period;
+#define ADC_STREAM_RATE_MAX 200000		//Hz;
+
+//One finished half-buffer with its statistics (12-bit LSB);
+struct ADCBlock{
+	const uint16_t *samples;	//ADC_STREAM_BLOCK raw samples;
+	const uint16_t *decimated;	//ADC_STREAM_BLOCK / ADC_STREAM_DECIM averages;
+	uint32_t seq;				//Block number since ADCStream_start;
+	uint32_t time;				//SysTime_getCycles() when the block was complete;
+	uint16_t min, max, mean;
+	uint16_t rms;				//RMS around the mean (AC part);
+	uint8_t half;				//0: first half of the buffer, 1: second half;
+};
+
+//Called once per block at the lowest interrupt priority, must return within one block period;
+typedef void (*ADCStream_Handler)(const struct ADCBlock *block);
+
+extern volatile uint32_t gADCStreamOverrun;	//Blocks overwritten before the handler got to them;
+extern volatile uint32_t gADCStreamLost;	//ADC results overwritten before the DMA took them;
+
+uint32_t ADCStream_start(uint32_t rate, ADCStream_Handler handler);
+void ADCStream_stop();
+uint32_t ADCStream_getRate();
+void ADCStream_report();
+
+#endif
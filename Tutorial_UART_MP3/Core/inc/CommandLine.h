@@ -7,6 +7,15 @@
 //#include "sys.h"
 //#include "stdlib.h"	  
 
+#define CMD_SYNC 7		//"sync": write the changed settings to the EEPROM now;
+#define CMD_WEAR 8		//"wear": print the EEPROM sector erase counts and projected lifetime;
+#define CMD_FILES 9		//"files": list the files on the SPI flash;
+#define CMD_UPLOAD 10	//"upload N": receive score N over UART into the SPI flash (ScoreStore.h);
+#define CMD_PLAY 11		//"play N": play uploaded score N; N = 1..6 gives the built-in command N;
+#define CMD_IMU 12		//"imu": print the attitude of the IMU filter;
+
+extern uint16_t gCmdArg;	//Number after "upload" / "play";
+
 inline void UpperAlphabet(char *str);
 inline char* DoubleSize(char * content);
 void CommandLineON();
@@ -0,0 +1,143 @@
+#ifndef __CONTAINERS_H
+#define __CONTAINERS_H
+#include "ti_msp_dl_config.h"
+#include "Vector.h"
+#include <string.h>
+
+/*
+Containers specialized to one element type by a macro, as inline functions: an element is copied
+as its type (a 4-byte struct is one word load and store, where Vector.c loops over elem_size
+bytes), an index is scaled by a constant, and a fixed capacity (a power of 2) becomes a mask.
+Define each one once, in the .c that uses it or in a header:
+	VECTOR_DEFINE(NoteVector, struct MusicNote)		//NoteVector_init(&v, buffer, capacity), NoteVector_push(&v, note), ...
+	RING_DEFINE(SampleRing, struct MPUSample, 64)	//Buffer inside; SampleRing_pushOverwrite keeps the newest;
+	QUEUE_DEFINE(RxQueue, uint8_t, 2048)			//One producer and one consumer, either may be an interrupt;
+Results are VectorError (Vector.h). Ring and queue indices are free-running uint16_t, so the
+capacity is at most 32768. In a queue the producer only writes head and the consumer only tail,
+each after its elements are copied, so no interrupt has to be disabled on either side.
+*/
+
+#define VECTOR_DEFINE(name, type) \
+typedef struct { \
+	type *buffer; \
+	size_t capacity, size; \
+} name; \
+__STATIC_FORCEINLINE void name##_init(name *v, type *buffer, size_t capacity) \
+{ \
+	v->buffer = buffer; \
+	v->capacity = capacity; \
+	v->size = 0; \
+} \
+__STATIC_FORCEINLINE VectorError name##_push(name *v, type value) \
+{ \
+	if (v->size >= v->capacity) \
+		return VECTOR_FULL; \
+	v->buffer[v->size++] = value; \
+	return VECTOR_OK; \
+} \
+__STATIC_FORCEINLINE VectorError name##_pop(name *v, type *value) \
+{ \
+	if (v->size == 0) \
+		return VECTOR_EMPTY; \
+	*value = v->buffer[--v->size]; \
+	return VECTOR_OK; \
+} \
+/* Element index, or 0 past the end; */ \
+__STATIC_FORCEINLINE type *name##_at(const name *v, size_t index) \
+{ \
+	return index < v->size ? v->buffer + index : 0; \
+} \
+/* Append count elements, all or none; */ \
+static inline VectorError name##_append(name *v, const type *src, size_t count) \
+{ \
+	if (count > v->capacity - v->size) \
+		return VECTOR_FULL; \
+	memcpy(v->buffer + v->size, src, count * sizeof(type)); \
+	v->size += count; \
+	return VECTOR_OK; \
+} \
+__STATIC_FORCEINLINE void name##_clear(name *v) { v->size = 0; } \
+__STATIC_FORCEINLINE size_t name##_size(const name *v) { return v->size; } \
+__STATIC_FORCEINLINE size_t name##_capacity(const name *v) { return v->capacity; }
+
+//Common part of RING_DEFINE and QUEUE_DEFINE: index qualifier and the barrier before publishing an index;
+#define CONTAINERS_RING(name, type, capacity, qualifier, barrier) \
+_Static_assert(((capacity) & ((capacity) - 1)) == 0 && (capacity) <= 32768, #name ": capacity must be a power of 2, <= 32768"); \
+typedef struct { \
+	qualifier uint16_t head, tail; \
+	type buffer[capacity]; \
+} name; \
+__STATIC_FORCEINLINE void name##_init(name *r) { r->head = r->tail = 0; } \
+__STATIC_FORCEINLINE uint16_t name##_count(const name *r) { return (uint16_t)(r->head - r->tail); } \
+__STATIC_FORCEINLINE uint16_t name##_capacity(const name *r) { (void)r; return (capacity); } \
+__STATIC_FORCEINLINE VectorError name##_push(name *r, type value) \
+{ \
+	uint16_t head = r->head; \
+	if ((uint16_t)(head - r->tail) >= (capacity)) \
+		return VECTOR_FULL; \
+	r->buffer[head & ((capacity) - 1)] = value; \
+	barrier; \
+	r->head = head + 1; \
+	return VECTOR_OK; \
+} \
+__STATIC_FORCEINLINE VectorError name##_pop(name *r, type *value) \
+{ \
+	uint16_t tail = r->tail; \
+	if (tail == r->head) \
+		return VECTOR_EMPTY; \
+	*value = r->buffer[tail & ((capacity) - 1)]; \
+	barrier; \
+	r->tail = tail + 1; \
+	return VECTOR_OK; \
+} \
+/* Producer: copy in up to count elements, in at most two memcpy; returns the number copied; */ \
+static inline uint16_t name##_write(name *r, const type *src, uint16_t count) \
+{ \
+	uint16_t head = r->head, at = head & ((capacity) - 1), first; \
+	if (count > (capacity) - (uint16_t)(head - r->tail)) \
+		count = (capacity) - (uint16_t)(head - r->tail); \
+	first = count < (capacity) - at ? count : (capacity) - at; \
+	memcpy(r->buffer + at, src, first * sizeof(type)); \
+	memcpy(r->buffer, src + first, (count - first) * sizeof(type)); \
+	barrier; \
+	r->head = head + count; \
+	return count; \
+} \
+/* Consumer: copy out up to count elements, oldest first; returns the number copied; */ \
+static inline uint16_t name##_read(name *r, type *dst, uint16_t count) \
+{ \
+	uint16_t tail = r->tail, at = tail & ((capacity) - 1), first; \
+	if (count > (uint16_t)(r->head - tail)) \
+		count = (uint16_t)(r->head - tail); \
+	first = count < (capacity) - at ? count : (capacity) - at; \
+	memcpy(dst, r->buffer + at, first * sizeof(type)); \
+	memcpy(dst + first, r->buffer, (count - first) * sizeof(type)); \
+	barrier; \
+	r->tail = tail + count; \
+	return count; \
+} \
+/* Consumer: drop everything queued so far; */ \
+__STATIC_FORCEINLINE void name##_flush(name *r) { r->tail = r->head; }
+
+//Ring used from one context (or with the interrupts held off by the caller);
+#define RING_DEFINE(name, type, capacity) \
+CONTAINERS_RING(name, type, capacity, , (void)0) \
+/* Push, dropping the oldest element when full; */ \
+__STATIC_FORCEINLINE void name##_pushOverwrite(name *r, type value) \
+{ \
+	if ((uint16_t)(r->head - r->tail) >= (capacity)) \
+		++r->tail; \
+	r->buffer[r->head++ & ((capacity) - 1)] = value; \
+} \
+/* index-th oldest element, or 0 past the newest; */ \
+__STATIC_FORCEINLINE type *name##_peek(name *r, uint16_t index) \
+{ \
+	return index < (uint16_t)(r->head - r->tail) ? &r->buffer[(r->tail + index) & ((capacity) - 1)] : 0; \
+}
+
+//Single-producer single-consumer queue between an interrupt and the main loop (Cortex-M0+ has
+//one core and keeps its own memory order, so a compiler barrier is enough);
+#define QUEUE_DEFINE(name, type, capacity) \
+CONTAINERS_RING(name, type, capacity, volatile, __COMPILER_BARRIER())
+
+#endif
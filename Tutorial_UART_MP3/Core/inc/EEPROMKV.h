@@ -0,0 +1,54 @@
+#ifndef __EEPROMKV_H
+#define __EEPROMKV_H
+#include "ti_msp_dl_config.h"
+#include "eeprom_emulation_type_a.h"
+
+/*
+Entries are appended to the records of the emulated EEPROM (EEPROM Type A), each one
+padded to whole 64-bit flash words:
+	key (u16) | len (u8) | crc (u8, CRC-8 of key, len and value) | value (len bytes) | 0xFF padding
+Each batch of entries ends with a commit word (one 64-bit flash word of zeros), programmed
+last: the entries before it count only once it reads all zero, which a program cut short by
+a reset never leaves. len EEPROM_KV_DELETED marks a deleted key; an erased header ends a
+record. The first record of a sector holds the compacted state, so a sector replays on its own.
+The compacted state also carries the erase count of each sector (key EEPROM_KV_KEY_WEAR: the
+lowest count as u32, then each sector's count above it as u8), which EEPROMKV_init loads back into
+gEEPROMTypeAEraseCount for the wear leveling.
+*/
+#define EEPROM_KV_MAX_KEYS 16			//Keys held in the RAM index, EEPROM_KV_KEY_WEAR included;
+#define EEPROM_KV_KEY_MAX 0xFFFD
+#define EEPROM_KV_KEY_WEAR 0xFFFE		//Reserved: sector erase counts;
+#define EEPROM_KV_BATCH_MAX 8			//Puts per EEPROMKV_putBatch;
+#define EEPROM_KV_HEADER 4
+#define EEPROM_KV_COMMIT 8
+#define EEPROM_KV_VALUE_MAX (EEPROM_EMULATION_DATA_SIZE - EEPROM_KV_HEADER - EEPROM_KV_COMMIT)
+#define EEPROM_KV_CAPACITY (EEPROM_EMULATION_DATA_SIZE - EEPROM_KV_COMMIT)	//Bytes of live entries, one compacted record;
+#define EEPROM_KV_DELETED 0xFF
+#define EEPROM_KV_ENDURANCE 10000		//Rated erase cycles of a sector outside the lower 32 KB of flash (MSPM0G3507 datasheet);
+
+//EEPROMKV_put / EEPROMKV_putBatch / EEPROMKV_delete status;
+#define EEPROM_KV_OK 0
+#define EEPROM_KV_WRITE_ERROR 1		//Flash program or erase failed;
+#define EEPROM_KV_FULL 2			//No index slot or no room left after compaction;
+#define EEPROM_KV_INVALID 3			//Key above EEPROM_KV_KEY_MAX, value or batch too long;
+
+struct EEPROMKVPut{
+	const void *value;
+	uint16_t key;
+	uint8_t len;				//EEPROM_KV_DELETED removes the key;
+};
+
+extern uint32_t gEEPROMKVBytes;			//Flash bytes programmed: entries, compactions and record headers;
+extern uint32_t gEEPROMKVCompactions;	//Sector changes (compacted records written);
+extern uint32_t gEEPROMKVWriteMax;		//Longest put/putBatch/delete, CPU cycles;
+
+uint32_t EEPROMKV_init(void);
+int16_t EEPROMKV_get(uint16_t key, void *value, uint8_t size);
+uint8_t EEPROMKV_put(uint16_t key, const void *value, uint8_t len);
+uint8_t EEPROMKV_putBatch(const struct EEPROMKVPut *puts, uint8_t n);
+uint8_t EEPROMKV_delete(uint16_t key);
+uint16_t EEPROMKV_used(void);
+void EEPROMKV_report(void);
+void EEPROMKV_reportWear(void);
+
+#endif
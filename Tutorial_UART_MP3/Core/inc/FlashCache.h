@@ -0,0 +1,24 @@
+#ifndef __FLASHCACHE_H
+#define __FLASHCACHE_H
+#include "ti_msp_dl_config.h"
+
+//RAM cache of SPI flash lines in front of SPIFlash.h: FLASH_CACHE_SETS x FLASH_CACHE_WAYS lines,
+//LRU within a set; line n goes to set n % FLASH_CACHE_SETS, so a sequential read walks the sets;
+#define FLASH_CACHE_LINE 256		//Bytes, = SPI_FLASH_PAGE;
+#define FLASH_CACHE_SETS 4			//Power of 2;
+#define FLASH_CACHE_WAYS 4
+#define FLASH_CACHE_BYPASS 1024		//Reads this long go straight to the flash and leave the cache alone;
+
+extern uint32_t gFlashCacheHits;		//Lines found in the cache;
+extern uint32_t gFlashCacheMisses;		//Lines read from the flash on demand;
+extern uint32_t gFlashCacheReadAheads;	//Lines read ahead by DMA after a sequential miss or hit;
+extern uint32_t gFlashCacheReadAheadHits;	//Read-ahead lines later used;
+extern uint32_t gFlashCacheBypass;		//Bytes of long reads past the cache;
+
+void FlashCache_init();
+uint8_t FlashCache_read(uint32_t addr, void *buf, uint32_t len);
+uint8_t FlashCache_program(uint32_t addr, const void *data, uint16_t len);
+uint8_t FlashCache_erase(uint32_t addr);
+void FlashCache_report();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __IMUFILTER_H
+#define __IMUFILTER_H
+#include "ti_msp_dl_config.h"
+#include "MPU6500_SPI.h"
+
+//Mahony gains in Q16 (Kp = 0.5, Ki = 0: no gyro bias estimation);
+#define IMU_FILTER_KP_Q16 32768
+#define IMU_FILTER_KI_Q16 0
+
+struct IMUAttitude{
+	int32_t q[4];			//Quaternion w,x,y,z, Q30;
+	int16_t roll, pitch, yaw;	//Unit: 0.01deg;
+	uint16_t seq;			//Sample number of the last update (struct MPUSample);
+};
+
+//MATHACL has no lock: while the filter runs in the MPU6500 interrupts (IMUFilter_start, IMUStream),
+//the foreground must not use it (Spectrum);
+void IMUFilter_init(uint16_t rate);
+void IMUFilter_update(const struct MPUData *data);
+const struct IMUAttitude *IMUFilter_get();
+void IMUFilter_feed(const struct MPUSample *sample);
+void IMUFilter_start(uint16_t rate, uint8_t acquisition);
+uint8_t IMUFilter_read(struct IMUAttitude *att);
+void IMUFilter_report();
+void IMUFilter_Bench(uint16_t n);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __IMUSTREAM_H
+#define __IMUSTREAM_H
+#include "ti_msp_dl_config.h"
+#include "MPU6500_SPI.h"
+
+//UART0 TX by DMA; channels 0/1 are the ADCs, 2/3 the MPU6500;
+#define IMU_STREAM_DMA_CHAN 4
+#define IMU_STREAM_BATCH MPU_FIFO_BATCH	//Samples per frame, one frame per FIFO drain;
+#define IMU_STREAM_STATS_PERIOD 1000	//ms between statistics frames;
+
+/*
+Frame layout (multi-byte fields little-endian):
+	0xA5 0x5A | type (u8) | len (u8) | payload (len bytes) | sum (u8, type..payload mod 256)
+Type IMU_FRAME_SAMPLES:
+	seq (u16, first sample) | time (u32, CPU cycles of the first sample) | period (u32, cycles)
+	| n * (ax ay az temp gx gy gz: 7 * s16 raw LSB), n = (len - 10) / 14, consecutive seq;
+Type IMU_FRAME_STATS:
+	ring overflow | FIFO overflow | frames sent (3 * u32), see gMPURingOverflow / gMPUFifoOverflow;
+*/
+#define IMU_FRAME_SYNC0 0xA5
+#define IMU_FRAME_SYNC1 0x5A
+#define IMU_FRAME_SAMPLES 0x01
+#define IMU_FRAME_STATS 0x02
+
+extern uint32_t gIMUStreamFrames;
+
+void IMUStream_start(uint16_t rate);
+void IMUStream_stop();
+void IMUStream_onTxDone();
+uint8_t IMUStream_active();
+
+#endif
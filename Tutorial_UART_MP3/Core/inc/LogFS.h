@@ -0,0 +1,58 @@
+#ifndef __LOGFS_H
+#define __LOGFS_H
+#include "ti_msp_dl_config.h"
+
+/*
+Append-only files on the SPI flash (SPIFlash.h), one 4 KB erase sector per block. A block
+belongs to a single file and starts with a header, then the commit slots, then the data:
+	  0 magic (u32) | seq (u32) | file id (u16) | index (u16) | prev (u16) | crc (u16)
+	 16 name (LOGFS_NAME bytes, 0xFF past block 0)
+	 30 deleted (u16, block 0 only: anything but 0xFFFF = the file is deleted)
+	 32 commit slots (LOGFS_SLOTS x u32: data bytes in the block | ~data bytes << 16)
+	128 data (LOGFS_DATA bytes)
+The header (all but deleted) is programmed once when the block is taken; seq counts
+the blocks taken, index numbers the blocks of a file from 0 and prev is the block before it.
+An append programs its data, then the next commit slot: bytes past the last valid slot do not
+count, so a power failure keeps a whole prefix of the appends. A slot or a header torn by a
+reset fails its check and closes the block (the next append takes a new block).
+There is no directory on flash: LogFS_mount reads every header and rebuilds the file table and
+the block chains in RAM. The blocks of deleted files (and blocks no file owns) are stale; they
+are erased in the background by LogFS_poll, the deleted block 0s last, so a file id cannot
+come back while any of its blocks remain.
+*/
+#define LOGFS_BLOCK 4096			//= SPI_FLASH_SECTOR;
+#define LOGFS_BLOCKS_MAX 512		//Blocks in RAM tables (2 MB), 4 bytes of RAM each;
+#define LOGFS_FILES 16
+#define LOGFS_NAME 14				//Name bytes, NUL-terminated when shorter;
+#define LOGFS_SLOTS 24				//Appends per block: append in pieces of LOGFS_DATA / LOGFS_SLOTS bytes or more;
+#define LOGFS_HEADER 32
+#define LOGFS_DATA (LOGFS_BLOCK - LOGFS_HEADER - LOGFS_SLOTS * 4)	//3968;
+#define LOGFS_MAGIC 0x3153464C		//"LFS1";
+
+//Status of the LogFS calls;
+#define LOGFS_OK 0
+#define LOGFS_NO_FLASH 1			//Not mounted, or no SPI flash;
+#define LOGFS_FULL 2				//No free block, or the file table is full;
+#define LOGFS_NOT_FOUND 3
+#define LOGFS_EXISTS 4
+#define LOGFS_INVALID 5				//Bad handle or name;
+
+extern uint32_t gLogFSBlocks;		//Blocks mounted;
+extern uint32_t gLogFSFree;			//Blocks ready to take;
+extern uint32_t gLogFSStale;		//Blocks waiting for the background erase;
+extern uint32_t gLogFSErases;		//Blocks erased since mount;
+extern uint32_t gLogFSMountMs;
+
+uint8_t LogFS_mount(uint32_t base, uint32_t size);
+uint8_t LogFS_create(const char *name, uint8_t *file);
+uint8_t LogFS_open(const char *name, uint8_t *file);
+uint8_t LogFS_append(uint8_t file, const void *data, uint32_t len);
+uint32_t LogFS_read(uint8_t file, uint32_t offset, void *buf, uint32_t len);
+uint32_t LogFS_size(uint8_t file);
+const char *LogFS_name(uint8_t file);		//0 for a handle with no file, so 0..LOGFS_FILES-1 lists them;
+uint8_t LogFS_delete(uint8_t file);
+void LogFS_sync();
+void LogFS_poll();
+void LogFS_report();
+
+#endif
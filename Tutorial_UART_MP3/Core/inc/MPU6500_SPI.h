@@ -0,0 +1,113 @@
+#ifndef __MPU6500_SPI_H
+#define __MPU6500_SPI_H
+#include "ti_msp_dl_config.h"
+
+//MPU6500 on SPI0 (SysConfig: SPI_Flash, CS1);
+#define MPU_INST SPI_Flash_INST
+#define MPU_DMA_RX_TRIG DMA_SPI0_RX_TRIG
+#define MPU_DMA_TX_TRIG DMA_SPI0_TX_TRIG
+//DMA channels 0/1 belong to the ADCs (SysConfig);
+#define MPU_DMA_RX_CHAN 2
+#define MPU_DMA_TX_CHAN 3
+//SPI clock = 80MHz / ((1 + SCR) * 2): registers are written at 1MHz, sensor data is read at 8MHz (datasheet limits 1MHz/20MHz);
+#define MPU_SCR_REG 39
+#define MPU_SCR_DATA 4
+//One sample: ACCEL_XOUT_H..GYRO_ZOUT_L;
+#define MPU_SAMPLE_BYTES 14
+#define MPU_INST_IRQHandler SPI_Flash_INST_IRQHandler
+#define MPU_INST_INT_IRQN SPI_Flash_INST_INT_IRQN
+
+//INT pin: PA9, data-ready pulse (active high, 50us);
+#define MPU_INT_PORT GPIOA
+#define MPU_INT_PIN DL_GPIO_PIN_9
+#define MPU_INT_IOMUX (IOMUX_PINCM20)
+#define MPU_INT_IIDX DL_GPIO_IIDX_DIO9
+#define MPU_INT_EDGE DL_GPIO_PIN_9_EDGE_RISE
+//FIFO batching: the sensor FIFO (512 bytes) is drained by DMA every MPU_FIFO_BATCH data-ready edges;
+#define MPU_FIFO_BATCH 8
+#define MPU_FIFO_DRAIN_MAX 16	//Samples per DMA drain, 16 * 14 = 224 bytes; a larger backlog goes in the next drains;
+#define MPU_RING_SIZE 64		//Samples buffered for the foreground, power of 2;
+
+//Raw sample as stored in the ring (register order, byte-swapped);
+struct MPUSample{
+	int16_t acc[3];
+	int16_t temp;
+	int16_t gyro[3];
+	uint16_t seq;		//Sample number, gaps mean samples were dropped (FIFO/acquisition mode);
+	uint32_t time;		//SysTime_getCycles() of the data-ready edge (FIFO/acquisition mode);
+};
+
+extern volatile uint32_t gMPURingOverflow;	//Samples dropped because the ring was full;
+extern volatile uint32_t gMPUFifoOverflow;	//Sensor FIFO overruns (FIFO reset, samples lost);
+extern volatile uint32_t gMPUMissed;		//Data-ready edges skipped because the previous read was still running;
+
+struct MPUInfo{
+	double xAcc,yAcc,zAcc;		//Unit: 0.0001g;
+	double xGypo,yGypo,zGypo;	//Unit: 0.01dps;
+	double temp;				//Unit: degC;
+};
+
+//Fixed-point sample, see MPU6500_Convert;
+struct MPUData{
+	int32_t acc[3];		//Unit: 0.0001g;
+	int32_t gyro[3];	//Unit: 0.01dps;
+	int16_t temp;		//Unit: 0.01degC;
+};
+
+//Calibration as kept in flash, see MPU6500_getCalib / MPU6500_setCalib;
+struct MPUCalib{
+	int16_t gyroOffset[3];	//XG/YG/ZG_OFFSET, 1/32.8dps;
+	int16_t accOffset[3];	//XA/YA/ZA_OFFSET 15-bit value incl. factory trim, 0.98mg;
+	uint16_t accGain[3];	//Q14, 16384 = 1;
+};
+
+//Newest sample, published by the interrupts (see MPU6500_readLatest) for foreground readers:
+//IMUFilter_report, MPU6500_UARTDebugger; the interrupt-side consumers (IMUFilter, IMUStream) take every sample from the ring;
+struct MPULatest{
+	struct MPUSample raw;
+	struct MPUData data;
+};
+
+extern const double AUnit[4];	//LSB/g for +-2/4/8/16g;
+extern const double GUnit[4];	//LSB/dps for +-250/500/1000/2000dps;
+
+uint8_t MPU6500_Init(void);
+uint8_t MPU6500_Write_Byte(uint8_t reg,uint8_t data);
+uint8_t MPU6500_Read_Byte(uint8_t reg);
+uint8_t MPU6500_Read_Len(uint8_t reg, uint8_t len,uint8_t *buf);
+uint8_t MPU6500_ReadBurst(uint8_t *buf);
+uint8_t MPU6500_Set_Gyro_Fsr(uint8_t fsr);
+uint8_t MPU6500_Set_Accel_Fsr(uint8_t fsr);
+uint8_t MPU6500_Set_LPF(uint16_t lpf);
+uint8_t MPU6500_Set_Rate(uint16_t rate);
+uint8_t MPU6500_Set_xAOFFSET(int16_t xoffset);
+uint8_t MPU6500_Set_yAOFFSET(int16_t yoffset);
+uint8_t MPU6500_Set_zAOFFSET(int16_t zoffset);
+uint8_t MPU6500_Set_xGOFFSET(int16_t xoffset);
+uint8_t MPU6500_Set_yGOFFSET(int16_t yoffset);
+uint8_t MPU6500_Set_zGOFFSET(int16_t zoffset);
+struct MPUInfo MPU6500_Calibration();
+struct MPUInfo MPU6500_getRawData();
+struct MPUInfo MPU6500_getData();
+uint8_t MPU6500_CalibrateGyro(uint16_t n);
+uint8_t MPU6500_CalibrateAccelPose(uint8_t pose, uint16_t n);
+uint8_t MPU6500_CalibrateAccelApply();
+void MPU6500_getCalib(struct MPUCalib *calib);
+uint8_t MPU6500_setCalib(const struct MPUCalib *calib);
+uint16_t MPU6500_RateTest(uint16_t rate, uint16_t period);
+void MPU6500_Convert(const struct MPUSample *raw, struct MPUData *out);
+uint8_t MPU6500_getDataFixed(struct MPUData *out);
+void MPU6500_ConvertBench(uint16_t n);
+uint8_t MPU6500_FIFO_start(uint16_t rate);
+void MPU6500_FIFO_stop();
+uint16_t MPU6500_FIFO_available();
+uint8_t MPU6500_FIFO_pop(struct MPUSample *sample);
+void MPU6500_FIFO_setHandler(void (*handler)(void));
+uint8_t MPU6500_Acq_start(uint16_t rate);
+void MPU6500_Acq_stop();
+uint8_t MPU6500_readLatest(struct MPULatest *latest);
+uint8_t MPU6500_ClaimBus();
+void MPU6500_ReleaseBus();
+void MPU6500_UARTDebugger();
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __MATHUTIL_H
+#define __MATHUTIL_H
+#include "ti_msp_dl_config.h"
+
+//MATHACL runs one operation at a time and has no lock: use it (MathUtil_sqrt, IMUFilter) either from
+//the foreground or from the interrupts (PendSV, MPU6500), never from both;
+
+#define MATHUTIL_CRC16_INIT 0xFFFF	//Start value of MathUtil_crc16;
+
+uint32_t MathUtil_sqrt(uint32_t x);
+uint16_t MathUtil_crc16(uint16_t crc, const void *data, uint16_t len);
+
+#endif
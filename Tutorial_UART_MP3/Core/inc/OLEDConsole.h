@@ -0,0 +1,16 @@
+#ifndef __OLEDCONSOLE_H
+#define __OLEDCONSOLE_H
+#include "oled_spi_V0.2.h"
+
+//6x8 font: one text row per page;
+#define CONSOLE_COLS 21		//128 / 6;
+#define CONSOLE_ROWS 8
+#define CONSOLE_HISTORY 32	//Lines kept in RAM for scrollback;
+
+void OLEDConsole_init();
+void OLEDConsole_close();
+void OLEDConsole_putc(char ch);
+void OLEDConsole_puts(const char *str);
+void OLEDConsole_scroll(int8_t lines);
+
+#endif
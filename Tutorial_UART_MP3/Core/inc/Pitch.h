@@ -0,0 +1,29 @@
+#ifndef __PITCH_H
+#define __PITCH_H
+#include "ti_msp_dl_config.h"
+#include "ADCStream.h"
+
+//YIN pitch detection on ADCStream blocks, range of the MusicPlayer.h note table (L1 262Hz .. HH7 3951Hz);
+#define PITCH_WINDOW 128			//Samples per difference sum;
+#define PITCH_FMIN 240				//Hz, sets the longest lag;
+#define PITCH_FMAX 4200				//Hz, sets the shortest lag;
+#define PITCH_THRESHOLD_Q15 4915	//YIN absolute threshold 0.15;
+#define PITCH_MIN_RMS 16			//LSB, quieter blocks are unvoiced;
+#define PITCH_TAU_MAX (ADC_STREAM_BLOCK - PITCH_WINDOW - 2)
+
+struct PitchResult{
+	uint32_t freq;		//Hz in Q4, 0 = no pitch;
+	uint8_t note;		//Nearest entry of the note table, see Pitch_noteName;
+	int8_t cents;		//Offset from that note, -99..99;
+	uint32_t seq;		//ADC block number;
+	uint32_t time;		//SysTime_getCycles() of the block end;
+};
+
+uint32_t Pitch_start(uint32_t rate);
+void Pitch_stop();
+uint8_t Pitch_get(struct PitchResult *result);
+const char *Pitch_noteName(uint8_t note);
+uint8_t Pitch_poll();
+void Pitch_report();
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __SPIFLASH_H
+#define __SPIFLASH_H
+#include "ti_msp_dl_config.h"
+
+//SPI NOR flash (W25Qxx / GD25Qxx class, 3-byte addresses) on SPI0 (SysConfig: SPI_Flash);
+//SPI0 is shared with the MPU6500 on CS1: the flash /CS is a GPIO held low for a whole command,
+//meanwhile the SPI's own chip select is moved to the unrouted CS0, so CS1 stays high;
+#define FLASH_INST SPI_Flash_INST
+#define FLASH_CS_PORT GPIOA
+#define FLASH_CS_PIN DL_GPIO_PIN_2
+#define FLASH_CS_IOMUX (IOMUX_PINCM7)
+//DMA channels 0/1 belong to the ADCs, 2/3 to the MPU6500, 4 to the IMU stream;
+#define FLASH_DMA_RX_CHAN 5
+#define FLASH_DMA_TX_CHAN 6
+//SPI clock = 80MHz / ((1 + SCR) * 2) = 20MHz (Fast Read is good to 50MHz and more);
+#define FLASH_SCR 1
+
+#define SPI_FLASH_PAGE 256			//Program unit, a program must not cross a page;
+#define SPI_FLASH_SECTOR 4096		//Erase unit;
+#define SPI_FLASH_QUEUE 4			//Queued page programs and sector erases, power of 2;
+
+//Status of the SPIFlash calls;
+#define SPI_FLASH_OK 0
+#define SPI_FLASH_NONE 1			//No flash answered the JEDEC ID;
+#define SPI_FLASH_BUSY 2			//Queue full or a read running, call SPIFlash_poll and try again;
+#define SPI_FLASH_INVALID 3			//Outside the chip, unaligned erase, or more than SPI_FLASH_QUEUE pages;
+
+struct SPIFlashInfo{
+	uint8_t manufacturer;		//JEDEC ID: 0xEF Winbond, 0xC8 GigaDevice, 0x20 Micron/XMC...;
+	uint8_t type;
+	uint8_t capacity;			//log2 of the size in bytes;
+	uint32_t size;				//Bytes, 0 = no flash found;
+};
+
+extern struct SPIFlashInfo gSPIFlash;
+extern uint32_t gSPIFlashReadBytes;		//Bytes read by DMA;
+extern uint32_t gSPIFlashProgramBytes;	//Bytes programmed;
+extern uint32_t gSPIFlashErases;		//Sectors erased;
+extern uint32_t gSPIFlashBusyPolls;		//Status reads that found the chip still busy;
+extern uint32_t gSPIFlashBusWaits;		//Bus claims refused by a running MPU6500 transfer;
+
+uint8_t SPIFlash_init();
+uint8_t SPIFlash_read(uint32_t addr, void *buf, uint32_t len);
+uint8_t SPIFlash_readStart(uint32_t addr, void *buf, uint32_t len);
+uint8_t SPIFlash_readBusy();
+uint8_t SPIFlash_program(uint32_t addr, const void *data, uint16_t len);
+uint8_t SPIFlash_erase(uint32_t addr);
+uint8_t SPIFlash_poll();
+void SPIFlash_sync();
+void SPIFlash_bench(uint32_t addr, uint32_t len);
+void SPIFlash_report();
+
+#endif
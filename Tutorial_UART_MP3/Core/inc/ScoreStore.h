@@ -0,0 +1,64 @@
+#ifndef __SCORESTORE_H
+#define __SCORESTORE_H
+#include "ti_msp_dl_config.h"
+
+//Scores uploaded over UART0 into LogFS files "score<ID>", played by ID; IDs 1-6 are the built-in scores;
+#define SCORE_ID_FIRST 7
+#define SCORE_ID_MAX 9999
+#define SCORE_RX_RING 2048			//Bytes buffered by the UART interrupt, power of 2, >= window * frame;
+#define SCORE_CHUNK_MAX 128			//Payload bytes per data frame;
+#define SCORE_WINDOW 8				//Data frames the host may send ahead of the ACKs;
+#define SCORE_STAGE 1024			//Bytes gathered before a LogFS append;
+#define SCORE_TIMEOUT_MS 2000		//Upload given up after this long without a frame;
+#define SCORE_REPEAT_MS 100			//Last ACK sent again after this long without a frame;
+#define SCORE_TRAILER_MAGIC 0x31524353	//"SCR1";
+
+/*
+Upload: the host sends the command line "upload <ID>", then waits for an ACK of seq 0.
+Frames (multi-byte fields little-endian), both ways:
+	0xA5 0x5A | type (u8) | seq (u16) | len (u8) | payload (len bytes) | crc (u16, CRC-16/CCITT of type..payload)
+Host to MCU:
+	SCORE_FRAME_DATA: seq counts from 0, payload 1..SCORE_CHUNK_MAX bytes of the score
+	SCORE_FRAME_END: seq = number of data frames, payload = total bytes (u32)
+	SCORE_FRAME_ABORT: no payload
+MCU to host:
+	SCORE_FRAME_ACK: seq = next data frame expected (all before it are stored), payload = status (u8)
+The MCU keeps only the frame it expects (go-back-N): on any other frame, or a bad CRC, it ACKs
+the seq it expects again, and the host resends from there. A quiet line makes the MCU repeat
+its last ACK, so a lost ACK (the ready one too) does not stall the upload. The host keeps up to SCORE_WINDOW
+frames in flight, so the line stays busy while the flash is programmed.
+Score: struct MusicNote records (Frq = timer period, 0 = rest; length in ms), 4 bytes each,
+then the trailer SCORE_TRAILER_MAGIC (u32) | notes (u32), appended once the END frame checks
+out: a file without it (an upload cut short) is not played.
+*/
+#define SCORE_FRAME_SYNC0 0xA5
+#define SCORE_FRAME_SYNC1 0x5A
+#define SCORE_FRAME_DATA 0x01
+#define SCORE_FRAME_END 0x02
+#define SCORE_FRAME_ABORT 0x03
+#define SCORE_FRAME_ACK 0x81
+#define SCORE_FRAME_HEADER 6		//Sync to len;
+#define SCORE_NOTE_BYTES 4
+
+//ACK status, and results of the ScoreStore calls;
+#define SCORE_OK 0					//Upload going on (ACK), score played;
+#define SCORE_DONE 1				//ACK of the END frame: stored and playable;
+#define SCORE_FAILED 2				//No flash, flash full, END total mismatch, abort or time-out;
+#define SCORE_NOT_FOUND 3			//No such ID, or its upload did not finish;
+#define SCORE_BUSY 4				//ScoreStore_poll: upload going on;
+
+extern uint32_t gScoreFrames;		//Data frames stored;
+extern uint32_t gScoreBadFrames;	//CRC errors and frames out of order;
+extern uint32_t gScoreRxOverflow;	//Bytes lost with the ring full;
+extern uint32_t gScoreLastBytes;	//Score bytes of the last finished upload;
+extern uint32_t gScoreLastMs;		//Its duration, from the ready ACK to the END frame;
+
+uint8_t ScoreStore_begin(uint16_t id);
+uint8_t ScoreStore_upload(uint16_t id);
+uint8_t ScoreStore_receiving();
+void ScoreStore_rx(uint8_t byte);
+uint8_t ScoreStore_poll();
+uint8_t ScoreStore_play(uint16_t id);
+void ScoreStore_report();
+
+#endif
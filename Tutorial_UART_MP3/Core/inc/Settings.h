@@ -0,0 +1,21 @@
+#ifndef __SETTINGS_H
+#define __SETTINGS_H
+#include "ti_msp_dl_config.h"
+#include "EEPROMKV.h"
+
+//RAM shadow of settings kept in the EEPROMKV store, committed as one batch;
+#define SETTINGS_MAX 6				//Shadowed keys, at most EEPROM_KV_BATCH_MAX;
+#define SETTINGS_SIZE_MAX 24		//Bytes per value; SETTINGS_MAX entries must fit one EEPROM record;
+
+extern uint32_t gSettingsSets;		//Settings_set calls that changed a value;
+extern uint32_t gSettingsCommits;	//Batches written to the EEPROMKV store;
+extern uint32_t gSettingsErrors;	//Failed commits, retried at the next interval;
+
+void Settings_init(uint32_t intervalMs);
+int16_t Settings_get(uint16_t key, void *value, uint8_t size);
+uint8_t Settings_set(uint16_t key, const void *value, uint8_t len);
+uint8_t Settings_sync();
+void Settings_poll();
+void Settings_report();
+
+#endif
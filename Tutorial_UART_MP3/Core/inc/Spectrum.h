@@ -0,0 +1,20 @@
+#ifndef __SPECTRUM_H
+#define __SPECTRUM_H
+#include "ti_msp_dl_config.h"
+#include "ADCStream.h"
+
+//Radix-2 FFT sizes; the tables in Spectrum.c are built for SPECTRUM_N_MAX points;
+#define SPECTRUM_N_MIN 64
+#define SPECTRUM_N_MAX 256
+#define SPECTRUM_TOP 8			//Pixel rows above the bars, a multiple of 8; the status line is in the last page of them;
+
+#if ADC_STREAM_BLOCK < SPECTRUM_N_MAX
+#error "Spectrum: an FFT frame is taken from one ADC block"
+#endif
+
+uint8_t Spectrum_start(uint32_t rate, uint16_t n);
+void Spectrum_stop();
+uint8_t Spectrum_poll();
+void Spectrum_report();
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __SYSTIME_H
+#define __SYSTIME_H
+#include "ti_msp_dl_config.h"
+
+//SysTick runs at CPUCLK_FREQ with a 1 ms period (SysConfig: SYSTICK.period = 80000);
+#define SYSTIME_CYCLES_PER_MS (CPUCLK_FREQ / 1000)
+
+extern volatile uint32_t gSysTimeMs;
+
+void SysTime_init();
+uint32_t SysTime_getMs();
+uint32_t SysTime_getCycles();
+
+#endif
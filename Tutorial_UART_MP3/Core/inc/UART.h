@@ -4,6 +4,8 @@
 #include "Vector.h"
 #include <stdio.h>
 
+#define UART_OLED_MIRROR 1	//1: printf output is also written to the OLED console (when open);
+
 extern Vector* Uart_Buffer;
 
 void UART_init();
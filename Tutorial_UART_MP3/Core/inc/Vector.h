@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+// Type-specialized, inline versions (and ring buffers, ISR-safe queues): Containers.h
+
 // 
 typedef enum {
     VECTOR_OK = 0,
@@ -66,17 +66,33 @@
  * @{
  */
 /*!
- * @brief The sector address to use
+ * @brief The sector address to use: the top 4 KB of the 128 KB main flash,
+ *        which keil/mspm0g3507.sct keeps free of code (ER_EEPROM)
  */
-#define EEPROM_EMULATION_ADDRESS                                    (0x00009000)
+#ifndef EEPROM_EMULATION_ADDRESS
+#define EEPROM_EMULATION_ADDRESS                                    (0x0001F000)
+#endif
 /*!
- * @brief The number of sectors to use
+ * @brief The number of sectors to use, 2 or more. A sector change moves to the
+ *        least-worn free sector, so more sectors spread the erases thinner.
+ *        The sectors must lie inside ER_EEPROM in the linker scatter file.
  */
-#define EEPROM_EMULATION_SECTOR_ACCOUNT                                      (2)
+#ifndef EEPROM_EMULATION_SECTOR_ACCOUNT
+#define EEPROM_EMULATION_SECTOR_ACCOUNT                                      (4)
+#endif
+/*!
+ * @brief Size of the per-sector tables, for builds that set the sector count
+ *        at run time
+ */
+#ifndef EEPROM_EMULATION_SECTOR_ACCOUNT_MAX
+#define EEPROM_EMULATION_SECTOR_ACCOUNT_MAX  (EEPROM_EMULATION_SECTOR_ACCOUNT)
+#endif
 /*!
  * @brief The record size. Valid values are 64 (64B), 128 (128B), or 256 (256B).
  */
+#ifndef EEPROM_EMULATION_RECORD_SIZE
 #define EEPROM_EMULATION_RECORD_SIZE                                       (256)
+#endif
 /** @}*/
 
  /** @addtogroup EEPROM_TYPE_A_LIB_PARAMETERS
@@ -150,6 +166,8 @@ extern uint32_t gNextRecordAddress;
 extern uint16_t gActiveRecordNum;
 /** \brief Store the number of active sectors */
 extern uint16_t gActiveSectorNum;
+/** \brief Store the sequence number of the active sector */
+extern uint16_t gActiveSectorSeq;
 
 /** \brief Indicate when the active record exists */
 extern bool gEEPROMTypeASearchFlag;
@@ -157,6 +175,15 @@ extern bool gEEPROMTypeASearchFlag;
 extern bool gEEPROMTypeAEraseFlag;
 /** \brief Indicate when a format error is found */
 extern bool gEEPROMTypeAFormatErrorFlag;
+/** \brief Sector waiting for its erase, 0 if none */
+extern uint32_t gEEPROMTypeAErasePending;
+/** \brief Indicate when the erase of gEEPROMTypeAErasePending is running */
+extern bool gEEPROMTypeAEraseBusy;
+/** \brief Count the erases that had to run inside a write */
+extern uint32_t gEEPROMTypeAEraseForced;
+/** \brief Erase cycles per sector, counted from boot; the caller may load
+ *  the counts kept from earlier runs (EEPROMKV does) before the next erase */
+extern uint32_t gEEPROMTypeAEraseCount[EEPROM_EMULATION_SECTOR_ACCOUNT_MAX];
 
 /**
  *  @brief      Store provided data to the virtual EEPROM
@@ -180,6 +207,45 @@ extern bool gEEPROMTypeAFormatErrorFlag;
  */
 uint32_t EEPROM_TypeA_writeData(uint32_t *data);
 
+/**
+ *  @brief      Store the first words of a new record
+ *
+ *  Same as @ref EEPROM_TypeA_writeData, but only the first words of the data
+ *  portion are programmed. The rest stays erased and can be filled later with
+ *  @ref EEPROM_TypeA_appendData while the record is active.
+ *
+ *  @param[in]  data          Pointer to the buffer in RAM
+ *  @param[in]  words         Number of 32-bit words to program, even, may be 0
+ *
+ *  @return     Whether or not the program succeeded
+ *
+ *  @retval     EEPROM_EMULATION_WRITE_OK        Program was successful
+ *  @retval     EEPROM_EMULATION_FORMAT_ERROR    Next address was not erased
+ *
+ *  @post        Same as @ref EEPROM_TypeA_writeData.
+ */
+uint32_t EEPROM_TypeA_writeRecord(uint32_t *data, uint16_t words);
+
+/**
+ *  @brief      Program more data into the erased part of the active record
+ *
+ *  The header of the active record is not touched. Every 64-bit flash word
+ *  must be programmed only once, so the caller keeps track of the words
+ *  already written and appends whole flash words after them.
+ *
+ *  @param[in]  offset        Byte offset in the data portion, multiple of 8
+ *  @param[in]  data          Pointer to the buffer in RAM
+ *  @param[in]  words         Number of 32-bit words to program, even
+ *
+ *  @return     Whether or not the program succeeded
+ *
+ *  @retval     EEPROM_EMULATION_WRITE_OK        Program was successful
+ *  @retval     EEPROM_EMULATION_WRITE_ERROR     No active record, bad range,
+ *                                               or the program failed
+ *  @retval     EEPROM_EMULATION_FORMAT_ERROR    Target was not erased
+ */
+uint32_t EEPROM_TypeA_appendData(uint16_t offset, uint32_t *data, uint16_t words);
+
 /**
  *  @brief      Initialize the specified area in flash
  *
@@ -254,9 +320,19 @@ bool EEPROM_TypeA_repairFormat(uint32_t *data);
 /**
  *  @brief      Search the active record and check the format
  *
- *  The function will traverse records� header. If the active record exists,
- *  gEEPROMTypeASearchFlag will be set, and 4 global variables about active record are
- *  updated. If the format is wrong, gEEPROMTypeAFormatErrorFlag is set
+ *  Every record header carries the sequence number of its sector in the low
+ *  half of its second word, incremented each time a new sector is started.
+ *  The function reads the first header of each sector to find the newest
+ *  committed sector, then binary-searches its headers for the last programmed
+ *  record, since records are written in order. Mount time therefore grows with
+ *  the number of sectors by one header read each, and with the number of
+ *  records only logarithmically.
+ *
+ *  Only the headers read are checked: a torn record (Recording, or a header
+ *  program cut short by a reset) is skipped for the one before it, and sets
+ *  gEEPROMTypeAFormatErrorFlag like any unknown state. If the active record exists,
+ *  gEEPROMTypeASearchFlag will be set, and 4 global variables about active
+ *  record and gActiveSectorSeq are updated.
  *
  *  @post        If the active record exists, gEEPROMTypeASearchFlag will be set,
  *               and 4 global variables about active record are updated.
@@ -264,6 +340,30 @@ bool EEPROM_TypeA_repairFormat(uint32_t *data);
  */
 void EEPROM_TypeA_searchCheck(void);
 
+/**
+ *  @brief      Run the erase of a full sector in the background
+ *
+ *  When a write starts a new sector, the previous sector is recorded in
+ *  gEEPROMTypeAErasePending (gEEPROMTypeAEraseFlag is set as before). Called
+ *  from the idle loop, this function starts that erase with the non-blocking
+ *  DL_FlashCTL_eraseMemory and returns; later calls check the command status
+ *  and clear gEEPROMTypeAErasePending and gEEPROMTypeAEraseFlag once it passed.
+ *
+ *  A write waits for a running erase, since the flash controller executes
+ *  one command at a time. A write that starts a new sector while an erase
+ *  is still pending erases that sector first (counted in
+ *  gEEPROMTypeAEraseForced), so at most one sector ever waits for an erase.
+ *
+ *  @return     Whether nothing is left to erase
+ *
+ *  @retval     false   An erase is running, pending or has failed
+ *  @retval     true    No sector is waiting for an erase
+ *
+ *  NOTE: Call it from the context that writes, never from an interrupt.
+ *        Code fetched from the same flash bank stalls while the erase runs.
+ */
+bool EEPROM_TypeA_eraseService(void);
+
 /**
  *  @brief      Erase the previous sector of the active sector
  *
@@ -272,8 +372,9 @@ void EEPROM_TypeA_searchCheck(void);
  *  @retval     false   Program didn't succeed
  *  @retval     true    Program was successful
  *
- * According to gActiveSectorNum, the function can find the sector with active record.
- * Then it will erase the previous sector
+ * Erases the sector left by the last sector change. Since a new sector is the
+ * least-worn free one (ties in sector order), that need not be the sector
+ * before gActiveSectorNum; with no change since boot it is.
  */
 bool EEPROM_TypeA_eraseLastSector(void);
 
@@ -286,12 +387,13 @@ bool EEPROM_TypeA_eraseLastSector(void);
  *  @retval     true    Program was successful
  *
  * According to gActiveSectorNum, the function can find the sector with active record.
- * Then it will erase sectors other than the active sector
+ * Then it will erase sectors other than the active sector. Sectors that are
+ * already blank are skipped, so a boot does not wear the free sectors.
  */
 bool EEPROM_TypeA_eraseNonActiveSectors(void);
 
 /**
- *  @brief      Erase all sectors used by EEPROM emulation
+ *  @brief      Erase all sectors used by EEPROM emulation, skipping blank ones
  *
  *  @return     Whether or not the program succeeded
  *
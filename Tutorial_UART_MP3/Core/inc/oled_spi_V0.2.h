@@ -6,6 +6,9 @@
 #define OLED_CMD 0  // 鍐欏懡浠?
 #define OLED_DATA 1 // 鍐欐暟鎹?
 #define OLED_MODE 0
+// 1: OLED_Present copies the changed pages into the new back buffer, so drawing can continue incrementally
+// 0: the back buffer keeps the frame before last; redraw everything each frame
+#define OLED_COPY_FORWARD 1
 
 #define  u8  unsigned char 
 #define  u32 unsigned int 
@@ -59,6 +62,9 @@
 #define YOFFSET 0
 #endif
 
+// Back buffer that drawing functions write to, indexed [column][page]
+extern u8 (*OLED_GRAM)[8];
+
 // OLED鎺у埗鐢ㄥ嚱鏁?
 void OLED_WR_Byte(u8 dat,u8 cmd);	    
 void OLED_Display_On(void);
@@ -71,12 +77,20 @@ void OLED_ShowChar(u8 x,u8 y,char chr);
 void OLED_ShowNum(u8 x,u8 y,u32 num,u8 len,u8 size2);
 void OLED_ShowSignedNum(u8 x, u8 y, int32_t num, u8 len, u8 size2);
 void OLED_ShowString(u8 x,u8 y, char *p);	 
+void OLED_DrawString(u8 x,u8 page,const char *str);
 void OLED_Set_Pos(unsigned char x, unsigned char y);
 void OLED_ShowCHinese(u8 x,u8 y,u8 no);
 void OLED_DrawBMP(unsigned char x0, unsigned char y0,unsigned char x1, unsigned char y1,const unsigned char BMP[]);
+void OLED_DrawRLE(unsigned char x0, unsigned char y0,unsigned char x1, unsigned char y1,const unsigned char RLE[]);
+void OLED_DecodeRLE(unsigned char x0, unsigned char y0,unsigned char x1, unsigned char y1,const unsigned char RLE[]);
+void OLED_RLE_Decode(const unsigned char RLE[], u8 *dst, uint16_t len);
 void OLED_ColorTurn(u8 i);
 void OLED_DisplayTurn(u8 i);
 void OLED_Refresh(void);
+void OLED_ClearBuffer(void);
+void OLED_Present(void);
+void OLED_WaitFlush(void);
+u8 OLED_IsFlushing(void);
 void OLED_DrawPoint(u8 x,u8 y,u8 t);
 void OLED_DrawLine(u8 x1,u8 y1,u8 x2,u8 y2,u8 mode);
 void OLED_DrawCircle(u8 x,u8 y,u8 r);
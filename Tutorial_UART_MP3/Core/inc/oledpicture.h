@@ -1,61 +1,25 @@
 #ifndef __OLEDPICTURE_H
 #define __OLEDPICTURE_H 	   
-const unsigned char Genshin[] = {
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x80,0xFE,0xFF,
-0xFF,0xC0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xC0,0xC0,0xE0,
-0xE0,0xF0,0xFC,0xFE,0xFC,0xF0,0xE0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,
-0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,0xC0,
-0xC0,0xC0,0xC0,0xC0,0xC0,0xE0,0xE0,0xF8,0xFE,0xFE,0xF8,0xE0,0xE0,0xC0,0xC0,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xC0,0xC0,0xE0,0xF8,0xFF,0xFF,0xFF,0xFF,0xFF,
-0xF8,0xE0,0xE0,0xC0,0xC0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xFF,0xFF,
-0xFF,0xFF,0xFF,0xFF,0xFF,0x01,0xFC,0xFC,0xFC,0xFC,0xF8,0xF8,0xF8,0x18,0x38,0x1F,
-0x3F,0x3F,0x3F,0x3F,0x3A,0x38,0x38,0xF8,0xFC,0xFC,0xFC,0xF8,0xF8,0x70,0x00,0xF8,
-0xF8,0xF8,0xF8,0xF8,0xF9,0xFF,0xFF,0xFF,0xFF,0xFD,0xFE,0xFE,0xFC,0xF8,0xF0,0xFC,
-0xFC,0xFC,0xFC,0xF8,0xF8,0xF8,0x38,0x19,0x99,0xFB,0xFF,0xFF,0xFF,0xFB,0x99,0x39,
-0x38,0xF8,0xFC,0xFC,0xFC,0xFC,0xFC,0xF8,0x38,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xFF,0xFF,0xFF,0xFF,
-0xFF,0xFF,0x7F,0x00,0xFF,0xFF,0xFF,0xFF,0xFF,0x7F,0x7F,0x63,0xE3,0xE3,0xE3,0xE3,
-0xE3,0xE3,0xE3,0x63,0x72,0xFF,0xFF,0xFF,0xFF,0xFF,0x7F,0x00,0x00,0xFF,0xFF,0xFF,
-0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFE,0xFE,0xFE,0xFE,0xFE,0xFF,0xFF,0xFF,
-0xFF,0xFF,0xFF,0xFF,0xCF,0x8F,0x9F,0xFF,0xFF,0xFF,0xFF,0xFF,0xDF,0xCF,0xCF,0xFF,
-0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x80,0xE0,0xF0,0xFE,0x7F,0x3F,0x3F,0x1F,0x77,0xF9,
-0xFC,0xFC,0xFD,0xBF,0x3E,0x3E,0x3E,0x1E,0x1C,0x18,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,
-0x7F,0x18,0x1C,0x1E,0x1F,0x3E,0x3E,0xBE,0xFC,0xFC,0xFC,0xFF,0x7F,0x3F,0x1F,0x0F,
-0xFF,0xFF,0xFF,0xFF,0xFF,0x7F,0x07,0x07,0x03,0x03,0x00,0x0F,0x0F,0x0F,0x0F,0x07,
-0x03,0x23,0x71,0xF1,0xF9,0xFD,0xFF,0xFF,0xFF,0xFD,0xF9,0xF1,0x71,0x61,0x23,0x07,
-0x0F,0x0F,0x1F,0x0F,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x01,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x01,0x01,0x01,0x01,0x00,0x00,0x00,0x00,0x08,0x0F,0x0F,0x07,0x07,0x03,0x00,0x00,
-0x00,0x00,0x00,0x01,0x01,0x01,0x01,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x07,0x0F,
-0x0F,0x07,0x03,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x03,0x1F,0xFF,0xFF,0xFF,0x3F,0x03,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x07,0xFF,0x3F,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x07,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+//Assets are RLE-compressed page bytes, generated with oledrle.py;
+//Genshin_RLE: 110x64 px (8 pages), 880 -> 268 bytes; draw with OLED_DrawRLE(x0,y0,x0+110,y0+8,Genshin_RLE);
+const unsigned char Genshin_RLE[] = {
+0xBF,0x8C,0x04,0x80,0xFE,0xFF,0xFF,0xC0,0xAA,0xC0,0xC0,0xC0,0xE0,0x05,0xF0,0xFC,
+0xFE,0xFC,0xF0,0xE0,0xDC,0xC0,0xC0,0xE0,0x07,0xF8,0xFE,0xFE,0xF8,0xE0,0xE0,0xC0,
+0xC0,0x87,0xC0,0xC0,0x01,0xE0,0xF8,0xC3,0xFF,0x04,0xF8,0xE0,0xE0,0xC0,0xC0,0xA8,
+0xC5,0xFF,0x00,0x01,0xC2,0xFC,0xC1,0xF8,0x02,0x18,0x38,0x1F,0xC2,0x3F,0x03,0x3A,
+0x38,0x38,0xF8,0xC1,0xFC,0xC0,0xF8,0x00,0x70,0x80,0xC3,0xF8,0x00,0xF9,0xC2,0xFF,
+0x05,0xFD,0xFE,0xFE,0xFC,0xF8,0xF0,0xC2,0xFC,0xC1,0xF8,0x03,0x38,0x19,0x99,0xFB,
+0xC1,0xFF,0x04,0xFB,0x99,0x39,0x38,0xF8,0xC3,0xFC,0x01,0xF8,0x38,0xA2,0xC4,0xFF,
+0x00,0x7F,0x80,0xC3,0xFF,0xC0,0x7F,0x00,0x63,0xC5,0xE3,0x01,0x63,0x72,0xC3,0xFF,
+0x00,0x7F,0x81,0xC9,0xFF,0xC3,0xFE,0xC5,0xFF,0x02,0xCF,0x8F,0x9F,0xC3,0xFF,0x02,
+0xDF,0xCF,0xCF,0xC5,0xFF,0x9F,0x0D,0x80,0xE0,0xF0,0xFE,0x7F,0x3F,0x3F,0x1F,0x77,
+0xF9,0xFC,0xFC,0xFD,0xBF,0xC1,0x3E,0x03,0x1E,0x1C,0x18,0xBF,0xC3,0xFF,0x07,0x7F,
+0x18,0x1C,0x1E,0x1F,0x3E,0x3E,0xBE,0xC1,0xFC,0x04,0xFF,0x7F,0x3F,0x1F,0x0F,0xC3,
+0xFF,0x04,0x7F,0x07,0x07,0x03,0x03,0x80,0xC2,0x0F,0x06,0x07,0x03,0x23,0x71,0xF1,
+0xF9,0xFD,0xC1,0xFF,0x0A,0xFD,0xF9,0xF1,0x71,0x61,0x23,0x07,0x0F,0x0F,0x1F,0x0F,
+0x9F,0xC0,0x01,0x89,0xC2,0x01,0x83,0x05,0x08,0x0F,0x0F,0x07,0x07,0x03,0x84,0xC3,
+0x01,0x85,0x04,0x07,0x0F,0x0F,0x07,0x03,0x8E,0x01,0x03,0x1F,0xC1,0xFF,0x01,0x3F,
+0x03,0xBF,0xA8,0x02,0x07,0xFF,0x3F,0xBF,0xAB,0x00,0x07,0x9D,
 };
 
 #endif
@@ -0,0 +1,281 @@
+/*
+ * @file ADCStream.c
+ * @brief Continuous ADC acquisition into ping-pong half-buffers
+ * @details TIMG0 publishes its zero event to ADC12_0, which converts one sample per event;
+ *          DMA_CH0 moves every result into the current half-buffer. When a half is full
+ *          the ADC DMA_DONE interrupt re-arms the DMA on the other half at once, so the
+ *          sampling never stops, and pends PendSV. PendSV runs at the lowest priority,
+ *          computes the block statistics and calls the block handler, so block processing
+ *          never delays the UART, MPU6500 or buzzer interrupts.
+ *          The CPU load counts both handlers, each in its own counter, with the ADC interrupts
+ *          nested in PendSV taken out of its time (other interrupts nested in it still count);
+ *          the sustained rate counts delivered samples.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "ADCStream.h"
+#include "SysTime.h"
+#include "UART.h"
+
+volatile uint32_t gADCStreamOverrun = 0;
+volatile uint32_t gADCStreamLost = 0;
+
+static uint16_t ADC_Buf[2][ADC_STREAM_BLOCK];
+static uint16_t ADC_Dec[ADC_STREAM_BLOCK / ADC_STREAM_DECIM];
+static struct ADCBlock ADC_Block;			//Statistics of the newest processed block;
+static ADCStream_Handler ADC_Handler = 0;
+static volatile uint8_t ADC_Filling = 0;	//Half the DMA writes to;
+static volatile uint8_t ADC_Ready = 0;		//Half + 1 waiting for PendSV, 0 = none;
+static volatile int8_t ADC_Processing = -1;	//Half PendSV is working on;
+static volatile uint32_t ADC_Seq = 0;
+static volatile uint32_t ADC_ReadyTime = 0;
+static uint32_t ADC_Rate = 0;
+static uint8_t ADC_Active = 0;
+
+//Measurement window of ADCStream_report;
+static volatile uint32_t ADC_WinBlocks = 0;
+static volatile uint32_t ADC_WinIsr = 0;	//Cycles in ADC12_0_INST_IRQHandler, written by it only;
+static volatile uint32_t ADC_WinPendSV = 0;	//Cycles in PendSV_Handler less the ADC interrupts nested in it, written by it only;
+static uint32_t ADC_WinStart = 0;
+
+static const DL_TimerG_ClockConfig gADCTimerClockConfig = {
+	.clockSel    = DL_TIMER_CLOCK_BUSCLK,
+	.divideRatio = DL_TIMER_CLOCK_DIVIDE_1,
+	.prescale    = 39,
+};
+
+static void ADCStream_arm(uint8_t half)
+{
+	DL_DMA_setSrcAddr(DMA, DMA_CH0_CHAN_ID, DL_ADC12_getMemResultAddress(ADC12_0_INST, ADC12_0_ADCMEM_0));
+	DL_DMA_setDestAddr(DMA, DMA_CH0_CHAN_ID, (uint32_t) &ADC_Buf[half][0]);
+	DL_DMA_setTransferSize(DMA, DMA_CH0_CHAN_ID, ADC_STREAM_BLOCK);
+	DL_DMA_enableChannel(DMA, DMA_CH0_CHAN_ID);
+	ADC_Filling = half;
+}
+
+static uint16_t ADCStream_isqrt(uint32_t v)
+{
+	uint32_t root = 0, bit = 1UL << 30;
+	while (bit > v)
+		bit >>= 2;
+	while (bit)
+	{
+		if (v >= root + bit)
+		{
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+		bit >>= 2;
+	}
+	return (uint16_t)root;
+}
+
+/**
+ * @brief Statistics and decimation of one half-buffer
+ * @details Samples are summed around mid-scale, so the sum of squares fits 32 bits for 512 samples.
+ */
+static void ADCStream_process(uint8_t half)
+{
+	const uint16_t *s = ADC_Buf[half];
+	uint16_t min = 0xFFFF, max = 0, i, j;
+	int32_t sum = 0, d, dec;
+	uint32_t sq = 0;
+	int64_t var;
+	for (i = 0; i < ADC_STREAM_BLOCK; i += ADC_STREAM_DECIM)
+	{
+		dec = 0;
+		for (j = i; j < i + ADC_STREAM_DECIM; j++)
+		{
+			if (s[j] < min) min = s[j];
+			if (s[j] > max) max = s[j];
+			d = (int32_t)s[j] - 2048;
+			dec += s[j];
+			sum += d;
+			sq += (uint32_t)(d * d);
+		}
+		ADC_Dec[i / ADC_STREAM_DECIM] = (uint16_t)(dec / ADC_STREAM_DECIM);
+	}
+	var = ((int64_t)sq * ADC_STREAM_BLOCK - (int64_t)sum * sum) / ((int64_t)ADC_STREAM_BLOCK * ADC_STREAM_BLOCK);
+	ADC_Block.samples = s;
+	ADC_Block.decimated = ADC_Dec;
+	ADC_Block.seq = ADC_Seq;
+	ADC_Block.time = ADC_ReadyTime;
+	ADC_Block.min = min;
+	ADC_Block.max = max;
+	ADC_Block.mean = (uint16_t)(2048 + sum / ADC_STREAM_BLOCK);
+	ADC_Block.rms = ADCStream_isqrt((uint32_t)var);
+	ADC_Block.half = half;
+}
+
+/**
+ * @brief Block processing at the lowest priority, pended by the DMA_DONE interrupt
+ */
+void PendSV_Handler(void)
+{
+	uint32_t c0, isr0;
+	uint8_t half;
+	__disable_irq();
+	c0 = SysTime_getCycles();
+	isr0 = ADC_WinIsr;
+	__enable_irq();
+	while (ADC_Ready)
+	{
+		__disable_irq();
+		half = ADC_Ready - 1;
+		ADC_Ready = 0;
+		ADC_Processing = half;
+		__enable_irq();
+		ADCStream_process(half);
+		if (ADC_Handler)
+			ADC_Handler(&ADC_Block);
+		ADC_Processing = -1;
+	}
+	//The ADC interrupt preempts PendSV: its time inside this span is already in ADC_WinIsr
+	//(both ends are masked so that none falls between the cycle count and ADC_WinIsr);
+	__disable_irq();
+	ADC_WinPendSV += SysTime_getCycles() - c0 - (ADC_WinIsr - isr0);
+	__enable_irq();
+}
+
+/**
+ * @brief Half-buffer done: re-arm the DMA on the other half and hand this one to PendSV
+ */
+void ADC12_0_INST_IRQHandler(void)
+{
+	uint32_t c0 = SysTime_getCycles();
+	uint8_t half, next;
+	switch (DL_ADC12_getPendingInterrupt(ADC12_0_INST)){
+		case DL_ADC12_IIDX_DMA_DONE:
+			half = ADC_Filling;
+			next = half ^ 1;
+			ADCStream_arm(next);
+			if (ADC_Ready == next + 1 || ADC_Processing == next)
+				++gADCStreamOverrun;	//That half is refilled before it was used;
+			ADC_ReadyTime = c0;
+			++ADC_Seq;
+			++ADC_WinBlocks;
+			ADC_Ready = half + 1;
+			SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+			break;
+		case DL_ADC12_IIDX_OVERFLOW:
+			++gADCStreamLost;
+			break;
+		default:
+			break;
+	}
+	ADC_WinIsr += SysTime_getCycles() - c0;
+}
+
+/**
+ * @brief Start sampling ADC12_0 continuously
+ * @param rate The sample rate in Hz (ADC_STREAM_RATE_MIN-ADC_STREAM_RATE_MAX)
+ * @param handler Called for every block, see ADCStream_Handler; 0 for statistics only
+ * @return The actual sample rate in Hz (the timer period is a whole number of us)
+ * @details Needs SysTime_init. Takes over the SysConfig setup of ADC12_0 and DMA_CH0.
+ */
+uint32_t ADCStream_start(uint32_t rate, ADCStream_Handler handler)
+{
+	DL_TimerG_TimerConfig timerConfig = {
+		.timerMode   = DL_TIMER_TIMER_MODE_PERIODIC,
+		.startTimer  = DL_TIMER_STOP,
+		.genIntermInt = DL_TIMER_INTERM_INT_DISABLED,
+		.counterVal  = 0,
+	};
+	if (ADC_Active)
+		ADCStream_stop();
+	if (rate < ADC_STREAM_RATE_MIN) rate = ADC_STREAM_RATE_MIN;
+	if (rate > ADC_STREAM_RATE_MAX) rate = ADC_STREAM_RATE_MAX;
+	timerConfig.period = ADC_STREAM_TIMER_CLK / rate - 1;
+	ADC_Rate = ADC_STREAM_TIMER_CLK / (timerConfig.period + 1);
+
+	ADC_Handler = handler;
+	ADC_Ready = 0;
+	ADC_Processing = -1;
+	ADC_Seq = 0;
+	gADCStreamOverrun = gADCStreamLost = 0;
+
+	//Timer: zero event every sample period, published on the event channel;
+	DL_TimerG_reset(ADC_STREAM_TIMER);
+	DL_TimerG_enablePower(ADC_STREAM_TIMER);
+	delay_cycles(POWER_STARTUP_DELAY);
+	DL_TimerG_setClockConfig(ADC_STREAM_TIMER, (DL_TimerG_ClockConfig *) &gADCTimerClockConfig);
+	DL_TimerG_initTimerMode(ADC_STREAM_TIMER, &timerConfig);
+	DL_TimerG_setPublisherChanID(ADC_STREAM_TIMER, DL_TIMERG_PUBLISHER_INDEX_0, ADC_STREAM_EVENT_CHAN);
+	DL_TimerG_enableEvent(ADC_STREAM_TIMER, DL_TIMERG_EVENT_ROUTE_1, DL_TIMERG_EVENT_ZERO_EVENT);
+	DL_TimerG_enableClock(ADC_STREAM_TIMER);
+
+	//ADC: one conversion per event instead of free-running;
+	DL_ADC12_disableConversions(ADC12_0_INST);
+	DL_ADC12_initSingleSample(ADC12_0_INST,
+		DL_ADC12_REPEAT_MODE_ENABLED, DL_ADC12_SAMPLING_SOURCE_AUTO, DL_ADC12_TRIG_SRC_EVENT,
+		DL_ADC12_SAMP_CONV_RES_12_BIT, DL_ADC12_SAMP_CONV_DATA_FORMAT_UNSIGNED);
+	DL_ADC12_configConversionMem(ADC12_0_INST, ADC12_0_ADCMEM_0,
+		DL_ADC12_INPUT_CHAN_0, DL_ADC12_REFERENCE_VOLTAGE_VDDA, DL_ADC12_SAMPLE_TIMER_SOURCE_SCOMP0, DL_ADC12_AVERAGING_MODE_DISABLED,
+		DL_ADC12_BURN_OUT_SOURCE_DISABLED, DL_ADC12_TRIGGER_MODE_TRIGGER_NEXT, DL_ADC12_WINDOWS_COMP_MODE_DISABLED);
+	DL_ADC12_setSubscriberChanID(ADC12_0_INST, ADC_STREAM_EVENT_CHAN);
+	DL_ADC12_clearInterruptStatus(ADC12_0_INST, DL_ADC12_INTERRUPT_DMA_DONE | DL_ADC12_INTERRUPT_OVERFLOW);
+	DL_ADC12_enableInterrupt(ADC12_0_INST, DL_ADC12_INTERRUPT_DMA_DONE | DL_ADC12_INTERRUPT_OVERFLOW);
+	ADCStream_arm(0);
+	DL_ADC12_enableConversions(ADC12_0_INST);
+
+	NVIC_SetPriority(PendSV_IRQn, 3);
+	NVIC_ClearPendingIRQ(ADC12_0_INST_INT_IRQN);
+	NVIC_EnableIRQ(ADC12_0_INST_INT_IRQN);
+	ADC_WinBlocks = ADC_WinIsr = ADC_WinPendSV = 0;
+	ADC_WinStart = SysTime_getMs();
+	ADC_Active = 1;
+	DL_TimerG_startCounter(ADC_STREAM_TIMER);
+	return ADC_Rate;
+}
+
+/**
+ * @brief Stop sampling; a block being processed is finished first
+ */
+void ADCStream_stop()
+{
+	DL_TimerG_stopCounter(ADC_STREAM_TIMER);
+	NVIC_DisableIRQ(ADC12_0_INST_INT_IRQN);
+	DL_ADC12_disableConversions(ADC12_0_INST);
+	DL_DMA_disableChannel(DMA, DMA_CH0_CHAN_ID);
+	DL_ADC12_disableInterrupt(ADC12_0_INST, DL_ADC12_INTERRUPT_DMA_DONE | DL_ADC12_INTERRUPT_OVERFLOW);
+	ADC_Ready = 0;
+	ADC_Active = 0;
+}
+
+/**
+ * @brief Get the programmed sample rate
+ * @return The sample rate in Hz, 0 if not started
+ */
+uint32_t ADCStream_getRate()
+{
+	return ADC_Rate;
+}
+
+/**
+ * @brief Print the sustained rate, CPU load and newest block statistics over UART, then start a new window
+ */
+void ADCStream_report()
+{
+	uint32_t ms, blocks, busy, load;
+	struct ADCBlock block;
+	//PendSV may rewrite ADC_Block between two reads of the foreground;
+	__disable_irq();
+	ms = SysTime_getMs() - ADC_WinStart;
+	blocks = ADC_WinBlocks;
+	busy = ADC_WinIsr + ADC_WinPendSV;
+	block = ADC_Block;
+	ADC_WinBlocks = ADC_WinIsr = ADC_WinPendSV = 0;
+	ADC_WinStart = SysTime_getMs();
+	__enable_irq();
+	if (ms == 0)
+		return;
+	load = (uint32_t)((uint64_t)busy * 1000 / ((uint64_t)ms * SYSTIME_CYCLES_PER_MS));	//0.1%;
+	printf("ADCStream: %lu Hz sustained (%lu set), load %lu.%lu%%, %lu overruns, %lu lost\n",
+		(unsigned long)((uint64_t)blocks * ADC_STREAM_BLOCK * 1000 / ms), (unsigned long)ADC_Rate,
+		(unsigned long)(load / 10), (unsigned long)(load % 10),
+		(unsigned long)gADCStreamOverrun, (unsigned long)gADCStreamLost);
+	printf("ADCStream: block %lu min %u max %u mean %u rms %u\n", (unsigned long)block.seq,
+		block.min, block.max, block.mean, block.rms);
+}
@@ -12,6 +12,7 @@
  
  static uint16_t Wcnt = 0, CmdNumber = 0, nowSize = DEFAULT_COMMAND_LENGTH;
  static char *CommandLine;
+ uint16_t gCmdArg = 0;
  
  /**
   * @brief Convert a string to uppercase
@@ -55,6 +56,14 @@
 	 free(CommandLine);
  }
  
+ /**
+  * @brief Read the number after a command word into gCmdArg
+  * @param word The command word found in the line
+  */
+ static void CmdArg(const char *word) {
+	 gCmdArg = (uint16_t)strtoul(word + strcspn(word, "0123456789"), 0, 10);
+ }
+ 
  /**
   * @brief Analyze the command line input
   * @param CommandLine The command line input to analyze
@@ -63,6 +72,19 @@
   */
  uint16_t AnalyseCmd(char* CommandLine) {
 	 uint16_t CodeCmdNumber = 0;
+	 char *word;
+	 if (strstr(CommandLine, "sync") || strstr(CommandLine, "SYNC")) return CMD_SYNC;
+	 if (strstr(CommandLine, "wear") || strstr(CommandLine, "WEAR")) return CMD_WEAR;
+	 if (strstr(CommandLine, "files") || strstr(CommandLine, "FILES")) return CMD_FILES;
+	 if (strstr(CommandLine, "imu") || strstr(CommandLine, "IMU")) return CMD_IMU;
+	 if ((word = strstr(CommandLine, "upload")) || (word = strstr(CommandLine, "UPLOAD"))) {
+		 CmdArg(word);
+		 return CMD_UPLOAD;
+	 }
+	 if ((word = strstr(CommandLine, "play")) || (word = strstr(CommandLine, "PLAY"))) {
+		 CmdArg(word);
+		 return gCmdArg >= 1 && gCmdArg <= 6 ? gCmdArg : CMD_PLAY;
+	 }
 	 if (strstr(CommandLine, "1")) return 1;
 	 if (strstr(CommandLine, "2")) return 2;
 	 if (strstr(CommandLine, "3")) return 3;
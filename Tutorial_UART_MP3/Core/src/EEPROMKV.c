@@ -0,0 +1,503 @@
+/*
+ * @file EEPROMKV.c
+ * @brief Key-value store on the emulated EEPROM
+ * @details Settings are kept as small entries (layout in EEPROMKV.h) appended to the erased
+ *          part of the active EEPROM Type A record, so changing a value programs its own
+ *          few flash words instead of a whole 256-byte record. A new record is opened when
+ *          the active one has no room; only when the sector is full are the live entries
+ *          compacted into the first record of the next sector; the old sector is then erased
+ *          in the background by EEPROM_TypeA_eraseService from the idle loop. A RAM index
+ *          (key -> entry address) is rebuilt at boot by replaying the records of the active
+ *          sector, so reads come straight from flash.
+ *          Every entry carries a CRC and every batch a commit word; a batch torn by a reset is
+ *          dropped and ends the replay of its record, and a torn record is repaired by
+ *          compacting into the next sector.
+ *          Each compaction also saves the sector erase counts of the wear leveling; they are
+ *          loaded at boot, so EEPROMKV_report can project the flash lifetime from the erase
+ *          rate seen since then.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "EEPROMKV.h"
+#include "SysTime.h"
+#include "UART.h"
+#include <string.h>
+
+//Flash bytes taken by an entry, whole 64-bit flash words;
+#define EEPROM_KV_ENTRY_SIZE(len) ((EEPROM_KV_HEADER + ((len) == EEPROM_KV_DELETED ? 0 : (len)) + 7) & ~7)
+#define EEPROM_KV_RECORD_OVERHEAD 24	//Header programs of a new record: Recording, Active, previous Used;
+
+struct EEPROMKVItem{
+	uint32_t addr;		//Entry header in flash;
+	uint16_t key;
+	uint8_t len;
+};
+
+uint32_t gEEPROMKVBytes = 0;
+uint32_t gEEPROMKVCompactions = 0;
+uint32_t gEEPROMKVWriteMax = 0;
+
+static struct EEPROMKVItem KV_Index[EEPROM_KV_MAX_KEYS];
+static uint8_t KV_Count = 0;
+static uint16_t KV_Offset = EEPROM_EMULATION_DATA_SIZE;	//Next free byte of the active record, full = open a new one;
+static uint32_t KV_Buffer[EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t)];
+static uint32_t KV_ErasesAtBoot = 0;	//Sum of the sector erase counts after EEPROMKV_init loaded them;
+
+/**
+ * @brief CRC-8 (polynomial 0x07) of the key, the length and the value of an entry
+ */
+static uint8_t EEPROMKV_crc(uint16_t key, uint8_t len, const uint8_t *value)
+{
+	uint8_t head[3] = {key & 0xFF, key >> 8, len};
+	uint8_t crc = 0xFF, i;
+	uint16_t n;
+	for (n = 0; n < 3 + (len == EEPROM_KV_DELETED ? 0 : len); n++)
+	{
+		crc ^= n < 3 ? head[n] : value[n - 3];
+		for (i = 0; i < 8; i++)
+			crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+static int8_t EEPROMKV_find(uint16_t key)
+{
+	int8_t i;
+	for (i = 0; i < KV_Count; i++)
+		if (KV_Index[i].key == key)
+			return i;
+	return -1;
+}
+
+/**
+ * @brief Apply one entry to the RAM index
+ * @param addr The flash address of the entry, already checked
+ */
+static void EEPROMKV_apply(uint32_t addr)
+{
+	uint32_t head = *(const uint32_t *)addr;
+	uint16_t key = head & 0xFFFF;
+	uint8_t len = (head >> 16) & 0xFF;
+	int8_t i = EEPROMKV_find(key);
+	if (len == EEPROM_KV_DELETED)
+	{
+		if (i >= 0)
+			KV_Index[i] = KV_Index[--KV_Count];
+		return;
+	}
+	if (i < 0)
+	{
+		if (KV_Count == EEPROM_KV_MAX_KEYS)
+			return;
+		i = KV_Count++;
+	}
+	KV_Index[i].key = key;
+	KV_Index[i].len = len;
+	KV_Index[i].addr = addr;
+}
+
+/**
+ * @brief Replay the entries of one record into the RAM index
+ * @param record The address of the record header
+ * @return Bytes used in the data portion, EEPROM_EMULATION_DATA_SIZE if the record is damaged
+ * @details The entries of a batch are applied at its commit word; a batch without one was cut
+ *          short by a reset and is dropped.
+ */
+static uint16_t EEPROMKV_scan(uint32_t record)
+{
+	uint32_t batch[EEPROM_KV_MAX_KEYS];	//Entries of the uncommitted batch, a compacted record is one;
+	uint32_t head, entry;
+	uint16_t offset = 0;
+	uint8_t len, pending = 0, n;
+	while (offset < EEPROM_EMULATION_DATA_SIZE)
+	{
+		entry = record + 8 + offset;
+		head = *(const uint32_t *)entry;
+		if (head == 0xFFFFFFFF)
+			break;
+		if (head == 0 && *(const uint32_t *)(entry + 4) == 0)
+		{
+			for (n = 0; n < pending; n++)
+				EEPROMKV_apply(batch[n]);
+			pending = 0;
+			offset += EEPROM_KV_COMMIT;
+			continue;
+		}
+		len = (head >> 16) & 0xFF;
+		if ((len > EEPROM_KV_VALUE_MAX && len != EEPROM_KV_DELETED)
+			|| offset + EEPROM_KV_ENTRY_SIZE(len) > EEPROM_EMULATION_DATA_SIZE
+			|| EEPROMKV_crc(head & 0xFFFF, len, (const uint8_t *)entry + EEPROM_KV_HEADER) != head >> 24
+			|| pending == EEPROM_KV_MAX_KEYS)
+			return EEPROM_EMULATION_DATA_SIZE;	//Torn or foreign data, nothing more goes into this record;
+		batch[pending++] = entry;
+		offset += EEPROM_KV_ENTRY_SIZE(len);
+	}
+	//Nothing may follow an uncommitted batch, or the next commit word would take it in;
+	return pending ? EEPROM_EMULATION_DATA_SIZE : offset;
+}
+
+/**
+ * @brief Build an entry in RAM
+ * @param dst Where the entry goes, EEPROM_KV_ENTRY_SIZE(len) bytes
+ * @return The entry size
+ */
+static uint16_t EEPROMKV_build(uint8_t *dst, uint16_t key, const void *value, uint8_t len)
+{
+	uint16_t size = EEPROM_KV_ENTRY_SIZE(len);
+	uint32_t head = key | (uint32_t)len << 16 | (uint32_t)EEPROMKV_crc(key, len, value) << 24;
+	memset(dst, 0xFF, size);
+	memcpy(dst, &head, sizeof(head));
+	if (len != EEPROM_KV_DELETED)
+		memcpy(dst + EEPROM_KV_HEADER, value, len);
+	return size;
+}
+
+/**
+ * @brief Bytes of the EEPROM_KV_KEY_WEAR value: the lowest count, then one u8 per sector above it
+ */
+static uint8_t EEPROMKV_wearLen(void)
+{
+	uint16_t n = EEPROM_EMULATION_SECTOR_ACCOUNT;
+	if (n > EEPROM_KV_VALUE_MAX - sizeof(uint32_t))
+		n = EEPROM_KV_VALUE_MAX - sizeof(uint32_t);
+	return sizeof(uint32_t) + n;
+}
+
+static uint32_t EEPROMKV_erases(void)
+{
+	uint32_t sum = 0;
+	uint16_t n;
+	for (n = 0; n < EEPROM_EMULATION_SECTOR_ACCOUNT; n++)
+		sum += gEEPROMTypeAEraseCount[n];
+	return sum;
+}
+
+/**
+ * @brief Build the EEPROM_KV_KEY_WEAR entry for a record about to start a new sector
+ * @details The active sector and the pending one are counted as erased already: the sector
+ *          change erases them, and the next chance to save the counts is the next change.
+ *          The leveling keeps the counts close, a difference above 255 is saved as 255.
+ */
+static uint16_t EEPROMKV_buildWear(uint8_t *dst)
+{
+	uint8_t value[EEPROM_KV_VALUE_MAX];
+	uint32_t counts[EEPROM_EMULATION_SECTOR_ACCOUNT_MAX], base = ~0u;
+	uint8_t len = EEPROMKV_wearLen();
+	uint16_t n;
+	for (n = 0; n < len - sizeof(uint32_t); n++)
+	{
+		counts[n] = gEEPROMTypeAEraseCount[n];
+		if (n == gActiveSectorNum - 1 || (gEEPROMTypeAErasePending
+			&& n == (gEEPROMTypeAErasePending - EEPROM_EMULATION_ADDRESS) / 1024))
+			++counts[n];
+		if (counts[n] < base)
+			base = counts[n];
+	}
+	memcpy(value, &base, sizeof(base));
+	for (n = 0; n < len - sizeof(uint32_t); n++)
+		value[sizeof(uint32_t) + n] = counts[n] - base > 0xFF ? 0xFF : counts[n] - base;
+	return EEPROMKV_build(dst, EEPROM_KV_KEY_WEAR, value, len);
+}
+
+/**
+ * @brief Load the saved erase counts, keeping any count already higher in RAM
+ */
+static void EEPROMKV_loadWear(void)
+{
+	const uint8_t *value;
+	uint32_t base;
+	uint16_t n;
+	int8_t i = EEPROMKV_find(EEPROM_KV_KEY_WEAR);
+	if (i < 0 || KV_Index[i].len < sizeof(uint32_t))
+		return;
+	value = (const uint8_t *)(KV_Index[i].addr + EEPROM_KV_HEADER);
+	memcpy(&base, value, sizeof(base));
+	for (n = 0; n < KV_Index[i].len - sizeof(uint32_t) && n < EEPROM_EMULATION_SECTOR_ACCOUNT; n++)
+		if (base + value[sizeof(uint32_t) + n] > gEEPROMTypeAEraseCount[n])
+			gEEPROMTypeAEraseCount[n] = base + value[sizeof(uint32_t) + n];
+}
+
+static uint8_t EEPROMKV_inBatch(const struct EEPROMKVPut *puts, uint8_t n, uint16_t key)
+{
+	while (n--)
+		if (puts[n].key == key)
+			return 1;
+	return 0;
+}
+
+/**
+ * @brief Copy the live entries into KV_Buffer, with the keys of a batch replaced
+ * @param puts The new values, len EEPROM_KV_DELETED leaves the key out
+ * @param n The number of puts
+ * @return The bytes used with the commit word, the rest of KV_Buffer is erased (0xFF)
+ * @pre The result fits, see EEPROMKV_used
+ */
+static uint16_t EEPROMKV_snapshot(const struct EEPROMKVPut *puts, uint8_t n)
+{
+	uint8_t *dst = (uint8_t *)KV_Buffer;
+	uint16_t size = 0;
+	uint8_t i;
+	for (i = 0; i < KV_Count; i++)
+	{
+		if (KV_Index[i].key != EEPROM_KV_KEY_WEAR && !EEPROMKV_inBatch(puts, n, KV_Index[i].key))
+			size += EEPROMKV_build(dst + size, KV_Index[i].key,
+				(const void *)(KV_Index[i].addr + EEPROM_KV_HEADER), KV_Index[i].len);
+	}
+	for (i = 0; i < n; i++)
+		if (puts[i].len != EEPROM_KV_DELETED)
+			size += EEPROMKV_build(dst + size, puts[i].key, puts[i].value, puts[i].len);
+	size += EEPROMKV_buildWear(dst + size);
+	memset(dst + size, 0, EEPROM_KV_COMMIT);
+	size += EEPROM_KV_COMMIT;
+	memset(dst + size, 0xFF, EEPROM_EMULATION_DATA_SIZE - size);
+	return size;
+}
+
+/**
+ * @brief Write the compacted state as the first record of the next sector
+ * @details The old sector is left to EEPROM_TypeA_eraseService.
+ */
+static uint8_t EEPROMKV_compact(const struct EEPROMKVPut *puts, uint8_t n)
+{
+	uint16_t size = EEPROMKV_snapshot(puts, n);
+	if (EEPROM_TypeA_writeRecord(KV_Buffer, size / sizeof(uint32_t)) != EEPROM_EMULATION_WRITE_OK)
+	{
+		KV_Offset = EEPROM_EMULATION_DATA_SIZE;
+		return EEPROM_KV_WRITE_ERROR;
+	}
+	gEEPROMKVBytes += size + EEPROM_KV_RECORD_OVERHEAD;
+	++gEEPROMKVCompactions;
+	KV_Count = 0;
+	KV_Offset = EEPROMKV_scan(gActiveRecordAddress);
+	return EEPROM_KV_OK;
+}
+
+/**
+ * @brief Write a batch of entries in one program: appended to the active record,
+ *        as a new record, or compacted into the next sector
+ * @details The entries and the commit word are programmed in one go, the commit word last, so
+ *          a reset in the middle drops the whole batch; a new record or a compaction is atomic
+ *          through the record header states as well.
+ */
+static uint8_t EEPROMKV_commit(const struct EEPROMKVPut *puts, uint8_t n)
+{
+	uint8_t *dst = (uint8_t *)KV_Buffer;
+	uint16_t size = 0, used = EEPROMKV_used(), keys = KV_Count + (EEPROMKV_find(EEPROM_KV_KEY_WEAR) < 0);
+	uint32_t status, addr, end;
+	uint8_t i;
+	int8_t k;
+	if (n > EEPROM_KV_BATCH_MAX)
+		return EEPROM_KV_INVALID;
+	for (i = 0; i < n; i++)
+	{
+		if (puts[i].key > EEPROM_KV_KEY_MAX || (puts[i].len > EEPROM_KV_VALUE_MAX && puts[i].len != EEPROM_KV_DELETED))
+			return EEPROM_KV_INVALID;
+		k = EEPROMKV_find(puts[i].key);
+		if (k >= 0)
+			used -= EEPROM_KV_ENTRY_SIZE(KV_Index[k].len), --keys;
+		if (puts[i].len != EEPROM_KV_DELETED)
+			used += EEPROM_KV_ENTRY_SIZE(puts[i].len), ++keys;
+	}
+	//Must still fit the index and a compacted record;
+	if (keys > EEPROM_KV_MAX_KEYS || used > EEPROM_KV_CAPACITY)
+		return EEPROM_KV_FULL;
+	for (i = 0; i < n; i++)
+	{
+		//Unchanged values and deletes of missing keys cost nothing;
+		k = EEPROMKV_find(puts[i].key);
+		if (puts[i].len == EEPROM_KV_DELETED ? k < 0 : (k >= 0 && KV_Index[k].len == puts[i].len
+			&& memcmp((const void *)(KV_Index[k].addr + EEPROM_KV_HEADER), puts[i].value, puts[i].len) == 0))
+			continue;
+		if (size + EEPROM_KV_ENTRY_SIZE(puts[i].len) > EEPROM_KV_CAPACITY)
+			return EEPROM_KV_FULL;	//A batch must fit one record;
+		size += EEPROMKV_build(dst + size, puts[i].key, puts[i].value, puts[i].len);
+	}
+	if (size == 0)
+		return EEPROM_KV_OK;
+	memset(dst + size, 0, EEPROM_KV_COMMIT);
+	size += EEPROM_KV_COMMIT;
+
+	if (KV_Offset + size <= EEPROM_EMULATION_DATA_SIZE)
+	{
+		addr = gActiveRecordAddress + 8 + KV_Offset;
+		status = EEPROM_TypeA_appendData(KV_Offset, KV_Buffer, size / sizeof(uint32_t));
+		KV_Offset += size;
+	}
+	else if (gActiveRecordNum < EEPROM_EMULATION_ACTIVE_RECORD_NUM_MAX)
+	{
+		status = EEPROM_TypeA_writeRecord(KV_Buffer, size / sizeof(uint32_t));
+		addr = gActiveRecordAddress + 8;
+		KV_Offset = size;
+		gEEPROMKVBytes += EEPROM_KV_RECORD_OVERHEAD;
+	}
+	else
+		return EEPROMKV_compact(puts, n);
+	if (status != EEPROM_EMULATION_WRITE_OK)
+	{
+		KV_Offset = EEPROM_EMULATION_DATA_SIZE;	//Skip the words that may be half programmed;
+		return EEPROM_KV_WRITE_ERROR;
+	}
+	gEEPROMKVBytes += size;
+	for (end = addr + size - EEPROM_KV_COMMIT; addr < end; addr += EEPROM_KV_ENTRY_SIZE((*(const uint32_t *)addr >> 16) & 0xFF))
+		EEPROMKV_apply(addr);
+	return EEPROM_KV_OK;
+}
+
+/**
+ * @brief Mount the store: find the active sector, rebuild the index, repair or tidy the other sectors
+ * @return EEPROM_EMULATION_INIT_OK or EEPROM_EMULATION_INIT_ERROR
+ * @details Replaces EEPROM_TypeA_init, whose repair would keep only the active record.
+ */
+uint32_t EEPROMKV_init(void)
+{
+	uint32_t sector;
+	uint16_t num;
+	KV_Count = 0;
+	KV_Offset = EEPROM_EMULATION_DATA_SIZE;
+	EEPROM_TypeA_searchCheck();
+	if (gEEPROMTypeASearchFlag == 0)
+	{
+		KV_ErasesAtBoot = EEPROMKV_erases();
+		if (!EEPROM_TypeA_eraseAllSectors())
+			return EEPROM_EMULATION_INIT_ERROR;
+		gActiveRecordAddress = EEPROM_EMULATION_ADDRESS;
+		gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
+		gActiveRecordNum = 0;
+		gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
+		gActiveSectorSeq = 0;
+		return EEPROM_EMULATION_INIT_OK;
+	}
+	sector = EEPROM_EMULATION_ADDRESS + 1024 * (gActiveSectorNum - 1);
+	for (num = 0; num < gActiveRecordNum; num++)
+		KV_Offset = EEPROMKV_scan(sector + num * EEPROM_EMULATION_RECORD_SIZE);
+	EEPROMKV_loadWear();
+	KV_ErasesAtBoot = EEPROMKV_erases();
+	if (gEEPROMTypeAFormatErrorFlag == 1)
+	{
+		//A record was torn by a reset: carry the replayed state over to the next sector;
+		EEPROMKV_snapshot(0, 0);
+		if (!EEPROM_TypeA_repairFormat(KV_Buffer))
+			return EEPROM_EMULATION_INIT_ERROR;
+		gEEPROMTypeAFormatErrorFlag = 0;
+		++gEEPROMKVCompactions;
+		KV_Count = 0;
+		EEPROMKV_scan(gActiveRecordAddress);
+		KV_Offset = EEPROM_EMULATION_DATA_SIZE;		//The repair programs the whole record;
+	}
+	else if (!EEPROM_TypeA_eraseNonActiveSectors())
+		return EEPROM_EMULATION_INIT_ERROR;
+	return EEPROM_EMULATION_INIT_OK;
+}
+
+/**
+ * @brief Read a value
+ * @param key The key
+ * @param value Filled with up to size bytes of the value
+ * @param size The size of the value buffer
+ * @return The stored length, -1 if the key is not stored
+ */
+int16_t EEPROMKV_get(uint16_t key, void *value, uint8_t size)
+{
+	int8_t i = EEPROMKV_find(key);
+	if (i < 0)
+		return -1;
+	memcpy(value, (const void *)(KV_Index[i].addr + EEPROM_KV_HEADER), size < KV_Index[i].len ? size : KV_Index[i].len);
+	return KV_Index[i].len;
+}
+
+/**
+ * @brief Store a value
+ * @param key The key, 0x0000-EEPROM_KV_KEY_MAX
+ * @param value The value
+ * @param len The length, at most EEPROM_KV_VALUE_MAX
+ * @return EEPROM_KV_OK, EEPROM_KV_WRITE_ERROR, EEPROM_KV_FULL or EEPROM_KV_INVALID
+ * @details Programs EEPROM_KV_HEADER + len bytes rounded up to 8 and the commit word,
+ *          nothing if the value is unchanged.
+ */
+uint8_t EEPROMKV_put(uint16_t key, const void *value, uint8_t len)
+{
+	struct EEPROMKVPut put = {value, key, len};
+	return EEPROMKV_putBatch(&put, 1);
+}
+
+/**
+ * @brief Store several values at once, all or none of them survive a reset
+ * @param puts The keys (distinct) and values, len EEPROM_KV_DELETED removes a key
+ * @param n The number of puts, at most EEPROM_KV_BATCH_MAX
+ * @return EEPROM_KV_OK, EEPROM_KV_WRITE_ERROR, EEPROM_KV_FULL or EEPROM_KV_INVALID
+ * @details The changed entries must fit one record together. A batch that fills the sector
+ *          also compacts it (one record program). The sector erase runs in EEPROM_TypeA_eraseService,
+ *          or here if it was not called since the last compaction.
+ */
+uint8_t EEPROMKV_putBatch(const struct EEPROMKVPut *puts, uint8_t n)
+{
+	uint32_t t0 = SysTime_getCycles();
+	uint8_t status = EEPROMKV_commit(puts, n);
+	t0 = SysTime_getCycles() - t0;
+	if (t0 > gEEPROMKVWriteMax)
+		gEEPROMKVWriteMax = t0;
+	return status;
+}
+
+/**
+ * @brief Remove a key
+ * @param key The key
+ * @return EEPROM_KV_OK (also if the key was not stored), EEPROM_KV_WRITE_ERROR or EEPROM_KV_INVALID
+ */
+uint8_t EEPROMKV_delete(uint16_t key)
+{
+	return EEPROMKV_put(key, 0, EEPROM_KV_DELETED);
+}
+
+/**
+ * @brief Bytes a compacted record of the live entries would take, at most EEPROM_KV_CAPACITY
+ * @details The erase counts are always counted in, also before the first compaction saved them.
+ */
+uint16_t EEPROMKV_used(void)
+{
+	uint16_t size = EEPROM_KV_ENTRY_SIZE(EEPROMKV_wearLen());
+	uint8_t i;
+	for (i = 0; i < KV_Count; i++)
+		if (KV_Index[i].key != EEPROM_KV_KEY_WEAR)
+			size += EEPROM_KV_ENTRY_SIZE(KV_Index[i].len);
+	return size;
+}
+
+/**
+ * @brief Print the store state over UART
+ */
+void EEPROMKV_report(void)
+{
+	printf("EEPROMKV: %u keys, %u/%u bytes live, sector %u record %u at +%u\n",
+		KV_Count, EEPROMKV_used(), EEPROM_KV_CAPACITY, gActiveSectorNum, gActiveRecordNum, KV_Offset);
+	printf("EEPROMKV: %lu bytes programmed, %lu compactions, %lu erases in a write, worst write %lu us\n",
+		(unsigned long)gEEPROMKVBytes, (unsigned long)gEEPROMKVCompactions,
+		(unsigned long)gEEPROMTypeAEraseForced, (unsigned long)(gEEPROMKVWriteMax / (CPUCLK_FREQ / 1000000)));
+	EEPROMKV_reportWear();
+}
+
+/**
+ * @brief Print the erase count of each sector and the projected flash lifetime over UART
+ * @details The erases left before every sector reaches EEPROM_KV_ENDURANCE, at the erase rate
+ *          seen since boot. The wear leveling moves to the least-worn sector, so all of them
+ *          wear out together. No projection is made before the first erase.
+ */
+void EEPROMKV_reportWear(void)
+{
+	uint32_t erased = EEPROMKV_erases() - KV_ErasesAtBoot, ms = SysTime_getMs();
+	uint64_t left = 0;
+	uint16_t n;
+	printf("EEPROMKV: erases per sector");
+	for (n = 0; n < EEPROM_EMULATION_SECTOR_ACCOUNT; n++)
+	{
+		printf(" %lu", (unsigned long)gEEPROMTypeAEraseCount[n]);
+		if (gEEPROMTypeAEraseCount[n] < EEPROM_KV_ENDURANCE)
+			left += EEPROM_KV_ENDURANCE - gEEPROMTypeAEraseCount[n];
+	}
+	printf(" of %u, %lu since boot\n", EEPROM_KV_ENDURANCE, (unsigned long)erased);
+	if (erased == 0)
+		printf("EEPROMKV: lifetime not projected yet, no erase since boot (%lu s)\n", (unsigned long)(ms / 1000));
+	else
+		printf("EEPROMKV: %lu erases left, about %lu days at the rate since boot (%lu s)\n", (unsigned long)left,
+			(unsigned long)(left * ms / erased / 86400000u), (unsigned long)(ms / 1000));
+}
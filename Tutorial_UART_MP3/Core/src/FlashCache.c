@@ -0,0 +1,238 @@
+/*
+ * @file FlashCache.c
+ * @brief Set-associative read cache for the SPI flash, with sequential read-ahead
+ * @details A read looks up each FLASH_CACHE_LINE-byte line it covers; a missing line is read
+ *          whole from the flash into the least recently used way of its set. When a read moves
+ *          on to the line after the last one read, the next line is started by DMA
+ *          (SPIFlash_readStart) while the caller works on this one, so a stream of small reads
+ *          (a score played note by note, a bitmap drawn row by row) waits for the flash only
+ *          on its first two lines. The read-ahead is skipped while programs are queued.
+ *          Programs and erases go through the cache as well (write-through): a cached line gets
+ *          the new bytes ANDed in, as on the NOR array, or is set back to 0xFF, so the cache
+ *          never holds stale data and is never flushed.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "FlashCache.h"
+#include "SPIFlash.h"
+#include "UART.h"
+#include <string.h>
+
+#define FLASH_CACHE_EMPTY 0xFFFFFFFF
+
+struct FlashCacheLine{
+	uint32_t tag;				//Line number (address / FLASH_CACHE_LINE), FLASH_CACHE_EMPTY = none;
+	uint8_t age;				//0 = most recently used, FLASH_CACHE_WAYS - 1 = next to go;
+	uint8_t readAhead;			//Read ahead and not used yet;
+};
+
+uint32_t gFlashCacheHits = 0;
+uint32_t gFlashCacheMisses = 0;
+uint32_t gFlashCacheReadAheads = 0;
+uint32_t gFlashCacheReadAheadHits = 0;
+uint32_t gFlashCacheBypass = 0;
+
+static struct FlashCacheLine FlashCache_Lines[FLASH_CACHE_SETS][FLASH_CACHE_WAYS];
+static uint32_t FlashCache_Data[FLASH_CACHE_SETS][FLASH_CACHE_WAYS][FLASH_CACHE_LINE / 4];
+static struct FlashCacheLine *FlashCache_Filling = 0;	//Line the read-ahead DMA is writing;
+static uint32_t FlashCache_LastLine = FLASH_CACHE_EMPTY;	//Line of the last read;
+
+static uint8_t *FlashCache_data(uint32_t line, uint8_t way)
+{
+	return (uint8_t *)FlashCache_Data[line & (FLASH_CACHE_SETS - 1)][way];
+}
+
+//Wait for the read-ahead DMA if it is writing this line;
+static void FlashCache_settle(struct FlashCacheLine *l)
+{
+	if (FlashCache_Filling && (!l || l == FlashCache_Filling))
+	{
+		while (SPIFlash_readBusy());
+		FlashCache_Filling = 0;
+	}
+}
+
+static uint8_t FlashCache_find(struct FlashCacheLine *set, uint32_t line)
+{
+	uint8_t way;
+	for (way = 0; way < FLASH_CACHE_WAYS && set[way].tag != line; way++);
+	return way;
+}
+
+static void FlashCache_touch(struct FlashCacheLine *set, uint8_t way)
+{
+	uint8_t w, age = set[way].age;
+	for (w = 0; w < FLASH_CACHE_WAYS; w++)
+		if (set[w].age < age)
+			++set[w].age;
+	set[way].age = 0;
+}
+
+//The least recently used way, emptied;
+static uint8_t FlashCache_victim(struct FlashCacheLine *set)
+{
+	uint8_t way;
+	for (way = 0; way < FLASH_CACHE_WAYS && set[way].age != FLASH_CACHE_WAYS - 1; way++);
+	FlashCache_settle(&set[way]);
+	set[way].tag = FLASH_CACHE_EMPTY;
+	set[way].readAhead = 0;
+	return way;
+}
+
+static void FlashCache_readAhead(uint32_t line)
+{
+	struct FlashCacheLine *set = FlashCache_Lines[line & (FLASH_CACHE_SETS - 1)];
+	uint8_t way;
+	if (FlashCache_Filling || (line + 1) * FLASH_CACHE_LINE > gSPIFlash.size
+		|| FlashCache_find(set, line) < FLASH_CACHE_WAYS)
+		return;
+	way = FlashCache_victim(set);
+	if (SPIFlash_readStart(line * FLASH_CACHE_LINE, FlashCache_data(line, way), FLASH_CACHE_LINE) != SPI_FLASH_OK)
+		return;
+	set[way].tag = line;
+	set[way].readAhead = 1;
+	FlashCache_Filling = &set[way];
+	FlashCache_touch(set, way);
+	++gFlashCacheReadAheads;
+}
+
+/**
+ * @brief Empty the cache
+ */
+void FlashCache_init()
+{
+	uint8_t s, w;
+	FlashCache_settle(0);
+	for (s = 0; s < FLASH_CACHE_SETS; s++)
+		for (w = 0; w < FLASH_CACHE_WAYS; w++)
+		{
+			FlashCache_Lines[s][w].tag = FLASH_CACHE_EMPTY;
+			FlashCache_Lines[s][w].age = w;
+			FlashCache_Lines[s][w].readAhead = 0;
+		}
+	FlashCache_LastLine = FLASH_CACHE_EMPTY;
+}
+
+/**
+ * @brief Read through the cache, see SPIFlash_read
+ * @return SPI_FLASH_OK, SPI_FLASH_NONE or SPI_FLASH_INVALID
+ */
+uint8_t FlashCache_read(uint32_t addr, void *buf, uint32_t len)
+{
+	struct FlashCacheLine *set;
+	uint8_t *dst = buf;
+	uint32_t line, in, chunk;
+	uint8_t way, status;
+	if (len >= FLASH_CACHE_BYPASS)
+	{
+		gFlashCacheBypass += len;
+		return SPIFlash_read(addr, buf, len);
+	}
+	if (gSPIFlash.size == 0)
+		return SPI_FLASH_NONE;
+	if (addr > gSPIFlash.size || len > gSPIFlash.size - addr)
+		return SPI_FLASH_INVALID;
+	while (len)
+	{
+		line = addr / FLASH_CACHE_LINE;
+		in = addr % FLASH_CACHE_LINE;
+		chunk = FLASH_CACHE_LINE - in < len ? FLASH_CACHE_LINE - in : len;
+		set = FlashCache_Lines[line & (FLASH_CACHE_SETS - 1)];
+		way = FlashCache_find(set, line);
+		if (way < FLASH_CACHE_WAYS)
+		{
+			FlashCache_settle(&set[way]);
+			++gFlashCacheHits;
+			if (set[way].readAhead)
+			{
+				set[way].readAhead = 0;
+				++gFlashCacheReadAheadHits;
+			}
+		}
+		else
+		{
+			way = FlashCache_victim(set);
+			if ((status = SPIFlash_read(line * FLASH_CACHE_LINE, FlashCache_data(line, way), FLASH_CACHE_LINE)) != SPI_FLASH_OK)
+				return status;
+			set[way].tag = line;
+			++gFlashCacheMisses;
+		}
+		FlashCache_touch(set, way);
+		memcpy(dst, FlashCache_data(line, way) + in, chunk);
+		if (line == FlashCache_LastLine + 1)
+			FlashCache_readAhead(line + 1);
+		FlashCache_LastLine = line;
+		addr += chunk;
+		dst += chunk;
+		len -= chunk;
+	}
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief SPIFlash_program, and the same bytes cleared in the cached lines
+ */
+uint8_t FlashCache_program(uint32_t addr, const void *data, uint16_t len)
+{
+	struct FlashCacheLine *set;
+	const uint8_t *src = data;
+	uint32_t line, in, chunk, i;
+	uint8_t way, *p, status = SPIFlash_program(addr, data, len);
+	if (status != SPI_FLASH_OK)
+		return status;
+	while (len)
+	{
+		line = addr / FLASH_CACHE_LINE;
+		in = addr % FLASH_CACHE_LINE;
+		chunk = FLASH_CACHE_LINE - in < len ? FLASH_CACHE_LINE - in : len;
+		set = FlashCache_Lines[line & (FLASH_CACHE_SETS - 1)];
+		way = FlashCache_find(set, line);
+		if (way < FLASH_CACHE_WAYS)
+		{
+			FlashCache_settle(&set[way]);
+			p = FlashCache_data(line, way) + in;
+			for (i = 0; i < chunk; i++)
+				p[i] &= src[i];
+		}
+		addr += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief SPIFlash_erase, and the cached lines of the sector set to 0xFF
+ */
+uint8_t FlashCache_erase(uint32_t addr)
+{
+	struct FlashCacheLine *set;
+	uint32_t line;
+	uint8_t way, status = SPIFlash_erase(addr);
+	if (status != SPI_FLASH_OK)
+		return status;
+	for (line = addr / FLASH_CACHE_LINE; line < (addr + SPI_FLASH_SECTOR) / FLASH_CACHE_LINE; line++)
+	{
+		set = FlashCache_Lines[line & (FLASH_CACHE_SETS - 1)];
+		way = FlashCache_find(set, line);
+		if (way < FLASH_CACHE_WAYS)
+		{
+			FlashCache_settle(&set[way]);
+			memset(FlashCache_data(line, way), 0xFF, FLASH_CACHE_LINE);
+		}
+	}
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief Print the hit rate and the read-ahead over UART
+ */
+void FlashCache_report()
+{
+	uint32_t lines = gFlashCacheHits + gFlashCacheMisses;
+	printf("FlashCache: %lu hits, %lu misses (%lu%% hit), %lu read ahead (%lu used), %lu bytes past the cache\n",
+		(unsigned long)gFlashCacheHits, (unsigned long)gFlashCacheMisses,
+		(unsigned long)(lines ? (uint64_t)gFlashCacheHits * 100 / lines : 0),
+		(unsigned long)gFlashCacheReadAheads, (unsigned long)gFlashCacheReadAheadHits,
+		(unsigned long)gFlashCacheBypass);
+}
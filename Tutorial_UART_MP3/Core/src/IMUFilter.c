@@ -0,0 +1,292 @@
+/*
+ * @file IMUFilter.c
+ * @brief Mahony attitude filter in fixed point
+ * @details Takes the integer samples of MPU6500_Convert and keeps the attitude as a Q30
+ *          quaternion. Products use 32x32->64 bit multiplies; square roots, divisions and
+ *          the atan2 for the Euler angles run on the MATHACL accelerator (dl_mathacl.c).
+ *          MATHACL is used without locking (see MathUtil.h), so call the filter from one context only.
+ *          IMUFilter_start runs it in the MPU6500 interrupts on every sample of the ring, in
+ *          FIFO batches or at each data-ready edge (acquisition mode);
+ *          the foreground takes a consistent copy of the attitude with IMUFilter_read
+ *          (version count, odd while an update is being published, as MPU6500_readLatest).
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "IMUFilter.h"
+#include "MathUtil.h"
+#include "SysTime.h"
+#include "UART.h"
+
+#define Q30_ONE (1L << 30)
+//0.01dps -> rad per half sample period in Q30, times 2^16 for precision: pi / 36000 * 2^46 / rate;
+#define IMU_GYRO_HALF_Q46 6140831382ULL
+
+//DIV with equal Q formats: RES1 = OP1 / OP2 in Q30;
+static const DL_MathACL_operationConfig gIMUDivConfig = {
+	.opType      = DL_MATHACL_OP_TYPE_DIV,
+	.opSign      = DL_MATHACL_OPSIGN_SIGNED,
+	.iterations  = 0,
+	.scaleFactor = 0,
+	.qType       = DL_MATHACL_Q_TYPE_Q30,
+};
+
+//ATAN2 of two operands in the same format, result in Q31 with 1.0 = pi;
+static const DL_MathACL_operationConfig gIMUAtan2Config = {
+	.opType      = DL_MATHACL_OP_TYPE_ARCTAN2,
+	.opSign      = DL_MATHACL_OPSIGN_SIGNED,
+	.iterations  = 16,
+	.scaleFactor = 0,
+	.qType       = DL_MATHACL_Q_TYPE_Q31,
+};
+
+static struct IMUAttitude IMU_Att = {{Q30_ONE, 0, 0, 0}, 0, 0, 0, 0};
+static volatile uint32_t IMU_Version = 0;	//Odd while IMU_Published is rewritten;
+static struct IMUAttitude IMU_Published;
+static uint32_t IMU_Updates = 0;
+static int32_t IMU_Integral[3];		//Ki feedback, rad/s in Q30;
+static int64_t IMU_GyroK;			//0.01dps -> half-step angle, Q30 << 16;
+static int32_t IMU_KpHalf;			//Kp * dt / 2, Q30;
+static int32_t IMU_KiDt;			//Ki * dt, Q30;
+static int32_t IMU_HalfDt;			//dt / 2, Q30;
+
+static inline int32_t IMUFilter_mul(int32_t a, int32_t b)
+{
+	return (int32_t)(((int64_t)a * b) >> 30);
+}
+
+/**
+ * @brief Ratio of two numbers in the same format on MATHACL
+ * @return num / den in Q30, |num / den| must stay below 2
+ */
+static int32_t IMUFilter_div(int32_t num, int32_t den)
+{
+	DL_MathACL_startDivOperation(MATHACL, &gIMUDivConfig, num, den);
+	DL_MathACL_waitForOperation(MATHACL);
+	return (int32_t)DL_MathACL_getResultOne(MATHACL);
+}
+
+/**
+ * @brief atan2(y, x) on MATHACL
+ * @return The angle in 0.01deg
+ */
+static int16_t IMUFilter_atan2(int32_t y, int32_t x)
+{
+	int32_t pu;
+	DL_MathACL_startArcTan2Operation(MATHACL, &gIMUAtan2Config, x, y);
+	DL_MathACL_waitForOperation(MATHACL);
+	pu = (int32_t)DL_MathACL_getResultOne(MATHACL);
+	return (int16_t)(((int64_t)pu * 18000) >> 31);
+}
+
+static void IMUFilter_euler()
+{
+	int32_t q0 = IMU_Att.q[0], q1 = IMU_Att.q[1], q2 = IMU_Att.q[2], q3 = IMU_Att.q[3];
+	int32_t s, c;
+
+	IMU_Att.roll = IMUFilter_atan2(2 * (IMUFilter_mul(q0, q1) + IMUFilter_mul(q2, q3)),
+		Q30_ONE - 2 * (IMUFilter_mul(q1, q1) + IMUFilter_mul(q2, q2)));
+	//asin(s) = atan2(s, sqrt(1 - s^2));
+	s = 2 * (IMUFilter_mul(q0, q2) - IMUFilter_mul(q3, q1));
+	if (s > Q30_ONE) s = Q30_ONE;
+	if (s < -Q30_ONE) s = -Q30_ONE;
+	c = (int32_t)MathUtil_sqrt((uint32_t)(Q30_ONE - IMUFilter_mul(s, s)) >> 14) << 14;
+	IMU_Att.pitch = IMUFilter_atan2(s, c);
+	IMU_Att.yaw = IMUFilter_atan2(2 * (IMUFilter_mul(q0, q3) + IMUFilter_mul(q1, q2)),
+		Q30_ONE - 2 * (IMUFilter_mul(q2, q2) + IMUFilter_mul(q3, q3)));
+}
+
+/**
+ * @brief Reset the attitude and set the sample rate
+ * @param rate The IMU sample rate in Hz, the rate IMUFilter_update will be called at
+ */
+void IMUFilter_init(uint16_t rate)
+{
+	uint8_t i;
+	if (rate == 0)
+		rate = 1;
+	IMU_Att.q[0] = Q30_ONE;
+	IMU_Att.q[1] = IMU_Att.q[2] = IMU_Att.q[3] = 0;
+	IMU_Att.roll = IMU_Att.pitch = IMU_Att.yaw = 0;
+	for (i = 0; i < 3; i++)
+		IMU_Integral[i] = 0;
+	IMU_GyroK = (int64_t)(IMU_GYRO_HALF_Q46 / rate);
+	IMU_KpHalf = (int32_t)(((int64_t)IMU_FILTER_KP_Q16 << 13) / rate);
+	IMU_KiDt = (int32_t)(((int64_t)IMU_FILTER_KI_Q16 << 14) / rate);
+	IMU_HalfDt = (int32_t)((1L << 29) / rate);
+}
+
+/**
+ * @brief Advance the attitude by one sample
+ * @param data The converted sample (MPU6500_Convert)
+ * @details Accel is used as the gravity reference; a zero accel vector skips the correction.
+ *          The roll/pitch/yaw are refreshed on every call.
+ */
+void IMUFilter_update(const struct MPUData *data)
+{
+	int32_t ax = data->acc[0] >> 3, ay = data->acc[1] >> 3, az = data->acc[2] >> 3;	//|a| < 2^15 up to 16g;
+	int32_t q0 = IMU_Att.q[0], q1 = IMU_Att.q[1], q2 = IMU_Att.q[2], q3 = IMU_Att.q[3];
+	int32_t h[3], e[3], v[3];
+	uint32_t norm;
+	uint8_t i;
+
+	for (i = 0; i < 3; i++)
+		h[i] = (int32_t)(((int64_t)data->gyro[i] * IMU_GyroK) >> 16);
+
+	norm = MathUtil_sqrt((uint32_t)(ax * ax + ay * ay + az * az));	//|a| * 2^8;
+	if (norm)
+	{
+		ax = IMUFilter_div(ax << 8, norm);
+		ay = IMUFilter_div(ay << 8, norm);
+		az = IMUFilter_div(az << 8, norm);
+		//Gravity as seen by the current attitude;
+		v[0] = 2 * (IMUFilter_mul(q1, q3) - IMUFilter_mul(q0, q2));
+		v[1] = 2 * (IMUFilter_mul(q0, q1) + IMUFilter_mul(q2, q3));
+		v[2] = IMUFilter_mul(q0, q0) - IMUFilter_mul(q1, q1) - IMUFilter_mul(q2, q2) + IMUFilter_mul(q3, q3);
+		e[0] = IMUFilter_mul(ay, v[2]) - IMUFilter_mul(az, v[1]);
+		e[1] = IMUFilter_mul(az, v[0]) - IMUFilter_mul(ax, v[2]);
+		e[2] = IMUFilter_mul(ax, v[1]) - IMUFilter_mul(ay, v[0]);
+		for (i = 0; i < 3; i++)
+		{
+			if (IMU_KiDt)
+				IMU_Integral[i] += IMUFilter_mul(IMU_KiDt, e[i]);
+			h[i] += IMUFilter_mul(IMU_KpHalf, e[i]) + IMUFilter_mul(IMU_Integral[i], IMU_HalfDt);
+		}
+	}
+
+	//q += q * (0, h);
+	IMU_Att.q[0] = q0 - IMUFilter_mul(q1, h[0]) - IMUFilter_mul(q2, h[1]) - IMUFilter_mul(q3, h[2]);
+	IMU_Att.q[1] = q1 + IMUFilter_mul(q0, h[0]) + IMUFilter_mul(q2, h[2]) - IMUFilter_mul(q3, h[1]);
+	IMU_Att.q[2] = q2 + IMUFilter_mul(q0, h[1]) - IMUFilter_mul(q1, h[2]) + IMUFilter_mul(q3, h[0]);
+	IMU_Att.q[3] = q3 + IMUFilter_mul(q0, h[2]) + IMUFilter_mul(q1, h[1]) - IMUFilter_mul(q2, h[0]);
+
+	norm = 0;
+	for (i = 0; i < 4; i++)
+		norm += (uint32_t)IMUFilter_mul(IMU_Att.q[i], IMU_Att.q[i]);
+	norm = MathUtil_sqrt(norm >> 14) << 14;	//Q30;
+	for (i = 0; i < 4; i++)
+		IMU_Att.q[i] = IMUFilter_div(IMU_Att.q[i], (int32_t)norm);
+
+	IMUFilter_euler();
+}
+
+/**
+ * @brief Get the current attitude
+ * @return Pointer to the attitude, valid until the next IMUFilter_update
+ * @details Only from the context that runs the updates; the foreground uses IMUFilter_read.
+ */
+const struct IMUAttitude *IMUFilter_get()
+{
+	return &IMU_Att;
+}
+
+/**
+ * @brief Advance the attitude by one raw sample and publish it (interrupt context)
+ * @param sample The sample as taken from the FIFO ring
+ */
+void IMUFilter_feed(const struct MPUSample *sample)
+{
+	struct MPUData data;
+	MPU6500_Convert(sample, &data);
+	IMUFilter_update(&data);
+	IMU_Att.seq = sample->seq;
+	++IMU_Updates;
+	++IMU_Version;
+	__DMB();
+	IMU_Published = IMU_Att;
+	__DMB();
+	++IMU_Version;
+}
+
+/**
+ * @brief Take every sample in the ring, runs after each FIFO drain or acquisition read
+ */
+static void IMUFilter_service()
+{
+	struct MPUSample sample;
+	while (MPU6500_FIFO_pop(&sample))
+		IMUFilter_feed(&sample);
+}
+
+/**
+ * @brief Run the filter on every MPU6500 sample at a sample rate
+ * @param rate The sample rate in Hz (4-1000)
+ * @param acquisition 0: FIFO batches (MPU6500_FIFO_start), nothing lost while the SPI flash holds SPI0;
+ *                    1: acquisition mode (MPU6500_Acq_start), each sample read and filtered at its
+ *                    data-ready edge for the lowest latency, but missed while the flash holds SPI0
+ * @details Needs MPU6500_Init. The updates run in interrupt context, so nothing else may use
+ *          MATHACL meanwhile (see the note in IMUFilter.h). Not with IMUStream_start, which
+ *          consumes the ring itself and feeds the filter through IMUFilter_feed.
+ */
+void IMUFilter_start(uint16_t rate, uint8_t acquisition)
+{
+	if (rate > 1000) rate = 1000;
+	if (rate < 4) rate = 4;
+	IMUFilter_init(1000 / (1000 / rate));	//Rate of the ODR divider;
+	MPU6500_FIFO_setHandler(IMUFilter_service);
+	if (acquisition)
+		MPU6500_Acq_start(rate);
+	else
+		MPU6500_FIFO_start(rate);
+}
+
+/**
+ * @brief Copy the newest published attitude without blocking the interrupts
+ * @param att The copy
+ * @return 0 if no sample has been fed yet
+ */
+uint8_t IMUFilter_read(struct IMUAttitude *att)
+{
+	uint32_t version;
+	do {
+		version = IMU_Version;
+		__DMB();
+		*att = IMU_Published;
+		__DMB();
+	} while ((version & 1) || version != IMU_Version);
+	return version != 0;
+}
+
+/**
+ * @brief Print the published attitude and the newest sample over UART
+ * @details Both are seqlock copies; the sample numbers show how far the filter is behind the sensor.
+ */
+void IMUFilter_report()
+{
+	struct IMUAttitude att;
+	struct MPULatest latest;
+	if (!IMUFilter_read(&att) || !MPU6500_readLatest(&latest))
+	{
+		printf("IMUFilter: no samples\n");
+		return;
+	}
+	printf("IMUFilter: roll %d pitch %d yaw %d (0.01deg), q %ld %ld %ld %ld (Q30), %lu updates\n",
+		att.roll, att.pitch, att.yaw, (long)att.q[0], (long)att.q[1], (long)att.q[2], (long)att.q[3],
+		(unsigned long)IMU_Updates);
+	printf("IMUFilter: sample %u filtered, %u newest: acc %ld %ld %ld (0.0001g), gyro %ld %ld %ld (0.01dps), %lu missed\n",
+		att.seq, latest.raw.seq, (long)latest.data.acc[0], (long)latest.data.acc[1], (long)latest.data.acc[2],
+		(long)latest.data.gyro[0], (long)latest.data.gyro[1], (long)latest.data.gyro[2], (unsigned long)gMPUMissed);
+}
+
+/**
+ * @brief Measure the update cost and print it over UART
+ * @param n Number of updates to average over
+ * @details Runs on a synthetic tilted, rotating sample and resets the filter afterwards.
+ *          The maximum rate is the CPU clock over the update cost, with nothing else running.
+ */
+void IMUFilter_Bench(uint16_t n)
+{
+	struct MPUData data = {{2588, 0, 9659}, {1500, -800, 3000}, 2500};	//15deg tilt, a few dps;
+	uint32_t c0, cycles;
+	uint16_t i;
+	if (n == 0)
+		return;
+	IMUFilter_init(1000);
+	c0 = SysTime_getCycles();
+	for (i = 0; i < n; i++)
+		IMUFilter_update(&data);
+	cycles = (SysTime_getCycles() - c0) / n;
+	printf("IMUFilter: %lu cycles/update, max %lu Hz, roll %d pitch %d yaw %d\n",
+		(unsigned long)cycles, (unsigned long)(CPUCLK_FREQ / cycles),
+		IMU_Att.roll, IMU_Att.pitch, IMU_Att.yaw);
+	IMUFilter_init(1000);
+}
@@ -0,0 +1,236 @@
+/*
+ * @file IMUStream.c
+ * @brief Binary IMU telemetry over UART0
+ * @details Packs the samples of the MPU6500 FIFO ring into framed batches (layout in
+ *          IMUStream.h) and sends them by DMA from two frame buffers, so a frame is built
+ *          while the previous one is on the wire. Everything runs in interrupt context:
+ *          after each FIFO drain and when a frame transfer ends (UART0 DMA_DONE_TX), so
+ *          blocking code in the main loop does not stall the stream.
+ *          A frame of 8 samples is 127 bytes, 1.3 ms at 1 Mbaud for 8 ms of data at 1 kHz.
+ *          printf shares UART0, so fputc drops the console text while the stream is active.
+ *          Every sample taken from the ring is also fed to the attitude filter (IMUFilter_feed).
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "IMUStream.h"
+#include "IMUFilter.h"
+#include "SysTime.h"
+#include <string.h>
+
+#define IMU_FRAME_HEAD 4
+#define IMU_SAMPLES_HEAD 10		//seq + time + period;
+#define IMU_FRAME_MAX (IMU_FRAME_HEAD + IMU_SAMPLES_HEAD + IMU_STREAM_BATCH * MPU_SAMPLE_BYTES + 1)
+
+uint32_t gIMUStreamFrames = 0;
+
+static uint8_t IMU_Frame[2][IMU_FRAME_MAX];
+static uint8_t IMU_FrameLen[2];			//Bytes to send, 0 = buffer free;
+static uint8_t IMU_Fill = 0;			//Buffer being filled;
+static uint8_t IMU_FillCount = 0;		//Samples in the fill buffer;
+static int8_t IMU_Sending = -1;			//Buffer on the wire;
+static uint16_t IMU_NextSeq = 0;
+static uint32_t IMU_PeriodCycles = 0;
+static uint32_t IMU_StatsTime = 0;
+static struct MPUSample IMU_Held;		//Popped sample that did not fit the current frame;
+static uint8_t IMU_HeldValid = 0;
+static uint8_t IMU_Active = 0;
+
+static const DL_DMA_Config gIMUStreamDMAConfig = {
+	.transferMode   = DL_DMA_SINGLE_TRANSFER_MODE,
+	.extendedMode   = DL_DMA_NORMAL_MODE,
+	.destIncrement  = DL_DMA_ADDR_UNCHANGED,
+	.srcIncrement   = DL_DMA_ADDR_INCREMENT,
+	.destWidth      = DL_DMA_WIDTH_BYTE,
+	.srcWidth       = DL_DMA_WIDTH_BYTE,
+	.trigger        = DMA_UART0_TX_TRIG,
+	.triggerType    = DL_DMA_TRIGGER_TYPE_EXTERNAL,
+};
+
+static void IMUStream_kick();
+
+static void IMUStream_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static void IMUStream_put32(uint8_t *p, uint32_t v)
+{
+	IMUStream_put16(p, v & 0xFFFF);
+	IMUStream_put16(p + 2, v >> 16);
+}
+
+/**
+ * @brief Finish the frame in the fill buffer and move on to the other buffer
+ * @param type The frame type
+ * @param len The payload length
+ */
+static void IMUStream_close(uint8_t type, uint8_t len)
+{
+	uint8_t *f = IMU_Frame[IMU_Fill];
+	uint8_t sum = 0, i;
+	f[0] = IMU_FRAME_SYNC0;
+	f[1] = IMU_FRAME_SYNC1;
+	f[2] = type;
+	f[3] = len;
+	for (i = 2; i < IMU_FRAME_HEAD + len; i++)
+		sum += f[i];
+	f[IMU_FRAME_HEAD + len] = sum;
+	IMU_FrameLen[IMU_Fill] = IMU_FRAME_HEAD + len + 1;
+	IMU_FillCount = 0;
+	IMU_Fill ^= 1;
+	++gIMUStreamFrames;
+	IMUStream_kick();
+}
+
+static void IMUStream_closeSamples()
+{
+	IMUStream_close(IMU_FRAME_SAMPLES, IMU_SAMPLES_HEAD + IMU_FillCount * MPU_SAMPLE_BYTES);
+}
+
+static void IMUStream_add(const struct MPUSample *sample)
+{
+	uint8_t *p = &IMU_Frame[IMU_Fill][IMU_FRAME_HEAD];
+	if (IMU_FillCount == 0)
+	{
+		IMUStream_put16(p, sample->seq);
+		IMUStream_put32(p + 2, sample->time);
+		IMUStream_put32(p + 6, IMU_PeriodCycles);
+	}
+	//acc[3], temp, gyro[3] are contiguous little-endian int16 on the M0+;
+	memcpy(p + IMU_SAMPLES_HEAD + IMU_FillCount * MPU_SAMPLE_BYTES, sample->acc, MPU_SAMPLE_BYTES);
+	IMU_NextSeq = sample->seq + 1;
+	if (++IMU_FillCount == IMU_STREAM_BATCH)
+		IMUStream_closeSamples();
+}
+
+/**
+ * @brief Start the next finished frame if the DMA is idle
+ */
+static void IMUStream_kick()
+{
+	uint8_t b;
+	if (IMU_Sending >= 0)
+	{
+		if (DL_DMA_isChannelEnabled(DMA, IMU_STREAM_DMA_CHAN))
+			return;
+		IMU_FrameLen[IMU_Sending] = 0;
+		IMU_Sending = -1;
+	}
+	//Every close tries to start its frame, so at most one finished frame is waiting here;
+	b = IMU_FrameLen[0] ? 0 : 1;
+	if (!IMU_FrameLen[b])
+		return;
+	DL_DMA_setSrcAddr(DMA, IMU_STREAM_DMA_CHAN, (uint32_t) &IMU_Frame[b][0]);
+	DL_DMA_setDestAddr(DMA, IMU_STREAM_DMA_CHAN, (uint32_t) &UART_0_INST->TXDATA);
+	DL_DMA_setTransferSize(DMA, IMU_STREAM_DMA_CHAN, IMU_FrameLen[b]);
+	DL_DMA_enableChannel(DMA, IMU_STREAM_DMA_CHAN);
+	IMU_Sending = b;
+}
+
+/**
+ * @brief Move ring samples into frames and keep the DMA busy
+ * @details Runs after each FIFO drain and at the end of each frame transfer; both interrupts
+ *          have the same priority, so this never preempts itself. Samples stay in the ring
+ *          while both buffers are busy; what does not fit there is counted in gMPURingOverflow.
+ */
+static void IMUStream_service()
+{
+	uint8_t *p;
+	if (!IMU_Active)
+		return;
+	IMUStream_kick();
+	while (!IMU_FrameLen[IMU_Fill])
+	{
+		if (!IMU_HeldValid)
+		{
+			if (!MPU6500_FIFO_pop(&IMU_Held))
+				break;
+			IMUFilter_feed(&IMU_Held);
+			IMU_HeldValid = 1;
+		}
+		if (IMU_FillCount && IMU_Held.seq != IMU_NextSeq)
+		{
+			IMUStream_closeSamples();	//Gap: frames only hold consecutive samples;
+			continue;
+		}
+		IMUStream_add(&IMU_Held);
+		IMU_HeldValid = 0;
+	}
+	if (IMU_FillCount == 0 && !IMU_FrameLen[IMU_Fill] && SysTime_getMs() - IMU_StatsTime >= IMU_STREAM_STATS_PERIOD)
+	{
+		IMU_StatsTime = SysTime_getMs();
+		p = &IMU_Frame[IMU_Fill][IMU_FRAME_HEAD];
+		IMUStream_put32(p, gMPURingOverflow);
+		IMUStream_put32(p + 4, gMPUFifoOverflow);
+		IMUStream_put32(p + 8, gIMUStreamFrames);
+		IMUStream_close(IMU_FRAME_STATS, 12);
+	}
+	IMUStream_kick();
+}
+
+/**
+ * @brief Start streaming the IMU at a sample rate
+ * @param rate The sample rate in Hz (4-1000), see MPU6500_FIFO_start
+ * @details Needs MPU6500_Init and SysTime_init. The FIFO ring is consumed by the stream until IMUStream_stop.
+ *          Call IMUFilter_init with the same rate first for the attitude.
+ */
+void IMUStream_start(uint16_t rate)
+{
+	if (rate > 1000) rate = 1000;
+	if (rate < 4) rate = 4;
+	IMU_PeriodCycles = (CPUCLK_FREQ / 1000) * (1000 / rate);
+	IMU_FrameLen[0] = IMU_FrameLen[1] = 0;
+	IMU_Fill = IMU_FillCount = IMU_HeldValid = 0;
+	IMU_Sending = -1;
+	IMU_StatsTime = SysTime_getMs();
+	gIMUStreamFrames = 0;
+
+	DL_DMA_initChannel(DMA, IMU_STREAM_DMA_CHAN, (DL_DMA_Config *) &gIMUStreamDMAConfig);
+	DL_UART_enableDMATransmitEvent(UART_0_INST);
+	DL_UART_clearInterruptStatus(UART_0_INST, DL_UART_INTERRUPT_DMA_DONE_TX);
+	DL_UART_enableInterrupt(UART_0_INST, DL_UART_INTERRUPT_DMA_DONE_TX);
+	IMU_Active = 1;
+	MPU6500_FIFO_setHandler(IMUStream_service);
+	MPU6500_FIFO_start(rate);
+}
+
+/**
+ * @brief Stop the sensor FIFO and send what is left
+ */
+void IMUStream_stop()
+{
+	MPU6500_FIFO_stop();
+	MPU6500_FIFO_setHandler(0);
+	__disable_irq();
+	IMUStream_service();					//Last samples in the ring;
+	if (IMU_FillCount && !IMU_FrameLen[IMU_Fill])
+		IMUStream_closeSamples();
+	__enable_irq();
+	while (IMU_FrameLen[0] || IMU_FrameLen[1])
+	{
+		__disable_irq();
+		IMUStream_kick();
+		__enable_irq();
+	}
+	IMU_Active = 0;
+	DL_UART_disableInterrupt(UART_0_INST, DL_UART_INTERRUPT_DMA_DONE_TX);
+	DL_UART_disableDMATransmitEvent(UART_0_INST);
+}
+
+/**
+ * @brief Check whether the stream owns UART0 TX
+ * @return 1 from IMUStream_start until IMUStream_stop has sent the last frame
+ */
+uint8_t IMUStream_active()
+{
+	return IMU_Active;
+}
+
+/**
+ * @brief Frame transfer finished, call from UART_0_INST_IRQHandler on DL_UART_MAIN_IIDX_DMA_DONE_TX
+ */
+void IMUStream_onTxDone()
+{
+	IMUStream_service();
+}
@@ -0,0 +1,608 @@
+/*
+ * @file LogFS.c
+ * @brief Log-structured file store on the SPI flash
+ * @details Files are chains of 4 KB blocks (layout in LogFS.h) that only grow at the end, so
+ *          nothing is ever rewritten in place: an append programs erased bytes and a commit
+ *          slot, a delete programs one mark. The RAM tables (next block of each block, data
+ *          bytes of each block, the file table) are rebuilt by LogFS_mount from the block
+ *          headers, then kept up to date by the calls.
+ *          Blocks are taken in a ring from the one after the newest (highest seq), so the erases
+ *          spread over the whole area. A block whose header was blank at mount is checked blank
+ *          before it is used, as an erase cut by a reset can leave a blank header on a dirty block.
+ *          Stale blocks are erased by LogFS_poll one at a time while the flash queue is idle, or
+ *          right away when a file needs a block and none is free.
+ *          Programs go through the SPIFlash queue: a call returns once they are queued, and
+ *          LogFS_sync waits until they are on the flash. File data is read, programmed and
+ *          erased through FlashCache, so small sequential reads are served from RAM; the
+ *          mount and blank checks read the flash directly and leave the cache alone.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "LogFS.h"
+#include "SPIFlash.h"
+#include "FlashCache.h"
+#include "MathUtil.h"
+#include "SysTime.h"
+#include "UART.h"
+#include <stddef.h>
+#include <string.h>
+
+//LogFS_Next: below LogFS_Blocks the next block of the file, else the block state;
+#define LOGFS_B_FREE 0xFFFF			//Erased since the mount;
+#define LOGFS_B_BLANK 0xFFFE		//Blank header at the mount, checked before it is taken;
+#define LOGFS_B_STALE 0xFFFD
+#define LOGFS_B_DEAD 0xFFFC			//Block 0 of a deleted file, erased after every stale block;
+#define LOGFS_B_END 0xFFFB			//Last block of its file;
+#define LOGFS_NO_PREV 0xFFFF
+#define LOGFS_SLOTS_AT LOGFS_HEADER
+#define LOGFS_DATA_AT (LOGFS_HEADER + LOGFS_SLOTS * 4)
+
+struct LogFSHeader{
+	uint32_t magic;
+	uint32_t seq;
+	uint16_t id;
+	uint16_t index;
+	uint16_t prev;
+	uint16_t crc;
+	char name[LOGFS_NAME];
+	uint16_t deleted;
+};
+
+struct LogFSFile{
+	char name[LOGFS_NAME + 1];
+	uint16_t id;				//0 = no file;
+	uint16_t first, last;
+	uint16_t lastIndex;
+	uint8_t slots;				//Commit slots used in the last block, LOGFS_SLOTS = closed;
+	uint32_t size;
+	uint16_t cursor;			//Block holding byte cursorBase, where the last read ended;
+	uint32_t cursorBase;
+};
+
+uint32_t gLogFSBlocks = 0;
+uint32_t gLogFSFree = 0;
+uint32_t gLogFSStale = 0;
+uint32_t gLogFSErases = 0;
+uint32_t gLogFSMountMs = 0;
+
+static uint32_t LogFS_Base = 0;
+static uint16_t LogFS_Blocks = 0;			//0 = not mounted;
+static uint16_t LogFS_Next[LOGFS_BLOCKS_MAX];
+static uint16_t LogFS_Used[LOGFS_BLOCKS_MAX];	//Committed data bytes of each block of a file;
+static struct LogFSFile LogFS_Files[LOGFS_FILES];
+static uint32_t LogFS_Seq = 0;
+static uint16_t LogFS_NextId = 1;
+static uint16_t LogFS_Cursor = 0;			//Where the search for a free block starts;
+static uint8_t LogFS_Scratch[256];
+
+static uint32_t LogFS_address(uint16_t block)
+{
+	return LogFS_Base + (uint32_t)block * LOGFS_BLOCK;
+}
+
+/**
+ * @brief CRC-16/CCITT of a header, crc and deleted left out
+ */
+static uint16_t LogFS_crc(const struct LogFSHeader *h)
+{
+	const uint8_t *p = (const uint8_t *)h;
+	uint16_t crc = MathUtil_crc16(MATHUTIL_CRC16_INIT, p, offsetof(struct LogFSHeader, crc));
+	return MathUtil_crc16(crc, p + offsetof(struct LogFSHeader, crc) + sizeof(h->crc),
+		offsetof(struct LogFSHeader, deleted) - offsetof(struct LogFSHeader, crc) - sizeof(h->crc));
+}
+
+static uint8_t LogFS_blank(uint32_t addr, uint32_t len)
+{
+	uint32_t chunk, i;
+	while (len)
+	{
+		chunk = len > sizeof(LogFS_Scratch) ? sizeof(LogFS_Scratch) : len;
+		if (SPIFlash_read(addr, LogFS_Scratch, chunk) != SPI_FLASH_OK)
+			return 0;
+		for (i = 0; i < chunk; i++)
+			if (LogFS_Scratch[i] != 0xFF)
+				return 0;
+		addr += chunk;
+		len -= chunk;
+	}
+	return 1;
+}
+
+//Queue a program of any length, waiting for room in the queue;
+static void LogFS_program(uint32_t addr, const void *data, uint32_t len)
+{
+	const uint8_t *src = data;
+	uint32_t chunk;
+	while (len)
+	{
+		chunk = SPI_FLASH_PAGE - addr % SPI_FLASH_PAGE;
+		if (chunk > len)
+			chunk = len;
+		while (FlashCache_program(addr, src, chunk) == SPI_FLASH_BUSY)
+			SPIFlash_poll();
+		addr += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+}
+
+static void LogFS_erase(uint16_t block)
+{
+	while (FlashCache_erase(LogFS_address(block)) == SPI_FLASH_BUSY)
+		SPIFlash_poll();
+	++gLogFSErases;
+}
+
+/**
+ * @brief The stale block to erase next: any stale block, then the block 0s of deleted files
+ * @return LogFS_Blocks if there is none
+ */
+static uint16_t LogFS_staleBlock()
+{
+	uint16_t b;
+	for (b = 0; b < LogFS_Blocks; b++)
+		if (LogFS_Next[b] == LOGFS_B_STALE)
+			return b;
+	for (b = 0; b < LogFS_Blocks; b++)
+		if (LogFS_Next[b] == LOGFS_B_DEAD)
+			return b;
+	return LogFS_Blocks;
+}
+
+/**
+ * @brief Take an erased block, the next free one in the ring, else a stale one erased now
+ * @return LogFS_Blocks if every block holds live data
+ */
+static uint16_t LogFS_take()
+{
+	uint16_t i, b;
+	for (i = 0; i < LogFS_Blocks; i++)
+	{
+		b = LogFS_Cursor + i < LogFS_Blocks ? LogFS_Cursor + i : LogFS_Cursor + i - LogFS_Blocks;
+		if (LogFS_Next[b] == LOGFS_B_FREE)
+			break;
+		if (LogFS_Next[b] == LOGFS_B_BLANK)
+		{
+			if (!LogFS_blank(LogFS_address(b), LOGFS_BLOCK))
+				LogFS_erase(b);
+			break;
+		}
+	}
+	if (i == LogFS_Blocks)
+	{
+		b = LogFS_staleBlock();
+		if (b == LogFS_Blocks)
+			return b;
+		LogFS_erase(b);
+		--gLogFSStale;
+		++gLogFSFree;
+	}
+	--gLogFSFree;
+	LogFS_Cursor = b + 1 < LogFS_Blocks ? b + 1 : 0;
+	return b;
+}
+
+/**
+ * @brief Give a file a new last block (its block 0 if head), writing its header
+ * @return LOGFS_OK or LOGFS_FULL
+ */
+static uint8_t LogFS_newBlock(struct LogFSFile *f, uint8_t head)
+{
+	struct LogFSHeader h;
+	uint16_t b = LogFS_take();
+	if (b == LogFS_Blocks)
+		return LOGFS_FULL;
+	memset(&h, 0xFF, sizeof(h));
+	h.magic = LOGFS_MAGIC;
+	h.seq = LogFS_Seq++;
+	h.id = f->id;
+	if (head)
+	{
+		h.index = 0;
+		h.prev = LOGFS_NO_PREV;
+		memcpy(h.name, f->name, strlen(f->name));
+		f->first = f->cursor = b;
+		f->cursorBase = 0;
+	}
+	else
+	{
+		h.index = f->lastIndex + 1;
+		h.prev = f->last;
+		LogFS_Next[f->last] = b;
+	}
+	h.crc = LogFS_crc(&h);
+	LogFS_program(LogFS_address(b), &h, offsetof(struct LogFSHeader, deleted));
+	f->last = b;
+	f->lastIndex = h.index;
+	f->slots = 0;
+	LogFS_Next[b] = LOGFS_B_END;
+	LogFS_Used[b] = 0;
+	return LOGFS_OK;
+}
+
+static struct LogFSFile *LogFS_file(uint8_t file)
+{
+	if (!LogFS_Blocks || file >= LOGFS_FILES || LogFS_Files[file].id == 0)
+		return 0;
+	return &LogFS_Files[file];
+}
+
+static uint8_t LogFS_headerValid(const struct LogFSHeader *h)
+{
+	if (h->magic != LOGFS_MAGIC || h->crc != LogFS_crc(h) || h->id == 0)
+		return 0;
+	if (h->index == 0)
+		return h->prev == LOGFS_NO_PREV;
+	return h->prev < LogFS_Blocks;
+}
+
+/**
+ * @brief Commit slots of a block: committed bytes, slots used, LOGFS_SLOTS if one was torn
+ */
+static uint16_t LogFS_readSlots(uint16_t block, uint8_t *slots)
+{
+	uint32_t v[LOGFS_SLOTS];
+	uint16_t used = 0, len;
+	uint8_t i;
+	SPIFlash_read(LogFS_address(block) + LOGFS_SLOTS_AT, v, sizeof(v));
+	for (i = 0; i < LOGFS_SLOTS && v[i] != 0xFFFFFFFF; i++)
+	{
+		len = v[i] & 0xFFFF;
+		if ((v[i] >> 16) != (uint16_t)~len || len < used || len > LOGFS_DATA)
+		{
+			*slots = LOGFS_SLOTS;
+			return used;
+		}
+		used = len;
+	}
+	*slots = i;
+	return used;
+}
+
+/**
+ * @brief Rebuild the file table and the block chains from the block headers
+ * @param base Start of the area on the SPI flash, a multiple of LOGFS_BLOCK
+ * @param size Bytes, the first LOGFS_BLOCKS_MAX blocks are used
+ * @return LOGFS_OK, LOGFS_NO_FLASH, or LOGFS_FULL if the flash holds more than LOGFS_FILES files
+ *         (the others are kept, but cannot be opened)
+ * @details Reads 32 bytes of each block, 32 more of the blocks past block 0 of a file, and the
+ *          commit slots of the blocks of the files. Blank or invalid headers and the blocks of
+ *          deleted files are erased later, see LogFS_poll.
+ */
+uint8_t LogFS_mount(uint32_t base, uint32_t size)
+{
+	struct LogFSHeader h;
+	struct LogFSFile *f;
+	uint32_t t0 = SysTime_getMs(), n;
+	uint16_t b, k;
+	uint8_t i, status = LOGFS_OK;
+	LogFS_Blocks = 0;
+	FlashCache_init();
+	memset(LogFS_Files, 0, sizeof(LogFS_Files));
+	gLogFSBlocks = gLogFSFree = gLogFSStale = gLogFSErases = 0;
+	n = size / LOGFS_BLOCK;
+	if (n > LOGFS_BLOCKS_MAX)
+		n = LOGFS_BLOCKS_MAX;
+	if (gSPIFlash.size == 0 || base % LOGFS_BLOCK || n < 2)
+		return LOGFS_NO_FLASH;
+	LogFS_Base = base;
+	LogFS_Blocks = n;
+	LogFS_Seq = 0;
+	LogFS_NextId = 1;
+	LogFS_Cursor = 0;
+
+	//Block 0s make the file table;
+	for (b = 0; b < LogFS_Blocks; b++)
+	{
+		SPIFlash_read(LogFS_address(b), &h, sizeof(h));
+		LogFS_Next[b] = LOGFS_B_STALE;
+		if (!LogFS_headerValid(&h))
+		{
+			const uint32_t *w = (const uint32_t *)&h;
+			for (i = 0; i < sizeof(h) / 4 && w[i] == 0xFFFFFFFF; i++);
+			if (i == sizeof(h) / 4)
+				LogFS_Next[b] = LOGFS_B_BLANK;
+			continue;
+		}
+		if (h.seq >= LogFS_Seq)
+		{
+			LogFS_Seq = h.seq + 1;
+			LogFS_Cursor = b + 1 < LogFS_Blocks ? b + 1 : 0;
+		}
+		if (h.id >= LogFS_NextId)
+			LogFS_NextId = h.id + 1;
+		if (h.index)
+			LogFS_Next[b] = LOGFS_B_END;	//Owner found below;
+		else if (h.deleted != 0xFFFF)
+			LogFS_Next[b] = LOGFS_B_DEAD;
+		else
+		{
+			LogFS_Next[b] = LOGFS_B_END;
+			for (i = 0; i < LOGFS_FILES && LogFS_Files[i].id; i++);
+			if (i == LOGFS_FILES)
+			{
+				status = LOGFS_FULL;
+				continue;
+			}
+			f = &LogFS_Files[i];
+			memcpy(f->name, h.name, LOGFS_NAME);
+			for (k = 0; k < LOGFS_NAME && f->name[k] != (char)0xFF; k++);
+			f->name[k] = 0;
+			f->id = h.id;
+			f->first = f->last = f->cursor = b;
+		}
+	}
+
+	//Link the other blocks to the block before them, the one with the highest index is the last;
+	for (b = 0; b < LogFS_Blocks; b++)
+	{
+		if (LogFS_Next[b] != LOGFS_B_END && LogFS_Next[b] >= LogFS_Blocks)
+			continue;
+		SPIFlash_read(LogFS_address(b), &h, sizeof(h));
+		if (h.index == 0)
+			continue;
+		for (i = 0; i < LOGFS_FILES && LogFS_Files[i].id != h.id; i++);
+		if (i == LOGFS_FILES)
+		{
+			//No live file: deleted (or beyond the file table, then kept);
+			if (status == LOGFS_OK && LogFS_Next[b] == LOGFS_B_END)
+				LogFS_Next[b] = LOGFS_B_STALE;
+			continue;
+		}
+		f = &LogFS_Files[i];
+		if (LogFS_Next[h.prev] == LOGFS_B_END || LogFS_Next[h.prev] < LogFS_Blocks)
+			LogFS_Next[h.prev] = b;
+		if (h.index > f->lastIndex)
+		{
+			f->last = b;
+			f->lastIndex = h.index;
+		}
+	}
+
+	//Sizes: walk each chain through its commit slots;
+	for (i = 0; i < LOGFS_FILES; i++)
+	{
+		f = &LogFS_Files[i];
+		if (!f->id)
+			continue;
+		for (b = f->first, k = 0; ; b = LogFS_Next[b], k++)
+		{
+			LogFS_Used[b] = LogFS_readSlots(b, &f->slots);
+			f->size += LogFS_Used[b];
+			if (b == f->last || LogFS_Next[b] >= LogFS_Blocks || k == LogFS_Blocks)
+				break;
+		}
+		//A broken chain ends the file early, the blocks past the break are kept as they are;
+		f->last = b;
+		f->lastIndex = k;
+		LogFS_Next[b] = LOGFS_B_END;
+		//Bytes of a program cut before its commit would spoil the next append;
+		if (f->slots < LOGFS_SLOTS
+			&& !LogFS_blank(LogFS_address(b) + LOGFS_DATA_AT + LogFS_Used[b], LOGFS_DATA - LogFS_Used[b]))
+			f->slots = LOGFS_SLOTS;
+	}
+
+	for (b = 0; b < LogFS_Blocks; b++)
+	{
+		if (LogFS_Next[b] == LOGFS_B_BLANK)
+			++gLogFSFree;
+		else if (LogFS_Next[b] == LOGFS_B_STALE || LogFS_Next[b] == LOGFS_B_DEAD)
+			++gLogFSStale;
+	}
+	gLogFSBlocks = LogFS_Blocks;
+	gLogFSMountMs = SysTime_getMs() - t0;
+	return status;
+}
+
+/**
+ * @brief Create an empty file
+ * @param name 1 to LOGFS_NAME characters
+ * @param file The handle
+ * @return LOGFS_OK, LOGFS_EXISTS, LOGFS_FULL, LOGFS_INVALID or LOGFS_NO_FLASH
+ */
+uint8_t LogFS_create(const char *name, uint8_t *file)
+{
+	struct LogFSFile *f;
+	uint8_t i, status;
+	size_t len = strlen(name);
+	if (!LogFS_Blocks)
+		return LOGFS_NO_FLASH;
+	if (len == 0 || len > LOGFS_NAME)
+		return LOGFS_INVALID;
+	if (LogFS_open(name, &i) == LOGFS_OK)
+		return LOGFS_EXISTS;
+	for (i = 0; i < LOGFS_FILES && LogFS_Files[i].id; i++);
+	if (i == LOGFS_FILES || LogFS_NextId == 0xFFFF)
+		return LOGFS_FULL;
+	f = &LogFS_Files[i];
+	memset(f, 0, sizeof(*f));
+	memcpy(f->name, name, len);
+	f->id = LogFS_NextId;
+	status = LogFS_newBlock(f, 1);
+	if (status != LOGFS_OK)
+	{
+		f->id = 0;
+		return status;
+	}
+	++LogFS_NextId;
+	*file = i;
+	return LOGFS_OK;
+}
+
+/**
+ * @brief Find a file by name
+ * @return LOGFS_OK, LOGFS_NOT_FOUND or LOGFS_NO_FLASH
+ */
+uint8_t LogFS_open(const char *name, uint8_t *file)
+{
+	uint8_t i;
+	if (!LogFS_Blocks)
+		return LOGFS_NO_FLASH;
+	for (i = 0; i < LOGFS_FILES; i++)
+		if (LogFS_Files[i].id && strncmp(LogFS_Files[i].name, name, LOGFS_NAME + 1) == 0)
+		{
+			*file = i;
+			return LOGFS_OK;
+		}
+	return LOGFS_NOT_FOUND;
+}
+
+/**
+ * @brief Add bytes at the end of a file
+ * @return LOGFS_OK, LOGFS_FULL (the bytes that fit were added), LOGFS_INVALID or LOGFS_NO_FLASH
+ * @details Each block the bytes go into gets one commit slot; after a power failure the file
+ *          ends at a block boundary inside the append, or where it ended before.
+ */
+uint8_t LogFS_append(uint8_t file, const void *data, uint32_t len)
+{
+	struct LogFSFile *f = LogFS_file(file);
+	const uint8_t *src = data;
+	uint32_t addr, slot;
+	uint16_t used, chunk;
+	uint8_t status;
+	if (!f)
+		return LogFS_Blocks ? LOGFS_INVALID : LOGFS_NO_FLASH;
+	while (len)
+	{
+		if (f->slots >= LOGFS_SLOTS || LogFS_Used[f->last] >= LOGFS_DATA)
+			if ((status = LogFS_newBlock(f, 0)) != LOGFS_OK)
+				return status;
+		used = LogFS_Used[f->last];
+		chunk = len < (uint32_t)(LOGFS_DATA - used) ? len : LOGFS_DATA - used;
+		addr = LogFS_address(f->last);
+		LogFS_program(addr + LOGFS_DATA_AT + used, src, chunk);
+		used += chunk;
+		slot = used | (uint32_t)(uint16_t)~used << 16;
+		LogFS_program(addr + LOGFS_SLOTS_AT + f->slots * 4, &slot, 4);
+		++f->slots;
+		LogFS_Used[f->last] = used;
+		f->size += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+	return LOGFS_OK;
+}
+
+/**
+ * @brief Read bytes of a file
+ * @return The bytes read, fewer than len at the end of the file
+ * @details Sequential reads carry on from the block where the last one ended; reading
+ *          backwards walks the chain from block 0.
+ */
+uint32_t LogFS_read(uint8_t file, uint32_t offset, void *buf, uint32_t len)
+{
+	struct LogFSFile *f = LogFS_file(file);
+	uint8_t *dst = buf;
+	uint32_t done = 0, in, chunk;
+	if (!f || offset >= f->size)
+		return 0;
+	if (len > f->size - offset)
+		len = f->size - offset;
+	if (offset < f->cursorBase)
+	{
+		f->cursor = f->first;
+		f->cursorBase = 0;
+	}
+	while (offset >= f->cursorBase + LogFS_Used[f->cursor] && f->cursor != f->last)
+	{
+		f->cursorBase += LogFS_Used[f->cursor];
+		f->cursor = LogFS_Next[f->cursor];
+	}
+	while (1)
+	{
+		in = offset - f->cursorBase;
+		chunk = LogFS_Used[f->cursor] - in;
+		if (chunk > len - done)
+			chunk = len - done;
+		if (chunk)
+			FlashCache_read(LogFS_address(f->cursor) + LOGFS_DATA_AT + in, dst + done, chunk);
+		done += chunk;
+		offset += chunk;
+		if (done == len)
+			break;
+		f->cursorBase += LogFS_Used[f->cursor];
+		f->cursor = LogFS_Next[f->cursor];
+	}
+	return done;
+}
+
+uint32_t LogFS_size(uint8_t file)
+{
+	struct LogFSFile *f = LogFS_file(file);
+	return f ? f->size : 0;
+}
+
+const char *LogFS_name(uint8_t file)
+{
+	struct LogFSFile *f = LogFS_file(file);
+	return f ? f->name : 0;
+}
+
+/**
+ * @brief Delete a file: mark its block 0, its blocks are erased later by LogFS_poll
+ * @return LOGFS_OK, LOGFS_INVALID or LOGFS_NO_FLASH
+ */
+uint8_t LogFS_delete(uint8_t file)
+{
+	struct LogFSFile *f = LogFS_file(file);
+	const uint16_t deleted = 0;
+	uint16_t b, next;
+	if (!f)
+		return LogFS_Blocks ? LOGFS_INVALID : LOGFS_NO_FLASH;
+	LogFS_program(LogFS_address(f->first) + offsetof(struct LogFSHeader, deleted), &deleted, 2);
+	for (b = f->first; ; b = next)
+	{
+		next = LogFS_Next[b];
+		LogFS_Next[b] = b == f->first ? LOGFS_B_DEAD : LOGFS_B_STALE;
+		++gLogFSStale;
+		if (b == f->last)
+			break;
+	}
+	f->id = 0;
+	return LOGFS_OK;
+}
+
+/**
+ * @brief Wait until every append and delete is on the flash
+ */
+void LogFS_sync()
+{
+	SPIFlash_sync();
+}
+
+/**
+ * @brief Background erase of one stale block, when the flash queue is idle; call from the idle loop
+ */
+void LogFS_poll()
+{
+	uint16_t b;
+	if (!gLogFSStale || !SPIFlash_poll())
+		return;
+	b = LogFS_staleBlock();
+	if (b == LogFS_Blocks || FlashCache_erase(LogFS_address(b)) != SPI_FLASH_OK)
+		return;
+	LogFS_Next[b] = LOGFS_B_FREE;
+	++gLogFSErases;
+	--gLogFSStale;
+	++gLogFSFree;
+}
+
+/**
+ * @brief Print the files and the block counts over UART
+ */
+void LogFS_report()
+{
+	uint8_t i;
+	if (!LogFS_Blocks)
+	{
+		printf("LogFS: not mounted\n");
+		return;
+	}
+	printf("LogFS: %lu blocks at 0x%06lx, %lu free, %lu stale, %lu erased; mount %lu ms\n",
+		(unsigned long)gLogFSBlocks, (unsigned long)LogFS_Base, (unsigned long)gLogFSFree,
+		(unsigned long)gLogFSStale, (unsigned long)gLogFSErases, (unsigned long)gLogFSMountMs);
+	for (i = 0; i < LOGFS_FILES; i++)
+		if (LogFS_Files[i].id)
+			printf("LogFS: %-14s %lu bytes, %u blocks\n", LogFS_Files[i].name,
+				(unsigned long)LogFS_Files[i].size, LogFS_Files[i].lastIndex + 1);
+}
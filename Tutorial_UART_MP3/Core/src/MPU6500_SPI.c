@@ -19,7 +19,10 @@ Description{
 #include "MPU6500_SPI.h"
 #include "UART.h"
 #include "oled_spi_V0.2.h"
+#include "SysTime.h"
+#include "Containers.h"
 #include <math.h>
+#include <string.h>
 
 //Notes:
 /*
@@ -34,6 +37,85 @@ delay_cycles(CPU_Frq * 100);  ==  delay_ms(100);
 static int16_t ACC_DATA[7];
 static double xAoffset = 0,yAoffset = 0,zAoffset = 0;
 static double xGoffset = 0,yGoffset = 0,zGoffset = 0;
+const double AUnit[4] = {16384, 8192, 4096, 2048};
+const double GUnit[4] = {131, 65.5, 32.8, 16.4};
+
+//Fixed-point conversion, out = (raw * mul) >> shift with the offsets folded in:
+//Accel 0.0001g/LSB = 10000 / AUnit[fsr] = 10000 >> (14 - fsr) exactly;
+//Gyro 0.01dps/LSB = 100 / GUnit[fsr] in Q(15 - fsr), so raw * mul stays below 2^31;
+//Temp 0.01degC/LSB = 100 / 333.87 in Q16;
+static const uint16_t GScaleMul[4] = {25014, 25014, 24976, 24976};
+#define TEMP_SCALE_Q16 19629
+static uint8_t MPU_AFsr = Aopt, MPU_GFsr = Gopt;
+static int16_t MPU_AOffset[3] = {0}, MPU_GOffset[3] = {0};	//Unit: LSB;
+static int32_t MPU_ABias[3] = {0}, MPU_GBias[3] = {0};		//Offsets in output units;
+static uint16_t MPU_AGain[3] = {16384, 16384, 16384};		//Calibrated accel gain, Q14;
+static int32_t MPU_AMul[3] = {10000, 10000, 10000};		//10000 * gain, see MPU6500_Convert;
+
+//Hardware offsets: the calibration lands in the sensor's offset registers, samples arrive corrected;
+//XG_OFFSET: 1/32.8dps per LSB at any range, raw LSB = reg * 4 / 2^FS_SEL;
+//XA_OFFSET: 15 bits in [15:1] on top of the factory trim, 0.98mg per LSB, bit 0 reserved;
+static const uint8_t MPU_GOffsetReg[3] = {XG_OFFSET_H, YG_OFFSET_H, ZG_OFFSET_H};
+static const uint8_t MPU_AOffsetReg[3] = {XA_OFFSET_H, YA_OFFSET_H, ZA_OFFSET_H};
+#define MPU_CAL_MAX 4096			//Samples per average, keeps the int32 sums safe;
+static int32_t MPU_CalPose[6][3];	//Accel average per pose, raw LSB;
+static uint8_t MPU_CalPoses = 0;	//Bit per captured pose;
+
+//DMA burst: address byte + samples, CS stays asserted while DMA keeps the TX FIFO fed;
+//Shared by MPU6500_ReadBurst (one sample) and the FIFO drain (up to MPU_FIFO_DRAIN_MAX samples);
+#define MPU_DMA_LEN (MPU_FIFO_DRAIN_MAX * MPU_SAMPLE_BYTES + 1)
+static uint8_t MPU_DMATx[MPU_DMA_LEN];
+static uint8_t MPU_DMARx[MPU_DMA_LEN];
+static uint8_t MPU_BusSCR = 0xFF;
+
+//FIFO batching: GROUP1_IRQHandler counts data-ready edges, MPU_INST_IRQHandler unpacks the finished drain;
+#define MPU_FIFO_SIZE 512
+QUEUE_DEFINE(MPURing, struct MPUSample, MPU_RING_SIZE)
+static MPURing MPU_Ring;						//Filled by MPU_INST_IRQHandler, emptied by MPU6500_FIFO_pop;
+static volatile uint8_t MPU_FifoPending = 0;	//Samples in the sensor FIFO not drained yet (edges since the drain + backlog);
+static volatile uint8_t MPU_DrainBusy = 0;
+static volatile uint8_t MPU_BusClaimed = 0;	//SPI0 lent to the SPI flash, see MPU6500_ClaimBus;
+static uint8_t MPU_DrainSamples = 0;
+static volatile uint32_t MPU_LastEdge = 0;		//Cycle time of the newest data-ready edge;
+static uint32_t MPU_DrainTime = 0;				//Edge time of the newest sample in the drain (not of the FIFO);
+static uint32_t MPU_PeriodCycles = 0;			//Cycles per sample at the FIFO rate;
+static uint16_t MPU_SampleSeq = 0;
+static void (*MPU_BatchHandler)(void) = 0;		//Called after each drain, in interrupt context;
+volatile uint32_t gMPURingOverflow = 0;
+volatile uint32_t gMPUFifoOverflow = 0;
+volatile uint32_t gMPUMissed = 0;
+
+//Interrupt-driven modes: FIFO batches every MPU_FIFO_BATCH edges, acquisition reads each sample at its edge;
+#define MPU_MODE_OFF 0
+#define MPU_MODE_FIFO 1
+#define MPU_MODE_ACQ 2
+static volatile uint8_t MPU_Mode = MPU_MODE_OFF;
+
+//Seqlock slot with the newest sample: the version is odd while the interrupt rewrites it;
+static volatile uint32_t MPU_LatestVersion = 0;
+static struct MPULatest MPU_Latest;
+
+static const DL_DMA_Config gMPU_DMARxConfig = {
+		.transferMode   = DL_DMA_SINGLE_TRANSFER_MODE,
+		.extendedMode   = DL_DMA_NORMAL_MODE,
+		.destIncrement  = DL_DMA_ADDR_INCREMENT,
+		.srcIncrement   = DL_DMA_ADDR_UNCHANGED,
+		.destWidth      = DL_DMA_WIDTH_BYTE,
+		.srcWidth       = DL_DMA_WIDTH_BYTE,
+		.trigger        = MPU_DMA_RX_TRIG,
+		.triggerType    = DL_DMA_TRIGGER_TYPE_EXTERNAL,
+};
+
+static const DL_DMA_Config gMPU_DMATxConfig = {
+		.transferMode   = DL_DMA_SINGLE_TRANSFER_MODE,
+		.extendedMode   = DL_DMA_NORMAL_MODE,
+		.destIncrement  = DL_DMA_ADDR_UNCHANGED,
+		.srcIncrement   = DL_DMA_ADDR_INCREMENT,
+		.destWidth      = DL_DMA_WIDTH_BYTE,
+		.srcWidth       = DL_DMA_WIDTH_BYTE,
+		.trigger        = MPU_DMA_TX_TRIG,
+		.triggerType    = DL_DMA_TRIGGER_TYPE_EXTERNAL,
+};
 
 //Inner Functions:
 inline uint8_t ReadWriteByte(SPI_Regs *spi, uint8_t byte) {  
@@ -46,8 +128,19 @@ inline uint8_t ReadWriteByte(SPI_Regs *spi, uint8_t byte) {
 }
 
 
+//Switch the SPI clock between register (1MHz) and sensor data (8MHz) speed;
+static void MPU6500_SetBusSpeed(uint8_t scr) {
+		if (MPU_BusSCR == scr) return;
+		while (DL_SPI_isBusy(MPU_INST));
+		DL_SPI_disable(MPU_INST);
+		DL_SPI_setBitRateSerialClockDivider(MPU_INST, scr);
+		DL_SPI_enable(MPU_INST);
+		MPU_BusSCR = scr;
+}
+
 //SPI writes a byte;
 uint8_t MPU6500_Write_Byte(uint8_t reg,uint8_t data) {
+		MPU6500_SetBusSpeed(MPU_SCR_REG);
 		//ֵ|Return Value Reserved;
 		ReadWriteByte(MPU_INST,reg); 	//MPU6500дʱλΪ0ҼĴַλΪ0;
 		ReadWriteByte(MPU_INST,data);
@@ -57,11 +150,21 @@ uint8_t MPU6500_Write_Byte(uint8_t reg,uint8_t data) {
 //SPI reads a byte;
 uint8_t MPU6500_Read_Byte(uint8_t reg){
 		uint8_t tmp=0;
+		MPU6500_SetBusSpeed(reg == INT_STATUS ? MPU_SCR_DATA : MPU_SCR_REG);
 		ReadWriteByte(MPU_INST,reg|0x80);//r λΪ1
 		tmp = ReadWriteByte(MPU_INST,0xff);
 		return tmp;
 }
 
+//Fold the raw offsets into output units for the current full-scale ranges;
+static void MPU6500_UpdateBias(){
+		uint8_t i;
+		for (i = 0; i < 3; ++i){
+				MPU_ABias[i] = ((int32_t)MPU_AOffset[i] * 10000) >> (14 - MPU_AFsr);
+				MPU_GBias[i] = ((int32_t)MPU_GOffset[i] * GScaleMul[MPU_GFsr]) >> (15 - MPU_GFsr);
+		}
+}
+
 int16_t AEncoder(int16_t Origin) {  
     if (Origin >= 0) {  
         return Origin;  
@@ -88,6 +191,8 @@ uint8_t MPU6500_Init(void){
 		//ֲܽᣡ
 		//ֲܽᣡ
 		xAoffset = yAoffset = zAoffset = xGoffset = yGoffset = zGoffset = 0;	//Initialize Offset;
+		DL_DMA_initChannel(DMA, MPU_DMA_RX_CHAN, (DL_DMA_Config *) &gMPU_DMARxConfig);
+		DL_DMA_initChannel(DMA, MPU_DMA_TX_CHAN, (DL_DMA_Config *) &gMPU_DMATxConfig);
 		MPU6500_Write_Byte(PWR_MGMT_1,0X80);					//λmpu6500;
 		delay_cycles(CPU_Frq * 100); 									//Unit:ms; - delay 100ms;
 		MPU6500_Write_Byte(PWR_MGMT_1,0X01);					//ʼmpu6500;
@@ -147,6 +252,10 @@ struct MPUInfo MPU6500_Calibration(){
 		xGoffset = AvgOffset.xGypo = Integral.xGypo / Calibration_Period;
 		yGoffset = AvgOffset.yGypo = Integral.yGypo / Calibration_Period;
 		zGoffset = AvgOffset.zGypo = Integral.zGypo / Calibration_Period;
+		MPU_GOffset[0] = (int16_t)(xGoffset / 100);
+		MPU_GOffset[1] = (int16_t)(yGoffset / 100);
+		MPU_GOffset[2] = (int16_t)(zGoffset / 100);
+		MPU6500_UpdateBias();
 		/*
 		xAoffset = AvgOffset.xAcc = Integral.xAcc / Calibration_Period /AUnit[Aopt];
 		yAoffset = AvgOffset.yAcc = Integral.yAcc / Calibration_Period /AUnit[Aopt];
@@ -172,6 +281,8 @@ uint8_t MPU6500_Set_Gyro_Fsr(uint8_t fsr){
 //fsr:0,250dps;1,500dps;2,1000dps;3,2000dps
 //ֵ:0,óɹ
 //    ,ʧ
+	MPU_GFsr = fsr & 3;
+	MPU6500_UpdateBias();
 	return MPU6500_Write_Byte(GYRO_CONFIG, fsr<<3);//̷Χ  
 }
 
@@ -180,6 +291,8 @@ uint8_t MPU6500_Set_Accel_Fsr(uint8_t fsr){
 //fsr:0,2g;1,4g;2,8g;3,16g
 //ֵ:0,óɹ
 //    ,ʧ 	
+	MPU_AFsr = fsr & 3;
+	MPU6500_UpdateBias();
 	return MPU6500_Write_Byte(ACCEL_CONFIG, fsr<<3);//üٶȴ̷Χ  
 }
 
@@ -226,6 +339,7 @@ uint8_t MPU6500_Read_Len(uint8_t reg, uint8_t len,uint8_t *buf){
 //lenĴܸ
 //*buf洢ڴʼָ
 		uint8_t tmp=0;
+		MPU6500_SetBusSpeed(MPU_SCR_DATA);
 		ReadWriteByte(MPU_INST, reg|0x80);//ȡλΪ1
 		while(len){
 				*buf = ReadWriteByte(MPU_INST,0x00);
@@ -235,10 +349,54 @@ uint8_t MPU6500_Read_Len(uint8_t reg, uint8_t len,uint8_t *buf){
 		return tmp;
 }
 
+//Start a DMA read of [len] bytes from [reg]; the data lands in MPU_DMARx[1..len];
+static void MPU6500_DMAStart(uint8_t reg, uint16_t len){
+		MPU6500_SetBusSpeed(MPU_SCR_DATA);
+		while (!DL_SPI_isRXFIFOEmpty(MPU_INST)) DL_SPI_receiveData8(MPU_INST);	//Drop stale bytes;
+		MPU_DMATx[0] = reg | 0x80;
+		DL_DMA_setSrcAddr(DMA, MPU_DMA_RX_CHAN, (uint32_t) &MPU_INST->RXDATA);
+		DL_DMA_setDestAddr(DMA, MPU_DMA_RX_CHAN, (uint32_t) &MPU_DMARx[0]);
+		DL_DMA_setTransferSize(DMA, MPU_DMA_RX_CHAN, len + 1);
+		DL_DMA_setSrcAddr(DMA, MPU_DMA_TX_CHAN, (uint32_t) &MPU_DMATx[0]);
+		DL_DMA_setDestAddr(DMA, MPU_DMA_TX_CHAN, (uint32_t) &MPU_INST->TXDATA);
+		DL_DMA_setTransferSize(DMA, MPU_DMA_TX_CHAN, len + 1);
+		DL_DMA_enableChannel(DMA, MPU_DMA_RX_CHAN);
+		DL_DMA_enableChannel(DMA, MPU_DMA_TX_CHAN);
+		DL_SPI_enableDMAReceiveEvent(MPU_INST, DL_SPI_DMA_INTERRUPT_RX);
+		DL_SPI_enableDMATransmitEvent(MPU_INST);
+}
+
+static void MPU6500_DMAStop(){
+		DL_SPI_disableDMAReceiveEvent(MPU_INST, DL_SPI_DMA_INTERRUPT_RX);
+		DL_SPI_disableDMATransmitEvent(MPU_INST);
+}
+
+//Read one sample (accel, temp, gyro) in a single DMA burst from ACCEL_XOUT_H;
+//buf: MPU_SAMPLE_BYTES bytes, same layout as the registers;
+//Not available while FIFO batching runs (the interrupts own the bus);
+uint8_t MPU6500_ReadBurst(uint8_t *buf){
+		MPU6500_DMAStart(ACCEL_XOUT_H, MPU_SAMPLE_BYTES);
+		while (DL_DMA_isChannelEnabled(DMA, MPU_DMA_RX_CHAN));	//Channel disables itself after the last byte, ~15us at 8MHz;
+		MPU6500_DMAStop();
+		memcpy(buf, &MPU_DMARx[1], MPU_SAMPLE_BYTES);
+		return 0;
+}
+
+//Unpack one big-endian sample (burst or FIFO record, ACCEL_XOUT_H..GYRO_ZOUT_L order);
+static void MPU6500_Unpack(const uint8_t *raw, struct MPUSample *sample){
+		sample->acc[0]  = (int16_t)((raw[0]  << 8) | raw[1]);
+		sample->acc[1]  = (int16_t)((raw[2]  << 8) | raw[3]);
+		sample->acc[2]  = (int16_t)((raw[4]  << 8) | raw[5]);
+		sample->temp    = (int16_t)((raw[6]  << 8) | raw[7]);
+		sample->gyro[0] = (int16_t)((raw[8]  << 8) | raw[9]);
+		sample->gyro[1] = (int16_t)((raw[10] << 8) | raw[11]);
+		sample->gyro[2] = (int16_t)((raw[12] << 8) | raw[13]);
+}
+
 uint8_t MPU6500_Set_xAOFFSET(int16_t xoffset){
 	uint8_t tmpH,tmpL;
 	tmpH = (xoffset >> 7) & 0xFF;							//ȡֽ  
-  tmpL = (xoffset & 0xFF) << 1;										//ȡֽ  
+  tmpL = ((xoffset & 0x7F) << 1) | (MPU6500_Read_Byte(XA_OFFSET_L) & 0x01);	//ȡֽ, keep the reserved bit;
 	MPU6500_Write_Byte(XA_OFFSET_H,tmpH);
 	MPU6500_Write_Byte(XA_OFFSET_L,tmpL);
 	return 0;
@@ -247,7 +405,7 @@ uint8_t MPU6500_Set_xAOFFSET(int16_t xoffset){
 uint8_t MPU6500_Set_yAOFFSET(int16_t yoffset){
 	uint8_t tmpH,tmpL;
 	tmpH = (yoffset >> 7) & 0xFF;							//ȡֽ  
-  tmpL = (yoffset & 0xFF) << 1;										//ȡֽ  
+  tmpL = ((yoffset & 0x7F) << 1) | (MPU6500_Read_Byte(YA_OFFSET_L) & 0x01);	//ȡֽ, keep the reserved bit;
 	MPU6500_Write_Byte(YA_OFFSET_H,tmpH);
 	MPU6500_Write_Byte(YA_OFFSET_L,tmpL);
 	return 0;
@@ -256,7 +414,7 @@ uint8_t MPU6500_Set_yAOFFSET(int16_t yoffset){
 uint8_t MPU6500_Set_zAOFFSET(int16_t zoffset){
 	uint8_t tmpH,tmpL;
 	tmpH = (zoffset >> 7) & 0xFF;							//ȡֽ  
-  tmpL = (zoffset & 0xFF) << 1;										//ȡֽ  
+  tmpL = ((zoffset & 0x7F) << 1) | (MPU6500_Read_Byte(ZA_OFFSET_L) & 0x01);	//ȡֽ, keep the reserved bit;
 	MPU6500_Write_Byte(ZA_OFFSET_H,tmpH);
 	MPU6500_Write_Byte(ZA_OFFSET_L,tmpL);
 	return 0;
@@ -295,13 +453,9 @@ struct MPUInfo MPU6500_getRawData(){
 		uint8_t res;
 		res = MPU6500_Read_Byte(INT_STATUS); //Ĭ϶˼Ĵܹ˱־λ.ѭѯ˼Ĵ
 		//printf("int status:%x\n", res);
-		delay_cycles(CPU_Frq * 50);
-		if(res == 0x01) {
+		if(res & INT_STATUS_RAW_DATA_RDY) {
 				//ready
-				MPU6500_Read_Len(ACCEL_XOUT_H, 8, &raw_datas[0]);
-				delay_cycles(CPU_Frq * 50);
-				MPU6500_Read_Len(GYRO_XOUT_H, 6, &raw_datas[8]);
-				delay_cycles(CPU_Frq * 50);
+				MPU6500_ReadBurst(raw_datas);	//acc+temp+gyr in one burst, no settling delays needed;
 				
 				ACC_DATA[0] = ADecoder(((int16_t)raw_datas[0]		<<8) | raw_datas[1]);//ٶ
 				ACC_DATA[1] = ADecoder(((int16_t)raw_datas[2]		<<8) | raw_datas[3]);
@@ -339,58 +493,486 @@ struct MPUInfo MPU6500_getRawData(){
 		return nowValue;
 }
 
+//Double conversion (struct MPUInfo units), kept for reference and MPU6500_ConvertBench;
+static void MPU6500_ConvertDouble(const struct MPUSample *raw, struct MPUInfo *nowValue){
+		nowValue->xAcc  = (((double)raw->acc[0])	*10000.0	 - xAoffset)		/AUnit[Aopt];//ٶ
+		nowValue->yAcc  = (((double)raw->acc[1])	*10000.0	 - yAoffset)		/AUnit[Aopt];
+		nowValue->zAcc  = (((double)raw->acc[2])	*10000.0	 - zAoffset)		/AUnit[Aopt];
+		nowValue->xGypo = ((double)raw->gyro[0]		*100.0		 - xGoffset)		/GUnit[Gopt];//ٶ
+		nowValue->yGypo = ((double)raw->gyro[1]		*100.0		 - yGoffset)		/GUnit[Gopt];
+		nowValue->zGypo = ((double)raw->gyro[2]		*100.0		 - zGoffset)		/GUnit[Gopt];
+		nowValue->temp  = ((double)raw->temp-RoomTempDegC) / 333.87 + 21; //¶
+}
+
 struct MPUInfo MPU6500_getData(){
 		struct MPUInfo nowValue;
+		struct MPUSample sample;
 		uint8_t raw_datas[14]={0}; //acc*6+temp*2+gyr*6
 		uint8_t res;
 		res = MPU6500_Read_Byte(INT_STATUS); //Ĭ϶˼Ĵܹ˱־λ.ѭѯ˼Ĵ
-		//printf("int status:%x\n", res);
-		delay_cycles(CPU_Frq * 50);
-		if(res == 0x01) {
+		if(res & INT_STATUS_RAW_DATA_RDY) {
 				//ready
-				MPU6500_Read_Len(ACCEL_XOUT_H, 8, &raw_datas[0]);
-				delay_cycles(CPU_Frq * 50);
-				MPU6500_Read_Len(GYRO_XOUT_H, 6, &raw_datas[8]);
-				delay_cycles(CPU_Frq * 50);
-				
-				ACC_DATA[0] = ADecoder(((int16_t)raw_datas[0]		<<8) | raw_datas[1]);//ٶ
-				ACC_DATA[1] = ADecoder(((int16_t)raw_datas[2]		<<8) | raw_datas[3]);
-				ACC_DATA[2] = ADecoder(((int16_t)raw_datas[4]		<<8) | raw_datas[5]);
-				ACC_DATA[3] = (((int16_t)raw_datas[8]		<<8) | raw_datas[9]);//ٶ
-				ACC_DATA[4] = (((int16_t)raw_datas[10]	<<8) | raw_datas[11]);
-				ACC_DATA[5] = (((int16_t)raw_datas[12]	<<8) | raw_datas[13]);
-				ACC_DATA[6] = (((int16_t)raw_datas[6]		<<8) | raw_datas[7]); //¶
-				nowValue.xAcc  = (((double)ACC_DATA[0])	*10000.0	 - xAoffset)		/AUnit[Aopt];//ٶ
-				nowValue.yAcc  = (((double)ACC_DATA[0])	*10000.0	 - yAoffset)		/AUnit[Aopt];
-				nowValue.zAcc  = (((double)ACC_DATA[0])	*10000.0	 - zAoffset)		/AUnit[Aopt];
-				nowValue.xGypo = ((double)ACC_DATA[3]		*100.0		 - xGoffset)		/GUnit[Gopt];//ٶ
-				nowValue.yGypo = ((double)ACC_DATA[4]		*100.0		 - yGoffset)		/GUnit[Gopt];
-				nowValue.zGypo = ((double)ACC_DATA[5]		*100.0		 - zGoffset)		/GUnit[Gopt];
-				nowValue.temp  = ((double)ACC_DATA[6]-RoomTempDegC) / 333.87 + 21; //¶
-		
-				/*
-				OLED_ShowNum(0,0,ACC_DATA[0],6,16);
-				OLED_ShowNum(0,1,ACC_DATA[1],6,16);
-				OLED_ShowNum(0,2,ACC_DATA[2],6,16);
-				OLED_ShowNum(64,0,ACC_DATA[3],6,16);
-				OLED_ShowNum(64,1,ACC_DATA[4],6,16);
-				OLED_ShowNum(64,2,ACC_DATA[5],6,16);
-				OLED_ShowNum(0,3,ACC_DATA[6],6,16);
-				OLED_ShowSignedNum(0,0,ACC_DATA[0],6,16);
-				OLED_ShowSignedNum(0,1,ACC_DATA[1],6,16);
-				OLED_ShowSignedNum(0,2,ACC_DATA[2],6,16);
-				OLED_ShowSignedNum(64,0,ACC_DATA[3],6,16);
-				OLED_ShowSignedNum(64,1,ACC_DATA[4],6,16);
-				OLED_ShowSignedNum(64,2,ACC_DATA[5],6,16);
-				OLED_ShowSignedNum(0,3,ACC_DATA[6],6,16);
-				*/	
+				MPU6500_ReadBurst(raw_datas);	//acc+temp+gyr in one burst, no settling delays needed;
+				MPU6500_Unpack(raw_datas, &sample);
+				MPU6500_ConvertDouble(&sample, &nowValue);
 		}
 		return nowValue;
 }
 
+//Integer conversion of a raw sample for the current full-scale ranges and offsets;
+//No soft-float: a few multiplies and shifts per axis on the M0+;
+void MPU6500_Convert(const struct MPUSample *raw, struct MPUData *out){
+		uint8_t ashift = 14 - MPU_AFsr, gshift = 15 - MPU_GFsr;
+		int32_t gmul = GScaleMul[MPU_GFsr];
+		out->acc[0]  = (((int32_t)raw->acc[0] * MPU_AMul[0]) >> ashift) - MPU_ABias[0];
+		out->acc[1]  = (((int32_t)raw->acc[1] * MPU_AMul[1]) >> ashift) - MPU_ABias[1];
+		out->acc[2]  = (((int32_t)raw->acc[2] * MPU_AMul[2]) >> ashift) - MPU_ABias[2];
+		out->gyro[0] = (((int32_t)raw->gyro[0] * gmul) >> gshift) - MPU_GBias[0];
+		out->gyro[1] = (((int32_t)raw->gyro[1] * gmul) >> gshift) - MPU_GBias[1];
+		out->gyro[2] = (((int32_t)raw->gyro[2] * gmul) >> gshift) - MPU_GBias[2];
+		out->temp    = (int16_t)(((((int32_t)raw->temp - RoomTempDegC) * TEMP_SCALE_Q16) >> 16) + 2100);
+}
+
+//Polled read with the integer conversion, returns 1 if a new sample was converted;
+uint8_t MPU6500_getDataFixed(struct MPUData *out){
+		uint8_t raw_datas[MPU_SAMPLE_BYTES];
+		struct MPUSample sample;
+		if (!(MPU6500_Read_Byte(INT_STATUS) & INT_STATUS_RAW_DATA_RDY)) return 0;
+		MPU6500_ReadBurst(raw_datas);
+		MPU6500_Unpack(raw_datas, &sample);
+		MPU6500_Convert(&sample, out);
+		return 1;
+}
+
+//Cycle cost per sample of the double and the fixed-point conversion, printed over UART;
+//Results go to volatile copies so the compiler cannot drop either loop;
+static volatile struct MPUInfo MPU_BenchInfo;
+static volatile struct MPUData MPU_BenchData;
+void MPU6500_ConvertBench(uint16_t n){
+		struct MPUSample sample = {{1200, -800, 16000}, 2500, {-150, 75, 3000}};
+		struct MPUInfo info;
+		struct MPUData data;
+		uint32_t c0, dCycles, fCycles;
+		uint16_t i;
+		if (n == 0) return;
+		c0 = SysTime_getCycles();
+		for (i = 0; i < n; ++i){
+				sample.gyro[0] = i;
+				MPU6500_ConvertDouble(&sample, &info);
+				MPU_BenchInfo = info;
+		}
+		dCycles = SysTime_getCycles() - c0;
+		c0 = SysTime_getCycles();
+		for (i = 0; i < n; ++i){
+				sample.gyro[0] = i;
+				MPU6500_Convert(&sample, &data);
+				MPU_BenchData = data;
+		}
+		fCycles = SysTime_getCycles() - c0;
+		printf("MPU6500 convert: double %lu, fixed %lu cycles/sample\n",
+				(unsigned long)(dCycles / n), (unsigned long)(fCycles / n));
+}
+
+
+//Calibration in the offset registers (see MPU_GOffsetReg): no per-sample cost, kept in flash by the caller;
+static int32_t MPU6500_DivRound(int32_t v, int32_t n){
+		return (v >= 0 ? v + n / 2 : v - n / 2) / n;
+}
+
+static int16_t MPU6500_Clamp16(int32_t v){
+		return v > 32767 ? 32767 : (v < -32768 ? -32768 : (int16_t)v);
+}
+
+static int16_t MPU6500_ReadOffset(uint8_t regH){
+		return (int16_t)((MPU6500_Read_Byte(regH) << 8) | MPU6500_Read_Byte(regH + 1));
+}
+
+//Accel registers hold the 15-bit value in [15:1]: write it with the reserved bit 0 untouched;
+static void MPU6500_WriteAOffset(uint8_t regH, int16_t offset){
+		MPU6500_Write_Byte(regH, (offset >> 7) & 0xFF);
+		MPU6500_Write_Byte(regH + 1, ((offset & 0x7F) << 1) | (MPU6500_Read_Byte(regH + 1) & 0x01));
+}
+
+static void MPU6500_WriteGOffset(uint8_t regH, int16_t offset){
+		MPU6500_Write_Byte(regH, (offset >> 8) & 0xFF);
+		MPU6500_Write_Byte(regH + 1, offset & 0xFF);
+}
+
+static void MPU6500_SetGain(uint8_t axis, uint16_t gain){
+		MPU_AGain[axis] = gain;
+		MPU_AMul[axis] = (10000L * gain + 8192) >> 14;
+}
+
+//Average [n] polled samples (raw LSB, rounded); returns 1 if data-ready stays low for 20ms;
+static uint8_t MPU6500_Average(uint16_t n, int32_t acc[3], int32_t gyro[3]){
+		uint8_t raw[MPU_SAMPLE_BYTES];
+		struct MPUSample sample;
+		int32_t sum[6] = {0};
+		uint32_t t0;
+		uint16_t k;
+		uint8_t i;
+		if (n == 0) n = 1;
+		if (n > MPU_CAL_MAX) n = MPU_CAL_MAX;
+		for (k = 0; k < n; ++k){
+				t0 = SysTime_getMs();
+				while (!(MPU6500_Read_Byte(INT_STATUS) & INT_STATUS_RAW_DATA_RDY))
+						if (SysTime_getMs() - t0 > 20) return 1;
+				MPU6500_ReadBurst(raw);
+				MPU6500_Unpack(raw, &sample);
+				for (i = 0; i < 3; ++i){
+						sum[i] += sample.acc[i];
+						sum[3 + i] += sample.gyro[i];
+				}
+		}
+		for (i = 0; i < 3; ++i){
+				acc[i] = MPU6500_DivRound(sum[i], n);
+				gyro[i] = MPU6500_DivRound(sum[3 + i], n);
+		}
+		return 0;
+}
+
+//Keep the board still: the gyro bias over [n] samples is cancelled in XG/YG/ZG_OFFSET;
+//Works on top of the current register values, so it can be repeated; returns 1 on failure;
+//Needs SysTime_init() and no FIFO/acquisition mode running;
+uint8_t MPU6500_CalibrateGyro(uint16_t n){
+		int32_t acc[3], gyro[3];
+		uint8_t i;
+		if (MPU_Mode != MPU_MODE_OFF || MPU6500_Average(n, acc, gyro)) return 1;
+		for (i = 0; i < 3; ++i){
+				//One register step is 4 / 2^FS_SEL raw LSB;
+				MPU6500_WriteGOffset(MPU_GOffsetReg[i], MPU6500_Clamp16(
+						MPU6500_ReadOffset(MPU_GOffsetReg[i]) - MPU6500_DivRound(gyro[i] << MPU_GFsr, 4)));
+				MPU_GOffset[i] = 0;
+		}
+		MPU6500_UpdateBias();
+		return 0;
+}
+
+//Capture one accel pose with the board still, see MPU6500_CalibrateAccelApply; returns 1 on failure;
+//pose: 0/1 = +X/-X up, 2/3 = +Y/-Y up, 4/5 = +Z/-Z up (that axis reads +1g/-1g);
+uint8_t MPU6500_CalibrateAccelPose(uint8_t pose, uint16_t n){
+		int32_t gyro[3];
+		if (pose >= 6 || MPU_Mode != MPU_MODE_OFF || MPU6500_Average(n, MPU_CalPose[pose], gyro)) return 1;
+		MPU_CalPoses |= 1 << pose;
+		return 0;
+}
+
+//All six poses: per-axis bias from the mean of the +-1g pair, gain from its span;
+//Only the +Z pose (board level): bias only, X/Y should read 0g and Z +1g;
+//The bias goes into XA/YA/ZA_OFFSET, the gain into MPU6500_Convert; the poses are consumed;
+//Returns 1 if the poses are missing or the gain is off by more than 10%;
+uint8_t MPU6500_CalibrateAccelApply(){
+		int32_t one = 16384 >> MPU_AFsr, bias[3], span;
+		uint16_t gain[3];
+		uint8_t i;
+		if (MPU_Mode != MPU_MODE_OFF) return 1;
+		if (MPU_CalPoses == 0x3F){
+				for (i = 0; i < 3; ++i){
+						bias[i] = MPU6500_DivRound(MPU_CalPose[2 * i][i] + MPU_CalPose[2 * i + 1][i], 2);
+						span = MPU_CalPose[2 * i][i] - MPU_CalPose[2 * i + 1][i];	//2g;
+						if (span <= 0) return 1;
+						gain[i] = (uint16_t)MPU6500_DivRound((2 * one) << 14, span);
+						if (gain[i] < 14746 || gain[i] > 18022) return 1;
+				}
+		}
+		else if (MPU_CalPoses & (1 << 4)){
+				bias[0] = MPU_CalPose[4][0];
+				bias[1] = MPU_CalPose[4][1];
+				bias[2] = MPU_CalPose[4][2] - one;
+				for (i = 0; i < 3; ++i) gain[i] = MPU_AGain[i];
+		}
+		else return 1;
+		for (i = 0; i < 3; ++i){
+				//One register step (0.98mg) is 16 / 2^fsr raw LSB;
+				MPU6500_WriteAOffset(MPU_AOffsetReg[i], MPU6500_Clamp16(
+						(MPU6500_ReadOffset(MPU_AOffsetReg[i]) >> 1) - MPU6500_DivRound(bias[i] << MPU_AFsr, 16)));
+				MPU6500_SetGain(i, gain[i]);
+				MPU_AOffset[i] = 0;
+		}
+		MPU6500_UpdateBias();
+		MPU_CalPoses = 0;
+		return 0;
+}
+
+//Current calibration for storage: offset register values (range independent) and accel gains;
+void MPU6500_getCalib(struct MPUCalib *calib){
+		uint8_t i;
+		for (i = 0; i < 3; ++i){
+				calib->gyroOffset[i] = MPU6500_ReadOffset(MPU_GOffsetReg[i]);
+				calib->accOffset[i] = MPU6500_ReadOffset(MPU_AOffsetReg[i]) >> 1;
+				calib->accGain[i] = MPU_AGain[i];
+		}
+}
+
+//Restore a stored calibration after MPU6500_Init() (the reset reloads the factory offsets);
+//Returns 1 and changes nothing if a gain is off by more than 10%;
+uint8_t MPU6500_setCalib(const struct MPUCalib *calib){
+		uint8_t i;
+		if (MPU_Mode != MPU_MODE_OFF) return 1;
+		for (i = 0; i < 3; ++i)
+				if (calib->accGain[i] < 14746 || calib->accGain[i] > 18022) return 1;
+		for (i = 0; i < 3; ++i){
+				MPU6500_WriteGOffset(MPU_GOffsetReg[i], calib->gyroOffset[i]);
+				MPU6500_WriteAOffset(MPU_AOffsetReg[i], calib->accOffset[i]);
+				MPU6500_SetGain(i, calib->accGain[i]);
+				MPU_AOffset[i] = MPU_GOffset[i] = 0;
+		}
+		MPU6500_UpdateBias();
+		return 0;
+}
+
+
+//Throughput check: poll data-ready for [period] ms at [rate] Hz and print the achieved sample rate;
+//Needs SysTime_init() and the DLPF enabled (see MPU6500_Set_Rate);
+uint16_t MPU6500_RateTest(uint16_t rate, uint16_t period){
+		uint8_t raw[MPU_SAMPLE_BYTES];
+		uint32_t samples = 0, burstCycles = 0, t0, c0;
+		if(rate>1000)rate=1000;	//Same limits as MPU6500_Set_Rate;
+		if(rate<4)rate=4;
+		MPU6500_Set_Rate(rate);
+		t0 = SysTime_getMs();
+		while (SysTime_getMs() - t0 < period){
+				if (MPU6500_Read_Byte(INT_STATUS) & INT_STATUS_RAW_DATA_RDY){
+						c0 = SysTime_getCycles();
+						MPU6500_ReadBurst(raw);
+						burstCycles += SysTime_getCycles() - c0;
+						++samples;
+				}
+		}
+		printf("MPU6500: set %u Hz (ODR %u Hz), got %lu Hz, %lu cycles/burst\n", rate, 1000 / (1000 / rate),
+				(unsigned long)(samples * 1000 / period), (unsigned long)(samples ? burstCycles / samples : 0));
+		return samples * 1000 / period;
+}
+
+//FIFO batching:
+//Read FIFO_COUNT and start a DMA drain of the oldest whole samples in the FIFO (interrupt context);
+//The newest sample in the FIFO arrived at MPU_LastEdge, so a drain capped at MPU_FIFO_DRAIN_MAX
+//ends (count - MPU_DrainSamples) periods before it, and that backlog stays in MPU_FifoPending;
+static void MPU6500_FIFO_drain(){
+		uint8_t cnt[2];
+		uint16_t bytes, count;
+		uint32_t edge = MPU_LastEdge;
+		MPU_FifoPending = 0;	//Edges from here on belong to the next drain;
+		MPU6500_Read_Len(FIFO_COUNTH, 2, cnt);
+		bytes = ((uint16_t)(cnt[0] & 0x1F) << 8) | cnt[1];
+		count = bytes / MPU_SAMPLE_BYTES;
+		if (bytes > MPU_FIFO_SIZE - MPU_SAMPLE_BYTES){
+				//Stop-when-full mode: the next sample did not fit, restart on a sample boundary;
+				++gMPUFifoOverflow;
+				MPU_SampleSeq += count;	//Leave a gap for the samples thrown away;
+				MPU6500_Write_Byte(USER_CTRL, 0x54);	//I2C_IF_DIS + FIFO_EN + FIFO_RST;
+				return;
+		}
+		MPU_DrainSamples = count > MPU_FIFO_DRAIN_MAX ? MPU_FIFO_DRAIN_MAX : count;
+		if (MPU_DrainSamples == 0) return;
+		MPU_FifoPending += count - MPU_DrainSamples;	//Plus any edge since the read above;
+		MPU_DrainTime = edge - (count - MPU_DrainSamples) * MPU_PeriodCycles;
+		MPU_DrainBusy = 1;
+		MPU6500_DMAStart(FIFO_R_W, MPU_DrainSamples * MPU_SAMPLE_BYTES);
+}
+
+//Acquisition mode: read the sample of this edge right away;
+static void MPU6500_Acq_read(){
+		if (MPU_DrainBusy || MPU_BusClaimed){
+				++gMPUMissed;
+				++MPU_SampleSeq;		//Leave a gap for the consumers;
+				return;
+		}
+		MPU_DrainTime = MPU_LastEdge;
+		MPU_DrainSamples = 1;
+		MPU_DrainBusy = 1;
+		MPU6500_DMAStart(ACCEL_XOUT_H, MPU_SAMPLE_BYTES);
+}
+
+//Publish the newest sample to the seqlock slot (interrupt context);
+static void MPU6500_Publish(const struct MPUSample *sample){
+		++MPU_LatestVersion;
+		__DMB();
+		MPU_Latest.raw = *sample;
+		MPU6500_Convert(sample, &MPU_Latest.data);
+		__DMB();
+		++MPU_LatestVersion;
+}
+
+//SPI0 sharing with the SPI flash (SPIFlash.c, own /CS): while claimed the interrupts leave the bus alone,
+//FIFO mode keeps counting edges (the sensor FIFO holds them), acquisition mode counts them in gMPUMissed;
+//Returns 0 while a DMA read of the MPU6500 is running, try again later;
+uint8_t MPU6500_ClaimBus(){
+		__disable_irq();
+		if (MPU_DrainBusy){
+				__enable_irq();
+				return 0;
+		}
+		MPU_BusClaimed = 1;
+		__enable_irq();
+		MPU_BusSCR = 0xFF;	//The flash sets its own clock, set ours again on the next transfer;
+		return 1;
+}
+
+//Give SPI0 back, and start the drain that was held back meanwhile;
+void MPU6500_ReleaseBus(){
+		__disable_irq();
+		MPU_BusClaimed = 0;
+		if (MPU_Mode == MPU_MODE_FIFO && MPU_FifoPending >= MPU_FIFO_BATCH && !MPU_DrainBusy) MPU6500_FIFO_drain();
+		__enable_irq();
+}
+
+//Data-ready edge on the INT pin: timestamp it, then batch (FIFO mode) or read it (acquisition mode);
+void GROUP1_IRQHandler(void){
+		switch (DL_Interrupt_getPendingGroup(DL_INTERRUPT_GROUP_1)){
+				case DL_INTERRUPT_GROUP1_IIDX_GPIOA:
+						if (DL_GPIO_getPendingInterrupt(MPU_INT_PORT) != MPU_INT_IIDX) break;
+						MPU_LastEdge = SysTime_getCycles();
+						if (MPU_Mode == MPU_MODE_ACQ) MPU6500_Acq_read();
+						else if (++MPU_FifoPending >= MPU_FIFO_BATCH && !MPU_DrainBusy && !MPU_BusClaimed) MPU6500_FIFO_drain();
+						break;
+				default:
+						break;
+		}
+}
+
+//Drain or acquisition read finished: move the samples into the ring and publish the newest;
+void MPU_INST_IRQHandler(void){
+		uint8_t i;
+		struct MPUSample sample, newest;
+		switch (DL_SPI_getPendingInterrupt(MPU_INST)){
+				case DL_SPI_IIDX_DMA_DONE_RX:
+						MPU6500_DMAStop();
+						if (!MPU_DrainBusy) break;
+						for (i = 0; i < MPU_DrainSamples; ++i, ++MPU_SampleSeq){
+								MPU6500_Unpack(&MPU_DMARx[1 + i * MPU_SAMPLE_BYTES], &sample);
+								sample.seq = MPU_SampleSeq;
+								sample.time = MPU_DrainTime - (MPU_DrainSamples - 1 - i) * MPU_PeriodCycles;	//Oldest first;
+								if (MPURing_push(&MPU_Ring, sample) != VECTOR_OK){
+										gMPURingOverflow += MPU_DrainSamples - i;	//Foreground too slow, drop the rest of the batch;
+										MPU_SampleSeq += MPU_DrainSamples - i;
+										break;
+								}
+						}
+						//The newest sample is published even if the ring had no room for it;
+						MPU6500_Unpack(&MPU_DMARx[1 + (MPU_DrainSamples - 1) * MPU_SAMPLE_BYTES], &newest);
+						newest.seq = MPU_SampleSeq - 1;
+						newest.time = MPU_DrainTime;
+						MPU6500_Publish(&newest);
+						MPU_DrainBusy = 0;
+						if (MPU_Mode == MPU_MODE_FIFO && MPU_FifoPending >= MPU_FIFO_BATCH) MPU6500_FIFO_drain();	//Backlog, or fell behind during the transfer;
+						if (MPU_BatchHandler) MPU_BatchHandler();
+						break;
+				default:
+						break;
+		}
+}
+
+//Reset the ring and counters and set the sample rate for an interrupt-driven mode;
+static void MPU6500_IntPrepare(uint16_t rate){
+		MPURing_init(&MPU_Ring);
+		MPU_FifoPending = MPU_DrainBusy = 0;
+		gMPURingOverflow = gMPUFifoOverflow = gMPUMissed = 0;
+		MPU_SampleSeq = 0;
+		if(rate>1000)rate=1000;	//Same limits as MPU6500_Set_Rate;
+		if(rate<4)rate=4;
+		MPU_PeriodCycles = (CPUCLK_FREQ / 1000) * (1000 / rate);	//ODR = 1kHz / (SMPLRT_DIV + 1);
+		MPU6500_Set_Rate(rate);
+		MPU6500_Write_Byte(INT_PIN_CFG, 0x00);		//INT active high, push-pull, 50us pulse;
+}
+
+//Route the data-ready pulse to GROUP1_IRQHandler and the DMA completion to MPU_INST_IRQHandler;
+static void MPU6500_IntStart(uint8_t mode){
+		MPU_Mode = mode;
+		DL_GPIO_initDigitalInputFeatures(MPU_INT_IOMUX, DL_GPIO_INVERSION_DISABLE, DL_GPIO_RESISTOR_PULL_DOWN,
+				DL_GPIO_HYSTERESIS_DISABLE, DL_GPIO_WAKEUP_DISABLE);
+		DL_GPIO_setLowerPinsPolarity(MPU_INT_PORT, MPU_INT_EDGE);
+		DL_GPIO_clearInterruptStatus(MPU_INT_PORT, MPU_INT_PIN);
+		DL_GPIO_enableInterrupt(MPU_INT_PORT, MPU_INT_PIN);
+		DL_SPI_clearInterruptStatus(MPU_INST, DL_SPI_INTERRUPT_DMA_DONE_RX);
+		DL_SPI_enableInterrupt(MPU_INST, DL_SPI_INTERRUPT_DMA_DONE_RX);
+		NVIC_EnableIRQ(MPU_INST_INT_IRQN);
+		NVIC_EnableIRQ(GPIOA_INT_IRQn);
+		MPU6500_Write_Byte(INT_ENABLE, 0x01);		//RAW_RDY_EN: one INT pulse per sample;
+}
+
+static void MPU6500_IntStop(){
+		DL_GPIO_disableInterrupt(MPU_INT_PORT, MPU_INT_PIN);
+		while (MPU_DrainBusy);						//Let the running read land in the ring;
+		DL_SPI_disableInterrupt(MPU_INST, DL_SPI_INTERRUPT_DMA_DONE_RX);
+		MPU_Mode = MPU_MODE_OFF;
+		MPU6500_Write_Byte(INT_ENABLE, 0x00);
+}
+
+//Capture every sample at [rate] Hz into the ring, independent of the foreground;
+//The sensor FIFO holds accel+temp+gyro (14 bytes/sample), the INT pin counts samples and a DMA drain runs every MPU_FIFO_BATCH of them;
+//Register access from the foreground is not allowed until MPU6500_FIFO_stop();
+uint8_t MPU6500_FIFO_start(uint16_t rate){
+		MPU6500_IntPrepare(rate);
+		MPU6500_Write_Byte(CONFIG, 0x43);			//FIFO_MODE = stop when full, DLPF 41Hz (SMPLRT_DIV needs the DLPF);
+		MPU6500_Write_Byte(FIFO_EN, 0xF8);			//TEMP + XG + YG + ZG + ACCEL;
+		MPU6500_Write_Byte(USER_CTRL, 0x14);		//I2C_IF_DIS + FIFO_RST;
+		MPU6500_Write_Byte(USER_CTRL, 0x50);		//I2C_IF_DIS + FIFO_EN;
+		MPU6500_IntStart(MPU_MODE_FIFO);
+		return 0;
+}
+
+void MPU6500_FIFO_stop(){
+		MPU6500_IntStop();
+		MPU6500_Write_Byte(USER_CTRL, 0x10);
+		MPU6500_Write_Byte(FIFO_EN, 0x00);
+		MPU6500_Write_Byte(CONFIG, 0x03);
+}
+
+//Samples waiting in the ring;
+uint16_t MPU6500_FIFO_available(){
+		return MPURing_count(&MPU_Ring);
+}
+
+//Take the oldest sample from the ring, returns 1 if one was taken, 0 if the ring is empty;
+uint8_t MPU6500_FIFO_pop(struct MPUSample *sample){
+		return MPURing_pop(&MPU_Ring, sample) == VECTOR_OK;
+}
+
+//Consume the ring from interrupt context: [handler] runs after every drain (0 to remove);
+//It then owns MPU6500_FIFO_pop, other users must run at the same interrupt priority;
+void MPU6500_FIFO_setHandler(void (*handler)(void)){
+		MPU_BatchHandler = handler;
+}
+
+//Acquisition service: every data-ready edge is timestamped and its sample read by DMA at once;
+//Lowest latency (one sample, ~20us after the edge); the samples go to the ring and the latest slot,
+//and the handler of MPU6500_FIFO_setHandler runs after every read (IMUFilter_start with acquisition = 1);
+//Register access from the foreground is not allowed until MPU6500_Acq_stop();
+uint8_t MPU6500_Acq_start(uint16_t rate){
+		MPU6500_IntPrepare(rate);
+		MPU6500_Write_Byte(CONFIG, 0x03);			//DLPF 41Hz, no FIFO;
+		MPU6500_IntStart(MPU_MODE_ACQ);
+		return 0;
+}
+
+void MPU6500_Acq_stop(){
+		MPU6500_IntStop();
+}
+
+//Copy the newest sample without blocking the interrupts, returns 0 if nothing was published yet;
+//Retries if an interrupt rewrote the slot during the copy; call from the foreground only;
+//latest->raw.seq tells whether the sample is new since the last call;
+uint8_t MPU6500_readLatest(struct MPULatest *latest){
+		uint32_t version;
+		do {
+				version = MPU_LatestVersion;
+				__DMB();
+				*latest = MPU_Latest;
+				__DMB();
+		} while ((version & 1) || version != MPU_LatestVersion);
+		return version != 0;
+}
 
 void MPU6500_UARTDebugger(){
-		struct MPUInfo nowValue = MPU6500_getData();
+		struct MPUInfo nowValue;
+		struct MPULatest latest;
+		if (MPU_Mode == MPU_MODE_OFF) nowValue = MPU6500_getData();
+		else {
+				//Interrupts own the bus: show the published sample instead of polling;
+				if (!MPU6500_readLatest(&latest)) return;
+				MPU6500_ConvertDouble(&latest.raw, &nowValue);
+		}
 		/*
 		MCUTransData16(UART_0_INST,&nowValue.xAcc,1);
 		MCUTransData16(UART_0_INST,&nowValue.yAcc,1);
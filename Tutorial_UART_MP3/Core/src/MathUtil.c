@@ -0,0 +1,56 @@
+/*
+ * @file MathUtil.c
+ * @brief Arithmetic shared by the modules: square root on MATHACL and CRC-16/CCITT
+ * @details MATHACL is used without locking, see the note in MathUtil.h.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "MathUtil.h"
+
+//SQRT expects an unsigned Q16 operand in [1, 4); MathUtil_sqrt does the range reduction;
+static const DL_MathACL_operationConfig gMathSqrtConfig = {
+	.opType      = DL_MATHACL_OP_TYPE_SQRT,
+	.opSign      = DL_MATHACL_OPSIGN_UNSIGNED,
+	.iterations  = 16,
+	.scaleFactor = 0,
+	.qType       = DL_MATHACL_Q_TYPE_Q16,
+};
+
+/**
+ * @brief Square root on MATHACL
+ * @param x Unsigned Q16 operand
+ * @return sqrt(x) in Q16
+ * @details The operand is shifted by an even count into [1, 4) and the root shifted back by half of it.
+ */
+uint32_t MathUtil_sqrt(uint32_t x)
+{
+	int8_t n = 0;
+	if (x == 0)
+		return 0;
+	while (x >= (4UL << 16)) { x >>= 2; ++n; }
+	while (x < (1UL << 16)) { x <<= 2; --n; }
+	DL_MathACL_startSqrtOperation(MATHACL, &gMathSqrtConfig, x);
+	DL_MathACL_waitForOperation(MATHACL);
+	x = DL_MathACL_getResultOne(MATHACL);
+	return n >= 0 ? x << n : x >> -n;
+}
+
+/**
+ * @brief CRC-16/CCITT (polynomial 0x1021), bit by bit
+ * @param crc MATHUTIL_CRC16_INIT, or the result of the previous part
+ * @param data The bytes
+ * @param len Number of bytes
+ * @return The CRC over everything so far
+ */
+uint16_t MathUtil_crc16(uint16_t crc, const void *data, uint16_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint8_t bit;
+	while (len--)
+	{
+		crc ^= (uint16_t)*p++ << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
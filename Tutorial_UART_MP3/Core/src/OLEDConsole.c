@@ -0,0 +1,205 @@
+/*
+ * @file OLEDConsole.c
+ * @brief Scrolling text console on the OLED
+ * @details Terminal-style output in the 6x8 font with a scrollback ring in RAM.
+ *          The panel RAM holds exactly one screen (8 pages), so it is used as a ring of
+ *          text rows: a new line only rewrites the page that falls off the top and moves
+ *          the display start line (0x40 | line) by 8, instead of redrawing the whole screen.
+ *          The console owns the full screen while it is open; OLEDConsole_close restores
+ *          start line 0 for the graphic functions.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "OLEDConsole.h"
+#include <string.h>
+
+#define CONSOLE_GLYPHS 92	//Characters in F6x8, starting from ' ';
+
+//Defined in oledfont.h, which may only be included once (by the OLED driver);
+extern const unsigned char F6x8[][6];
+
+static char Console_Lines[CONSOLE_HISTORY][CONSOLE_COLS];
+static uint8_t Console_Head = 0;		//Ring index of the line being written;
+static uint8_t Console_Count = 0;		//Lines stored in the ring, including the current one;
+static uint8_t Console_Column = 0;		//Cursor column in the current line;
+static uint8_t Console_Row = 0;			//Screen row of the current line;
+static uint8_t Console_Top = 0;			//RAM page shown on the top row;
+static uint8_t Console_View = 0;		//Lines scrolled back into the history, 0 = live;
+static uint8_t Console_Active = 0;
+
+/**
+ * @brief Address a RAM page and screen column
+ * @param page The RAM page (0-7)
+ * @param x The screen column (0-127)
+ * @details Same column offset as OLED_Clear (XLevelL).
+ */
+static void OLEDConsole_setPos(uint8_t page, uint8_t x)
+{
+	uint8_t col = x + XLevelL;
+	OLED_WR_Byte(0xb0 + page, OLED_CMD);
+	OLED_WR_Byte(col & 0x0F, OLED_CMD);
+	OLED_WR_Byte(0x10 | (col >> 4), OLED_CMD);
+}
+
+static void OLEDConsole_drawChar(char ch)
+{
+	uint8_t i;
+	for (i = 0; i < 6; i++)
+		OLED_WR_Byte(F6x8[ch - ' '][i], OLED_DATA);
+}
+
+/**
+ * @brief Redraw one screen row from the ring
+ * @param row The screen row (0 = top)
+ */
+static void OLEDConsole_drawRow(uint8_t row)
+{
+	int16_t back = (int16_t)Console_Row - row + Console_View;
+	const char *line = 0;
+	uint8_t c;
+	if (back >= 0 && back < Console_Count)
+		line = Console_Lines[(Console_Head + CONSOLE_HISTORY - back) % CONSOLE_HISTORY];
+
+	OLEDConsole_setPos((Console_Top + row) & 7, 0);
+	for (c = 0; c < CONSOLE_COLS; c++)
+		OLEDConsole_drawChar(line ? line[c] : ' ');
+	OLED_WR_Byte(0, OLED_DATA);	//128 - 21 * 6 columns left;
+	OLED_WR_Byte(0, OLED_DATA);
+}
+
+static void OLEDConsole_setStartLine()
+{
+	OLED_WR_Byte(0x40 | (Console_Top << 3), OLED_CMD);
+}
+
+static void OLEDConsole_newLine()
+{
+	Console_Head = (Console_Head + 1) % CONSOLE_HISTORY;
+	memset(Console_Lines[Console_Head], ' ', CONSOLE_COLS);
+	if (Console_Count < CONSOLE_HISTORY)
+		++Console_Count;
+	Console_Column = 0;
+
+	if (Console_Row < CONSOLE_ROWS - 1)
+	{
+		++Console_Row;	//Screen not full yet, the row below is still blank;
+		return;
+	}
+	//Hardware scroll: the old top page becomes the bottom row;
+	Console_Top = (Console_Top + 1) & 7;
+	OLEDConsole_setStartLine();
+	OLEDConsole_drawRow(CONSOLE_ROWS - 1);
+}
+
+/**
+ * @brief Open the console and clear the screen
+ */
+void OLEDConsole_init()
+{
+	memset(Console_Lines, ' ', sizeof(Console_Lines));
+	Console_Head = 0;
+	Console_Count = 1;
+	Console_Column = 0;
+	Console_Row = 0;
+	Console_Top = 0;
+	Console_View = 0;
+	OLEDConsole_setStartLine();
+	OLED_Clear();
+	Console_Active = 1;
+}
+
+/**
+ * @brief Close the console and hand the screen back to the graphic functions
+ */
+void OLEDConsole_close()
+{
+	Console_Active = 0;
+	Console_Top = 0;
+	OLEDConsole_setStartLine();
+	OLED_Clear();
+}
+
+/**
+ * @brief Write one character to the console
+ * @param ch The character; '\n' starts a new line, '\r' returns to column 0, '\b' erases the last character
+ * @details Does nothing while the console is closed, so it can be fed from printf unconditionally.
+ *          Output while scrolled back jumps to the live view first.
+ */
+void OLEDConsole_putc(char ch)
+{
+	uint8_t row;
+	if (!Console_Active)
+		return;
+	if (Console_View)
+	{
+		Console_View = 0;
+		for (row = 0; row < CONSOLE_ROWS; row++)
+			OLEDConsole_drawRow(row);
+	}
+
+	switch (ch)
+	{
+	case '\n':
+		OLEDConsole_newLine();
+		break;
+	case '\r':
+		Console_Column = 0;
+		break;
+	case '\b':
+		if (Console_Column > 0)
+		{
+			--Console_Column;
+			Console_Lines[Console_Head][Console_Column] = ' ';
+			OLEDConsole_setPos((Console_Top + Console_Row) & 7, Console_Column * 6);
+			OLEDConsole_drawChar(' ');
+		}
+		break;
+	default:
+		if (ch < ' ' || ch - ' ' >= CONSOLE_GLYPHS)
+			break;
+		if (Console_Column == CONSOLE_COLS)
+			OLEDConsole_newLine();	//Wrap long lines;
+		Console_Lines[Console_Head][Console_Column] = ch;
+		OLEDConsole_setPos((Console_Top + Console_Row) & 7, Console_Column * 6);
+		OLEDConsole_drawChar(ch);
+		++Console_Column;
+		break;
+	}
+}
+
+/**
+ * @brief Write a string to the console
+ * @param str The null-terminated string
+ */
+void OLEDConsole_puts(const char *str)
+{
+	while (*str)
+		OLEDConsole_putc(*str++);
+}
+
+/**
+ * @brief Scroll through the history kept in RAM
+ * @param lines Positive to look back, negative to go towards the newest line
+ * @details Each step moves the start line by one text row and redraws only the row that comes into view.
+ */
+void OLEDConsole_scroll(int8_t lines)
+{
+	if (!Console_Active)
+		return;
+	while (lines > 0 && Console_View + Console_Row + 1 < Console_Count)
+	{
+		++Console_View;
+		Console_Top = (Console_Top + 7) & 7;
+		OLEDConsole_setStartLine();
+		OLEDConsole_drawRow(0);
+		--lines;
+	}
+	while (lines < 0 && Console_View > 0)
+	{
+		--Console_View;
+		Console_Top = (Console_Top + 1) & 7;
+		OLEDConsole_setStartLine();
+		OLEDConsole_drawRow(CONSOLE_ROWS - 1);
+		++lines;
+	}
+}
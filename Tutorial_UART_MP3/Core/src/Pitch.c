@@ -0,0 +1,266 @@
+/*
+ * @file Pitch.c
+ * @brief Tuner: fixed-point YIN pitch detection on the ADC stream
+ * @details Runs in the ADCStream block handler (PendSV) on the newest PITCH_WINDOW + lag samples
+ *          of each block: squared difference function, cumulative-mean threshold (compared by
+ *          cross-multiplying, so no division per lag), local minimum and parabolic interpolation.
+ *          The frequency is matched against the MusicPlayer.h note table, so the tuner agrees
+ *          with what the buzzer plays, and the offset is given in cents.
+ *          The foreground (Pitch_poll) draws the newest result on the OLED.
+ *          Latency = analysis window (ends at the block end) + handler + display time.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "Pitch.h"
+#include "MusicPlayer.h"
+#include "oled_spi_V0.2.h"
+#include "OLEDConsole.h"
+#include "SysTime.h"
+#include "UART.h"
+
+#define PITCH_NOTE_Q4 ((uint32_t)Cal_Frq * 16)	//Note frequency in Q4 = PITCH_NOTE_Q4 / period;
+
+struct PitchNote{
+	char name[5];
+	uint16_t period;	//Buzzer period, MusicPlayer.h;
+};
+
+static const struct PitchNote Pitch_Notes[] = {
+	{"L1", L1}, {"L1#", L1_}, {"L2", L2}, {"L2#", L2_}, {"L3", L3}, {"L4", L4},
+	{"L4#", L4_}, {"L5", L5}, {"L5#", L5_}, {"L6", L6}, {"L6#", L6_}, {"L7", L7},
+	{"M1", M1}, {"M1#", M1_}, {"M2", M2}, {"M2#", M2_}, {"M3", M3}, {"M4", M4},
+	{"M4#", M4_}, {"M5", M5}, {"M5#", M5_}, {"M6", M6}, {"M6#", M6_}, {"M7", M7},
+	{"H1", H1}, {"H1#", H1_}, {"H2", H2}, {"H2#", H2_}, {"H3", H3}, {"H4", H4},
+	{"H4#", H4_}, {"H5", H5}, {"H5#", H5_}, {"H6", H6}, {"H6#", H6_}, {"H7", H7},
+	{"HH1", HH1}, {"HH1#", HH1_}, {"HH2", HH2}, {"HH2#", HH2_}, {"HH3", HH3}, {"HH4", HH4},
+	{"HH4#", HH4_}, {"HH5", HH5}, {"HH5#", HH5_}, {"HH6", HH6}, {"HH6#", HH6_}, {"HH7", HH7},
+};
+#define PITCH_NOTES (sizeof(Pitch_Notes) / sizeof(Pitch_Notes[0]))
+
+static uint32_t Pitch_D[PITCH_TAU_MAX + 2];	//Difference function, index = lag;
+static struct PitchResult Pitch_Result;
+static volatile uint8_t Pitch_New = 0;
+static uint32_t Pitch_Rate = 0;
+static uint16_t Pitch_TauMin, Pitch_TauMax;
+
+//Measurement window of Pitch_report;
+static volatile uint32_t Pitch_Blocks = 0;
+static volatile uint32_t Pitch_Cycles = 0;		//Spent in the block handler;
+static volatile uint32_t Pitch_MaxCycles = 0;
+static uint32_t Pitch_Shown = 0;
+static uint32_t Pitch_LatencyCycles = 0;		//Block end to frame on its way to the panel, summed;
+
+/**
+ * @brief YIN on one frame
+ * @param x PITCH_WINDOW + Pitch_TauMax + 1 samples
+ * @return The frequency in Hz Q4, 0 if no lag passes the threshold
+ */
+static uint32_t Pitch_detect(const uint16_t *x)
+{
+	uint64_t cum = 0;
+	uint32_t sum;
+	int32_t diff;
+	int64_t num, den;
+	uint16_t tau, j, best = 0;
+	int16_t offset = 0;
+
+	//d(tau) = sum (x[j] - x[j + tau])^2, at most 128 * 2^24;
+	for (tau = 1; tau <= Pitch_TauMax + 1; tau++)
+	{
+		sum = 0;
+		for (j = 0; j < PITCH_WINDOW; j++)
+		{
+			diff = (int32_t)x[j] - x[j + tau];
+			sum += (uint32_t)(diff * diff);
+		}
+		Pitch_D[tau] = sum;
+	}
+	//First lag with d(tau) / (sum d(1..tau) / tau) below the threshold;
+	for (tau = 1; tau <= Pitch_TauMax; tau++)
+	{
+		cum += Pitch_D[tau];
+		if (tau >= Pitch_TauMin && (uint64_t)Pitch_D[tau] * tau * 32768 < (uint64_t)PITCH_THRESHOLD_Q15 * cum)
+		{
+			best = tau;
+			break;
+		}
+	}
+	if (best == 0)
+		return 0;
+	while (best < Pitch_TauMax && Pitch_D[best + 1] < Pitch_D[best])
+		best++;
+	//Parabola through d(best - 1), d(best), d(best + 1): vertex offset in 1/256 lag;
+	num = (int64_t)Pitch_D[best - 1] - Pitch_D[best + 1];
+	den = (int64_t)Pitch_D[best - 1] - 2 * (int64_t)Pitch_D[best] + Pitch_D[best + 1];
+	if (den > 0)
+	{
+		offset = (int16_t)(num * 128 / den);
+		if (offset > 128) offset = 128;
+		if (offset < -128) offset = -128;
+	}
+	return Pitch_Rate * 4096 / ((uint32_t)best * 256 + offset);
+}
+
+/**
+ * @brief Nearest note and the offset in cents
+ * @details |f * period - C| is smallest for the note closest in ratio, as all notes share C;
+ *          cents = 1200 / ln2 * ln(1 + d) with ln(1 + d) ~ d - d^2 / 2, exact to 0.1 cent within +-100.
+ */
+static void Pitch_match(uint32_t freq, struct PitchResult *r)
+{
+	uint32_t err, bestErr = 0xFFFFFFFF;
+	int64_t d;
+	int32_t cents;
+	uint8_t i;
+	for (i = 0; i < PITCH_NOTES; i++)
+	{
+		err = freq * Pitch_Notes[i].period;
+		err = err > PITCH_NOTE_Q4 ? err - PITCH_NOTE_Q4 : PITCH_NOTE_Q4 - err;
+		if (err < bestErr)
+		{
+			bestErr = err;
+			r->note = i;
+		}
+	}
+	d = ((int64_t)freq * Pitch_Notes[r->note].period - PITCH_NOTE_Q4) * 65536 / PITCH_NOTE_Q4;	//Q16;
+	cents = (int32_t)((1731 * (d - ((d * d) >> 17)) + 32768) >> 16);
+	if (cents > 99) cents = 99;
+	if (cents < -99) cents = -99;
+	r->cents = (int8_t)cents;
+}
+
+static void Pitch_onBlock(const struct ADCBlock *block)
+{
+	uint32_t c0 = SysTime_getCycles(), cycles;
+	struct PitchResult r = {0};
+	if (Pitch_TauMax == 0)
+		return;
+	r.seq = block->seq;
+	r.time = block->time;
+	if (block->rms >= PITCH_MIN_RMS)
+		r.freq = Pitch_detect(block->samples + ADC_STREAM_BLOCK - (PITCH_WINDOW + Pitch_TauMax + 1));
+	if (r.freq)
+		Pitch_match(r.freq, &r);
+	Pitch_Result = r;
+	Pitch_New = 1;
+	cycles = SysTime_getCycles() - c0;
+	Pitch_Cycles += cycles;
+	if (cycles > Pitch_MaxCycles)
+		Pitch_MaxCycles = cycles;
+	++Pitch_Blocks;
+}
+
+/**
+ * @brief Start the ADC stream with pitch detection on every block
+ * @param rate The ADC sample rate in Hz, at least 2 * PITCH_FMAX
+ * @return The actual sample rate in Hz
+ * @details Needs SysTime_init; the OLED console is closed for Pitch_poll.
+ */
+uint32_t Pitch_start(uint32_t rate)
+{
+	if (rate < 2 * PITCH_FMAX)
+		rate = 2 * PITCH_FMAX;
+	Pitch_New = 0;
+	Pitch_TauMax = 0;							//Blocks are skipped until the lags are set;
+	Pitch_Blocks = Pitch_Cycles = Pitch_MaxCycles = 0;
+	Pitch_Shown = Pitch_LatencyCycles = 0;
+	OLEDConsole_close();
+	Pitch_Rate = ADCStream_start(rate, Pitch_onBlock);
+	Pitch_TauMin = Pitch_Rate / PITCH_FMAX;
+	if (Pitch_TauMin < 2)
+		Pitch_TauMin = 2;
+	Pitch_TauMax = Pitch_Rate / PITCH_FMIN > PITCH_TAU_MAX ? PITCH_TAU_MAX : Pitch_Rate / PITCH_FMIN;
+	return Pitch_Rate;
+}
+
+/**
+ * @brief Stop the ADC stream
+ */
+void Pitch_stop()
+{
+	ADCStream_stop();
+	OLED_WaitFlush();
+}
+
+/**
+ * @brief Copy the newest result
+ * @param result Filled with the result of the newest block
+ * @return 1 if it is new since the last call, 0 otherwise
+ */
+uint8_t Pitch_get(struct PitchResult *result)
+{
+	uint8_t fresh;
+	__disable_irq();
+	*result = Pitch_Result;
+	fresh = Pitch_New;
+	Pitch_New = 0;
+	__enable_irq();
+	return fresh;
+}
+
+/**
+ * @brief Get the name of a note table entry
+ * @param note The index from struct PitchResult
+ * @return The MusicPlayer.h name, '#' for the sharp notes (e.g. "M6#")
+ */
+const char *Pitch_noteName(uint8_t note)
+{
+	return note < PITCH_NOTES ? Pitch_Notes[note].name : "?";
+}
+
+/**
+ * @brief Draw the newest result: note, frequency and a cents needle
+ * @details The whole frame, text included, is built in the back buffer and shown by OLED_Present.
+ * @return 1 if a new result was drawn, 0 otherwise
+ */
+uint8_t Pitch_poll()
+{
+	struct PitchResult r;
+	char line[17];
+	uint8_t x;
+	if (!Pitch_get(&r))
+		return 0;
+	OLED_ClearBuffer();
+	OLED_DrawString(0, 0, "Tuner");
+	if (r.freq)
+	{
+		snprintf(line, sizeof(line), "%-4s %+3dc", Pitch_noteName(r.note), r.cents);
+		OLED_DrawString(0, 2, line);
+		snprintf(line, sizeof(line), "%lu.%luHz", (unsigned long)(r.freq >> 4), (unsigned long)((r.freq & 15) * 10 >> 4));
+		OLED_DrawString(0, 4, line);
+		x = (uint8_t)(64 + (r.cents > 50 ? 50 : (r.cents < -50 ? -50 : r.cents)));
+		OLED_DrawLine(x, 48, x, 60, 1);
+	}
+	else
+		OLED_DrawString(0, 2, "---");
+	OLED_DrawLine(14, 62, 114, 62, 1);			//-50 .. +50 cents scale;
+	OLED_DrawLine(64, 58, 64, 63, 1);
+	OLED_Present();
+	Pitch_LatencyCycles += SysTime_getCycles() - r.time;
+	++Pitch_Shown;
+	return 1;
+}
+
+/**
+ * @brief Print the detection cost and latency over UART, then start a new window
+ * @details Latency = analysis window + block end to the frame handed to OLED_Present.
+ */
+void Pitch_report()
+{
+	uint32_t blocks, cycles, maxCycles, windowUs, delayUs = 0;
+	__disable_irq();
+	blocks = Pitch_Blocks;
+	cycles = Pitch_Cycles;
+	maxCycles = Pitch_MaxCycles;
+	Pitch_Blocks = Pitch_Cycles = Pitch_MaxCycles = 0;
+	__enable_irq();
+	if (blocks == 0 || Pitch_Rate == 0)
+		return;
+	windowUs = (uint32_t)((uint64_t)(PITCH_WINDOW + Pitch_TauMax + 1) * 1000000 / Pitch_Rate);
+	if (Pitch_Shown)
+		delayUs = Pitch_LatencyCycles / Pitch_Shown / (CPUCLK_FREQ / 1000000);
+	printf("Pitch: %lu cycles/block (%lu us), max %lu, latency %lu us (window %lu + %lu)\n",
+		(unsigned long)(cycles / blocks), (unsigned long)(cycles / blocks / (CPUCLK_FREQ / 1000000)),
+		(unsigned long)maxCycles, (unsigned long)(windowUs + delayUs), (unsigned long)windowUs, (unsigned long)delayUs);
+	Pitch_Shown = Pitch_LatencyCycles = 0;
+}
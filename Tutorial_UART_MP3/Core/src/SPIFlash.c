@@ -0,0 +1,484 @@
+/*
+ * @file SPIFlash.c
+ * @brief SPI NOR flash driver on SPI0
+ * @details The chip is probed by its JEDEC ID (0x9F). Reads use Fast Read (0x0B) with the data
+ *          moved by DMA straight into the caller's buffer, either waiting for the end
+ *          (SPIFlash_read) or not (SPIFlash_readStart + SPIFlash_readBusy). Page programs and
+ *          sector erases go into a small queue; SPIFlash_poll, called from the idle loop, starts
+ *          the next one and reads the status register (WIP bit) to see it finish, so the caller
+ *          never waits for the 0.7 ms of a page program or the 45 ms of a sector erase.
+ *          A read waits for the queue to empty first, so it always sees the queued data.
+ *          Every command claims SPI0 from the MPU6500 (MPU6500_ClaimBus) and drives its own /CS
+ *          GPIO, see SPIFlash.h.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "SPIFlash.h"
+#include "MPU6500_SPI.h"
+#include "SysTime.h"
+#include "UART.h"
+#include <string.h>
+
+#define FLASH_CMD_WRSR 0x01
+#define FLASH_CMD_PP 0x02
+#define FLASH_CMD_RDSR 0x05
+#define FLASH_CMD_WREN 0x06
+#define FLASH_CMD_FAST_READ 0x0B
+#define FLASH_CMD_SE 0x20
+#define FLASH_CMD_JEDEC_ID 0x9F
+#define FLASH_CMD_RELEASE_PD 0xAB
+#define FLASH_SR_WIP 0x01
+#define FLASH_SR_BP 0x3C			//Block protect bits, set at power-up on some parts;
+#define FLASH_DMA_MAX 0xFFFF		//Bytes per DMA transfer (16-bit size);
+
+//A queued command: a page program of len bytes, or a sector erase when len is 0;
+struct SPIFlashOp{
+	uint32_t addr;
+	uint16_t len;
+	uint8_t data[SPI_FLASH_PAGE];
+};
+
+struct SPIFlashInfo gSPIFlash = {0};
+uint32_t gSPIFlashReadBytes = 0;
+uint32_t gSPIFlashProgramBytes = 0;
+uint32_t gSPIFlashErases = 0;
+uint32_t gSPIFlashBusyPolls = 0;
+uint32_t gSPIFlashBusWaits = 0;
+
+static struct SPIFlashOp Flash_Queue[SPI_FLASH_QUEUE];
+static uint8_t Flash_Head = 0, Flash_Tail = 0;	//Free-running, the op at Flash_Tail runs first;
+static uint8_t Flash_Running = 0;				//The op at Flash_Tail was sent, the chip is busy with it;
+static uint8_t *Flash_ReadPtr = 0;				//Async read: next DMA destination, 0 = no read;
+static uint32_t Flash_ReadLeft = 0;				//Bytes still to start after the running DMA;
+static DL_SPI_CHIP_SELECT Flash_SavedCS;
+static const uint8_t Flash_DummyTx = 0xFF;
+static uint8_t Flash_DummyRx;
+
+static const DL_DMA_Config gFlash_DMARxConfig = {
+	.transferMode   = DL_DMA_SINGLE_TRANSFER_MODE,
+	.extendedMode   = DL_DMA_NORMAL_MODE,
+	.destIncrement  = DL_DMA_ADDR_INCREMENT,
+	.srcIncrement   = DL_DMA_ADDR_UNCHANGED,
+	.destWidth      = DL_DMA_WIDTH_BYTE,
+	.srcWidth       = DL_DMA_WIDTH_BYTE,
+	.trigger        = DMA_SPI0_RX_TRIG,
+	.triggerType    = DL_DMA_TRIGGER_TYPE_EXTERNAL,
+};
+
+static const DL_DMA_Config gFlash_DMATxConfig = {
+	.transferMode   = DL_DMA_SINGLE_TRANSFER_MODE,
+	.extendedMode   = DL_DMA_NORMAL_MODE,
+	.destIncrement  = DL_DMA_ADDR_UNCHANGED,
+	.srcIncrement   = DL_DMA_ADDR_INCREMENT,
+	.destWidth      = DL_DMA_WIDTH_BYTE,
+	.srcWidth       = DL_DMA_WIDTH_BYTE,
+	.trigger        = DMA_SPI0_TX_TRIG,
+	.triggerType    = DL_DMA_TRIGGER_TYPE_EXTERNAL,
+};
+
+static uint8_t SPIFlash_xfer(uint8_t byte)
+{
+	DL_SPI_transmitDataBlocking8(FLASH_INST, byte);
+	return DL_SPI_receiveDataBlocking8(FLASH_INST);
+}
+
+/**
+ * @brief Take SPI0 for the flash: its clock, no hardware chip select, an empty RX FIFO
+ * @return 0 if a MPU6500 transfer is running, try again later
+ */
+static uint8_t SPIFlash_claim()
+{
+	if (!MPU6500_ClaimBus())
+	{
+		++gSPIFlashBusWaits;
+		return 0;
+	}
+	while (DL_SPI_isBusy(FLASH_INST));
+	DL_SPI_disable(FLASH_INST);
+	Flash_SavedCS = DL_SPI_getChipSelect(FLASH_INST);
+	DL_SPI_setChipSelect(FLASH_INST, DL_SPI_CHIP_SELECT_0);
+	DL_SPI_setBitRateSerialClockDivider(FLASH_INST, FLASH_SCR);
+	DL_SPI_enable(FLASH_INST);
+	while (!DL_SPI_isRXFIFOEmpty(FLASH_INST))
+		DL_SPI_receiveData8(FLASH_INST);
+	return 1;
+}
+
+static void SPIFlash_release()
+{
+	while (DL_SPI_isBusy(FLASH_INST));
+	DL_SPI_disable(FLASH_INST);
+	DL_SPI_setChipSelect(FLASH_INST, Flash_SavedCS);
+	DL_SPI_enable(FLASH_INST);
+	MPU6500_ReleaseBus();
+}
+
+static void SPIFlash_select()
+{
+	DL_GPIO_clearPins(FLASH_CS_PORT, FLASH_CS_PIN);
+}
+
+static void SPIFlash_deselect()
+{
+	while (DL_SPI_isBusy(FLASH_INST));
+	DL_GPIO_setPins(FLASH_CS_PORT, FLASH_CS_PIN);
+}
+
+//Opcode and 24-bit address;
+static void SPIFlash_command(uint8_t cmd, uint32_t addr)
+{
+	SPIFlash_xfer(cmd);
+	SPIFlash_xfer(addr >> 16);
+	SPIFlash_xfer(addr >> 8);
+	SPIFlash_xfer(addr);
+}
+
+/**
+ * @brief Start clocking len bytes through the DMA channels
+ * @param tx The bytes to send, 0 sends 0xFF
+ * @param rx Where the received bytes go, 0 drops them
+ */
+static void SPIFlash_dmaStart(const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+	DL_DMA_setSrcAddr(DMA, FLASH_DMA_RX_CHAN, (uint32_t) &FLASH_INST->RXDATA);
+	DL_DMA_setDestAddr(DMA, FLASH_DMA_RX_CHAN, (uint32_t) (rx ? rx : &Flash_DummyRx));
+	DL_DMA_setDestIncrement(DMA, FLASH_DMA_RX_CHAN, rx ? DL_DMA_ADDR_INCREMENT : DL_DMA_ADDR_UNCHANGED);
+	DL_DMA_setTransferSize(DMA, FLASH_DMA_RX_CHAN, len);
+	DL_DMA_setSrcAddr(DMA, FLASH_DMA_TX_CHAN, (uint32_t) (tx ? tx : &Flash_DummyTx));
+	DL_DMA_setSrcIncrement(DMA, FLASH_DMA_TX_CHAN, tx ? DL_DMA_ADDR_INCREMENT : DL_DMA_ADDR_UNCHANGED);
+	DL_DMA_setDestAddr(DMA, FLASH_DMA_TX_CHAN, (uint32_t) &FLASH_INST->TXDATA);
+	DL_DMA_setTransferSize(DMA, FLASH_DMA_TX_CHAN, len);
+	DL_DMA_enableChannel(DMA, FLASH_DMA_RX_CHAN);
+	DL_DMA_enableChannel(DMA, FLASH_DMA_TX_CHAN);
+	DL_SPI_enableDMAReceiveEvent(FLASH_INST, DL_SPI_DMA_INTERRUPT_RX);
+	DL_SPI_enableDMATransmitEvent(FLASH_INST);
+}
+
+static void SPIFlash_dmaStop()
+{
+	DL_SPI_disableDMAReceiveEvent(FLASH_INST, DL_SPI_DMA_INTERRUPT_RX);
+	DL_SPI_disableDMATransmitEvent(FLASH_INST);
+}
+
+static uint8_t SPIFlash_status()
+{
+	uint8_t status;
+	SPIFlash_select();
+	SPIFlash_xfer(FLASH_CMD_RDSR);
+	status = SPIFlash_xfer(0xFF);
+	SPIFlash_deselect();
+	return status;
+}
+
+static void SPIFlash_writeEnable()
+{
+	SPIFlash_select();
+	SPIFlash_xfer(FLASH_CMD_WREN);
+	SPIFlash_deselect();
+}
+
+/**
+ * @brief Set up the /CS pin and the DMA channels, wake the chip and read its JEDEC ID
+ * @return SPI_FLASH_OK, or SPI_FLASH_NONE if no flash answered (every later call then returns it too)
+ */
+uint8_t SPIFlash_init()
+{
+	uint8_t id[3], i;
+	DL_GPIO_initDigitalOutput(FLASH_CS_IOMUX);
+	DL_GPIO_setPins(FLASH_CS_PORT, FLASH_CS_PIN);
+	DL_GPIO_enableOutput(FLASH_CS_PORT, FLASH_CS_PIN);
+	DL_DMA_initChannel(DMA, FLASH_DMA_RX_CHAN, (DL_DMA_Config *) &gFlash_DMARxConfig);
+	DL_DMA_initChannel(DMA, FLASH_DMA_TX_CHAN, (DL_DMA_Config *) &gFlash_DMATxConfig);
+	memset(&gSPIFlash, 0, sizeof(gSPIFlash));
+	while (!SPIFlash_claim());
+	SPIFlash_select();
+	SPIFlash_xfer(FLASH_CMD_RELEASE_PD);		//In case it was left in deep power-down;
+	SPIFlash_deselect();
+	delay_cycles(CPUCLK_FREQ / 100000);			//tRES1 is 3us, wait 10us;
+	SPIFlash_select();
+	SPIFlash_xfer(FLASH_CMD_JEDEC_ID);
+	for (i = 0; i < 3; i++)
+		id[i] = SPIFlash_xfer(0xFF);
+	SPIFlash_deselect();
+	//A floating or shorted POCI reads all 1s or all 0s; 3-byte addresses reach 16MB;
+	if (id[0] == 0x00 || id[0] == 0xFF || id[2] < 16 || id[2] > 24)
+	{
+		SPIFlash_release();
+		return SPI_FLASH_NONE;
+	}
+	gSPIFlash.manufacturer = id[0];
+	gSPIFlash.type = id[1];
+	gSPIFlash.capacity = id[2];
+	gSPIFlash.size = (uint32_t)1 << id[2];
+	if (SPIFlash_status() & FLASH_SR_BP)
+	{
+		//Clear the block protection some parts power up with;
+		SPIFlash_writeEnable();
+		SPIFlash_select();
+		SPIFlash_xfer(FLASH_CMD_WRSR);
+		SPIFlash_xfer(0x00);
+		SPIFlash_deselect();
+		while (SPIFlash_status() & FLASH_SR_WIP);
+	}
+	SPIFlash_release();
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief Start a Fast Read into a buffer by DMA, see SPIFlash_readBusy
+ * @param addr The flash address
+ * @param buf The destination, left alone by the caller until SPIFlash_readBusy returns 0
+ * @param len The number of bytes
+ * @return SPI_FLASH_OK, SPI_FLASH_BUSY (queued commands or a read still running; SPIFlash_poll
+ *         moves them on), SPI_FLASH_NONE or SPI_FLASH_INVALID
+ */
+uint8_t SPIFlash_readStart(uint32_t addr, void *buf, uint32_t len)
+{
+	uint16_t chunk;
+	if (gSPIFlash.size == 0)
+		return SPI_FLASH_NONE;
+	if (addr > gSPIFlash.size || len > gSPIFlash.size - addr)
+		return SPI_FLASH_INVALID;
+	if (len == 0)
+		return SPI_FLASH_OK;
+	if (Flash_ReadPtr || Flash_Running || Flash_Head != Flash_Tail || !SPIFlash_claim())
+		return SPI_FLASH_BUSY;
+	SPIFlash_select();
+	SPIFlash_command(FLASH_CMD_FAST_READ, addr);
+	SPIFlash_xfer(0xFF);						//Dummy byte;
+	chunk = len > FLASH_DMA_MAX ? FLASH_DMA_MAX : len;
+	Flash_ReadPtr = (uint8_t *)buf + chunk;
+	Flash_ReadLeft = len - chunk;
+	gSPIFlashReadBytes += len;
+	SPIFlash_dmaStart(0, buf, chunk);
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief Check on the read started by SPIFlash_readStart, ending it when the data is in
+ * @return 1 while the DMA still runs
+ */
+uint8_t SPIFlash_readBusy()
+{
+	uint16_t chunk;
+	if (!Flash_ReadPtr)
+		return 0;
+	if (DL_DMA_isChannelEnabled(DMA, FLASH_DMA_RX_CHAN))
+		return 1;
+	SPIFlash_dmaStop();
+	if (Flash_ReadLeft)
+	{
+		//The chip keeps streaming while /CS stays low;
+		chunk = Flash_ReadLeft > FLASH_DMA_MAX ? FLASH_DMA_MAX : Flash_ReadLeft;
+		SPIFlash_dmaStart(0, Flash_ReadPtr, chunk);
+		Flash_ReadPtr += chunk;
+		Flash_ReadLeft -= chunk;
+		return 1;
+	}
+	SPIFlash_deselect();
+	SPIFlash_release();
+	Flash_ReadPtr = 0;
+	return 0;
+}
+
+/**
+ * @brief Read into a buffer by DMA, after the queued commands
+ * @return SPI_FLASH_OK, SPI_FLASH_NONE or SPI_FLASH_INVALID
+ * @details Blocks until the queue is empty and the data is in.
+ */
+uint8_t SPIFlash_read(uint32_t addr, void *buf, uint32_t len)
+{
+	uint8_t status;
+	while ((status = SPIFlash_readStart(addr, buf, len)) == SPI_FLASH_BUSY)
+		SPIFlash_poll();
+	if (status != SPI_FLASH_OK)
+		return status;
+	while (SPIFlash_readBusy());
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief Queue a program, split at page boundaries; the data is copied
+ * @param addr The flash address, the bytes must be erased
+ * @param data The bytes
+ * @param len At most SPI_FLASH_QUEUE pages' worth, the pages it spans must all fit the queue
+ * @return SPI_FLASH_OK, SPI_FLASH_BUSY (nothing queued), SPI_FLASH_NONE or SPI_FLASH_INVALID
+ */
+uint8_t SPIFlash_program(uint32_t addr, const void *data, uint16_t len)
+{
+	const uint8_t *src = data;
+	struct SPIFlashOp *op;
+	uint16_t pages, chunk;
+	if (gSPIFlash.size == 0)
+		return SPI_FLASH_NONE;
+	if (addr > gSPIFlash.size || len > gSPIFlash.size - addr)
+		return SPI_FLASH_INVALID;
+	if (len == 0)
+		return SPI_FLASH_OK;
+	pages = (addr + len - 1) / SPI_FLASH_PAGE - addr / SPI_FLASH_PAGE + 1;
+	if (pages > SPI_FLASH_QUEUE)
+		return SPI_FLASH_INVALID;
+	if ((uint8_t)(Flash_Head - Flash_Tail) + pages > SPI_FLASH_QUEUE)
+		return SPI_FLASH_BUSY;
+	while (len)
+	{
+		chunk = SPI_FLASH_PAGE - addr % SPI_FLASH_PAGE;
+		if (chunk > len)
+			chunk = len;
+		op = &Flash_Queue[Flash_Head & (SPI_FLASH_QUEUE - 1)];
+		op->addr = addr;
+		op->len = chunk;
+		memcpy(op->data, src, chunk);
+		++Flash_Head;
+		addr += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief Queue the erase of one sector
+ * @param addr The sector address, a multiple of SPI_FLASH_SECTOR
+ * @return SPI_FLASH_OK, SPI_FLASH_BUSY (queue full), SPI_FLASH_NONE or SPI_FLASH_INVALID
+ */
+uint8_t SPIFlash_erase(uint32_t addr)
+{
+	struct SPIFlashOp *op;
+	if (gSPIFlash.size == 0)
+		return SPI_FLASH_NONE;
+	if (addr >= gSPIFlash.size || addr % SPI_FLASH_SECTOR)
+		return SPI_FLASH_INVALID;
+	if ((uint8_t)(Flash_Head - Flash_Tail) >= SPI_FLASH_QUEUE)
+		return SPI_FLASH_BUSY;
+	op = &Flash_Queue[Flash_Head & (SPI_FLASH_QUEUE - 1)];
+	op->addr = addr;
+	op->len = 0;
+	++Flash_Head;
+	return SPI_FLASH_OK;
+}
+
+/**
+ * @brief Move the queue on: see the running command finish, start the next one
+ * @return 1 when nothing is queued or running
+ * @details Each call holds SPI0 for a status read, or for the few us of sending a command
+ *          (a page of data goes out by DMA in about 110us at 20MHz). Call from the idle loop.
+ */
+uint8_t SPIFlash_poll()
+{
+	struct SPIFlashOp *op;
+	if (SPIFlash_readBusy())
+		return 0;
+	if (Flash_Running)
+	{
+		if (!SPIFlash_claim())
+			return 0;
+		if (SPIFlash_status() & FLASH_SR_WIP)
+		{
+			SPIFlash_release();
+			++gSPIFlashBusyPolls;
+			return 0;
+		}
+		SPIFlash_release();
+		Flash_Running = 0;
+		++Flash_Tail;
+	}
+	if (Flash_Head == Flash_Tail)
+		return 1;
+	if (!SPIFlash_claim())
+		return 0;
+	op = &Flash_Queue[Flash_Tail & (SPI_FLASH_QUEUE - 1)];
+	SPIFlash_writeEnable();
+	SPIFlash_select();
+	if (op->len)
+	{
+		SPIFlash_command(FLASH_CMD_PP, op->addr);
+		SPIFlash_dmaStart(op->data, 0, op->len);
+		while (DL_DMA_isChannelEnabled(DMA, FLASH_DMA_RX_CHAN));
+		SPIFlash_dmaStop();
+		gSPIFlashProgramBytes += op->len;
+	}
+	else
+	{
+		SPIFlash_command(FLASH_CMD_SE, op->addr);
+		++gSPIFlashErases;
+	}
+	SPIFlash_deselect();
+	SPIFlash_release();
+	Flash_Running = 1;
+	return 0;
+}
+
+/**
+ * @brief Wait until every queued command has finished
+ */
+void SPIFlash_sync()
+{
+	if (gSPIFlash.size == 0)
+		return;
+	while (!SPIFlash_poll());
+}
+
+/**
+ * @brief Sequential erase, program and read of a region, printed over UART
+ * @param addr Start of the region, sector aligned; its data is lost
+ * @param len Bytes, a multiple of SPI_FLASH_SECTOR
+ * @details Programs go through the queue like any caller's, reads are 512-byte DMA reads.
+ */
+void SPIFlash_bench(uint32_t addr, uint32_t len)
+{
+	static uint8_t buf[512];
+	uint32_t a, i, t0, eraseMs, programCycles, readCycles, bad = 0;
+	if (gSPIFlash.size == 0 || addr % SPI_FLASH_SECTOR || len % SPI_FLASH_SECTOR || len == 0)
+		return;
+	t0 = SysTime_getMs();
+	for (a = addr; a < addr + len; a += SPI_FLASH_SECTOR)
+		while (SPIFlash_erase(a) == SPI_FLASH_BUSY)
+			SPIFlash_poll();
+	SPIFlash_sync();
+	eraseMs = SysTime_getMs() - t0;
+
+	t0 = SysTime_getCycles();
+	for (a = addr; a < addr + len; a += SPI_FLASH_PAGE)
+	{
+		for (i = 0; i < SPI_FLASH_PAGE; i++)
+			buf[i] = (a + i) * 7 + ((a + i) >> 8);
+		while (SPIFlash_program(a, buf, SPI_FLASH_PAGE) == SPI_FLASH_BUSY)
+			SPIFlash_poll();
+	}
+	SPIFlash_sync();
+	programCycles = SysTime_getCycles() - t0;
+
+	readCycles = 0;
+	for (a = addr; a < addr + len; a += sizeof(buf))
+	{
+		t0 = SysTime_getCycles();
+		SPIFlash_read(a, buf, sizeof(buf));
+		readCycles += SysTime_getCycles() - t0;
+		for (i = 0; i < sizeof(buf); i++)
+			if (buf[i] != (uint8_t)((a + i) * 7 + ((a + i) >> 8)))
+				++bad;
+	}
+	printf("SPIFlash: %lu KB at 0x%06lx: erase %lu ms, program %lu KB/s, read %lu KB/s (bus %lu KB/s), %lu bad bytes\n",
+		(unsigned long)(len / 1024), (unsigned long)addr, (unsigned long)eraseMs,
+		(unsigned long)((uint64_t)len * CPUCLK_FREQ / 1024 / (programCycles ? programCycles : 1)),
+		(unsigned long)((uint64_t)len * CPUCLK_FREQ / 1024 / (readCycles ? readCycles : 1)),
+		(unsigned long)(CPUCLK_FREQ / ((1 + FLASH_SCR) * 2) / 8 / 1024), (unsigned long)bad);
+}
+
+/**
+ * @brief Print the chip and the counters over UART
+ */
+void SPIFlash_report()
+{
+	if (gSPIFlash.size == 0)
+	{
+		printf("SPIFlash: no flash on SPI0\n");
+		return;
+	}
+	printf("SPIFlash: JEDEC %02x %02x %02x, %lu KB; %lu bytes read, %lu programmed, %lu sectors erased\n",
+		gSPIFlash.manufacturer, gSPIFlash.type, gSPIFlash.capacity, (unsigned long)(gSPIFlash.size / 1024),
+		(unsigned long)gSPIFlashReadBytes, (unsigned long)gSPIFlashProgramBytes, (unsigned long)gSPIFlashErases);
+	printf("SPIFlash: %lu busy polls, %lu waits for the MPU6500\n",
+		(unsigned long)gSPIFlashBusyPolls, (unsigned long)gSPIFlashBusWaits);
+}
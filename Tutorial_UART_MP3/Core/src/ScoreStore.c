@@ -0,0 +1,280 @@
+/*
+ * @file ScoreStore.c
+ * @brief Score upload over UART0 into LogFS, and playback by ID
+ * @details The UART0 interrupt hands the received bytes to ScoreStore_rx while an upload runs;
+ *          they wait in a ring while ScoreStore_poll parses the frames (protocol in
+ *          ScoreStore.h), gathers the data in SCORE_STAGE-byte pieces for LogFS_append and ACKs
+ *          each frame. The host's window of unACKed frames is smaller than the ring, so a
+ *          block erase on the flash side (tens of ms) only stalls the host, nothing is lost.
+ *          An upload replaces the score with the same ID; the old one is deleted first.
+ *          ScoreStore_play reads the notes back a few at a time, through the FlashCache, so
+ *          playing a score again costs no SPI traffic when it fits the cache.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "ScoreStore.h"
+#include "Containers.h"
+#include "LogFS.h"
+#include "MathUtil.h"
+#include "MusicPlayer.h"
+#include "SPIFlash.h"
+#include "SysTime.h"
+#include "UART.h"
+#include <string.h>
+
+//Where the ACK bytes go; the host test build names a function of its simulated line;
+#ifndef SCORE_STORE_PUTC
+#define SCORE_STORE_PUTC(c) DL_UART_transmitDataBlocking(UART_0_INST, c)
+#else
+void SCORE_STORE_PUTC(uint8_t c);
+#endif
+#define SCORE_PLAY_NOTES 16			//Notes read per LogFS_read when playing;
+
+uint32_t gScoreFrames = 0;
+uint32_t gScoreBadFrames = 0;
+uint32_t gScoreRxOverflow = 0;
+uint32_t gScoreLastBytes = 0;
+uint32_t gScoreLastMs = 0;
+
+QUEUE_DEFINE(ScoreRxQueue, uint8_t, SCORE_RX_RING)
+
+static ScoreRxQueue ScoreStore_Rx;				//Filled by the interrupt;
+static volatile uint8_t ScoreStore_Receiving = 0;
+static uint8_t ScoreStore_File;
+static uint16_t ScoreStore_Expected;			//Next data frame;
+static uint32_t ScoreStore_Bytes;				//Score bytes received in order;
+static uint8_t ScoreStore_Stage[SCORE_STAGE];
+static uint16_t ScoreStore_Staged;
+static uint8_t ScoreStore_Frame[SCORE_FRAME_HEADER + SCORE_CHUNK_MAX + 2];
+static uint16_t ScoreStore_FrameLen;
+static uint32_t ScoreStore_StartMs, ScoreStore_LastMs, ScoreStore_AckMs;
+static uint8_t ScoreStore_AckStatus;
+
+static void ScoreStore_ack(uint8_t status)
+{
+	uint8_t f[SCORE_FRAME_HEADER + 1 + 2] = {SCORE_FRAME_SYNC0, SCORE_FRAME_SYNC1, SCORE_FRAME_ACK,
+		ScoreStore_Expected & 0xFF, ScoreStore_Expected >> 8, 1, status};
+	uint16_t crc = MathUtil_crc16(MATHUTIL_CRC16_INIT, f + 2, 5), i;
+	ScoreStore_AckMs = SysTime_getMs();
+	ScoreStore_AckStatus = status;
+	f[7] = crc & 0xFF;
+	f[8] = crc >> 8;
+	for (i = 0; i < sizeof(f); i++)
+		SCORE_STORE_PUTC(f[i]);
+}
+
+static void ScoreStore_name(char *name, uint16_t id)
+{
+	sprintf(name, "score%u", id);
+}
+
+static uint8_t ScoreStore_fail()
+{
+	ScoreStore_Receiving = 0;
+	LogFS_delete(ScoreStore_File);
+	ScoreStore_ack(SCORE_FAILED);
+	return SCORE_FAILED;
+}
+
+static uint8_t ScoreStore_flush()
+{
+	uint8_t status = LogFS_append(ScoreStore_File, ScoreStore_Stage, ScoreStore_Staged);
+	ScoreStore_Staged = 0;
+	return status;
+}
+
+/**
+ * @brief Handle a whole frame in ScoreStore_Frame
+ * @return SCORE_BUSY, or the end of the upload
+ */
+static uint8_t ScoreStore_frame()
+{
+	const uint8_t *f = ScoreStore_Frame;
+	uint8_t type = f[2], len = f[5];
+	uint16_t seq = f[3] | (uint16_t)f[4] << 8, n;
+	uint32_t trailer[2];
+	if ((f[SCORE_FRAME_HEADER + len] | (uint16_t)f[SCORE_FRAME_HEADER + len + 1] << 8)
+		!= MathUtil_crc16(MATHUTIL_CRC16_INIT, f + 2, SCORE_FRAME_HEADER - 2 + len))
+	{
+		++gScoreBadFrames;
+		ScoreStore_ack(SCORE_OK);
+		return SCORE_BUSY;
+	}
+	ScoreStore_LastMs = SysTime_getMs();
+	if (type == SCORE_FRAME_ABORT)
+		return ScoreStore_fail();
+	if (seq != ScoreStore_Expected || (type == SCORE_FRAME_DATA && len == 0)
+		|| (type == SCORE_FRAME_END && len != 4) || (type != SCORE_FRAME_DATA && type != SCORE_FRAME_END))
+	{
+		++gScoreBadFrames;
+		ScoreStore_ack(SCORE_OK);
+		return SCORE_BUSY;
+	}
+	if (type == SCORE_FRAME_DATA)
+	{
+		ScoreStore_Bytes += len;
+		f += SCORE_FRAME_HEADER;
+		while (len)
+		{
+			n = SCORE_STAGE - ScoreStore_Staged < len ? SCORE_STAGE - ScoreStore_Staged : len;
+			memcpy(ScoreStore_Stage + ScoreStore_Staged, f, n);
+			ScoreStore_Staged += n;
+			f += n;
+			len -= n;
+			if (ScoreStore_Staged == SCORE_STAGE && ScoreStore_flush() != LOGFS_OK)
+				return ScoreStore_fail();
+		}
+		++ScoreStore_Expected;
+		++gScoreFrames;
+		ScoreStore_ack(SCORE_OK);
+		return SCORE_BUSY;
+	}
+	//END: the total must match, whole notes only;
+	memcpy(&trailer[1], f + SCORE_FRAME_HEADER, 4);
+	if (trailer[1] != ScoreStore_Bytes || ScoreStore_Bytes == 0 || ScoreStore_Bytes % SCORE_NOTE_BYTES)
+		return ScoreStore_fail();
+	trailer[0] = SCORE_TRAILER_MAGIC;
+	trailer[1] = ScoreStore_Bytes / SCORE_NOTE_BYTES;
+	if (ScoreStore_flush() != LOGFS_OK || LogFS_append(ScoreStore_File, trailer, sizeof(trailer)) != LOGFS_OK)
+		return ScoreStore_fail();
+	LogFS_sync();
+	ScoreStore_Receiving = 0;
+	gScoreLastBytes = ScoreStore_Bytes;
+	gScoreLastMs = ScoreStore_LastMs - ScoreStore_StartMs;
+	ScoreStore_ack(SCORE_DONE);
+	return SCORE_DONE;
+}
+
+/**
+ * @brief Start an upload: replace the file of the ID and send the ready ACK
+ * @return SCORE_BUSY, or SCORE_FAILED (bad ID, no flash, no room)
+ */
+uint8_t ScoreStore_begin(uint16_t id)
+{
+	char name[LOGFS_NAME + 1];
+	uint8_t file;
+	ScoreStore_Expected = 0;
+	if (id < SCORE_ID_FIRST || id > SCORE_ID_MAX)
+	{
+		ScoreStore_ack(SCORE_FAILED);
+		return SCORE_FAILED;
+	}
+	ScoreStore_name(name, id);
+	if (LogFS_open(name, &file) == LOGFS_OK)
+		LogFS_delete(file);
+	if (LogFS_create(name, &ScoreStore_File) != LOGFS_OK)
+	{
+		ScoreStore_ack(SCORE_FAILED);
+		return SCORE_FAILED;
+	}
+	ScoreStore_Bytes = 0;
+	ScoreStore_Staged = 0;
+	ScoreStore_FrameLen = 0;
+	ScoreRxQueue_flush(&ScoreStore_Rx);
+	ScoreStore_StartMs = ScoreStore_LastMs = SysTime_getMs();
+	ScoreStore_Receiving = 1;
+	ScoreStore_ack(SCORE_OK);
+	return SCORE_BUSY;
+}
+
+/**
+ * @brief Run an upload to its end: ScoreStore_begin, then ScoreStore_poll
+ * @return SCORE_DONE or SCORE_FAILED
+ * @details Blocks; printf must not be used meanwhile, it shares UART0 with the frames.
+ */
+uint8_t ScoreStore_upload(uint16_t id)
+{
+	uint8_t status = ScoreStore_begin(id);
+	while (status == SCORE_BUSY)
+		status = ScoreStore_poll();
+	return status;
+}
+
+uint8_t ScoreStore_receiving()
+{
+	return ScoreStore_Receiving;
+}
+
+/**
+ * @brief Buffer a received byte, call from the UART0 RX interrupt while ScoreStore_receiving
+ */
+void ScoreStore_rx(uint8_t byte)
+{
+	if (ScoreRxQueue_push(&ScoreStore_Rx, byte) != VECTOR_OK)
+		++gScoreRxOverflow;
+}
+
+/**
+ * @brief Parse the buffered bytes and handle the frames
+ * @return SCORE_BUSY while the upload goes on, else SCORE_DONE or SCORE_FAILED
+ */
+uint8_t ScoreStore_poll()
+{
+	uint8_t b, status;
+	if (!ScoreStore_Receiving)
+		return SCORE_FAILED;
+	while (ScoreRxQueue_pop(&ScoreStore_Rx, &b) == VECTOR_OK)
+	{
+		ScoreStore_Frame[ScoreStore_FrameLen++] = b;
+		if (ScoreStore_FrameLen == 1 && b != SCORE_FRAME_SYNC0)
+			ScoreStore_FrameLen = 0;
+		else if (ScoreStore_FrameLen == 2 && b != SCORE_FRAME_SYNC1)
+			ScoreStore_FrameLen = b == SCORE_FRAME_SYNC0;
+		else if (ScoreStore_FrameLen == SCORE_FRAME_HEADER && b > SCORE_CHUNK_MAX)
+		{
+			++gScoreBadFrames;
+			ScoreStore_FrameLen = 0;
+		}
+		else if (ScoreStore_FrameLen > SCORE_FRAME_HEADER
+			&& ScoreStore_FrameLen == SCORE_FRAME_HEADER + ScoreStore_Frame[5] + 2)
+		{
+			ScoreStore_FrameLen = 0;
+			status = ScoreStore_frame();
+			if (status != SCORE_BUSY)
+				return status;
+		}
+	}
+	SPIFlash_poll();
+	if (SysTime_getMs() - ScoreStore_LastMs > SCORE_TIMEOUT_MS)
+		return ScoreStore_fail();
+	if (SysTime_getMs() - ScoreStore_AckMs >= SCORE_REPEAT_MS)
+		ScoreStore_ack(ScoreStore_AckStatus);
+	return SCORE_BUSY;
+}
+
+/**
+ * @brief Play an uploaded score on the buzzer
+ * @return SCORE_OK, or SCORE_NOT_FOUND (no file, or no trailer: the upload did not finish)
+ */
+uint8_t ScoreStore_play(uint16_t id)
+{
+	struct MusicNote notes[SCORE_PLAY_NOTES];
+	char name[LOGFS_NAME + 1];
+	uint32_t trailer[2], size, i, n;
+	uint8_t file;
+	ScoreStore_name(name, id);
+	if (LogFS_open(name, &file) != LOGFS_OK)
+		return SCORE_NOT_FOUND;
+	size = LogFS_size(file);
+	if (size < sizeof(trailer) || LogFS_read(file, size - sizeof(trailer), trailer, sizeof(trailer)) != sizeof(trailer)
+		|| trailer[0] != SCORE_TRAILER_MAGIC || trailer[1] * SCORE_NOTE_BYTES != size - sizeof(trailer))
+		return SCORE_NOT_FOUND;
+	for (i = 0; i < trailer[1]; i += n)
+	{
+		n = trailer[1] - i < SCORE_PLAY_NOTES ? trailer[1] - i : SCORE_PLAY_NOTES;
+		LogFS_read(file, i * SCORE_NOTE_BYTES, notes, n * SCORE_NOTE_BYTES);
+		playMusic(notes, n);
+	}
+	return SCORE_OK;
+}
+
+/**
+ * @brief Print the upload counters over UART
+ */
+void ScoreStore_report()
+{
+	printf("ScoreStore: %lu frames stored, %lu bad, %lu bytes lost; last upload %lu bytes in %lu ms (%lu KB/s)\n",
+		(unsigned long)gScoreFrames, (unsigned long)gScoreBadFrames, (unsigned long)gScoreRxOverflow,
+		(unsigned long)gScoreLastBytes, (unsigned long)gScoreLastMs,
+		(unsigned long)(gScoreLastMs ? gScoreLastBytes / gScoreLastMs * 1000 / 1024 : 0));
+}
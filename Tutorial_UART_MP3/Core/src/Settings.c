@@ -0,0 +1,185 @@
+/*
+ * @file Settings.c
+ * @brief RAM shadow of the persisted settings
+ * @details Settings_set only updates a RAM slot; the changed slots are written to the EEPROMKV
+ *          store together, at most once per commit interval (Settings_poll from the idle loop)
+ *          or at once by Settings_sync, e.g. before a reset. A setting changed many times
+ *          between two commits costs one entry, and one commit is one EEPROMKV_putBatch, so
+ *          after a reset either all the values of a commit are stored or none of them.
+ *          Slots are filled on first use; reads of a key that has no slot go to the store.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "Settings.h"
+#include "SysTime.h"
+#include "UART.h"
+#include <string.h>
+
+struct SettingsSlot{
+	uint16_t key;
+	uint8_t len;		//0 = free slot;
+	uint8_t dirty;		//Changed since the last commit;
+	uint8_t data[SETTINGS_SIZE_MAX];
+};
+
+uint32_t gSettingsSets = 0;
+uint32_t gSettingsCommits = 0;
+uint32_t gSettingsErrors = 0;
+
+static struct SettingsSlot Settings_Slot[SETTINGS_MAX];
+static uint32_t Settings_IntervalMs = 1000;
+static uint32_t Settings_LastCommitMs = 0;
+static uint8_t Settings_Dirty = 0;		//Number of dirty slots;
+
+static struct SettingsSlot *Settings_find(uint16_t key)
+{
+	uint8_t i;
+	for (i = 0; i < SETTINGS_MAX; i++)
+		if (Settings_Slot[i].len && Settings_Slot[i].key == key)
+			return &Settings_Slot[i];
+	return 0;
+}
+
+/**
+ * @brief Take a slot for a key: a free one, else a clean one
+ * @return The slot, 0 if all slots are dirty
+ */
+static struct SettingsSlot *Settings_alloc(uint16_t key)
+{
+	uint8_t i;
+	for (i = 0; i < SETTINGS_MAX; i++)
+		if (!Settings_Slot[i].len)
+			break;
+	if (i == SETTINGS_MAX)
+		for (i = 0; i < SETTINGS_MAX; i++)
+			if (!Settings_Slot[i].dirty)
+				break;
+	if (i == SETTINGS_MAX)
+		return 0;
+	Settings_Slot[i].key = key;
+	Settings_Slot[i].dirty = 0;
+	return &Settings_Slot[i];
+}
+
+/**
+ * @brief Clear the shadow and set the commit interval
+ * @param intervalMs Minimum time between two commits from Settings_poll
+ * @pre EEPROMKV_init
+ */
+void Settings_init(uint32_t intervalMs)
+{
+	memset(Settings_Slot, 0, sizeof(Settings_Slot));
+	Settings_Dirty = 0;
+	Settings_IntervalMs = intervalMs;
+	Settings_LastCommitMs = SysTime_getMs();
+}
+
+/**
+ * @brief Read a setting, from its slot or from the store
+ * @param key The EEPROMKV key
+ * @param value Filled with up to size bytes of the value
+ * @param size The size of the value buffer
+ * @return The length of the value, -1 if it was never set
+ */
+int16_t Settings_get(uint16_t key, void *value, uint8_t size)
+{
+	struct SettingsSlot *slot = Settings_find(key);
+	int16_t len;
+	if (slot)
+	{
+		memcpy(value, slot->data, size < slot->len ? size : slot->len);
+		return slot->len;
+	}
+	len = EEPROMKV_get(key, value, size);
+	//Keep a copy when it fits, so that a later Settings_set can tell an unchanged value;
+	if (len > 0 && len <= size && len <= SETTINGS_SIZE_MAX && (slot = Settings_alloc(key)))
+	{
+		memcpy(slot->data, value, len);
+		slot->len = len;
+	}
+	return len;
+}
+
+/**
+ * @brief Change a setting in RAM, written by the next commit
+ * @param key The EEPROMKV key
+ * @param value The value
+ * @param len The length, 1-SETTINGS_SIZE_MAX
+ * @return EEPROM_KV_OK, EEPROM_KV_INVALID, or the status of the commit that freed a slot
+ */
+uint8_t Settings_set(uint16_t key, const void *value, uint8_t len)
+{
+	struct SettingsSlot *slot = Settings_find(key);
+	uint8_t status;
+	if (len == 0 || len > SETTINGS_SIZE_MAX || key > EEPROM_KV_KEY_MAX)
+		return EEPROM_KV_INVALID;
+	if (slot && slot->len == len && memcmp(slot->data, value, len) == 0)
+		return EEPROM_KV_OK;
+	if (!slot && !(slot = Settings_alloc(key)))
+	{
+		//Every slot holds an unwritten change: commit them now to free one;
+		status = Settings_sync();
+		if (status != EEPROM_KV_OK)
+			return status;
+		slot = Settings_alloc(key);
+	}
+	memcpy(slot->data, value, len);
+	slot->len = len;
+	if (!slot->dirty)
+		slot->dirty = 1, ++Settings_Dirty;
+	++gSettingsSets;
+	return EEPROM_KV_OK;
+}
+
+/**
+ * @brief Write the changed settings now
+ * @return The EEPROMKV_putBatch status, EEPROM_KV_OK if nothing changed
+ * @details The slots stay dirty if the write fails.
+ */
+uint8_t Settings_sync()
+{
+	struct EEPROMKVPut puts[SETTINGS_MAX];
+	uint8_t i, n = 0, status;
+	Settings_LastCommitMs = SysTime_getMs();
+	if (!Settings_Dirty)
+		return EEPROM_KV_OK;
+	for (i = 0; i < SETTINGS_MAX; i++)
+		if (Settings_Slot[i].dirty)
+		{
+			puts[n].key = Settings_Slot[i].key;
+			puts[n].value = Settings_Slot[i].data;
+			puts[n].len = Settings_Slot[i].len;
+			++n;
+		}
+	status = EEPROMKV_putBatch(puts, n);
+	if (status != EEPROM_KV_OK)
+	{
+		++gSettingsErrors;
+		return status;
+	}
+	for (i = 0; i < SETTINGS_MAX; i++)
+		Settings_Slot[i].dirty = 0;
+	Settings_Dirty = 0;
+	++gSettingsCommits;
+	return status;
+}
+
+/**
+ * @brief Commit the changed settings once the interval since the last commit has passed
+ * @details Call from the idle loop.
+ */
+void Settings_poll()
+{
+	if (Settings_Dirty && SysTime_getMs() - Settings_LastCommitMs >= Settings_IntervalMs)
+		Settings_sync();
+}
+
+/**
+ * @brief Print the shadow state over UART
+ */
+void Settings_report()
+{
+	printf("Settings: %u dirty, %lu sets, %lu commits, %lu failed, %lu flash bytes programmed\n",
+		Settings_Dirty, (unsigned long)gSettingsSets, (unsigned long)gSettingsCommits,
+		(unsigned long)gSettingsErrors, (unsigned long)gEEPROMKVBytes);
+}
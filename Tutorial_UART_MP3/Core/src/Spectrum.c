@@ -0,0 +1,282 @@
+/*
+ * @file Spectrum.c
+ * @brief Spectrum analyzer: fixed-point FFT of the ADC stream drawn on the OLED
+ * @details The ADCStream block handler copies the newest SPECTRUM_N samples of a block; the
+ *          foreground (Spectrum_poll) removes the mean, applies a Hann window, runs an in-place
+ *          radix-2 Q15 FFT and takes the bin magnitudes with the MATHACL square root.
+ *          Every stage halves the data, so the transform cannot overflow (output = sum / N).
+ *          The bars are drawn on a log2 scale into the back buffer and shown by OLED_Present
+ *          while the next frame is computed. Blocks arriving while a frame is being computed
+ *          are skipped, so the display rate is set by the foreground, not by the ADC.
+ *          MATHACL is used without locking (see MathUtil.h), so poll from one context only.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "Spectrum.h"
+#include "MathUtil.h"
+#include "oled_spi_V0.2.h"
+#include "OLEDConsole.h"
+#include "SysTime.h"
+#include "UART.h"
+#include <string.h>
+
+#define SPECTRUM_MASK (SPECTRUM_N_MAX - 1)
+#define SPECTRUM_COS (SPECTRUM_N_MAX / 4)	//cos(x) = sin(x + pi / 2);
+
+#if SPECTRUM_TOP < 8 || SPECTRUM_TOP % 8 || SPECTRUM_TOP >= 64
+#error "SPECTRUM_TOP must be whole pages, at least one for the status line"
+#endif
+
+//sin(2 * pi * k / 256) in Q15; cos is the same table shifted by 64;
+static const int16_t Spectrum_Sin[SPECTRUM_N_MAX] = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739,
+	9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+	18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811,
+	25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+	32609, 32678, 32728, 32757, 32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+	32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571, 30273, 29956, 29621, 29268,
+	28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+	23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151,
+	15446, 14732, 14010, 13279, 12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+	6393, 5602, 4808, 4011, 3212, 2410, 1608, 804, 0, -804, -1608, -2410,
+	-3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+	-12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159,
+	-20787, -21403, -22005, -22594, -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+	-27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956, -30273, -30571, -30852, -31113,
+	-31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+	-32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580,
+	-31356, -31113, -30852, -30571, -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+	-27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731, -23170, -22594, -22005, -21403,
+	-20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+	-12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011,
+	-3212, -2410, -1608, -804,
+};
+
+//Periodic Hann window for 256 points in Q15, first half (w[256 - i] = w[i]); N points use every 256/N-th entry;
+static const int16_t Spectrum_Hann[SPECTRUM_N_MAX / 2 + 1] = {
+	0, 5, 20, 44, 79, 123, 177, 241, 315, 398, 491, 593,
+	705, 827, 958, 1098, 1247, 1406, 1573, 1749, 1935, 2128, 2331, 2542,
+	2761, 2989, 3224, 3468, 3719, 3978, 4244, 4518, 4799, 5086, 5381, 5682,
+	5990, 6304, 6624, 6950, 7281, 7618, 7961, 8308, 8660, 9017, 9379, 9744,
+	10114, 10487, 10864, 11244, 11628, 12014, 12403, 12794, 13187, 13583, 13980, 14378,
+	14778, 15178, 15580, 15981, 16383, 16786, 17187, 17589, 17989, 18389, 18787, 19184,
+	19580, 19973, 20364, 20753, 21139, 21523, 21903, 22280, 22653, 23023, 23388, 23750,
+	24107, 24459, 24806, 25149, 25486, 25817, 26143, 26463, 26777, 27085, 27386, 27681,
+	27968, 28249, 28523, 28789, 29048, 29299, 29543, 29778, 30006, 30225, 30436, 30639,
+	30832, 31018, 31194, 31361, 31520, 31669, 31809, 31940, 32062, 32174, 32276, 32369,
+	32452, 32526, 32590, 32644, 32688, 32723, 32747, 32762, 32767,
+};
+
+static uint16_t Spectrum_In[SPECTRUM_N_MAX];		//Captured by the block handler;
+static int16_t Spectrum_Re[SPECTRUM_N_MAX];
+static int16_t Spectrum_Im[SPECTRUM_N_MAX];
+static uint16_t Spectrum_Mag[SPECTRUM_N_MAX / 2];
+static volatile uint8_t Spectrum_Ready = 0;			//Spectrum_In holds a frame for the foreground;
+static uint16_t Spectrum_Mean = 2048;
+static uint16_t Spectrum_N = 128;
+static uint8_t Spectrum_Log2N = 7;
+static uint32_t Spectrum_Rate = 0;
+
+//Timing window of Spectrum_report;
+static uint32_t Spectrum_Frames = 0;
+static uint32_t Spectrum_Cycles = 0;				//Window + FFT + magnitude, summed;
+static uint32_t Spectrum_MaxCycles = 0;
+static uint32_t Spectrum_WinStart = 0;
+
+static void Spectrum_onBlock(const struct ADCBlock *block)
+{
+	if (Spectrum_Ready)
+		return;
+	memcpy(Spectrum_In, block->samples + ADC_STREAM_BLOCK - Spectrum_N, Spectrum_N * sizeof(uint16_t));
+	Spectrum_Mean = block->mean;
+	Spectrum_Ready = 1;
+}
+
+static uint16_t Spectrum_reverse(uint16_t i)
+{
+	uint16_t r = 0;
+	uint8_t b;
+	for (b = 0; b < Spectrum_Log2N; b++)
+	{
+		r = (r << 1) | (i & 1);
+		i >>= 1;
+	}
+	return r;
+}
+
+/**
+ * @brief Remove the mean, window the frame to Q15 and store it in bit-reversed order
+ */
+static void Spectrum_load()
+{
+	uint16_t i, k, step = SPECTRUM_N_MAX / Spectrum_N, r;
+	int32_t x;
+	for (i = 0; i < Spectrum_N; i++)
+	{
+		k = i * step;
+		x = ((int32_t)Spectrum_In[i] - Spectrum_Mean) << 3;		//12 bit -> Q15;
+		r = Spectrum_reverse(i);
+		Spectrum_Re[r] = (int16_t)((x * Spectrum_Hann[k <= SPECTRUM_N_MAX / 2 ? k : SPECTRUM_N_MAX - k]) >> 15);
+		Spectrum_Im[r] = 0;
+	}
+}
+
+/**
+ * @brief In-place radix-2 decimation-in-time FFT, scaled by 1/2 per stage
+ */
+static void Spectrum_fft()
+{
+	uint16_t size, half, step, i, j, k, b;
+	int32_t wr, wi, tr, ti, ar, ai;
+	for (size = 2; size <= Spectrum_N; size <<= 1)
+	{
+		half = size >> 1;
+		step = SPECTRUM_N_MAX / size;
+		for (j = 0; j < half; j++)
+		{
+			k = j * step;
+			wr = Spectrum_Sin[(k + SPECTRUM_COS) & SPECTRUM_MASK];
+			wi = -Spectrum_Sin[k];
+			for (i = j; i < Spectrum_N; i += size)
+			{
+				b = i + half;
+				tr = (wr * Spectrum_Re[b] - wi * Spectrum_Im[b]) >> 15;
+				ti = (wr * Spectrum_Im[b] + wi * Spectrum_Re[b]) >> 15;
+				ar = Spectrum_Re[i];
+				ai = Spectrum_Im[i];
+				Spectrum_Re[b] = (int16_t)((ar - tr) >> 1);
+				Spectrum_Im[b] = (int16_t)((ai - ti) >> 1);
+				Spectrum_Re[i] = (int16_t)((ar + tr) >> 1);
+				Spectrum_Im[i] = (int16_t)((ai + ti) >> 1);
+			}
+		}
+	}
+}
+
+static void Spectrum_magnitude()
+{
+	uint16_t k;
+	int32_t re, im;
+	for (k = 0; k < Spectrum_N / 2; k++)
+	{
+		re = Spectrum_Re[k];
+		im = Spectrum_Im[k];
+		//re^2 + im^2 read as Q16: the Q16 root is sqrt() * 2^8;
+		Spectrum_Mag[k] = (uint16_t)(MathUtil_sqrt((uint32_t)(re * re + im * im)) >> 8);
+	}
+}
+
+//log2(v) with 3 fractional bits, 0 for v = 0;
+static uint8_t Spectrum_log2x8(uint16_t v)
+{
+	uint8_t n = 0;
+	if (v == 0)
+		return 0;
+	while (v >> (n + 1))
+		n++;
+	return n * 8 + (n >= 3 ? (v >> (n - 3)) : (v << (3 - n))) % 8;
+}
+
+static void Spectrum_bar(uint8_t x, uint8_t w, uint8_t h)
+{
+	uint8_t p, c, top = 64 - h, mask;
+	for (p = SPECTRUM_TOP / 8; p < 8; p++)
+	{
+		if (top >= p * 8 + 8)
+			continue;
+		mask = top <= p * 8 ? 0xFF : (uint8_t)(0xFF << (top - p * 8));
+		for (c = x; c < x + w; c++)
+			OLED_GRAM[c][p] = mask;
+	}
+}
+
+static void Spectrum_draw()
+{
+	uint8_t w = 128 / (Spectrum_N / 2), h, l;
+	uint16_t k, peak = 1;
+	char line[17];
+	OLED_ClearBuffer();
+	for (k = 1; k < Spectrum_N / 2; k++)
+	{
+		if (Spectrum_Mag[k] > Spectrum_Mag[peak])
+			peak = k;
+		l = Spectrum_log2x8(Spectrum_Mag[k]);
+		h = l > 8 ? (uint8_t)((l - 8) * (64 - SPECTRUM_TOP) / (15 * 8 - 8)) : 0;	//1 .. 2^15;
+		if (h > 64 - SPECTRUM_TOP)
+			h = 64 - SPECTRUM_TOP;
+		Spectrum_bar(k * w, w > 1 ? w - 1 : 1, h);
+	}
+	snprintf(line, sizeof(line), "%u %luHz", Spectrum_N, (unsigned long)(peak * Spectrum_Rate / Spectrum_N));
+	OLED_DrawString(0, SPECTRUM_TOP / 8 - 1, line);	//Last page above the bars;
+	OLED_Present();
+}
+
+/**
+ * @brief Start the ADC stream and take over the OLED for the spectrum
+ * @param rate The ADC sample rate in Hz, the display spans 0 .. rate / 2
+ * @param n The FFT size, a power of 2 in SPECTRUM_N_MIN .. SPECTRUM_N_MAX
+ * @return 0 on success, 1 if n is not supported
+ * @details Needs SysTime_init and OLED_Init; the OLED console is closed.
+ */
+uint8_t Spectrum_start(uint32_t rate, uint16_t n)
+{
+	if (n < SPECTRUM_N_MIN || n > SPECTRUM_N_MAX || (n & (n - 1)))
+		return 1;
+	Spectrum_N = n;
+	for (Spectrum_Log2N = 0; (1U << Spectrum_Log2N) < n; Spectrum_Log2N++);
+	Spectrum_Ready = 0;
+	Spectrum_Frames = Spectrum_Cycles = Spectrum_MaxCycles = 0;
+	Spectrum_WinStart = SysTime_getMs();
+	OLEDConsole_close();
+	Spectrum_Rate = ADCStream_start(rate, Spectrum_onBlock);
+	return 0;
+}
+
+/**
+ * @brief Stop the ADC stream; the screen keeps the last frame
+ */
+void Spectrum_stop()
+{
+	ADCStream_stop();
+	OLED_WaitFlush();
+}
+
+/**
+ * @brief Transform and draw the newest frame, if there is one
+ * @return 1 if a frame was drawn, 0 otherwise
+ */
+uint8_t Spectrum_poll()
+{
+	uint32_t c0, cycles;
+	if (!Spectrum_Ready)
+		return 0;
+	c0 = SysTime_getCycles();
+	Spectrum_load();
+	Spectrum_Ready = 0;				//Input consumed, the handler may capture the next frame;
+	Spectrum_fft();
+	Spectrum_magnitude();
+	cycles = SysTime_getCycles() - c0;
+	Spectrum_Cycles += cycles;
+	if (cycles > Spectrum_MaxCycles)
+		Spectrum_MaxCycles = cycles;
+	Spectrum_draw();
+	++Spectrum_Frames;
+	return 1;
+}
+
+/**
+ * @brief Print the transform time and the display rate over UART, then start a new window
+ */
+void Spectrum_report()
+{
+	uint32_t ms = SysTime_getMs() - Spectrum_WinStart, avg;
+	if (ms == 0 || Spectrum_Frames == 0)
+		return;
+	avg = Spectrum_Cycles / Spectrum_Frames;
+	printf("Spectrum: %u-point FFT %lu cycles (%lu us), max %lu, %lu.%lu fps\n", Spectrum_N,
+		(unsigned long)avg, (unsigned long)(avg / (CPUCLK_FREQ / 1000000)), (unsigned long)Spectrum_MaxCycles,
+		(unsigned long)(Spectrum_Frames * 1000 / ms), (unsigned long)(Spectrum_Frames * 10000 / ms % 10));
+	Spectrum_Frames = Spectrum_Cycles = Spectrum_MaxCycles = 0;
+	Spectrum_WinStart = SysTime_getMs();
+}
@@ -0,0 +1,47 @@
+/*
+ * @file SysTime.c
+ * @brief Millisecond tick and cycle counter on SysTick
+ * @details The Cortex-M0+ has no DWT cycle counter, so cycles are derived from the
+ *          millisecond count plus the current SysTick down-counter value.
+ *          Use the difference of two SysTime_getCycles() calls to profile a routine.
+ * @author Ldk, InnoLegend team.
+ */
+
+#include "SysTime.h"
+
+volatile uint32_t gSysTimeMs = 0;
+
+/**
+ * @brief Start the millisecond tick
+ * @details SYSCFG_DL_SYSTICK_init already loads the 1 ms period; this enables its interrupt.
+ */
+void SysTime_init(){
+	gSysTimeMs = 0;
+	DL_SYSTICK_enableInterrupt();
+}
+
+/**
+ * @brief Get the milliseconds since SysTime_init
+ * @return Elapsed time in ms
+ */
+uint32_t SysTime_getMs(){
+	return gSysTimeMs;
+}
+
+/**
+ * @brief Get a free-running CPU cycle count
+ * @return Elapsed cycles, wraps every 2^32 cycles (about 53 s at 80 MHz)
+ * @details The read is retried if the tick interrupt fired in between.
+ */
+uint32_t SysTime_getCycles(){
+	uint32_t ms, val;
+	do {
+		ms = gSysTimeMs;
+		val = SysTick->VAL;
+	} while (ms != gSysTimeMs);
+	return ms * SYSTIME_CYCLES_PER_MS + (SysTick->LOAD - val);
+}
+
+void SysTick_Handler(){
+	++gSysTimeMs;
+}
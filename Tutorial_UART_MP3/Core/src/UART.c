@@ -11,6 +11,10 @@ For G3507:
 
 */
 #include "UART.h"
+#include "IMUStream.h"
+#if UART_OLED_MIRROR
+#include "OLEDConsole.h"
+#endif
 
 
 
@@ -38,9 +42,14 @@ void MCUTransData16(const UART_Regs * UART_Port,const uint16_t *data,const uint1
 		DL_UART_transmitDataBlocking(UART_Port,'\n');
 }
 
+//While IMUStream sends frames on UART0 the console text is dropped (still mirrored to the OLED);
 int fputc(int ch, FILE *f)
 {
-	DL_UART_transmitDataBlocking(UART_0_INST, (uint8_t) ch);// ͵ֽ
+	if (!IMUStream_active())
+		DL_UART_transmitDataBlocking(UART_0_INST, (uint8_t) ch);// ͵ֽ
+#if UART_OLED_MIRROR
+	OLEDConsole_putc((char) ch);
+#endif
 	return (ch);
 }
 
@@ -5,7 +5,7 @@
  * @date Mar.21st,2024
  */
 
-#include "vector.h"
+#include "Vector.h"
 
 /**
  * @brief Initialize the vector
@@ -88,7 +88,7 @@ size_t vector_capacity(const Vector* vec) { return vec->capacity; }
 /*
 Example:
 
-#include "vector.h"
+#include "Vector.h"
 
 int main() {
     // User-defined static memory (can store 10 integers)
@@ -31,21 +31,169 @@
  */
 
 #include "eeprom_emulation_type_a.h"
+#include <string.h>
+
+/* The firmware erases these sectors at boot, so they must stay inside the area the scatter
+ * file reserves (ER_EEPROM in keil/mspm0g3507.sct, 0x1F000-0x1FFFF); the scatter file in turn
+ * fails the link if the code grows into it */
+#if defined(__ARMCC_VERSION) && (EEPROM_EMULATION_ADDRESS < 0x0001F000 || \
+    EEPROM_EMULATION_ADDRESS + EEPROM_EMULATION_SECTOR_ACCOUNT * 1024 > 0x00020000)
+#error "EEPROM_EMULATION_ADDRESS / EEPROM_EMULATION_SECTOR_ACCOUNT outside ER_EEPROM"
+#endif
+
+/* Header states in the high half of word 1, the low half is the sector's sequence number */
+#define EEPROM_HEADER_RECORDING(w0, w1) ((w0) == 0x0000ffff && ((w1) >> 16) == 0xffff)
+#define EEPROM_HEADER_ACTIVE(w0, w1)    ((w0) == 0x0000ffff && ((w1) >> 16) == 0x0000)
+
+/* Flash reads of the header search, counted by the host benchmark */
+#ifndef EEPROM_TYPEA_READ32
+#define EEPROM_TYPEA_READ32(address) (*(volatile uint32_t *)(address))
+#endif
+
 /* 4 global variables about active record  */
 uint32_t gActiveRecordAddress = EEPROM_EMULATION_ADDRESS;
 uint32_t gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
 uint16_t gActiveRecordNum = 0;
 uint16_t gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
+uint16_t gActiveSectorSeq = 0;
 /* 3 global variables about format  */
 bool gEEPROMTypeASearchFlag = 0;
 bool gEEPROMTypeAEraseFlag = 0;
 bool gEEPROMTypeAFormatErrorFlag = 0;
+/* Erase scheduler: at most one sector waits for its erase */
+uint32_t gEEPROMTypeAErasePending = 0;
+bool gEEPROMTypeAEraseBusy = 0;
+uint32_t gEEPROMTypeAEraseForced = 0;
+/* Wear leveling: erase cycles per sector */
+uint32_t gEEPROMTypeAEraseCount[EEPROM_EMULATION_SECTOR_ACCOUNT_MAX];
+
+/* Sector left by the last sector change, 0 if none since boot */
+static uint32_t EEPROM_TypeA_previousSector = 0;
+
+static uint32_t EEPROM_TypeA_sectorAddress(uint16_t sectorNum)
+{
+    return EEPROM_EMULATION_ADDRESS + 1024 * (sectorNum - 1);
+}
+
+/* Address of the sector left by the last sector change, or else the one
+ * before the active one */
+static uint32_t EEPROM_TypeA_lastSectorAddress(void)
+{
+    if (EEPROM_TypeA_previousSector != 0)
+    {
+        return EEPROM_TypeA_previousSector;
+    }
+    if (gActiveSectorNum > EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN)
+    {
+        return EEPROM_TypeA_sectorAddress(gActiveSectorNum - 1);
+    }
+    return EEPROM_TypeA_sectorAddress(EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX);
+}
+
+/* The sector to start next: the least-worn one other than the active sector.
+ * Ties go to the first one after the active sector, the order of the
+ * original library, so equal counts rotate through all sectors */
+static uint16_t EEPROM_TypeA_nextSector(void)
+{
+    uint16_t num, candidate, best = 0;
+
+    for (num = 1; num < EEPROM_EMULATION_SECTOR_ACCOUNT; num++)
+    {
+        candidate =
+            (gActiveSectorNum - 1 + num) % EEPROM_EMULATION_SECTOR_ACCOUNT + 1;
+        if (best == 0 || gEEPROMTypeAEraseCount[candidate - 1] <
+                             gEEPROMTypeAEraseCount[best - 1])
+        {
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+/* Whether a sector reads all erased */
+static bool EEPROM_TypeA_sectorBlank(uint32_t address)
+{
+    const volatile uint32_t *word = (const volatile uint32_t *)address;
+    uint16_t num;
+
+    for (num = 0; num < 1024 / sizeof(uint32_t); num++)
+    {
+        if (word[num] != 0xffffffff)
+            return false;
+    }
+    return true;
+}
+
+/* Blocking erase of one sector, counted; a blank sector is skipped if asked */
+static bool EEPROM_TypeA_eraseSector(uint32_t address, bool skipBlank)
+{
+    DL_FLASHCTL_COMMAND_STATUS FlashAPIState;
+
+    if (skipBlank && EEPROM_TypeA_sectorBlank(address))
+        return true;
+    DL_FlashCTL_unprotectSector(
+        FLASHCTL, address, DL_FLASHCTL_REGION_SELECT_MAIN);
+    FlashAPIState = DL_FlashCTL_eraseMemoryFromRAM(
+        FLASHCTL, address, DL_FLASHCTL_COMMAND_SIZE_SECTOR);
+    if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
+        return false;
+    gEEPROMTypeAEraseCount[(address - EEPROM_EMULATION_ADDRESS) / 1024]++;
+    return true;
+}
+
+/* The flash controller runs one command at a time: let a started erase finish */
+static void EEPROM_TypeA_eraseWait(void)
+{
+    while (gEEPROMTypeAEraseBusy)
+    {
+        EEPROM_TypeA_eraseService();
+    }
+}
+
+/* Erase the pending sector now, in the write path */
+static bool EEPROM_TypeA_eraseForce(void)
+{
+    EEPROM_TypeA_eraseWait();
+    if (gEEPROMTypeAErasePending == 0)
+        return true;
+    if (!EEPROM_TypeA_eraseSector(gEEPROMTypeAErasePending, false))
+        return false;
+    gEEPROMTypeAErasePending = 0;
+    gEEPROMTypeAEraseFlag = 0;
+    gEEPROMTypeAEraseForced++;
+    return true;
+}
 
 uint32_t EEPROM_TypeA_writeData(uint32_t *data)
+{
+    return EEPROM_TypeA_writeRecord(
+        data, EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t));
+}
+
+uint32_t EEPROM_TypeA_writeRecord(uint32_t *data, uint16_t words)
 {
     uint32_t *NextRecordPointer = (void *)gNextRecordAddress;
     uint32_t HeaderArray64[] = {0x0000ffff, 0xffffffff};
     DL_FLASHCTL_COMMAND_STATUS FlashAPIState;
+    uint16_t NextSectorSeq = gActiveSectorSeq;
+    uint16_t NextSectorNum = gActiveSectorNum;
+
+    EEPROM_TypeA_eraseWait();
+
+    /* The first record of a new sector takes the next sequence number, in
+     * the least-worn free sector. A sector still waiting for its erase is
+     * erased first, so that two sectors never need erasing at once */
+    if (gEEPROMTypeASearchFlag == 1 &&
+        gActiveRecordNum >= EEPROM_EMULATION_ACTIVE_RECORD_NUM_MAX)
+    {
+        NextSectorSeq++;
+        if (!EEPROM_TypeA_eraseForce())
+            return EEPROM_EMULATION_WRITE_ERROR;
+        NextSectorNum = EEPROM_TypeA_nextSector();
+        gNextRecordAddress = EEPROM_TypeA_sectorAddress(NextSectorNum);
+        NextRecordPointer = (void *)gNextRecordAddress;
+    }
+    HeaderArray64[1] = 0xffff0000 | NextSectorSeq;
 
     /* Check next address*/
     if (*NextRecordPointer != 0xffffffff)
@@ -63,14 +211,16 @@ uint32_t EEPROM_TypeA_writeData(uint32_t *data)
     if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
         return EEPROM_EMULATION_WRITE_ERROR;
 
-    /* Program data to the new record */
-    FlashAPIState =
-        DL_FlashCTL_programMemoryFromRAM(FLASHCTL, (gNextRecordAddress + 8),
-                                         data, EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t),
-                                         DL_FLASHCTL_REGION_SELECT_MAIN);
+    /* Program data to the new record, the rest of the data stays erased */
+    if (words != 0)
+    {
+        FlashAPIState = DL_FlashCTL_programMemoryFromRAM(FLASHCTL,
+            (gNextRecordAddress + 8), data, words,
+            DL_FLASHCTL_REGION_SELECT_MAIN);
 
-    if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
-        return EEPROM_EMULATION_WRITE_ERROR;
+        if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
+            return EEPROM_EMULATION_WRITE_ERROR;
+    }
 
     /* Set the new record's header to Active */
     HeaderArray64[1] = 0x0000ffff;
@@ -81,17 +231,17 @@ uint32_t EEPROM_TypeA_writeData(uint32_t *data)
     if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
         return EEPROM_EMULATION_WRITE_ERROR;
 
-    /* Update gActiveRecordNum, gActiveSectorNum*/
+    /* Update gActiveRecordNum, gActiveSectorNum, gActiveSectorSeq*/
+    gActiveSectorSeq = NextSectorSeq;
     gActiveRecordNum++;
-    if (gActiveRecordNum > EEPROM_EMULATION_ACTIVE_RECORD_NUM_MAX)
+    if (NextSectorNum != gActiveSectorNum)
     {
         gActiveRecordNum = EEPROM_EMULATION_ACTIVE_RECORD_NUM_MIN;
         gEEPROMTypeAEraseFlag = 1;
-        gActiveSectorNum++;
-        if (gActiveSectorNum > EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX)
-        {
-            gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
-        }
+        EEPROM_TypeA_previousSector =
+            EEPROM_TypeA_sectorAddress(gActiveSectorNum);
+        gEEPROMTypeAErasePending = EEPROM_TypeA_previousSector;
+        gActiveSectorNum = NextSectorNum;
     }
 
     /* if last active record exists, set the last active record's header to Used */
@@ -110,18 +260,44 @@ uint32_t EEPROM_TypeA_writeData(uint32_t *data)
         gEEPROMTypeASearchFlag = 1;
     }
 
-    /* Update gActiveRecordAddress, gNextRecordAddress*/
+    /* Update gActiveRecordAddress, gNextRecordAddress (past the end of a
+     * full sector, the next write picks the sector) */
     gActiveRecordAddress = gNextRecordAddress;
-    if (gActiveRecordNum >= EEPROM_EMULATION_ACTIVE_RECORD_NUM_MAX &&
-        gActiveSectorNum >= EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX)
+    gNextRecordAddress = gActiveRecordAddress + EEPROM_EMULATION_RECORD_SIZE;
+    return EEPROM_EMULATION_WRITE_OK;
+}
+
+uint32_t EEPROM_TypeA_appendData(uint16_t offset, uint32_t *data, uint16_t words)
+{
+    uint32_t AppendAddress = gActiveRecordAddress + 8 + offset;
+    uint32_t *AppendPointer;
+    DL_FLASHCTL_COMMAND_STATUS FlashAPIState;
+    uint16_t num;
+
+    EEPROM_TypeA_eraseWait();
+
+    /* Only whole flash words after the last programmed one of the active record */
+    if (gEEPROMTypeASearchFlag == 0 || words == 0 || (offset & 7) != 0 ||
+        offset + words * sizeof(uint32_t) > EEPROM_EMULATION_DATA_SIZE)
     {
-        gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
+        return EEPROM_EMULATION_WRITE_ERROR;
     }
-    else
+
+    /* Check the target is erased */
+    for (num = 0; num < words; num++)
     {
-        gNextRecordAddress =
-            gActiveRecordAddress + EEPROM_EMULATION_RECORD_SIZE;
+        AppendPointer = (void *)(AppendAddress + num * 4);
+        if (*AppendPointer != 0xffffffff)
+        {
+            return EEPROM_EMULATION_FORMAT_ERROR;
+        }
     }
+
+    FlashAPIState = DL_FlashCTL_programMemoryFromRAM(FLASHCTL,
+        AppendAddress, data, words, DL_FLASHCTL_REGION_SELECT_MAIN);
+    if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
+        return EEPROM_EMULATION_WRITE_ERROR;
+
     return EEPROM_EMULATION_WRITE_OK;
 }
 
@@ -161,49 +337,32 @@ uint32_t EEPROM_TypeA_init(uint32_t *data)
         gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
         gActiveRecordNum = 0;
         gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
+        gActiveSectorSeq = 0;
     }
     return EEPROM_EMULATION_INIT_OK;
 }
 
 void EEPROM_TypeA_readData(uint32_t *data)
 {
-    uint32_t *ReadRecordPointer;
-    uint32_t ReadRecordAddress;
-
-    ReadRecordAddress = gActiveRecordAddress + 8;
-    for (uint16_t num = 0; num < EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t);
-         num++)
-    {
-        ReadRecordPointer = (void *)ReadRecordAddress;
-        data[num] = *ReadRecordPointer;
-        ReadRecordAddress += 4;
-    }
+    memcpy(data, (const void *)(gActiveRecordAddress + 8),
+           EEPROM_EMULATION_DATA_SIZE);
 }
 
 bool EEPROM_TypeA_repairFormat(uint32_t *data)
 {
     uint32_t FormatRepairAddress;
-    uint32_t EraseSectorAddress;
     uint32_t HeaderArray64[] = {0x0000ffff, 0xffffffff};
     DL_FLASHCTL_COMMAND_STATUS FlashAPIState;
 
-    /* Firstly erase other sectors*/
-    FlashAPIState = EEPROM_TypeA_eraseNonActiveSectors();
-    if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
+    /* Firstly erase other sectors (bool result: DL_FLASHCTL_COMMAND_STATUS_FAILED is 1) */
+    if (!EEPROM_TypeA_eraseNonActiveSectors())
         return false;
 
-    /* Set pointer to next sector's beginning*/
-    if (gActiveSectorNum == EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX)
-    {
-        FormatRepairAddress = EEPROM_EMULATION_ADDRESS;
-    }
-    else
-    {
-        FormatRepairAddress =
-            EEPROM_EMULATION_ADDRESS + gActiveSectorNum * 1024;
-    }
+    /* Set pointer to the beginning of the next (least-worn) sector */
+    FormatRepairAddress = EEPROM_TypeA_sectorAddress(EEPROM_TypeA_nextSector());
 
-    /* Set the new record's header to Recording */
+    /* Set the new record's header to Recording, in a new sector */
+    HeaderArray64[1] = 0xffff0000 | (uint16_t)(gActiveSectorSeq + 1);
     DL_FlashCTL_unprotectSector(
         FLASHCTL, FormatRepairAddress, DL_FLASHCTL_REGION_SELECT_MAIN);
 #ifdef __MSPM0_HAS_ECC__
@@ -224,7 +383,7 @@ bool EEPROM_TypeA_repairFormat(uint32_t *data)
         DL_FLASHCTL_REGION_SELECT_MAIN);
 #else
     FlashAPIState =
-        DL_FlashCTL_programMemoryFromRAM(FLASHCTL, (gNextRecordAddress + 8),
+        DL_FlashCTL_programMemoryFromRAM(FLASHCTL, (FormatRepairAddress + 8),
                                          data, EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t),
                                          DL_FLASHCTL_REGION_SELECT_MAIN);
 #endif
@@ -242,160 +401,183 @@ bool EEPROM_TypeA_repairFormat(uint32_t *data)
         return false;
 
     /* Update 4 global variables about active record */
+    gActiveSectorSeq++;
     gActiveRecordNum = EEPROM_EMULATION_ACTIVE_RECORD_NUM_MIN;
-    if (gActiveSectorNum == EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX)
-    {
-        gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
-    }
-    else
-    {
-        gActiveSectorNum += 1;
-    }
+    EEPROM_TypeA_previousSector = EEPROM_TypeA_sectorAddress(gActiveSectorNum);
+    gActiveSectorNum = (FormatRepairAddress - EEPROM_EMULATION_ADDRESS) / 1024 + 1;
     gActiveRecordAddress = FormatRepairAddress;
     gNextRecordAddress = gActiveRecordAddress + EEPROM_EMULATION_RECORD_SIZE;
 
     /* Erase the last sector */
-    FlashAPIState = EEPROM_TypeA_eraseLastSector();
-    if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
+    if (!EEPROM_TypeA_eraseLastSector())
         return false;
     return true;
 }
 
 void EEPROM_TypeA_searchCheck(void)
 {
-    uint16_t SearchRecordNum, SearchSectorNum;
+    uint16_t SearchSectorNum, ActiveSectorNum = 0, ActiveSectorSeq = 0;
+    uint16_t Low, High, Mid;
+    uint32_t SectorAddress, SearchRecordAddress;
     uint32_t Temp0, Temp1;
-    bool SectorState;
-    uint32_t SearchRecordAddress = EEPROM_EMULATION_ADDRESS;
-    uint32_t *SearchRecordPointer = (void *)SearchRecordAddress;
 
     /* Clear flag*/
     gEEPROMTypeASearchFlag = 0;
     gEEPROMTypeAFormatErrorFlag = 0;
+    EEPROM_TypeA_previousSector = 0;
 
-    /* Traverse records header to search the active record and check the format*/
+    /* Find the newest committed sector from the first header of each sector:
+     * word 1 alone tells erased (0xffffffff), Recording (0xffff....) and
+     * Active or Used (0x0000....) apart */
     for (SearchSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
          SearchSectorNum <= EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX;
          SearchSectorNum++)
     {
-        SectorState = 0;
-        for (SearchRecordNum = EEPROM_EMULATION_ACTIVE_RECORD_NUM_MIN;
-             SearchRecordNum <= EEPROM_EMULATION_ACTIVE_RECORD_NUM_MAX;
-             SearchRecordNum++)
-        {
-            /* Read the header*/
-            SearchRecordPointer = (void *)SearchRecordAddress;
-            Temp0 = *SearchRecordPointer;
-            SearchRecordPointer = (void *)(SearchRecordAddress + 4);
-            Temp1 = *SearchRecordPointer;
+        SectorAddress =
+            EEPROM_EMULATION_ADDRESS + 1024 * (SearchSectorNum - 1);
+        Temp1 = EEPROM_TYPEA_READ32(SectorAddress + 4);
 
-            if (Temp0 == 0xffffffff && Temp1 == 0xffffffff) // Erased
-            {
-                /* if Erased is followed by other states in a sector, the format is error.
-                 * SectorState is to find out this situation*/
-                SectorState = 1;
-            }
-            else if (Temp0 == 0x00000000 && Temp1 == 0x0000ffff &&
-                     SectorState == 0) // Used
-            {
-            }
-            else if (Temp0 == 0x0000ffff && Temp1 == 0x0000ffff &&
-                     SectorState == 0) // Active
-            {
-                /* If active record is found, 4 global variables are updated, and gEEPROMTypeASearchFlag is set*/
-                gActiveRecordAddress = SearchRecordAddress;
-                if (gActiveRecordNum >=
-                        EEPROM_EMULATION_ACTIVE_RECORD_NUM_MAX &&
-                    gActiveSectorNum >=
-                        EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX)
-                {
-                    gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
-                }
-                else
-                {
-                    gNextRecordAddress =
-                        gActiveRecordAddress + EEPROM_EMULATION_RECORD_SIZE;
-                }
-                gActiveRecordNum = SearchRecordNum;
-                gActiveSectorNum = SearchSectorNum;
-                gEEPROMTypeASearchFlag = 1;
-            }
-            else if (Temp0 == 0x0000ffff && Temp1 == 0xffffffff &&
-                     SectorState == 0) // Recording
-            {
-                gEEPROMTypeAFormatErrorFlag = 1;
-            }
-            else
+        if (Temp1 == 0xffffffff)
+        {
+        }
+        else if ((Temp1 >> 16) == 0x0000)
+        {
+            /* Ties go to the later sector, as an address-order walk would */
+            if (ActiveSectorNum == 0 ||
+                (int16_t)((uint16_t)Temp1 - ActiveSectorSeq) >= 0)
             {
-                gEEPROMTypeAFormatErrorFlag = 1;
+                ActiveSectorNum = SearchSectorNum;
+                ActiveSectorSeq = (uint16_t)Temp1;
             }
-            /* Point to next record*/
-            SearchRecordAddress += (EEPROM_EMULATION_RECORD_SIZE);
+        }
+        else
+        {
+            /* A sector change was interrupted (Recording), or unknown state */
+            gEEPROMTypeAFormatErrorFlag = 1;
         }
     }
+    if (ActiveSectorNum == 0)
+    {
+        return;
+    }
+
+    /* Records are programmed in order: binary search for the last one */
+    SectorAddress = EEPROM_EMULATION_ADDRESS + 1024 * (ActiveSectorNum - 1);
+    Low = EEPROM_EMULATION_ACTIVE_RECORD_NUM_MIN;
+    High = EEPROM_EMULATION_ACTIVE_RECORD_NUM_MAX;
+    while (Low < High)
+    {
+        Mid = (Low + High + 1) / 2;
+        SearchRecordAddress =
+            SectorAddress + (Mid - 1) * EEPROM_EMULATION_RECORD_SIZE;
+        if (EEPROM_TYPEA_READ32(SearchRecordAddress) != 0xffffffff)
+        {
+            Low = Mid;
+        }
+        else
+        {
+            High = Mid - 1;
+        }
+    }
+
+    SearchRecordAddress =
+        SectorAddress + (Low - 1) * EEPROM_EMULATION_RECORD_SIZE;
+    Temp0 = EEPROM_TYPEA_READ32(SearchRecordAddress);
+    Temp1 = EEPROM_TYPEA_READ32(SearchRecordAddress + 4);
+    if (!EEPROM_HEADER_ACTIVE(Temp0, Temp1) && Low > EEPROM_EMULATION_ACTIVE_RECORD_NUM_MIN)
+    {
+        /* The last record is torn (Recording, or a header program cut short),
+         * the one before it is still active */
+        gEEPROMTypeAFormatErrorFlag = 1;
+        Low--;
+        SearchRecordAddress -= EEPROM_EMULATION_RECORD_SIZE;
+        Temp0 = EEPROM_TYPEA_READ32(SearchRecordAddress);
+        Temp1 = EEPROM_TYPEA_READ32(SearchRecordAddress + 4);
+    }
+    if (!EEPROM_HEADER_ACTIVE(Temp0, Temp1))
+    {
+        gEEPROMTypeAFormatErrorFlag = 1;
+    }
+
+    /* Active record is found, 4 global variables are updated, and gEEPROMTypeASearchFlag is set*/
+    gActiveRecordAddress = SearchRecordAddress;
+    gActiveRecordNum = Low;
+    gActiveSectorNum = ActiveSectorNum;
+    gActiveSectorSeq = ActiveSectorSeq;
+    gNextRecordAddress = gActiveRecordAddress + EEPROM_EMULATION_RECORD_SIZE;
+    gEEPROMTypeASearchFlag = 1;
 }
 
 bool EEPROM_TypeA_eraseLastSector(void)
 {
     uint32_t EraseSectorAddress;
+
+    EEPROM_TypeA_eraseWait();
+    EraseSectorAddress = EEPROM_TypeA_lastSectorAddress();
+
+    if (!EEPROM_TypeA_eraseSector(EraseSectorAddress, false))
+        return false;
+
+    if (gEEPROMTypeAErasePending == EraseSectorAddress)
+        gEEPROMTypeAErasePending = 0;
+    return true;
+}
+
+bool EEPROM_TypeA_eraseService(void)
+{
     DL_FLASHCTL_COMMAND_STATUS FlashAPIState;
-    if (gActiveSectorNum > EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN)
-    {
-        EraseSectorAddress =
-            EEPROM_EMULATION_ADDRESS + 1024 * (gActiveSectorNum - 2);
-    }
-    else
+
+    if (gEEPROMTypeAEraseBusy)
     {
-        EraseSectorAddress =
-            EEPROM_EMULATION_ADDRESS +
-            1024 * (EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MAX - 1);
+        FlashAPIState = DL_FlashCTL_getCommandStatus(FLASHCTL);
+        if ((FlashAPIState & FLASHCTL_STATCMD_CMDDONE_MASK) !=
+            FLASHCTL_STATCMD_CMDDONE_STATDONE)
+            return false;
+        gEEPROMTypeAEraseBusy = 0;
+        if (FlashAPIState != DL_FLASHCTL_COMMAND_STATUS_PASSED)
+            return false; /* Still pending, retried on the next call */
+        gEEPROMTypeAEraseCount[(gEEPROMTypeAErasePending -
+                                   EEPROM_EMULATION_ADDRESS) / 1024]++;
+        gEEPROMTypeAErasePending = 0;
+        gEEPROMTypeAEraseFlag = 0;
+        return true;
     }
+    if (gEEPROMTypeAErasePending == 0)
+        return true;
 
+    /* Start the erase and return, DL_FlashCTL_eraseMemory does not wait */
     DL_FlashCTL_unprotectSector(
-        FLASHCTL, EraseSectorAddress, DL_FLASHCTL_REGION_SELECT_MAIN);
-    FlashAPIState = DL_FlashCTL_eraseMemoryFromRAM(
-        FLASHCTL, EraseSectorAddress, DL_FLASHCTL_COMMAND_SIZE_SECTOR);
-    if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
-        return false;
-
-    return true;
+        FLASHCTL, gEEPROMTypeAErasePending, DL_FLASHCTL_REGION_SELECT_MAIN);
+    DL_FlashCTL_eraseMemory(
+        FLASHCTL, gEEPROMTypeAErasePending, DL_FLASHCTL_COMMAND_SIZE_SECTOR);
+    gEEPROMTypeAEraseBusy = 1;
+    return false;
 }
 
 bool EEPROM_TypeA_eraseNonActiveSectors(void)
 {
-    uint32_t EraseSectorAddress;
-    DL_FLASHCTL_COMMAND_STATUS FlashAPIState;
     uint16_t num;
+    EEPROM_TypeA_eraseWait();
+    /* Sectors already blank are left alone: this runs at every boot */
     for (num = 0; num < EEPROM_EMULATION_SECTOR_ACCOUNT; num++)
     {
-        if (num != (gActiveSectorNum - 1))
-        {
-            EraseSectorAddress = EEPROM_EMULATION_ADDRESS + 1024 * num;
-            DL_FlashCTL_unprotectSector(
-                FLASHCTL, EraseSectorAddress, DL_FLASHCTL_REGION_SELECT_MAIN);
-            FlashAPIState = DL_FlashCTL_eraseMemoryFromRAM(
-                FLASHCTL, EraseSectorAddress, DL_FLASHCTL_COMMAND_SIZE_SECTOR);
-            if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
-                return false;
-        }
+        if (num != (gActiveSectorNum - 1) &&
+            !EEPROM_TypeA_eraseSector(EEPROM_EMULATION_ADDRESS + 1024 * num, true))
+            return false;
     }
+    gEEPROMTypeAErasePending = 0;
     return true;
 }
 
 bool EEPROM_TypeA_eraseAllSectors(void)
 {
-    uint32_t EraseSectorAddress;
-    DL_FLASHCTL_COMMAND_STATUS FlashAPIState;
     uint16_t num;
+    EEPROM_TypeA_eraseWait();
     for (num = 0; num < EEPROM_EMULATION_SECTOR_ACCOUNT; num++)
     {
-        EraseSectorAddress = EEPROM_EMULATION_ADDRESS + 1024 * num;
-        DL_FlashCTL_unprotectSector(
-            FLASHCTL, EraseSectorAddress, DL_FLASHCTL_REGION_SELECT_MAIN);
-        FlashAPIState = DL_FlashCTL_eraseMemoryFromRAM(
-            FLASHCTL, EraseSectorAddress, DL_FLASHCTL_COMMAND_SIZE_SECTOR);
-        if (FlashAPIState == DL_FLASHCTL_COMMAND_STATUS_FAILED)
+        if (!EEPROM_TypeA_eraseSector(EEPROM_EMULATION_ADDRESS + 1024 * num, true))
             return false;
     }
+    gEEPROMTypeAErasePending = 0;
     return true;
 }
@@ -27,19 +27,52 @@
 #include "oledpicture.h"
 #include "MusicPlayer.h"
 #include "MusicScore.h"
-#include "eeprom_emulation_type_a.h"
+#include "EEPROMKV.h"
+#include "Settings.h"
 #include "UART.h"
 #include "CommandLine.h"
+#include "SysTime.h"
+#include "OLEDConsole.h"
+#include "MPU6500_SPI.h"
+#include "IMUFilter.h"
+#include "IMUStream.h"
+#include "ADCStream.h"
+#include "Spectrum.h"
+#include "Pitch.h"
+#include "SPIFlash.h"
+#include "LogFS.h"
+#include "FlashCache.h"
+#include "ScoreStore.h"
 #include <math.h>
+#include <string.h>
 
 //Definitions&Variables:
 #define CPU_Frq 80000	//Unit:kHz;
 #define CPU_Frq_MHz 80	//Unit:MHz;
 #define PI 3.1415926
+#define PROFILE_REPORT 0	//1: print boot-time profiling results over UART;
+#define IMU_ENABLE 0		//1: MPU6500 fitted on SPI0 (CS1);
+#define IMU_RATE 1000		//Hz, sample rate of the attitude filter and the stream;
+#define IMU_LOW_LATENCY 0	//1: read and filter each IMU sample at its data-ready edge instead of in FIFO batches;
+#define IMU_STREAM 0		//1: stream IMU frames over UART0 instead of the console and the commands (needs IMU_ENABLE);
+#define IMU_CALIBRATE 0		//1: run the six-position IMU calibration at boot even if one is stored;
+#define IMU_CALIB_SAMPLES 512	//Samples averaged per calibration pose;
+#define ADC_STREAM 0		//1: sample ADC12_0 (PA27) continuously at ADC_STREAM_HZ;
+#define ADC_STREAM_HZ 16000
+#define SPECTRUM 0			//1: run the OLED spectrum analyzer on ADC12_0 instead of the keypad player;
+#define SPECTRUM_POINTS 128	//FFT size, 64-256;
+#define TUNER 0				//1: run the OLED tuner (pitch detection on ADC12_0) instead of the keypad player;
+#define SPI_FLASH_BENCH_SIZE 65536	//Bytes at the top of the SPI flash rewritten by the boot benchmark (PROFILE_REPORT);
 
-//Simulated EEPROM on Flash:
+#if IMU_ENABLE && SPECTRUM
+#error "The IMU filter runs MATHACL in the MPU6500 interrupts, the spectrum in the foreground"
+#endif
+
+//Simulated EEPROM on Flash (key-value store, see EEPROMKV.h):
 uint32_t EEPROMEmulationState;
-uint32_t EEPROMEmulationBuffer[EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t)];
+//Keys in the store:
+#define EEPROM_KEY_IMU_CALIB 0x0001			//struct MPUCalib;
+#define SETTINGS_COMMIT_MS 5000				//Changed settings are written at most this often (or on "sync");
 
 //UART:
 #define TxLength 16
@@ -51,8 +84,11 @@ void Initialization();
 void other_value_input(uint8_t key_value);
 
 //EEPROM:
-void SaveData(uint32_t * State);
-void LoadData();
+uint32_t SaveIMUCalib(const struct MPUCalib *calib);
+uint8_t LoadIMUCalib(struct MPUCalib *calib);
+
+//IMU:
+void IMUCalibration();
 
 //MusicPlayer:
 void BeepWarning();
@@ -69,58 +105,85 @@ int main(void)
 	
 		Initialization();
 		
+#if SPECTRUM
+		Spectrum_start(ADC_STREAM_HZ, SPECTRUM_POINTS);
+		uint32_t reportMs = SysTime_getMs();
+		while(1)
+		{
+			if (!Spectrum_poll())
+				__WFI();							//Woken by the ADC block interrupts;
+			if (SysTime_getMs() - reportMs >= 1000)
+			{
+				reportMs = SysTime_getMs();
+				Spectrum_report();					//Transform time & display rate;
+			}
+		}
+#elif TUNER
+		Pitch_start(ADC_STREAM_HZ);
+		uint32_t reportMs = SysTime_getMs();
+		while(1)
+		{
+			if (!Pitch_poll())
+				__WFI();
+			if (SysTime_getMs() - reportMs >= 1000)
+			{
+				reportMs = SysTime_getMs();
+				Pitch_report();						//CPU cost per block & latency;
+			}
+		}
+#endif
 		while(1)
 		{
 			//printf("HelloWorld!");
+			EEPROM_TypeA_eraseService();	//Full EEPROM sector erased while idle, not in a write;
+			SPIFlash_poll();				//Queued SPI flash programs & erases;
+			LogFS_poll();					//Erase of deleted files' blocks;
+			Settings_poll();				//Changed settings, once per SETTINGS_COMMIT_MS;
 			key_value = 0;  
 			key_value = KeySCInput();
 			delay_cycles(32000000);	    //Delay 0.4s;
-		    OLED_ShowNum(0,0,key_value,2,12);
 			
 			// Backspace
 			if (key_value == 13 && InCTL > 0) 
 			{
 				--InCTL;
-				OLED_Clear();
+				OLEDConsole_putc('\b');
 			}
 			
 			// Send message if press "sendMsg". Relocation function printf();
 			if (key_value == 16 && InCTL > 0)
 			{
-				OLED_ShowString(0,4,"Message Sent!");
-				delay_cycles(16000000);	//Delay 0.2s;
+				OLEDConsole_putc('\r');		//The sent line replaces the echo on the console;
 				printf("Password:");
 				for(uint8_t i = 0;i < InCTL;++i)
 				{
 					printf("%d",TxMsg[i]);
 				}
 				printf("\n");
-				OLED_Clear();
 				InCTL = 0;
 			}
 
 			// Send message if input 16 numbers.
 			if (InCTL == 16)
 			{
-				OLED_ShowString(0,4,"Message Sent!");
-				delay_cycles(16000000);	//Delay 0.2s;
+				OLEDConsole_putc('\r');
 				printf("Password:");
 				for(uint8_t i = 0;i < InCTL;++i)
 				{
 					printf("%d",TxMsg[i]);
 				}
 				printf("\n");
-				OLED_Clear();
 				InCTL = 0;
 			}
 
 			// Other buttons input.
+			uint8_t lastCTL = InCTL;
 			other_value_input(key_value);
 			
-			// Show the input message.
-			for(uint8_t i = 0;i < InCTL;++i) 
+			// Echo the new digit on the console.
+			if (InCTL > lastCTL)
 			{
-				OLED_ShowNum(6*i,1,TxMsg[i],1,12);
+				OLEDConsole_putc('0' + TxMsg[InCTL - 1]);
 			}
 
 			// Play music according to the password.
@@ -136,6 +199,24 @@ int main(void)
 				Cmd = 0,playMusic(NightOfNights,95);
 			if (Cmd == 6) 
 				Cmd = 0,playMusic(FunkyStar,75);
+			if (Cmd == CMD_SYNC)
+				Cmd = 0,Settings_sync(),Settings_report();
+			if (Cmd == CMD_WEAR)
+				Cmd = 0,EEPROMKV_reportWear();
+			if (Cmd == CMD_FILES)
+				Cmd = 0,LogFS_report();
+			if (Cmd == CMD_UPLOAD)
+				Cmd = 0,ScoreStore_upload(gCmdArg),ScoreStore_report();
+			if (Cmd == CMD_PLAY)
+			{
+				Cmd = 0;
+				if (ScoreStore_play(gCmdArg) != SCORE_OK)
+					printf("No score %u\n", gCmdArg);
+			}
+#if IMU_ENABLE
+			if (Cmd == CMD_IMU)
+				Cmd = 0,IMUFilter_report();
+#endif
 		}
 		while(1){__WFI();}
 		
@@ -208,18 +289,102 @@ void other_value_input(uint8_t key_value)
 void Initialization()
 {
     SYSCFG_DL_init(); 							//Initialize MCU;
-	EEPROMEmulationState = EEPROM_TypeA_init(&EEPROMEmulationBuffer[0]);	//Initialize Storage;
+	EEPROMEmulationState = EEPROMKV_init();		//Initialize Storage, rebuild the key index;
     Keyboard_init();							//Initialize Keyboard;
     OLED_Init();								//Initialize OLED;
     MusicPlayer_init();							//Initialize Buzzer;
 	UART_init();								//Initialize UART;
-	OLED_DrawBMP(9,0,119,8,Genshin);			//LOGO;
+	SysTime_init();								//Initialize ms tick & cycle counter;
+	Settings_init(SETTINGS_COMMIT_MS);			//RAM shadow of the settings in the EEPROM;
+	SPIFlash_init();							//External SPI NOR flash on SPI0, if fitted;
+	if (gSPIFlash.size > SPI_FLASH_BENCH_SIZE)
+		LogFS_mount(0, gSPIFlash.size - SPI_FLASH_BENCH_SIZE);	//Files below the benchmark area;
+#if PROFILE_REPORT
+	uint32_t t0 = SysTime_getCycles();
+	OLED_DecodeRLE(9,0,119,8,Genshin_RLE);
+	printf("Genshin_RLE decode: %lu cycles\n", (unsigned long)(SysTime_getCycles() - t0));
+	EEPROMKV_report();							//Keys, free space & flash bytes programmed;
+	Settings_report();							//Commits & batched sets;
+	if (gSPIFlash.size >= SPI_FLASH_BENCH_SIZE)
+		SPIFlash_bench(gSPIFlash.size - SPI_FLASH_BENCH_SIZE, SPI_FLASH_BENCH_SIZE);
+	SPIFlash_report();							//JEDEC ID, size & traffic;
+	LogFS_report();								//Files & mount time;
+	FlashCache_report();						//Hits & read-ahead of the file reads;
+#endif
+#if IMU_ENABLE
+	MPU6500_Init();								//Initialize IMU;
+	IMUCalibration();							//Stored offsets, or a calibration pass on first boot;
+#if PROFILE_REPORT
+	MPU6500_RateTest(1000, 1000);				//Check the burst read keeps up with the ODR;
+	MPU6500_ConvertBench(1000);					//Soft-float vs fixed-point sample conversion;
+	IMUFilter_Bench(1000);						//Attitude update cost and max rate;
+#endif
+#if IMU_STREAM
+	IMUFilter_init(IMU_RATE);
+	IMUStream_start(IMU_RATE);					//Binary telemetry at the full ODR, see IMUStream.h, feeds the filter;
+#else
+	IMUFilter_start(IMU_RATE, IMU_LOW_LATENCY);	//Attitude on every sample, "imu" prints it;
+#endif
+#endif
+#if ADC_STREAM
+	ADCStream_start(ADC_STREAM_HZ, 0);			//Block statistics only;
+#if PROFILE_REPORT
 	delay_cycles(CPU_Frq*1000);
-	OLED_Clear();
+	ADCStream_report();							//Sustained rate & CPU load over 1s;
+#endif
+#endif
+	OLED_DrawRLE(9,0,119,8,Genshin_RLE);		//LOGO;
+	delay_cycles(CPU_Frq*1000);
+	OLEDConsole_init();							//Clear the logo, console & printf mirror from here on;
 	CommandLineON();							//Initialize complicated uart interaction;
 	BeepWarning();
 }
 
+/**
+ * @brief Restore the IMU calibration from the EEPROM, or calibrate and store it
+ * @details The offsets live in the sensor registers, so a restored calibration costs nothing per sample.
+ *          Without a stored one (or with IMU_CALIBRATE) the board is calibrated here: lying still and
+ *          level for the gyro bias and the level accel bias; with IMU_CALIBRATE the OLED asks for the
+ *          six poses in turn, confirmed with any key, which adds the accel gain.
+ */
+void IMUCalibration()
+{
+	static char *const poses[6] = {"+X up", "-X up", "+Y up", "-Y up", "+Z up", "-Z up"};
+	struct MPUCalib calib;
+	uint8_t i;
+	if (!IMU_CALIBRATE && EEPROMEmulationState == EEPROM_EMULATION_INIT_OK
+		&& LoadIMUCalib(&calib) && MPU6500_setCalib(&calib) == 0)
+		return;
+	OLED_Clear();
+	OLED_ShowString(0,0,"IMU calibration");
+	for (i = IMU_CALIBRATE ? 0 : 4; i < (IMU_CALIBRATE ? 6 : 5); ++i)
+	{
+		OLED_ShowString(0,2,poses[i]);
+		if (IMU_CALIBRATE)
+			while (KeySCInput() == 0);
+		delay_cycles(CPU_Frq*500);				//Let the board settle;
+		MPU6500_CalibrateAccelPose(i, IMU_CALIB_SAMPLES);
+	}
+	if (IMU_CALIBRATE)
+	{
+		OLED_ShowString(0,2,"+Z up, still");	//Back to level for the gyro bias;
+		while (KeySCInput() == 0);
+		delay_cycles(CPU_Frq*500);
+	}
+	if (MPU6500_CalibrateGyro(IMU_CALIB_SAMPLES) || MPU6500_CalibrateAccelApply())
+	{
+		OLED_ShowString(0,4,"Failed");
+		delay_cycles(CPU_Frq*1000);
+		OLED_Clear();
+		return;
+	}
+	MPU6500_getCalib(&calib);
+	EEPROMEmulationState = SaveIMUCalib(&calib);
+	OLED_ShowString(0,4,"Saved");
+	delay_cycles(CPU_Frq*500);
+	OLED_Clear();
+}
+
 /**
  * @brief Emit a warning beep sound
  * @details This function emits a warning beep sound using the buzzer.
@@ -239,50 +404,55 @@ void UART_0_INST_IRQHandler()
 	volatile uint8_t data;
 	switch (DL_UART_Main_getPendingInterrupt(UART_0_INST)){
 		case  DL_UART_MAIN_IIDX_RX:
+#if IMU_STREAM
+			// UART0 carries the IMU frames: no commands, their replies would land inside the frames.
+			while (!DL_UART_isRXFIFOEmpty(UART_0_INST))
+				DL_UART_receiveData(UART_0_INST);
+			DL_UART_clearInterruptStatus(UART_0_INST,DL_UART_INTERRUPT_RX);
+			break;
+#endif
+			// Score upload frames bypass the command line.
+			if (ScoreStore_receiving())
+			{
+				while (!DL_UART_isRXFIFOEmpty(UART_0_INST))
+					ScoreStore_rx(DL_UART_receiveData(UART_0_INST));
+				DL_UART_clearInterruptStatus(UART_0_INST,DL_UART_INTERRUPT_RX);
+				break;
+			}
 			data = DL_UART_Main_receiveDataBlocking(UART_0_INST);
 			Cmd = embedding(&data);
 			DL_UART_clearInterruptStatus(UART_0_INST,DL_UART_INTERRUPT_RX);
 			break;
+		case DL_UART_MAIN_IIDX_DMA_DONE_TX:
+			IMUStream_onTxDone();
+			break;
 	default:
 		break;
     }
 }
 
-/*
-void SysTick_Handler(){                                 
-	//Milisecond Source
-	SysTick->CTRL &= ~(1<<16);
-}
-
-
 //EEPROM:
-void SaveData(uint32_t * State){
-	//uint32_t data[EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t)];
-	if (gEEPROMTypeAEraseFlag == 1) {
-		// In this demo, when the sector is full, it will be erased immediately
-		EEPROM_TypeA_eraseLastSector();
-		gEEPROMTypeAEraseFlag = 0;
-	}
-	//EEPROM_TypeA_eraseLastSector();
-	
-	//Note: Starting from 1;
-	//EEPROMEmulationBuffer[1] = [Contents];
-	//EEPROMEmulationBuffer[1] = utick;
-	
-	
-	//*State = EEPROM_TypeA_writeData(data);
-	*State = EEPROM_TypeA_writeData(EEPROMEmulationBuffer);
-	if (*State != EEPROM_EMULATION_WRITE_OK) {
-		__BKPT(0);
-	}
+/**
+ * @brief Store the IMU calibration in the emulated EEPROM
+ * @param calib The calibration (MPU6500_getCalib)
+ * @return The EEPROMKV status
+ * @details Committed at once with any other changed setting, a calibration is worth keeping
+ *          even if the board is switched off right after.
+ */
+uint32_t SaveIMUCalib(const struct MPUCalib *calib)
+{
+	uint8_t status = Settings_set(EEPROM_KEY_IMU_CALIB, calib, sizeof(*calib));
+	return status != EEPROM_KV_OK ? status : Settings_sync();
 }
-	
-void LoadData(){
-	EEPROM_TypeA_readData(EEPROMEmulationBuffer);
-	//[Contents] = EEPROMEmulationBuffer[1]...;
-	//utick = EEPROMEmulationBuffer[1];
-	
+
+/**
+ * @brief Read the IMU calibration from the key-value store
+ * @param calib Filled with the stored calibration
+ * @return 1 if a calibration was stored, 0 otherwise
+ */
+uint8_t LoadIMUCalib(struct MPUCalib *calib)
+{
+	return Settings_get(EEPROM_KEY_IMU_CALIB, calib, sizeof(*calib)) == sizeof(*calib);
 }
-*/
 
 
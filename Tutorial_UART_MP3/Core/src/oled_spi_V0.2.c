@@ -10,8 +10,21 @@
  #include "oledfont.h"
  #include <string.h>
  
- // OLED display buffer
- u8 OLED_GRAM[130][8];
+ // OLED display buffers: drawing goes to OLED_GRAM (back) while the other one is flushed by OLED_Present
+ static u8 OLED_FrameBuf[2][130][8];
+ u8 (*OLED_GRAM)[8] = OLED_FrameBuf[0];
+ // Pages of OLED_GRAM changed since the last OLED_Present, one bit per page
+ static u8 OLED_DirtyPages = 0xFF;
+ 
+ // Background flush state, owned by SPI_OLED_INST_IRQHandler while busy is set
+ static struct
+ {
+     u8 (*frame)[8]; // front buffer on the wire
+     volatile u8 busy;
+     u8 pages;       // pages still to send
+     u8 page;        // page being sent
+     u8 column;      // next column to queue
+ } OLED_Flush;
  
  /**
   * @brief Write a byte to the OLED display
@@ -21,6 +34,8 @@
   */
  void OLED_WR_Byte(u8 dat, u8 cmd)
  {
+     if (OLED_Flush.busy)
+         OLED_WaitFlush();
      if (cmd)
      {
          OLED_DC_Set();
@@ -87,7 +102,17 @@
          for (n = 0; n < 128; n++)
              OLED_WR_Byte(0, OLED_DATA);
      }
-     memset(OLED_GRAM, 0, sizeof(OLED_GRAM));
+     OLED_ClearBuffer();
+ }
+ 
+ /**
+  * @brief Clear the OLED display buffer only
+  * @details The panel is left untouched until the next OLED_Refresh or OLED_Present.
+  */
+ void OLED_ClearBuffer(void)
+ {
+     memset(OLED_GRAM, 0, sizeof(OLED_FrameBuf[0]));
+     OLED_DirtyPages = 0xFF;
  }
  
  /**
@@ -238,6 +263,29 @@
      }
  }
  
+ /**
+  * @brief Draw a string into the OLED display buffer
+  * @param x The x-coordinate (0-127)
+  * @param page The page (0-7), the text fills its 8 pixel rows
+  * @param str The string to draw
+  * @details 6x8 font, 6 pixels per character, clipped at the right edge; characters outside
+  *          the font are drawn as spaces. Unlike OLED_ShowString the text goes to OLED_GRAM, so
+  *          it appears with the rest of the frame after the next OLED_Refresh or OLED_Present.
+  */
+ void OLED_DrawString(u8 x, u8 page, const char *str)
+ {
+     unsigned char c, i;
+     for (; *str && x < Max_Column; str++)
+     {
+         c = *str - ' ';
+         if (*str < ' ' || c >= sizeof(F6x8) / sizeof(F6x8[0]))
+             c = 0;
+         for (i = 0; i < 6 && x < Max_Column; i++)
+             OLED_GRAM[x++][page] = F6x8[c][i];
+     }
+     OLED_DirtyPages |= 1 << page;
+ }
+
  /**
   * @brief Display a Chinese character at the specified position
   * @param x The x-coordinate (0-127)
@@ -290,6 +338,112 @@
      }
  }
  
+ /**
+  * @brief RLE stream state, see oledrle.py for the token format
+  */
+ typedef struct
+ {
+     const unsigned char *src; // Next token or payload byte
+     u8 value;                 // Byte produced by the current run
+     u8 remain;                // Bytes left in the current token
+     u8 literal;               // 1 while copying a literal token
+ } OLED_RLE_Stream;
+ 
+ /**
+  * @brief Fetch the next decoded byte from an RLE stream
+  * @param s The stream state
+  * @return The decoded byte
+  * @details Runs may cross page boundaries, so the state is kept between calls.
+  */
+ static inline u8 OLED_RLE_Next(OLED_RLE_Stream *s)
+ {
+     if (s->remain == 0)
+     {
+         u8 tok = *s->src++;
+         if (tok < 0x80)
+         {
+             s->literal = 1;
+             s->remain = tok + 1;
+         }
+         else if (tok < 0xC0)
+         {
+             s->literal = 0;
+             s->value = 0;
+             s->remain = (tok & 0x3F) + 1;
+         }
+         else
+         {
+             s->literal = 0;
+             s->value = *s->src++;
+             s->remain = (tok & 0x3F) + 2;
+         }
+     }
+     s->remain--;
+     return s->literal ? *s->src++ : s->value;
+ }
+ 
+ /**
+  * @brief Decode an RLE stream into a linear buffer
+  * @param RLE The compressed asset
+  * @param dst The destination buffer (e.g. a DMA buffer)
+  * @param len The number of decoded bytes to produce
+  * @details The buffer receives page bytes in the same order as OLED_DrawBMP consumes them.
+  */
+ void OLED_RLE_Decode(const unsigned char RLE[], u8 *dst, uint16_t len)
+ {
+     OLED_RLE_Stream s = {RLE, 0, 0, 0};
+     while (len--)
+         *dst++ = OLED_RLE_Next(&s);
+ }
+ 
+ /**
+  * @brief Decode an RLE image into the OLED display buffer
+  * @param x0 The starting x-coordinate
+  * @param y0 The starting page
+  * @param x1 The ending x-coordinate
+  * @param y1 The ending page
+  * @param RLE The compressed image data
+  * @details The image appears on the panel after the next OLED_Refresh or OLED_Present.
+  */
+ void OLED_DecodeRLE(unsigned char x0, unsigned char y0, unsigned char x1, unsigned char y1, const unsigned char RLE[])
+ {
+     OLED_RLE_Stream s = {RLE, 0, 0, 0};
+     unsigned char x, y;
+ 
+     for (y = y0; y < y1; y++)
+     {
+         for (x = x0; x < x1; x++)
+         {
+             OLED_GRAM[x][y] = OLED_RLE_Next(&s);
+         }
+         OLED_DirtyPages |= 1 << y;
+     }
+ }
+ 
+ /**
+  * @brief Draw an RLE image on the OLED display
+  * @param x0 The starting x-coordinate
+  * @param y0 The starting y-coordinate
+  * @param x1 The ending x-coordinate
+  * @param y1 The ending y-coordinate
+  * @param RLE The compressed image data
+  * @details Same placement as OLED_DrawBMP, but the image is decoded while it is streamed to the panel.
+  */
+ void OLED_DrawRLE(unsigned char x0, unsigned char y0, unsigned char x1, unsigned char y1, const unsigned char RLE[])
+ {
+     OLED_RLE_Stream s = {RLE, 0, 0, 0};
+     unsigned char x, y;
+ 
+     for (y = y0; y < y1; y++)
+     {
+         OLED_Set_Pos(x0, y + (!YOFFSET));
+         for (x = x0; x < x1; x++)
+         {
+             OLED_WR_Byte(OLED_RLE_Next(&s), OLED_DATA);
+         }
+     }
+ }
+ 
  /**
   * @brief Invert the display colors
   * @param i The inversion flag (0 for normal, 1 for inverted)
@@ -329,22 +483,17 @@
  /**
   * @brief Refresh the OLED display
   * @details This function refreshes the OLED display by updating the display buffer.
+  *          Blocking; waits for a background flush started by OLED_Present first.
   */
  void OLED_Refresh(void)
  {
      u8 i, n;
+     OLED_WaitFlush();
      for (i = 0; i < 8; i++)
      {
          OLED_WR_Byte(0xb0 + i, OLED_CMD); // Set page address
-         OLED_WR_Byte(0x00, OLED_CMD);     // Set lower column address
-         OLED_WR_Byte(0x10, OLED_CMD);     // Set higher column address
-         while (DL_SPI_isBusy(SPI_OLED_INST)){}
-         DL_SPI_transmitData8(SPI_OLED_INST, 0x78);
-         while (DL_SPI_isBusy(SPI_OLED_INST)){}
-         DL_SPI_transmitData8(SPI_OLED_INST, 0x78);
-         while (DL_SPI_isBusy(SPI_OLED_INST)){}
-         DL_SPI_transmitData8(SPI_OLED_INST, 0x40);
-         while (DL_SPI_isBusy(SPI_OLED_INST)){}
+         OLED_WR_Byte(XLevelL, OLED_CMD);  // Set lower column address
+         OLED_WR_Byte(XLevelH, OLED_CMD);  // Set higher column address
          for (n = 0; n < 128; n++)
          {
              DL_SPI_transmitData8(SPI_OLED_INST, OLED_GRAM[n][i]);
@@ -353,6 +502,149 @@
      }
  }
  
+ /**
+  * @brief Start sending the next page of the front buffer, or finish the flush
+  * @details The page address commands go out with DC low; DC may only be raised once
+  *          they have left the shift register, so the data phase starts from the IDLE interrupt.
+  */
+ static void OLED_FlushNextPage(void)
+ {
+     while (OLED_Flush.pages && !(OLED_Flush.pages & (1 << OLED_Flush.page)))
+         OLED_Flush.page++;
+     if (!OLED_Flush.pages)
+     {
+         DL_SPI_disableInterrupt(SPI_OLED_INST, DL_SPI_INTERRUPT_IDLE | DL_SPI_INTERRUPT_TX);
+         OLED_Flush.busy = 0;
+         return;
+     }
+     OLED_Flush.pages &= ~(1 << OLED_Flush.page);
+     OLED_Flush.column = 0;
+     OLED_DC_Clr();
+     DL_SPI_transmitData8(SPI_OLED_INST, 0xb0 + OLED_Flush.page);
+     DL_SPI_transmitData8(SPI_OLED_INST, XLevelL);
+     DL_SPI_transmitData8(SPI_OLED_INST, XLevelH);
+     DL_SPI_clearInterruptStatus(SPI_OLED_INST, DL_SPI_INTERRUPT_IDLE);
+     DL_SPI_enableInterrupt(SPI_OLED_INST, DL_SPI_INTERRUPT_IDLE);
+ }
+ 
+ /**
+  * @brief Queue page data into the TX FIFO until it is full or the page is complete
+  */
+ static void OLED_FlushFill(void)
+ {
+     while (OLED_Flush.column < 128 && !DL_SPI_isTXFIFOFull(SPI_OLED_INST))
+     {
+         DL_SPI_transmitData8(SPI_OLED_INST, OLED_Flush.frame[OLED_Flush.column++][OLED_Flush.page]);
+     }
+     if (OLED_Flush.column == 128)
+     {
+         // Last byte queued: the page is done when the SPI goes idle
+         DL_SPI_disableInterrupt(SPI_OLED_INST, DL_SPI_INTERRUPT_TX);
+         DL_SPI_clearInterruptStatus(SPI_OLED_INST, DL_SPI_INTERRUPT_IDLE);
+         DL_SPI_enableInterrupt(SPI_OLED_INST, DL_SPI_INTERRUPT_IDLE);
+     }
+ }
+ 
+ /**
+  * @brief SPI_OLED interrupt: drives the background flush page by page
+  */
+ void SPI_OLED_INST_IRQHandler(void)
+ {
+     switch (DL_SPI_getPendingInterrupt(SPI_OLED_INST))
+     {
+     case DL_SPI_IIDX_IDLE:
+         if (OLED_Flush.column == 0)
+         {
+             // Page address sent, stream the page data
+             OLED_DC_Set();
+             DL_SPI_disableInterrupt(SPI_OLED_INST, DL_SPI_INTERRUPT_IDLE);
+             DL_SPI_clearInterruptStatus(SPI_OLED_INST, DL_SPI_INTERRUPT_TX);
+             DL_SPI_enableInterrupt(SPI_OLED_INST, DL_SPI_INTERRUPT_TX);
+             OLED_FlushFill();
+         }
+         else
+         {
+             OLED_FlushNextPage();
+         }
+         break;
+     case DL_SPI_IIDX_TX:
+         OLED_FlushFill();
+         break;
+     default:
+         break;
+     }
+ }
+ 
+ /**
+  * @brief Check whether a background flush is still on the wire
+  * @return 1 while OLED_Present is sending a frame, 0 otherwise
+  */
+ u8 OLED_IsFlushing(void)
+ {
+     return OLED_Flush.busy;
+ }
+ 
+ /**
+  * @brief Wait for the background flush to finish
+  * @details Sleeps between interrupts; PRIMASK is held around the check so the last
+  *          flush interrupt cannot slip in between the test and the WFI.
+  */
+ void OLED_WaitFlush(void)
+ {
+     __disable_irq();
+     while (OLED_Flush.busy)
+     {
+         __WFI();
+         __enable_irq();
+         __disable_irq();
+     }
+     __enable_irq();
+ }
+ 
+ /**
+  * @brief Show the back buffer and start drawing the next frame
+  * @details Waits for the previous frame to leave the wire, swaps the buffers and sends the
+  *          pages changed since the last call in the background. OLED_GRAM then points to the
+  *          other buffer, so frame N+1 can be built while frame N is transmitted. The swap only
+  *          happens once the flush interrupt has gone quiet, which keeps it tear-free.
+  *          With OLED_COPY_FORWARD the changed pages are copied into the new back buffer so it
+  *          holds the frame just presented; otherwise it keeps the previous frame's contents
+  *          and the application is expected to redraw everything.
+  */
+ void OLED_Present(void)
+ {
+     u8 pages, x, y;
+     OLED_WaitFlush();
+ 
+     pages = OLED_DirtyPages;
+     OLED_Flush.frame = OLED_GRAM;
+     OLED_GRAM = (OLED_GRAM == OLED_FrameBuf[0]) ? OLED_FrameBuf[1] : OLED_FrameBuf[0];
+ #if OLED_COPY_FORWARD
+     for (y = 0; y < 8; y++)
+     {
+         if (pages & (1 << y))
+         {
+             for (x = 0; x < 130; x++)
+                 OLED_GRAM[x][y] = OLED_Flush.frame[x][y];
+         }
+     }
+     OLED_DirtyPages = 0;
+ #else
+     (void)x;
+     (void)y;
+     // The new back buffer is one frame behind on these pages
+     OLED_DirtyPages = pages;
+ #endif
+ 
+     if (pages)
+     {
+         OLED_Flush.pages = pages;
+         OLED_Flush.page = 0;
+         OLED_Flush.busy = 1;
+         OLED_FlushNextPage();
+     }
+ }
+ 
  /**
   * @brief Draw a point on the OLED display
   * @param x The x-coordinate (0-127)
@@ -366,6 +658,7 @@
      i = y / 8;
      m = y % 8;
      n = 1 << m;
+     OLED_DirtyPages |= 1 << i;
      if (t)
      {
          OLED_GRAM[x][i] |= n;
@@ -481,6 +774,7 @@
      OLED_RST_Clr();
      delay_cycles(CPU_Frq * 100);
      OLED_RST_Set();
+     NVIC_EnableIRQ(SPI_OLED_INST_INT_IRQN); // Background flush, see OLED_Present
  
      OLED_WR_Byte(0xAE, OLED_CMD); // Turn off OLED panel
      OLED_WR_Byte(0x02, OLED_CMD); // Set low column address
@@ -0,0 +1,250 @@
+"""
+Convert bitmaps into the OLED RLE asset format used by OLED_DrawRLE/OLED_DecodeRLE.
+
+Input:  PBM (P1/P4), PNG (8-bit gray/RGB/RGBA/palette, 1/2/4/8-bit gray) or an
+        existing page-byte C array, e.g. "Core/inc/oledpicture.h:Genshin".
+Output: C arrays for oledpicture.h and a per-asset report (flash savings, tokens,
+        estimated decode time on the MSPM0G3507 at 80 MHz).
+
+Stream format (one byte-stream per asset, pages top to bottom, columns left to right):
+    0x00-0x7F  literal:     the next (n + 1) bytes are copied as-is   (1..128)
+    0x80-0xBF  zero run:    (n & 0x3F) + 1 blank bytes, no payload   (1..64)
+    0xC0-0xFF  repeat run:  the next byte repeated (n & 0x3F) + 2x   (2..65)
+
+Usage:
+    python oledrle.py logo.png --name Logo
+    python oledrle.py Core/inc/oledpicture.h:Genshin --width 110 --name Genshin_RLE
+"""
+import argparse
+import re
+import struct
+import sys
+import zlib
+
+LITERAL_MAX = 128
+ZERO_RUN_MAX = 64
+REPEAT_MIN, REPEAT_MAX = 2, 65
+
+# Rough cost model of OLED_DecodeRLE on the Cortex-M0+ (cycles); the exact figure is
+# printed on target when PROFILE_REPORT is enabled in main.c.
+CYCLES_PER_TOKEN = 14
+CYCLES_PER_BYTE = 9
+CPU_HZ = 80000000
+
+
+def read_pbm(path):
+    data = open(path, 'rb').read()
+    tokens, pos = [], 0
+    # Header: magic, width, height; comments start with '#'.
+    while len(tokens) < 3:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b'#':
+            while data[pos:pos + 1] not in (b'\n', b''):
+                pos += 1
+            continue
+        start = pos
+        while not data[pos:pos + 1].isspace():
+            pos += 1
+        tokens.append(data[start:pos])
+    magic, w, h = tokens[0], int(tokens[1]), int(tokens[2])
+    pos += 1
+    pixels = []
+    if magic == b'P1':
+        bits = [c for c in data[pos:].decode('ascii') if c in '01']
+        for y in range(h):
+            pixels.append([bits[y * w + x] == '1' for x in range(w)])
+    elif magic == b'P4':
+        stride = (w + 7) // 8
+        for y in range(h):
+            row = data[pos + y * stride:pos + (y + 1) * stride]
+            pixels.append([bool(row[x >> 3] & (0x80 >> (x & 7))) for x in range(w)])
+    else:
+        sys.exit('%s: unsupported PBM type %r' % (path, magic))
+    return w, h, pixels
+
+
+def read_png(path):
+    data = open(path, 'rb').read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        sys.exit('%s: not a PNG file' % path)
+    pos, idat, palette = 8, b'', None
+    while pos < len(data):
+        length, ctype = struct.unpack('>I4s', data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        if ctype == b'IHDR':
+            w, h, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif ctype == b'PLTE':
+            palette = [chunk[i:i + 3] for i in range(0, len(chunk), 3)]
+        elif ctype == b'IDAT':
+            idat += chunk
+        pos += 12 + length
+    if interlace:
+        sys.exit('%s: interlaced PNG is not supported' % path)
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}[color]
+    bpp = max(1, channels * depth // 8)
+    stride = (w * channels * depth + 7) // 8
+    raw, prev, rows = zlib.decompress(idat), bytearray(stride), []
+    for y in range(h):
+        ftype = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for i in range(stride):
+            a = line[i - bpp] if i >= bpp else 0
+            b, c = prev[i], prev[i - bpp] if i >= bpp else 0
+            if ftype == 1:
+                line[i] = (line[i] + a) & 0xFF
+            elif ftype == 2:
+                line[i] = (line[i] + b) & 0xFF
+            elif ftype == 3:
+                line[i] = (line[i] + ((a + b) >> 1)) & 0xFF
+            elif ftype == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                line[i] = (line[i] + pred) & 0xFF
+        rows.append(line)
+        prev = line
+    pixels = []
+    for line in rows:
+        row = []
+        for x in range(w):
+            if depth < 8:
+                shift = 8 - depth - (x * depth) % 8
+                v = (line[x * depth // 8] >> shift) & ((1 << depth) - 1)
+                lum = palette[v][1] if color == 3 else v * 255 // ((1 << depth) - 1)
+            elif color == 3:
+                r, g, b = palette[line[x]]
+                lum = (r * 299 + g * 587 + b * 114) // 1000
+            elif color in (0, 4):
+                lum = line[x * channels * depth // 8]
+            else:
+                o = x * channels
+                lum = (line[o] * 299 + line[o + 1] * 587 + line[o + 2] * 114) // 1000
+            # Dark ink on a light background becomes a lit pixel.
+            row.append(lum < 128)
+        pixels.append(row)
+    return w, h, pixels
+
+
+def read_c_array(spec, width):
+    path, name = spec.rsplit(':', 1)
+    text = open(path, encoding='utf-8', errors='replace').read()
+    m = re.search(r'\b%s\s*\[\s*\]\s*=\s*\{(.*?)\}' % re.escape(name), text, re.S)
+    if not m:
+        sys.exit('%s: array %s not found' % (path, name))
+    if not width:
+        sys.exit('--width is required when reading a C array')
+    return width, bytes(int(v, 16) for v in re.findall(r'0x[0-9A-Fa-f]{2}', m.group(1)))
+
+
+def to_pages(w, h, pixels):
+    """Pack rows into SSD1306/SH1106 page bytes (LSB is the top pixel)."""
+    pages = (h + 7) // 8
+    out = bytearray()
+    for p in range(pages):
+        for x in range(w):
+            byte = 0
+            for bit in range(8):
+                y = p * 8 + bit
+                if y < h and pixels[y][x]:
+                    byte |= 1 << bit
+            out.append(byte)
+    return bytes(out)
+
+
+def encode(raw):
+    out, tokens, i, n = bytearray(), 0, 0, len(raw)
+    while i < n:
+        run = 1
+        while i + run < n and raw[i + run] == raw[i] and run < (ZERO_RUN_MAX if raw[i] == 0 else REPEAT_MAX):
+            run += 1
+        if raw[i] == 0:
+            out.append(0x80 | (run - 1))
+            i += run
+        elif run >= REPEAT_MIN:
+            out += bytes((0xC0 | (run - REPEAT_MIN), raw[i]))
+            i += run
+        else:
+            # Literal until a zero byte or a repeat of 3+ makes a run token cheaper.
+            start = i
+            while i < n and i - start < LITERAL_MAX and raw[i] != 0:
+                if i + 2 < n and raw[i] == raw[i + 1] == raw[i + 2]:
+                    break
+                i += 1
+            out.append(i - start - 1)
+            out += raw[start:i]
+        tokens += 1
+    return bytes(out), tokens
+
+
+def decode(stream, length):
+    out, i = bytearray(), 0
+    while len(out) < length:
+        tok = stream[i]
+        i += 1
+        if tok < 0x80:
+            out += stream[i:i + tok + 1]
+            i += tok + 1
+        elif tok < 0xC0:
+            out += bytes((tok & 0x3F) + 1)
+        else:
+            out += bytes((stream[i],)) * ((tok & 0x3F) + REPEAT_MIN)
+            i += 1
+    return bytes(out[:length])
+
+
+def emit_c(name, width, pages, raw, stream):
+    lines = ['//%s: %dx%d px (%d pages), %d -> %d bytes; draw with OLED_DrawRLE(x0,y0,x0+%d,y0+%d,%s);'
+             % (name, width, pages * 8, pages, len(raw), len(stream), width, pages, name),
+             'const unsigned char %s[] = {' % name]
+    for i in range(0, len(stream), 16):
+        lines.append(','.join('0x%02X' % b for b in stream[i:i + 16]) + ',')
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('inputs', nargs='+', help='.pbm/.png file or header.h:ArrayName')
+    ap.add_argument('--name', action='append', help='C array name per input (default: file stem + _RLE)')
+    ap.add_argument('--width', type=int, help='column count when reading a page-byte C array')
+    ap.add_argument('--invert', action='store_true', help='swap lit and blank pixels')
+    ap.add_argument('-o', '--output', help='write C arrays here instead of stdout')
+    args = ap.parse_args()
+
+    arrays, report = [], []
+    for idx, spec in enumerate(args.inputs):
+        if spec.lower().endswith('.pbm'):
+            w, h, px = read_pbm(spec)
+            raw = to_pages(w, h, px)
+        elif spec.lower().endswith('.png'):
+            w, h, px = read_png(spec)
+            raw = to_pages(w, h, px)
+        else:
+            w, raw = read_c_array(spec, args.width)
+        if args.invert:
+            raw = bytes(b ^ 0xFF for b in raw)
+        pages = len(raw) // w
+        default = re.sub(r'\W', '_', spec.rsplit(':', 1)[-1].rsplit('/', 1)[-1].rsplit('.', 1)[0]) + '_RLE'
+        name = args.name[idx] if args.name and idx < len(args.name) else default
+        stream, tokens = encode(raw)
+        if decode(stream, len(raw)) != raw:
+            sys.exit('%s: round-trip check failed' % name)
+        arrays.append(emit_c(name, w, pages, raw, stream))
+        cycles = tokens * CYCLES_PER_TOKEN + len(raw) * CYCLES_PER_BYTE
+        report.append((name, len(raw), len(stream), tokens, cycles))
+
+    text = '\n\n'.join(arrays) + '\n'
+    if args.output:
+        open(args.output, 'w').write(text)
+    else:
+        print(text)
+
+    print('%-16s %8s %8s %8s %7s %8s %9s' % ('asset', 'raw', 'rle', 'saved', 'ratio', 'tokens', 'decode'), file=sys.stderr)
+    for name, raw_len, rle_len, tokens, cycles in report:
+        print('%-16s %8d %8d %8d %6.1f%% %8d %7.1fus' % (name, raw_len, rle_len, raw_len - rle_len,
+              100.0 * rle_len / raw_len, tokens, cycles * 1e6 / CPU_HZ), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,201 @@
+/*
+ * @file container_bench.c
+ * @brief Host micro-benchmark of the typed containers (Containers.h) against Vector.c
+ * @details For uint8_t, struct MusicNote (4 bytes) and struct MPUSample (16 bytes), fills a
+ *          vector of BENCH_ELEMS elements element by element and reads it back, once through
+ *          vector_push_back / vector_at and once through VECTOR_DEFINE, then moves the same
+ *          elements through a QUEUE_DEFINE queue one at a time and in BENCH_BLOCK-element
+ *          write / read calls, copying each element out again, and through a RING_DEFINE ring
+ *          that is filled once and then overwritten by pushOverwrite before it is read back
+ *          with peek. Reported is the host time per element, and every way must copy the
+ *          elements out unchanged. A small ring is also driven past 65535 pushes, so that
+ *          its free-running indices wrap, and checked after every step: overwrite when full,
+ *          peek past the newest, push on a full ring and pop order. The host CPU is not the Cortex-M0+, so the ratios matter more than
+ *          the times: Vector.c pays a call and a byte loop per element on either.
+ *
+ *          Build and run from the project root:
+ *              gcc -O2 -std=gnu11 -D__MSPM0G3507__ -Wall -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast \
+ *                  -Isim -ICore/inc -IDriver -IDriver/CMSIS/Core/Include \
+ *                  -o container_bench sim/container_bench.c Core/src/Vector.c
+ *              ./container_bench [rounds, default 2000]
+ * @author Ldk, InnoLegend team.
+ */
+#include "Containers.h"
+#include "MusicPlayer.h"
+#include "MPU6500_SPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ELEMS 1024		//Elements per round, = queue capacity;
+#define BENCH_BLOCK 64			//Elements per queue write / read call;
+
+static uint32_t Bench_Failed = 0;
+
+static uint64_t Bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void Bench_print(const char *type, const char *what, uint64_t ns, uint32_t rounds, uint64_t baseNs)
+{
+	double per = (double)ns / rounds / BENCH_ELEMS;
+	if (baseNs)
+		printf("  %-16s %-30s %7.2f ns/element  (%.1fx)\n", type, what, per, (double)baseNs / ns);
+	else
+		printf("  %-16s %-30s %7.2f ns/element\n", type, what, per);
+}
+
+/**
+ * @brief Run the benchmark for one element type
+ * @details Each way copies the elements into tag##_Out, which must then equal tag##_Src;
+ */
+#define BENCH_TYPE(tag, type) \
+VECTOR_DEFINE(tag##Vector, type) \
+QUEUE_DEFINE(tag##Queue, type, BENCH_ELEMS) \
+RING_DEFINE(tag##Ring, type, BENCH_ELEMS) \
+static type tag##_Src[BENCH_ELEMS], tag##_Buf[BENCH_ELEMS], tag##_Out[BENCH_ELEMS]; \
+static tag##Queue tag##_Queue; \
+static tag##Ring tag##_Ring; \
+static void Bench_##tag##Check(const char *what) \
+{ \
+	if (memcmp(tag##_Out, tag##_Src, sizeof(tag##_Src))) \
+	{ \
+		++Bench_Failed; \
+		printf("  FAILED: %s %s copied wrong\n", #type, what); \
+	} \
+	memset(tag##_Out, 0, sizeof(tag##_Out)); \
+} \
+static void Bench_##tag(uint32_t rounds) \
+{ \
+	Vector vec; \
+	tag##Vector tv; \
+	type *elem; \
+	uint32_t r, i, n; \
+	uint64_t t, vectorNs; \
+	for (i = 0; i < sizeof(tag##_Src); i++) \
+		((uint8_t *)tag##_Src)[i] = rand(); \
+	t = Bench_ns(); \
+	for (r = 0; r < rounds; r++) \
+	{ \
+		vector_init(&vec, tag##_Buf, sizeof(type), BENCH_ELEMS); \
+		for (i = 0; i < BENCH_ELEMS; i++) \
+			vector_push_back(&vec, &tag##_Src[i]); \
+		for (i = 0; i < vector_size(&vec); i++) \
+			if (vector_at(&vec, i, (void **)&elem) == VECTOR_OK) \
+				tag##_Out[i] = *elem; \
+	} \
+	vectorNs = Bench_ns() - t; \
+	Bench_print(#type, "vector_push_back/vector_at", vectorNs, rounds, 0); \
+	Bench_##tag##Check("Vector"); \
+	t = Bench_ns(); \
+	for (r = 0; r < rounds; r++) \
+	{ \
+		tag##Vector_init(&tv, tag##_Buf, BENCH_ELEMS); \
+		for (i = 0; i < BENCH_ELEMS; i++) \
+			tag##Vector_push(&tv, tag##_Src[i]); \
+		for (i = 0; i < tag##Vector_size(&tv); i++) \
+			tag##_Out[i] = *tag##Vector_at(&tv, i); \
+	} \
+	Bench_print(#type, "VECTOR_DEFINE push/at", Bench_ns() - t, rounds, vectorNs); \
+	Bench_##tag##Check("VECTOR_DEFINE"); \
+	t = Bench_ns(); \
+	for (r = 0; r < rounds; r++) \
+	{ \
+		tag##Queue_init(&tag##_Queue); \
+		for (i = 0; i < BENCH_ELEMS; i++) \
+			tag##Queue_push(&tag##_Queue, tag##_Src[i]); \
+		for (i = 0; tag##Queue_pop(&tag##_Queue, &tag##_Out[i]) == VECTOR_OK; i++); \
+	} \
+	Bench_print(#type, "QUEUE_DEFINE push/pop", Bench_ns() - t, rounds, vectorNs); \
+	Bench_##tag##Check("QUEUE_DEFINE push/pop"); \
+	t = Bench_ns(); \
+	for (r = 0; r < rounds; r++) \
+	{ \
+		tag##Queue_init(&tag##_Queue); \
+		for (i = 0; i < BENCH_ELEMS; i += BENCH_BLOCK) \
+			tag##Queue_write(&tag##_Queue, tag##_Src + i, BENCH_BLOCK); \
+		for (i = 0; (n = tag##Queue_read(&tag##_Queue, tag##_Out + i, BENCH_BLOCK)) != 0; i += n); \
+	} \
+	Bench_print(#type, "QUEUE_DEFINE write/read", Bench_ns() - t, rounds, vectorNs); \
+	Bench_##tag##Check("QUEUE_DEFINE write/read"); \
+	t = Bench_ns(); \
+	for (r = 0; r < rounds; r++) \
+	{ \
+		tag##Ring_init(&tag##_Ring); \
+		for (i = 0; i < BENCH_ELEMS; i++) \
+			tag##Ring_pushOverwrite(&tag##_Ring, tag##_Src[BENCH_ELEMS - 1 - i]); \
+		for (i = 0; i < BENCH_ELEMS; i++) \
+			tag##Ring_pushOverwrite(&tag##_Ring, tag##_Src[i]); \
+		for (i = 0; i < BENCH_ELEMS && (elem = tag##Ring_peek(&tag##_Ring, i)) != 0; i++) \
+			tag##_Out[i] = *elem; \
+	} \
+	Bench_print(#type, "RING_DEFINE pushOverwrite/peek", Bench_ns() - t, rounds, vectorNs); \
+	Bench_##tag##Check("RING_DEFINE pushOverwrite/peek"); \
+}
+
+#define WRAP_RING 8			//Capacity of the ring of Bench_ringWrap;
+#define WRAP_PUSHES 70000	//> 65536, so the uint16_t indices wrap;
+
+RING_DEFINE(WrapRing, uint16_t, WRAP_RING)
+
+static void Bench_wrapCheck(uint8_t ok, const char *what, uint32_t n)
+{
+	if (ok)
+		return;
+	if (++Bench_Failed <= 10)
+		printf("  FAILED: RING_DEFINE %s, step %u\n", what, n);
+}
+
+/**
+ * @brief Check a small ring against the expected contents after every step
+ */
+static void Bench_ringWrap()
+{
+	static WrapRing ring;
+	uint32_t n, count;
+	uint16_t v, i;
+	WrapRing_init(&ring);
+	for (n = 0; n < WRAP_PUSHES; n++)
+	{
+		WrapRing_pushOverwrite(&ring, (uint16_t)n);
+		count = n < WRAP_RING ? n + 1 : WRAP_RING;
+		Bench_wrapCheck(WrapRing_count(&ring) == count, "count after pushOverwrite", n);
+		for (i = 0; i < count; i++)
+			Bench_wrapCheck(WrapRing_peek(&ring, i) && *WrapRing_peek(&ring, i) == (uint16_t)(n + 1 - count + i),
+				"peek after pushOverwrite", n);
+		Bench_wrapCheck(WrapRing_peek(&ring, count) == 0, "peek past the newest", n);
+	}
+	Bench_wrapCheck(WrapRing_push(&ring, 0) == VECTOR_FULL, "push on a full ring", n);
+	for (i = 0; i < WRAP_RING; i++)
+		Bench_wrapCheck(WrapRing_pop(&ring, &v) == VECTOR_OK && v == (uint16_t)(n - WRAP_RING + i), "pop order", n);
+	Bench_wrapCheck(WrapRing_pop(&ring, &v) == VECTOR_EMPTY && WrapRing_count(&ring) == 0, "pop on an empty ring", n);
+
+	//push / pop with 3 elements in flight, the indices wrap again;
+	for (n = 0; n < WRAP_PUSHES; n++)
+	{
+		Bench_wrapCheck(WrapRing_push(&ring, (uint16_t)n) == VECTOR_OK, "push", n);
+		if (n >= 2)
+			Bench_wrapCheck(WrapRing_pop(&ring, &v) == VECTOR_OK && v == (uint16_t)(n - 2), "push / pop order", n);
+	}
+	printf("  RING_DEFINE(%u) %u pushOverwrite and %u push / pop steps checked\n", WRAP_RING, WRAP_PUSHES, WRAP_PUSHES);
+}
+
+BENCH_TYPE(Byte, uint8_t)
+BENCH_TYPE(Note, struct MusicNote)
+BENCH_TYPE(Sample, struct MPUSample)
+
+int main(int argc, char **argv)
+{
+	uint32_t rounds = argc > 1 ? strtoul(argv[1], 0, 0) : 2000;
+	srand(1);
+	printf("%u rounds of %u elements:\n", rounds, BENCH_ELEMS);
+	Bench_Byte(rounds);
+	Bench_Note(rounds);
+	Bench_Sample(rounds);
+	Bench_ringWrap();
+	return Bench_Failed > 255 ? 255 : Bench_Failed;
+}
@@ -0,0 +1,215 @@
+/*
+ * @file eeprom_bench.c
+ * @brief Host benchmark of the EEPROM Type A mount (active record search)
+ * @details Builds eeprom_emulation_type_a.c on Linux against the simulated flash (see
+ *          flash_sim_hw.h) and, for 2 to 64 sectors and each record size, fills random
+ *          images through EEPROM_TypeA_writeData (sometimes leaving the previous sector
+ *          unerased, as after a reset before the erase). Each image is mounted with
+ *          EEPROM_TypeA_searchCheck + EEPROM_TypeA_readData and with the linear header walk
+ *          the library used before, which must find the same active record. Reported are
+ *          the header words read (each one is a flash access on the MCU) and host time.
+ *          A second table shows the write amplification of each record size: a value of a
+ *          given size is rewritten over and over in 2 sectors, either as a full record
+ *          (EEPROM_TypeA_writeData) or as just its own words (EEPROM_TypeA_writeRecord), and
+ *          the flash bytes programmed per value byte, the sector erases per 1000 writes and
+ *          the writes until a sector reaches BENCH_ENDURANCE erases are reported.
+ *
+ *          Build and run from the project root:
+ *              gcc -O2 -std=gnu11 -D__MSPM0G3507__ -Wall -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast \
+ *                  -include sim/flash_sim_hw.h -ICore/inc -IDriver -IDriver/CMSIS/Core/Include \
+ *                  -o eeprom_bench sim/eeprom_bench.c sim/flash_sim.c Core/src/eeprom_emulation_type_a.c
+ *              ./eeprom_bench [images per configuration, default 200]
+ * @author Ldk, InnoLegend team.
+ */
+#include "eeprom_emulation_type_a.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MOUNTS 20		//Mounts per image for the timing;
+#define BENCH_WRITES 20000	//Writes per amplification run;
+#define BENCH_ENDURANCE 10000	//Erase cycles of a sector outside the lower 32 KB of flash (MSPM0G3507 datasheet);
+
+static uint32_t gBenchData[256 / sizeof(uint32_t)];
+
+static uint64_t Bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief The previous search: every header of every sector, last Active in address order
+ * @return The active record address, 0 if none
+ */
+static uint32_t Bench_linearSearch(uint32_t *data)
+{
+	uint32_t address = EEPROM_EMULATION_ADDRESS, active = 0;
+	uint32_t w0, w1, sector, record, *src;
+	uint16_t n;
+	for (sector = 0; sector < EEPROM_EMULATION_SECTOR_ACCOUNT; sector++)
+		for (record = 0; record < EEPROM_EMULATION_RECORD_ACCOUNT; record++)
+		{
+			w0 = FlashSim_read32(address);
+			w1 = FlashSim_read32(address + 4);
+			if (w0 == 0x0000ffff && (w1 >> 16) == 0)
+				active = address;
+			address += EEPROM_EMULATION_RECORD_SIZE;
+		}
+	if (active)
+		for (n = 0; n < EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t); n++)
+		{
+			src = (uint32_t *)(uintptr_t)(active + 8 + n * 4);
+			data[n] = *(volatile uint32_t *)src;
+		}
+	return active;
+}
+
+/**
+ * @brief Fill a fresh image with a random number of records
+ */
+static void Bench_fill(void)
+{
+	uint32_t writes, i;
+	FlashSim_init();
+	gActiveRecordAddress = gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
+	gActiveRecordNum = 0;
+	gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
+	gActiveSectorSeq = 0;
+	gEEPROMTypeASearchFlag = gEEPROMTypeAEraseFlag = 0;
+	memset(gEEPROMTypeAEraseCount, 0, sizeof(gEEPROMTypeAEraseCount));
+	writes = 1 + rand() % (3 * EEPROM_EMULATION_SECTOR_ACCOUNT * EEPROM_EMULATION_RECORD_ACCOUNT);
+	for (i = 0; i < writes; i++)
+	{
+		gBenchData[0] = i;
+		if (EEPROM_TypeA_writeData(gBenchData) != EEPROM_EMULATION_WRITE_OK)
+		{
+			printf("write %u failed\n", i);
+			exit(1);
+		}
+		//The last erase is skipped now and then, as if the board was reset before it;
+		if (gEEPROMTypeAEraseFlag && (i + 1 < writes || rand() % 4))
+		{
+			EEPROM_TypeA_eraseLastSector();
+			gEEPROMTypeAEraseFlag = 0;
+		}
+	}
+}
+
+static uint64_t Bench_flashBytes(void)
+{
+	uint64_t words = 0;
+	uint32_t sector;
+	for (sector = 0; sector < FLASH_SIM_SECTORS_MAX; sector++)
+		words += gFlashSimWords[sector];
+	return words * 8;
+}
+
+static uint32_t Bench_erasesMax(void)
+{
+	uint32_t sector, erases = 0;
+	for (sector = 0; sector < FLASH_SIM_SECTORS_MAX; sector++)
+		if (gFlashSimErases[sector] > erases)
+			erases = gFlashSimErases[sector];
+	return erases;
+}
+
+/**
+ * @brief Rewrite a value of a given size, as a full record or as its own words
+ * @return The flash bytes programmed per value byte
+ */
+static double Bench_amplification(uint16_t bytes, uint8_t full)
+{
+	uint32_t i;
+	FlashSim_init();
+	gActiveRecordAddress = gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
+	gActiveRecordNum = 0;
+	gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
+	gActiveSectorSeq = 0;
+	gEEPROMTypeASearchFlag = gEEPROMTypeAEraseFlag = 0;
+	gEEPROMTypeAErasePending = 0;
+	memset(gEEPROMTypeAEraseCount, 0, sizeof(gEEPROMTypeAEraseCount));
+	for (i = 0; i < BENCH_WRITES; i++)
+	{
+		gBenchData[0] = i;
+		if ((full ? EEPROM_TypeA_writeData(gBenchData)
+			: EEPROM_TypeA_writeRecord(gBenchData, (bytes + 3) / 4)) != EEPROM_EMULATION_WRITE_OK)
+		{
+			printf("write %u failed\n", i);
+			exit(1);
+		}
+		EEPROM_TypeA_eraseService();
+	}
+	while (!EEPROM_TypeA_eraseService());
+	return (double)Bench_flashBytes() / ((uint64_t)BENCH_WRITES * bytes);
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t sectors[] = {2, 4, 8, 16, 32, 64};
+	static const uint32_t sizes[] = {256, 128, 64};
+	static const uint16_t values[] = {8, 24, 56, 120, 248};
+	uint32_t images = argc > 1 ? atoi(argv[1]) : 200;
+	uint32_t s, z, i, m, expect, mismatch;
+	uint64_t readsNew, readsOld, nsNew, nsOld, t;
+	double full, own;
+	srand(1);
+	printf("sectors records/sector   header reads (search/linear)   ns per mount (search/linear)\n");
+	for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+		for (s = 0; s < sizeof(sectors) / sizeof(sectors[0]); s++)
+		{
+			gFlashSimSectors = sectors[s];
+			gFlashSimRecordSize = sizes[z];
+			readsNew = readsOld = nsNew = nsOld = 0;
+			mismatch = 0;
+			for (i = 0; i < images; i++)
+			{
+				Bench_fill();
+				expect = gActiveRecordAddress;
+
+				gFlashSimReads = 0;
+				t = Bench_ns();
+				for (m = 0; m < BENCH_MOUNTS; m++)
+				{
+					EEPROM_TypeA_searchCheck();
+					EEPROM_TypeA_readData(gBenchData);
+				}
+				nsNew += Bench_ns() - t;
+				readsNew += gFlashSimReads / BENCH_MOUNTS;
+				if (!gEEPROMTypeASearchFlag || gEEPROMTypeAFormatErrorFlag || gActiveRecordAddress != expect)
+					++mismatch;
+
+				gFlashSimReads = 0;
+				t = Bench_ns();
+				for (m = 0; m < BENCH_MOUNTS; m++)
+					if (Bench_linearSearch(gBenchData) != expect)
+						++mismatch;
+				nsOld += Bench_ns() - t;
+				readsOld += gFlashSimReads / BENCH_MOUNTS;
+			}
+			printf("%7u %15u %14.1f / %-14.1f %14.0f / %-14.0f%s\n",
+				gFlashSimSectors, 1024 / gFlashSimRecordSize,
+				(double)readsNew / images, (double)readsOld / images,
+				(double)nsNew / images / BENCH_MOUNTS, (double)nsOld / images / BENCH_MOUNTS,
+				mismatch ? "  MISMATCH" : "");
+		}
+
+	gFlashSimSectors = 2;
+	printf("\nrecord value   flash bytes/byte (full/own)   erases/1000 writes   writes to %u erases\n",
+		BENCH_ENDURANCE);
+	for (z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++)
+		for (i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		{
+			gFlashSimRecordSize = sizes[z];
+			if (values[i] > EEPROM_EMULATION_DATA_SIZE)
+				continue;
+			full = Bench_amplification(values[i], 1);
+			own = Bench_amplification(values[i], 0);
+			printf("%6u %5u %14.2f / %-12.2f %18.2f %20.3g\n", gFlashSimRecordSize, values[i], full, own,
+				1000.0 * Bench_erasesMax() * gFlashSimSectors / BENCH_WRITES,
+				(double)BENCH_ENDURANCE * BENCH_WRITES / Bench_erasesMax());
+		}
+	return 0;
+}
@@ -0,0 +1,380 @@
+/*
+ * @file eeprom_fuzz.c
+ * @brief Power-failure fuzzing of the EEPROM Type A library and the EEPROMKV store
+ * @details Builds eeprom_emulation_type_a.c and EEPROMKV.c on Linux against the simulated
+ *          flash (see flash_sim_hw.h) and fails the power at random program or erase steps:
+ *          in a write, in the background erase, and in the mount (and its repair) that
+ *          follows a failure. After every failure the RAM state is reset as at boot and the
+ *          store is mounted again; the mount must succeed and leave a clean format, and the
+ *          data must be exactly the state before or after the interrupted operation.
+ *          1. Type A alone, as in the TI example: EEPROM_TypeA_writeData of full records with
+ *             a checkable pattern, EEPROM_TypeA_init (EEPROM_TypeA_repairFormat) to mount.
+ *          2. EEPROMKV batches of puts and deletes, checked against a model of all keys.
+ *          3. Write amplification of EEPROMKV and of full Type A records at this record size,
+ *             without failures (see eeprom_bench for a record size sweep of Type A). The wear
+ *             leveling must keep the sector erase counts within one of each other, and the
+ *             counts EEPROMKV saves must come back at the next mount.
+ *
+ *          Build and run from the project root (record size 64, 128 or 256):
+ *              gcc -O2 -std=gnu11 -D__MSPM0G3507__ -DEEPROM_EMULATION_RECORD_SIZE=256 -Wall \
+ *                  -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast \
+ *                  -include sim/flash_sim_hw.h -ICore/inc -IDriver -IDriver/CMSIS/Core/Include \
+ *                  -o eeprom_fuzz sim/eeprom_fuzz.c sim/flash_sim.c \
+ *                  Core/src/eeprom_emulation_type_a.c Core/src/EEPROMKV.c
+ *              ./eeprom_fuzz [operations per test, default 20000] [seed, default 1] [sectors, default 4]
+ *          The exit code is the number of failed checks (capped at 255).
+ * @author Ldk, InnoLegend team.
+ */
+#include "eeprom_emulation_type_a.h"
+#include "EEPROMKV.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZ_CUT_ONE_IN 4		//Operations (and mounts) with a power failure;
+#define FUZZ_CUT_STEPS 48		//Steps after the start the failure may hit: a record, its headers and an erase;
+#define FUZZ_KEYS 12			//More than EEPROM_KV_BATCH_MAX, so compacted records hold more than a batch;
+#define FUZZ_VALUE_MAX (EEPROM_EMULATION_DATA_SIZE / 8)
+#define FUZZ_BATCH_MAX 3
+#define FUZZ_WA_KEYS 2			//Keys rewritten by the amplification test, all fit at any record size up to 8 sectors;
+#define FUZZ_REPORT_MAX 10		//Failed checks printed per test;
+
+static uint32_t Fuzz_data[EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t)];
+static uint32_t Fuzz_fails, Fuzz_cuts, Fuzz_repairs;
+
+//Model of the key-value store: before and after the operation in progress;
+struct FuzzState{
+	uint8_t value[FUZZ_KEYS][FUZZ_VALUE_MAX];
+	int16_t len[FUZZ_KEYS];		//-1 = not stored;
+};
+static struct FuzzState Fuzz_before, Fuzz_after;
+
+uint32_t SysTime_getCycles(){ return 0; }
+uint32_t SysTime_getMs(){ return 0; }
+
+static void Fuzz_fail(const char *test, uint32_t op, const char *what)
+{
+	if (Fuzz_fails++ < FUZZ_REPORT_MAX)
+		printf("  %s op %u: %s\n", test, op, what);
+}
+
+/**
+ * @brief What a reset leaves: the flash, and RAM at its initial values
+ */
+static void Fuzz_reboot(void)
+{
+	FlashSim_powerOn();
+	gActiveRecordAddress = gNextRecordAddress = EEPROM_EMULATION_ADDRESS;
+	gActiveRecordNum = 0;
+	gActiveSectorNum = EEPROM_EMULATION_ACTIVE_SECTOR_NUM_MIN;
+	gActiveSectorSeq = 0;
+	gEEPROMTypeASearchFlag = gEEPROMTypeAEraseFlag = gEEPROMTypeAFormatErrorFlag = 0;
+	gEEPROMTypeAErasePending = 0;
+	gEEPROMTypeAEraseBusy = 0;
+	memset(gEEPROMTypeAEraseCount, 0, sizeof(gEEPROMTypeAEraseCount));
+}
+
+static void Fuzz_cutMaybe(void)
+{
+	FlashSim_cut(rand() % FUZZ_CUT_ONE_IN ? 0 : 1 + rand() % FUZZ_CUT_STEPS);
+}
+
+/**
+ * @brief The format left by a mount: the active record found, nothing torn, or (EEPROMKV before
+ *        its first record is committed) the whole area erased
+ */
+static uint8_t Fuzz_formatClean(void)
+{
+	uint32_t address = gActiveRecordAddress, i;
+	EEPROM_TypeA_searchCheck();
+	if (!gEEPROMTypeASearchFlag)
+	{
+		for (i = 0; i < EEPROM_EMULATION_SECTOR_ACCOUNT * 1024; i += 4)
+			if (*(const uint32_t *)(uintptr_t)(EEPROM_EMULATION_ADDRESS + i) != 0xFFFFFFFF)
+				return 0;
+		return 1;
+	}
+	return !gEEPROMTypeAFormatErrorFlag && gActiveRecordAddress == address;
+}
+
+/**
+ * @brief Boot with EEPROM_TypeA_init, failing the power again now and then
+ */
+static uint32_t Fuzz_mountTypeA(void)
+{
+	Fuzz_reboot();
+	if (setjmp(gFlashSimPowerFail))
+	{
+		++Fuzz_cuts;
+		Fuzz_reboot();
+	}
+	Fuzz_cutMaybe();
+	EEPROM_TypeA_searchCheck();
+	Fuzz_repairs += gEEPROMTypeAFormatErrorFlag;
+	Fuzz_reboot();
+	if (EEPROM_TypeA_init(Fuzz_data) != EEPROM_EMULATION_INIT_OK)
+	{
+		FlashSim_cut(0);
+		return 0;
+	}
+	FlashSim_cut(0);
+	return 1;
+}
+
+static void Fuzz_fill(uint32_t value)
+{
+	uint16_t i;
+	for (i = 0; i < EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t); i++)
+		Fuzz_data[i] = i ? value * 0x9E3779B9u + i : value;
+}
+
+static uint8_t Fuzz_check(uint32_t value)
+{
+	uint16_t i;
+	for (i = 1; i < EEPROM_EMULATION_DATA_SIZE / sizeof(uint32_t); i++)
+		if (Fuzz_data[i] != value * 0x9E3779B9u + i)
+			return 0;
+	return 1;
+}
+
+/**
+ * @brief Full records through EEPROM_TypeA_writeData, each one the next value of a counter
+ */
+static void Fuzz_typeA(uint32_t ops)
+{
+	static uint32_t op, committed, pending;
+	Fuzz_cuts = Fuzz_repairs = 0;
+	FlashSim_init();
+	Fuzz_reboot();
+	EEPROM_TypeA_init(Fuzz_data);
+	committed = 0;
+	for (op = 0; op < ops; op++)
+	{
+		pending = committed + 1;
+		if (setjmp(gFlashSimPowerFail) == 0)
+		{
+			Fuzz_fill(pending);
+			Fuzz_cutMaybe();
+			if (EEPROM_TypeA_writeData(Fuzz_data) != EEPROM_EMULATION_WRITE_OK)
+				Fuzz_fail("typeA", op, "write failed");
+			if (gEEPROMTypeAEraseFlag)
+			{
+				EEPROM_TypeA_eraseLastSector();
+				gEEPROMTypeAEraseFlag = 0;
+			}
+			FlashSim_cut(0);
+			committed = pending;
+			if (rand() % 16)
+				continue;
+		}
+		else
+			++Fuzz_cuts;
+		//Reset: the value is the committed one, or the one being written;
+		if (!Fuzz_mountTypeA())
+			Fuzz_fail("typeA", op, "mount failed");
+		else if (!Fuzz_formatClean())
+			Fuzz_fail("typeA", op, "format not repaired");
+		else if (committed && ((Fuzz_data[0] != committed && Fuzz_data[0] != pending) || !Fuzz_check(Fuzz_data[0])))
+			Fuzz_fail("typeA", op, "data lost or mixed");
+		else
+			committed = Fuzz_data[0];
+	}
+	printf("typeA: %u writes, %u power failures, %u mounts repaired\n", ops, Fuzz_cuts, Fuzz_repairs);
+}
+
+static uint8_t Fuzz_kvMatches(const struct FuzzState *state)
+{
+	uint8_t value[FUZZ_VALUE_MAX], k;
+	for (k = 0; k < FUZZ_KEYS; k++)
+		if (EEPROMKV_get(k, value, sizeof(value)) != state->len[k]
+			|| (state->len[k] > 0 && memcmp(value, state->value[k], state->len[k])))
+			return 0;
+	return 1;
+}
+
+static uint32_t Fuzz_mountKV(void)
+{
+	Fuzz_reboot();
+	if (setjmp(gFlashSimPowerFail))
+	{
+		++Fuzz_cuts;
+		Fuzz_reboot();
+	}
+	Fuzz_cutMaybe();
+	EEPROM_TypeA_searchCheck();
+	Fuzz_repairs += gEEPROMTypeAFormatErrorFlag;
+	Fuzz_reboot();
+	if (EEPROMKV_init() != EEPROM_EMULATION_INIT_OK)
+	{
+		FlashSim_cut(0);
+		return 0;
+	}
+	FlashSim_cut(0);
+	return 1;
+}
+
+/**
+ * @brief Random batches of puts and deletes, all or none of a batch must survive
+ */
+static void Fuzz_kv(uint32_t ops)
+{
+	static struct EEPROMKVPut puts[FUZZ_BATCH_MAX];
+	static uint32_t op;
+	static uint8_t done, status;
+	uint8_t n, i, j, k;
+	uint16_t used;
+	Fuzz_cuts = Fuzz_repairs = 0;
+	FlashSim_init();
+	Fuzz_reboot();
+	EEPROMKV_init();
+	memset(&Fuzz_before, 0, sizeof(Fuzz_before));
+	for (k = 0; k < FUZZ_KEYS; k++)
+		Fuzz_before.len[k] = -1;
+	for (op = 0; op < ops; op++)
+	{
+		Fuzz_after = Fuzz_before;
+		n = 1 + rand() % FUZZ_BATCH_MAX;
+		for (i = used = 0; i < n; i++)
+		{
+			do
+				k = rand() % FUZZ_KEYS;
+			while (used & 1 << k);
+			used |= 1 << k;
+			puts[i].key = k;
+			puts[i].value = Fuzz_after.value[k];
+			if (rand() % 6 == 0)
+			{
+				puts[i].len = EEPROM_KV_DELETED;
+				Fuzz_after.len[k] = -1;
+				continue;
+			}
+			puts[i].len = rand() % (FUZZ_VALUE_MAX + 1);
+			Fuzz_after.len[k] = puts[i].len;
+			for (j = 0; j < puts[i].len; j++)
+				Fuzz_after.value[k][j] = rand();
+		}
+		done = 0;
+		if (setjmp(gFlashSimPowerFail) == 0)
+		{
+			Fuzz_cutMaybe();
+			status = EEPROMKV_putBatch(puts, n);
+			if (status == EEPROM_KV_FULL)
+				Fuzz_after = Fuzz_before;
+			else if (status != EEPROM_KV_OK)
+				Fuzz_fail("kv", op, "put failed");
+			done = 1;
+			if (rand() % 4 == 0)
+				EEPROM_TypeA_eraseService();
+			FlashSim_cut(0);
+			if (!Fuzz_kvMatches(&Fuzz_after))
+				Fuzz_fail("kv", op, "index differs from the model");
+			Fuzz_before = Fuzz_after;
+			if (rand() % 16)
+				continue;
+		}
+		else
+			++Fuzz_cuts;
+		if (!Fuzz_mountKV())
+			Fuzz_fail("kv", op, "mount failed");
+		else if (!Fuzz_formatClean())
+			Fuzz_fail("kv", op, "format not repaired");
+		else if (Fuzz_kvMatches(&Fuzz_after))
+			Fuzz_before = Fuzz_after;
+		else if (done || !Fuzz_kvMatches(&Fuzz_before))
+			Fuzz_fail("kv", op, "batch torn or data lost");
+	}
+	printf("kv: %u batches, %u power failures, %u mounts repaired, %u compactions\n",
+		ops, Fuzz_cuts, Fuzz_repairs, gEEPROMKVCompactions);
+}
+
+static uint32_t Fuzz_flashBytes(void)
+{
+	uint32_t sector, words = 0;
+	for (sector = 0; sector < FLASH_SIM_SECTORS_MAX; sector++)
+		words += gFlashSimWords[sector];
+	return words * 8;
+}
+
+static uint32_t Fuzz_flashErases(void)
+{
+	uint32_t sector, erases = 0;
+	for (sector = 0; sector < FLASH_SIM_SECTORS_MAX; sector++)
+		erases += gFlashSimErases[sector];
+	return erases;
+}
+
+/**
+ * @brief The erase counts of the library match the simulated flash and are level
+ */
+static void Fuzz_wear(const char *test)
+{
+	uint32_t sector, min = ~0u, max = 0;
+	for (sector = 0; sector < EEPROM_EMULATION_SECTOR_ACCOUNT; sector++)
+	{
+		if (gEEPROMTypeAEraseCount[sector] != gFlashSimErases[sector])
+			Fuzz_fail(test, sector, "erase count differs from the flash");
+		if (gFlashSimErases[sector] < min)
+			min = gFlashSimErases[sector];
+		if (gFlashSimErases[sector] > max)
+			max = gFlashSimErases[sector];
+	}
+	if (max > min + 1)
+		Fuzz_fail(test, max - min, "sector erase counts not level");
+	printf("  %u-%u erases per sector over %u sectors\n", min, max, EEPROM_EMULATION_SECTOR_ACCOUNT);
+}
+
+/**
+ * @brief Flash bytes programmed and sectors erased per value byte, EEPROMKV vs full records
+ */
+static void Fuzz_amplification(uint32_t ops)
+{
+	uint8_t value[FUZZ_VALUE_MAX];
+	uint32_t op, i;
+	FlashSim_init();
+	Fuzz_reboot();
+	EEPROMKV_init();
+	for (op = 0; op < ops; op++)
+	{
+		for (i = 0; i < sizeof(value); i++)
+			value[i] = rand();
+		if (EEPROMKV_put(op % FUZZ_WA_KEYS, value, sizeof(value)) != EEPROM_KV_OK)
+			Fuzz_fail("amplification", op, "put failed");
+		EEPROM_TypeA_eraseService();
+	}
+	while (!EEPROM_TypeA_eraseService());
+	printf("amplification, %u-byte values, %u-byte records:\n", FUZZ_VALUE_MAX, EEPROM_EMULATION_RECORD_SIZE);
+	printf("  EEPROMKV      %6.2f flash bytes/byte, %6.2f erases/1000 writes\n",
+		(double)Fuzz_flashBytes() / ((uint64_t)ops * FUZZ_VALUE_MAX), 1000.0 * Fuzz_flashErases() / ops);
+	//The counts of RAM are lost at a reset, the mount loads the ones saved at the last compaction;
+	Fuzz_reboot();
+	if (EEPROMKV_init() != EEPROM_EMULATION_INIT_OK)
+		Fuzz_fail("wear", op, "mount failed");
+	Fuzz_wear("wear");
+
+	FlashSim_init();
+	Fuzz_reboot();
+	EEPROM_TypeA_init(Fuzz_data);
+	for (op = 0; op < ops; op++)
+	{
+		Fuzz_fill(op);
+		EEPROM_TypeA_writeData(Fuzz_data);
+		EEPROM_TypeA_eraseService();
+	}
+	while (!EEPROM_TypeA_eraseService());
+	printf("  full records  %6.2f flash bytes/byte, %6.2f erases/1000 writes\n",
+		(double)Fuzz_flashBytes() / ((uint64_t)ops * FUZZ_VALUE_MAX), 1000.0 * Fuzz_flashErases() / ops);
+	Fuzz_wear("wear");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t ops = argc > 1 ? atoi(argv[1]) : 20000;
+	srand(argc > 2 ? atoi(argv[2]) : 1);
+	gFlashSimSectors = argc > 3 ? atoi(argv[3]) : 4;
+	gFlashSimRecordSize = EEPROM_EMULATION_RECORD_SIZE;
+	Fuzz_typeA(ops);
+	Fuzz_kv(ops);
+	Fuzz_amplification(ops);
+	printf("%u failed checks\n", Fuzz_fails);
+	return Fuzz_fails > 255 ? 255 : Fuzz_fails;
+}
@@ -0,0 +1,187 @@
+/*
+ * @file flash_sim.c
+ * @brief Simulated NOR flash for the EEPROM emulation host builds
+ * @details A FLASH_SIM_SECTORS_MAX KB array mapped at FLASH_SIM_BASE. Programming can only
+ *          clear bits (the new value is ANDed in, 64-bit words at a time as on the MSPM0),
+ *          erasing sets a whole 1 KB sector back to 0xFF. A non-blocking erase reports
+ *          FLASH_SIM_ERASE_POLLS in-progress statuses before it completes.
+ *          Each flash word programmed and each erase is one step. With FlashSim_cut the power
+ *          fails during a given step: a flash word gets only some of its bits cleared, an
+ *          erase leaves some bits of the sector set and the others as they were; then the
+ *          caller's setjmp(gFlashSimPowerFail) returns 1, as a reset would restart the code.
+ * @author Ldk, InnoLegend team.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+uint32_t gFlashSimSectors = 2;
+uint32_t gFlashSimRecordSize = 256;
+uint32_t gFlashSimReads = 0;
+uint32_t gFlashSimErases[FLASH_SIM_SECTORS_MAX];
+uint32_t gFlashSimWords[FLASH_SIM_SECTORS_MAX];
+uint32_t gFlashSimReprograms = 0;
+uint32_t gFlashSimSteps = 0;
+uint32_t gFlashSimCutAt = 0;
+jmp_buf gFlashSimPowerFail;
+
+#define FLASH_SIM_ERASE_POLLS 3
+
+static uint8_t *FlashSim_mem = 0;
+static uint32_t FlashSim_eraseAddress = 0;	//Non-blocking erase in progress, 0 = none;
+static uint32_t FlashSim_erasePolls = 0;
+static DL_FLASHCTL_COMMAND_STATUS FlashSim_lastStatus = DL_FLASHCTL_COMMAND_STATUS_PASSED;
+
+/**
+ * @brief Map the array (first call), erase all of it and clear the counters
+ */
+void FlashSim_init(void)
+{
+	if (!FlashSim_mem)
+	{
+		FlashSim_mem = mmap((void *)FLASH_SIM_BASE, FLASH_SIM_SECTORS_MAX * FLASH_SIM_SECTOR,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+		if (FlashSim_mem == MAP_FAILED)
+		{
+			perror("flash_sim: mmap");
+			exit(1);
+		}
+	}
+	memset(FlashSim_mem, 0xFF, FLASH_SIM_SECTORS_MAX * FLASH_SIM_SECTOR);
+	memset(gFlashSimErases, 0, sizeof(gFlashSimErases));
+	memset(gFlashSimWords, 0, sizeof(gFlashSimWords));
+	gFlashSimReprograms = gFlashSimSteps = gFlashSimCutAt = 0;
+	FlashSim_powerOn();
+}
+
+/**
+ * @brief Fail the power a number of steps from now
+ * @param steps 1 = during the next program or erase step, 0 = never
+ * @pre setjmp(gFlashSimPowerFail) was called by a function that is still running
+ */
+void FlashSim_cut(uint32_t steps)
+{
+	gFlashSimCutAt = steps ? gFlashSimSteps + steps : 0;
+}
+
+/**
+ * @brief Reset the controller after a power failure: no command in progress
+ */
+void FlashSim_powerOn(void)
+{
+	FlashSim_eraseAddress = 0;
+	FlashSim_erasePolls = 0;
+	FlashSim_lastStatus = DL_FLASHCTL_COMMAND_STATUS_PASSED;
+}
+
+static uint32_t FlashSim_sector(uint32_t address)
+{
+	return (address - FLASH_SIM_BASE) / FLASH_SIM_SECTOR;
+}
+
+/**
+ * @brief Count a step, fail the power if it is the one chosen by FlashSim_cut
+ * @return 1 if the power fails during this step
+ */
+static uint8_t FlashSim_step(void)
+{
+	if (++gFlashSimSteps != gFlashSimCutAt)
+		return 0;
+	gFlashSimCutAt = 0;
+	return 1;
+}
+
+static uint32_t FlashSim_random(void)
+{
+	return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+static uint8_t FlashSim_inRange(uint32_t address, uint32_t bytes)
+{
+	return address >= FLASH_SIM_BASE && address + bytes <= FLASH_SIM_BASE + FLASH_SIM_SECTORS_MAX * FLASH_SIM_SECTOR;
+}
+
+/**
+ * @brief Program 32-bit words, starting on a 64-bit flash word
+ * @details An odd last word programs its flash word with the upper half left at 0xFFFFFFFF.
+ */
+DL_FLASHCTL_COMMAND_STATUS FlashSim_program(uint32_t address, const uint32_t *data, uint32_t words)
+{
+	uint32_t *p = (uint32_t *)(uintptr_t)address;
+	uint32_t i, n, sector;
+	if (words == 0 || (address & 7) || !FlashSim_inRange(address, words * 4))
+		return DL_FLASHCTL_COMMAND_STATUS_FAILED;
+	for (i = 0; i < words; i += 2)
+	{
+		n = words - i < 2 ? words - i : 2;
+		sector = FlashSim_sector(address + i * 4);
+		++gFlashSimWords[sector];
+		if (p[i] != 0xFFFFFFFF || (n == 2 && p[i + 1] != 0xFFFFFFFF))
+			++gFlashSimReprograms;
+		if (FlashSim_step())
+		{
+			//Cut off mid-program: each bit to be cleared may or may not be;
+			p[i] &= data[i] | FlashSim_random();
+			if (n == 2)
+				p[i + 1] &= data[i + 1] | FlashSim_random();
+			longjmp(gFlashSimPowerFail, 1);
+		}
+		p[i] &= data[i];
+		if (n == 2)
+			p[i + 1] &= data[i + 1];
+	}
+	return DL_FLASHCTL_COMMAND_STATUS_PASSED;
+}
+
+/**
+ * @brief Erase the sector holding an address
+ */
+DL_FLASHCTL_COMMAND_STATUS FlashSim_erase(uint32_t address)
+{
+	uint32_t *p, i;
+	if (!FlashSim_inRange(address, 1))
+		return DL_FLASHCTL_COMMAND_STATUS_FAILED;
+	address &= ~(uint32_t)(FLASH_SIM_SECTOR - 1);
+	p = (uint32_t *)(uintptr_t)address;
+	++gFlashSimErases[FlashSim_sector(address)];
+	if (FlashSim_step())
+	{
+		//Cut off mid-erase: some bits are back to 1, the others keep their old value;
+		for (i = 0; i < FLASH_SIM_SECTOR / 4; i++)
+			p[i] |= FlashSim_random();
+		FlashSim_powerOn();
+		longjmp(gFlashSimPowerFail, 1);
+	}
+	memset(p, 0xFF, FLASH_SIM_SECTOR);
+	return DL_FLASHCTL_COMMAND_STATUS_PASSED;
+}
+
+/**
+ * @brief Start a non-blocking sector erase, see FlashSim_status
+ */
+void FlashSim_eraseStart(uint32_t address)
+{
+	FlashSim_eraseAddress = address;
+	FlashSim_erasePolls = FLASH_SIM_ERASE_POLLS;
+	FlashSim_lastStatus = DL_FLASHCTL_COMMAND_STATUS_IN_PROGRESS;
+}
+
+/**
+ * @brief Status of the last command; the erase completes after a few polls
+ */
+DL_FLASHCTL_COMMAND_STATUS FlashSim_status(void)
+{
+	if (FlashSim_eraseAddress && FlashSim_erasePolls-- == 0)
+	{
+		FlashSim_lastStatus = FlashSim_erase(FlashSim_eraseAddress);
+		FlashSim_eraseAddress = 0;
+	}
+	return FlashSim_lastStatus;
+}
+
+uint32_t FlashSim_read32(uint32_t address)
+{
+	++gFlashSimReads;
+	return *(volatile uint32_t *)(uintptr_t)address;
+}
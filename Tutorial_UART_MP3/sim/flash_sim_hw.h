@@ -0,0 +1,76 @@
+/*
+ * @file flash_sim_hw.h
+ * @brief Host stand-in for the flash controller calls made by the EEPROM emulation
+ * @details Force-included (gcc -include) ahead of every source of the flash simulator builds.
+ *          The driverlib headers are pulled in first so that their prototypes are declared;
+ *          the DL_FlashCTL calls used by eeprom_emulation_type_a.c are then redirected to the
+ *          simulated NOR array in flash_sim.c, which is mapped at FLASH_SIM_BASE so that the
+ *          library's 32-bit flash addresses stay valid pointers on a 64-bit host.
+ *          Sector count and record size become run-time variables unless given with -D,
+ *          so one binary can sweep them. The simulated array keeps per-sector program and
+ *          erase counts and can fail power at any program or erase step (see FlashSim_cut).
+ * @author Ldk, InnoLegend team.
+ */
+#ifndef __FLASH_SIM_HW_H
+#define __FLASH_SIM_HW_H
+
+#include <ti/devices/msp/msp.h>
+#include <ti/driverlib/driverlib.h>
+#include <setjmp.h>
+
+#define FLASH_SIM_BASE 0x30000000
+#define FLASH_SIM_SECTOR 1024
+#define FLASH_SIM_SECTORS_MAX 64
+
+extern uint32_t gFlashSimSectors;		//Sectors used by the EEPROM emulation, 2-FLASH_SIM_SECTORS_MAX;
+extern uint32_t gFlashSimRecordSize;	//64, 128 or 256;
+extern uint32_t gFlashSimReads;			//Header words read by the search;
+extern uint32_t gFlashSimErases[FLASH_SIM_SECTORS_MAX];	//Erase cycles per sector;
+extern uint32_t gFlashSimWords[FLASH_SIM_SECTORS_MAX];	//64-bit flash words programmed per sector;
+extern uint32_t gFlashSimReprograms;	//Programs of a flash word that was not erased (header state changes);
+extern uint32_t gFlashSimSteps;			//Program (one per flash word) and erase steps so far;
+extern uint32_t gFlashSimCutAt;			//Power fails during this step, 0 = never;
+extern jmp_buf gFlashSimPowerFail;		//Where the power failure returns to, see FlashSim_cut;
+
+void FlashSim_init(void);
+void FlashSim_cut(uint32_t steps);
+void FlashSim_powerOn(void);
+DL_FLASHCTL_COMMAND_STATUS FlashSim_program(uint32_t address, const uint32_t *data, uint32_t words);
+DL_FLASHCTL_COMMAND_STATUS FlashSim_erase(uint32_t address);
+void FlashSim_eraseStart(uint32_t address);
+DL_FLASHCTL_COMMAND_STATUS FlashSim_status(void);
+uint32_t FlashSim_read32(uint32_t address);
+
+#define EEPROM_EMULATION_ADDRESS FLASH_SIM_BASE
+//Fixed with -D for sources that size arrays by them (EEPROMKV.c);
+#ifndef EEPROM_EMULATION_SECTOR_ACCOUNT
+#define EEPROM_EMULATION_SECTOR_ACCOUNT gFlashSimSectors
+#endif
+#define EEPROM_EMULATION_SECTOR_ACCOUNT_MAX FLASH_SIM_SECTORS_MAX
+#ifndef EEPROM_EMULATION_RECORD_SIZE
+#define EEPROM_EMULATION_RECORD_SIZE gFlashSimRecordSize
+#endif
+#define EEPROM_TYPEA_READ32(address) FlashSim_read32(address)
+
+#undef DL_FlashCTL_unprotectSector
+#undef DL_FlashCTL_programMemoryFromRAM
+#undef DL_FlashCTL_programMemoryFromRAM64
+#undef DL_FlashCTL_programMemoryFromRAM64WithECCGenerated
+#undef DL_FlashCTL_programMemoryBlockingFromRAM64WithECCGenerated
+#undef DL_FlashCTL_eraseMemoryFromRAM
+#undef DL_FlashCTL_eraseMemory
+#undef DL_FlashCTL_getCommandStatus
+
+#define DL_FlashCTL_unprotectSector(flashctl, address, region) ((void)0)
+#define DL_FlashCTL_programMemoryFromRAM(flashctl, address, data, words, region) \
+	FlashSim_program(address, data, words)
+#define DL_FlashCTL_programMemoryFromRAM64(flashctl, address, data) FlashSim_program(address, data, 2)
+#define DL_FlashCTL_programMemoryFromRAM64WithECCGenerated(flashctl, address, data) \
+	FlashSim_program(address, data, 2)
+#define DL_FlashCTL_programMemoryBlockingFromRAM64WithECCGenerated(flashctl, address, data, words, region) \
+	FlashSim_program(address, data, words)
+#define DL_FlashCTL_eraseMemoryFromRAM(flashctl, address, size) FlashSim_erase(address)
+#define DL_FlashCTL_eraseMemory(flashctl, address, size) FlashSim_eraseStart(address)
+#define DL_FlashCTL_getCommandStatus(flashctl) FlashSim_status()
+
+#endif
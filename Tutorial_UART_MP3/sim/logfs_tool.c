@@ -0,0 +1,362 @@
+/*
+ * @file logfs_tool.c
+ * @brief Host image tool and power-failure fuzzer for LogFS
+ * @details Builds LogFS.c on Linux against the simulated SPI flash (spiflash_sim.h).
+ *          Image commands work on a file holding the LogFS area as it sits at the start of the
+ *          SPI flash (LogFS_mount(0, ...) in main.c), to prepare a chip with a programmer or to
+ *          look into one that was read out:
+ *              ./logfs_tool IMAGE mkfs SIZE_KB     blank (erased) image
+ *              ./logfs_tool IMAGE ls               files, sizes and block counts
+ *              ./logfs_tool IMAGE put NAME FILE    append a host file to NAME (created if missing)
+ *              ./logfs_tool IMAGE get NAME FILE    copy NAME out to a host file
+ *              ./logfs_tool IMAGE rm NAME
+ *              ./logfs_tool IMAGE gc               erase the stale blocks now
+ *              ./logfs_tool IMAGE play NAME [PIECE] [TIMES]
+ *                                                  read NAME TIMES times (default 4) in PIECE-byte
+ *                                                  reads (default 16), as the player or the OLED
+ *                                                  would, and print the SPI traffic and cache hits
+ *          The fuzzer runs random creates, appends, deletes and background erases on a small
+ *          area and fails the power at random steps; after each failure the area is mounted
+ *          again and every file must hold exactly its bytes before the operation, or a prefix
+ *          of its bytes after it (a created or deleted file: either state). Clean remounts
+ *          must rebuild the same files, and deleting everything must give every block back.
+ *          The reads go through FlashCache, which must stay in step with every program and erase.
+ *              ./logfs_tool fuzz [operations, default 20000] [seed, default 1]
+ *          The exit code is the number of failed checks (capped at 255).
+ *
+ *          Build from the project root:
+ *              gcc -O2 -std=gnu11 -D__MSPM0G3507__ -Wall -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast \
+ *                  -Isim -ICore/inc -IDriver -IDriver/CMSIS/Core/Include \
+ *                  -o logfs_tool sim/logfs_tool.c sim/spiflash_sim.c Core/src/LogFS.c Core/src/FlashCache.c \
+ *                  Core/src/MathUtil.c Driver/ti/driverlib/dl_mathacl.c
+ * @author Ldk, InnoLegend team.
+ */
+#include "LogFS.h"
+#include "FlashCache.h"
+#include "spiflash_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZ_BLOCKS 32			//Area of the fuzzer, small so that it fills up and the stale blocks get reused;
+#define FUZZ_FILES 6
+#define FUZZ_FILE_MAX 24000		//Bytes per file the model holds;
+#define FUZZ_APPEND_MAX 9000	//Longer than a block, so appends span blocks;
+#define FUZZ_CUT_ONE_IN 4		//Operations with a power failure;
+#define FUZZ_CUT_STEPS 12		//Steps after the start the failure may hit (an append of a page or two is 2-4);
+#define FUZZ_REMOUNT_ONE_IN 50	//Clean remounts, checked against the state before;
+#define FUZZ_REPORT_MAX 10		//Failed checks printed;
+
+uint32_t SysTime_getMs(){ return 0; }
+
+struct FuzzFile{
+	char name[LOGFS_NAME + 1];
+	uint8_t exists;
+	uint32_t len;
+	uint8_t data[FUZZ_FILE_MAX];
+};
+
+static struct FuzzFile Fuzz_Model[FUZZ_FILES];
+static uint8_t Fuzz_Buf[FUZZ_FILE_MAX];
+static uint32_t Fuzz_Failed = 0;
+
+static void Fuzz_fail(const char *what, const char *name, uint32_t op)
+{
+	if (++Fuzz_Failed <= FUZZ_REPORT_MAX)
+		printf("FAIL op %lu, %s: %s\n", (unsigned long)op, name, what);
+}
+
+/**
+ * @brief Read a whole file back in random pieces
+ * @return Bytes read
+ */
+static uint32_t Fuzz_readAll(uint8_t file, uint8_t *buf, uint32_t max)
+{
+	uint32_t done = 0, chunk, got;
+	while (done < max)
+	{
+		chunk = 1 + rand() % 5000;
+		if (chunk > max - done)
+			chunk = max - done;
+		got = LogFS_read(file, done, buf + done, chunk);
+		done += got;
+		if (got < chunk)
+			break;
+	}
+	return done;
+}
+
+/**
+ * @brief Compare a file with the model
+ * @param lenMin The file may be this short (a prefix of the model)
+ * @param mayExist The file may exist or not (create or delete cut by a failure)
+ * @details The model follows the flash where the check allows either: its length and existence.
+ */
+static void Fuzz_check(struct FuzzFile *m, uint32_t lenMin, uint8_t mayExist, uint32_t op)
+{
+	uint8_t file;
+	uint32_t size;
+	if (LogFS_open(m->name, &file) != LOGFS_OK)
+	{
+		if (m->exists && !mayExist)
+			Fuzz_fail("lost", m->name, op);
+		m->exists = 0;
+		m->len = 0;
+		return;
+	}
+	if (!m->exists && !mayExist)
+		Fuzz_fail("appeared", m->name, op);
+	if (!m->exists)
+		m->len = lenMin = 0;
+	m->exists = 1;
+	size = LogFS_size(file);
+	if (size < lenMin || size > m->len)
+	{
+		Fuzz_fail("size", m->name, op);
+		size = size < lenMin ? lenMin : m->len;
+	}
+	if (Fuzz_readAll(file, Fuzz_Buf, size + 1) != LogFS_size(file) || memcmp(Fuzz_Buf, m->data, size))
+		Fuzz_fail("data", m->name, op);
+	m->len = size;
+}
+
+static void Fuzz_checkAll(int8_t changed, uint32_t lenMin, uint8_t mayExist, uint32_t op)
+{
+	uint8_t i;
+	for (i = 0; i < FUZZ_FILES; i++)
+		if (i == changed)
+			Fuzz_check(&Fuzz_Model[i], lenMin, mayExist, op);
+		else
+			Fuzz_check(&Fuzz_Model[i], Fuzz_Model[i].len, 0, op);
+}
+
+static int Fuzz_run(uint32_t ops, uint32_t seed)
+{
+	static uint32_t op, cuts, remounts, full, lenMin;
+	static int8_t changed;
+	static uint8_t mayExist;
+	struct FuzzFile *m;
+	uint8_t file, status, i;
+	uint32_t len, k;
+	srand(seed);
+	SPIFlashSim_init(FUZZ_BLOCKS * LOGFS_BLOCK);
+	memset(Fuzz_Model, 0, sizeof(Fuzz_Model));
+	for (i = 0; i < FUZZ_FILES; i++)
+		sprintf(Fuzz_Model[i].name, "log%u.bin", i);
+	LogFS_mount(0, gSPIFlash.size);
+	cuts = remounts = full = 0;
+	for (op = 1; op <= ops; op++)
+	{
+		changed = rand() % FUZZ_FILES;
+		m = &Fuzz_Model[changed];
+		lenMin = m->len;
+		mayExist = 0;
+		if (setjmp(gSPIFlashSimPowerFail) == 0)
+		{
+			SPIFlashSim_cut(rand() % FUZZ_CUT_ONE_IN ? 0 : 1 + rand() % FUZZ_CUT_STEPS);
+			switch (rand() % 8)
+			{
+			case 0:
+				if (m->exists)
+				{
+					mayExist = 1;
+					LogFS_open(m->name, &file);
+					LogFS_delete(file);
+					m->exists = 0;
+					m->len = 0;
+				}
+				else
+				{
+					mayExist = 1;
+					status = LogFS_create(m->name, &file);
+					if (status == LOGFS_OK)
+						m->exists = 1;
+					else if (status == LOGFS_FULL)
+						++full;
+					else
+						Fuzz_fail("create", m->name, op);
+				}
+				break;
+			case 1:
+			case 2:
+				for (k = 0; k < 4; k++)
+					LogFS_poll();
+				break;
+			default:
+				if (!m->exists)
+					break;
+				len = 1 + rand() % (rand() % 4 ? 300 : FUZZ_APPEND_MAX);
+				if (len > FUZZ_FILE_MAX - m->len)
+					len = FUZZ_FILE_MAX - m->len;
+				for (k = 0; k < len; k++)
+					m->data[m->len + k] = rand();
+				LogFS_open(m->name, &file);
+				m->len += len;
+				status = LogFS_append(file, m->data + lenMin, len);
+				if (status == LOGFS_FULL)
+				{
+					//The bytes that fit went in;
+					++full;
+					lenMin = LogFS_size(file) < m->len ? LogFS_size(file) : m->len;
+					m->len = lenMin;
+				}
+				else if (status != LOGFS_OK)
+					Fuzz_fail("append", m->name, op);
+				break;
+			}
+			SPIFlashSim_cut(0);
+			if (mayExist)
+				mayExist = 0, lenMin = m->len;
+			if (rand() % FUZZ_REMOUNT_ONE_IN == 0)
+			{
+				++remounts;
+				LogFS_mount(0, gSPIFlash.size);
+			}
+			Fuzz_checkAll(changed, lenMin, mayExist, op);
+		}
+		else
+		{
+			//Power failure: reboot;
+			++cuts;
+			LogFS_mount(0, gSPIFlash.size);
+			Fuzz_checkAll(changed, lenMin, mayExist, op);
+		}
+		if (gLogFSFree + gLogFSStale > gLogFSBlocks)
+			Fuzz_fail("block counts", "-", op);
+	}
+
+	//Delete everything: every block must come back;
+	for (i = 0; i < FUZZ_FILES; i++)
+		if (LogFS_open(Fuzz_Model[i].name, &file) == LOGFS_OK)
+			LogFS_delete(file);
+	while (gLogFSStale)
+		LogFS_poll();
+	LogFS_mount(0, gSPIFlash.size);
+	if (gLogFSFree != gLogFSBlocks || gLogFSStale)
+		Fuzz_fail("blocks not given back", "-", op);
+	printf("%lu operations, %lu power failures, %lu remounts, %lu full; %lu KB programmed, %lu erases: %lu failed checks\n",
+		(unsigned long)ops, (unsigned long)cuts, (unsigned long)remounts, (unsigned long)full,
+		(unsigned long)(gSPIFlashProgramBytes / 1024), (unsigned long)gSPIFlashErases, (unsigned long)Fuzz_Failed);
+	FlashCache_report();
+	return Fuzz_Failed > 255 ? 255 : Fuzz_Failed;
+}
+
+static void Tool_load(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	long size;
+	if (!fp || fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 2 * LOGFS_BLOCK || size % LOGFS_BLOCK)
+	{
+		fprintf(stderr, "%s: not an image (a multiple of %u bytes)\n", path, LOGFS_BLOCK);
+		exit(1);
+	}
+	SPIFlashSim_init(size);
+	rewind(fp);
+	if (fread(gSPIFlashSim, 1, size, fp) != (size_t)size)
+		exit(1);
+	fclose(fp);
+	if (LogFS_mount(0, size) != LOGFS_OK)
+		fprintf(stderr, "%s: more files than LOGFS_FILES, some are not listed\n", path);
+	if (size / LOGFS_BLOCK > LOGFS_BLOCKS_MAX)
+		fprintf(stderr, "%s: only the first %u blocks are used\n", path, LOGFS_BLOCKS_MAX);
+}
+
+static void Tool_save(const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	if (!fp || fwrite(gSPIFlashSim, 1, gSPIFlash.size, fp) != gSPIFlash.size || fclose(fp))
+	{
+		perror(path);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t buf[LOGFS_DATA];
+	const char *image = argv[1], *cmd = argc > 2 ? argv[2] : "";
+	uint8_t file;
+	uint32_t offset, got;
+	size_t n;
+	FILE *fp;
+	if (argc >= 2 && strcmp(argv[1], "fuzz") == 0)
+		return Fuzz_run(argc > 2 ? strtoul(argv[2], 0, 0) : 20000, argc > 3 ? strtoul(argv[3], 0, 0) : 1);
+	if (argc == 4 && strcmp(cmd, "mkfs") == 0)
+	{
+		SPIFlashSim_init(strtoul(argv[3], 0, 0) * 1024 / LOGFS_BLOCK * LOGFS_BLOCK);
+		Tool_save(image);
+		return 0;
+	}
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s IMAGE mkfs SIZE_KB | ls | put NAME FILE | get NAME FILE | rm NAME | gc | play NAME [PIECE] [TIMES]\n"
+			"       %s fuzz [operations] [seed]\n", argv[0], argv[0]);
+		return 2;
+	}
+	Tool_load(image);
+	if (strcmp(cmd, "ls") == 0)
+	{
+		LogFS_report();
+		return 0;
+	}
+	if (strcmp(cmd, "gc") == 0)
+	{
+		while (gLogFSStale)
+			LogFS_poll();
+		Tool_save(image);
+		return 0;
+	}
+	if (argc < 4)
+		return 2;
+	if (strcmp(cmd, "rm") == 0)
+	{
+		if (LogFS_open(argv[3], &file) != LOGFS_OK || LogFS_delete(file) != LOGFS_OK)
+			return fprintf(stderr, "%s: not found\n", argv[3]), 1;
+		Tool_save(image);
+		return 0;
+	}
+	if (strcmp(cmd, "play") == 0)
+	{
+		uint32_t piece = argc > 4 ? strtoul(argv[4], 0, 0) : 16, times = argc > 5 ? strtoul(argv[5], 0, 0) : 4, t;
+		uint64_t bytes = 0;
+		if (LogFS_open(argv[3], &file) != LOGFS_OK)
+			return fprintf(stderr, "%s: not found\n", argv[3]), 1;
+		if (piece == 0 || piece > sizeof(buf))
+			piece = 16;
+		gSPIFlashReadBytes = 0;
+		for (t = 0; t < times; t++)
+			for (offset = 0; (got = LogFS_read(file, offset, buf, piece)) > 0; offset += got)
+				bytes += got;
+		printf("%llu bytes read in %lu-byte pieces, %lu bytes from the SPI flash\n",
+			(unsigned long long)bytes, (unsigned long)piece, (unsigned long)gSPIFlashReadBytes);
+		FlashCache_report();
+		return 0;
+	}
+	if (argc < 5)
+		return 2;
+	if (strcmp(cmd, "put") == 0)
+	{
+		if (LogFS_open(argv[3], &file) != LOGFS_OK && LogFS_create(argv[3], &file) != LOGFS_OK)
+			return fprintf(stderr, "%s: cannot create\n", argv[3]), 1;
+		if (!(fp = fopen(argv[4], "rb")))
+			return perror(argv[4]), 1;
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+			if (LogFS_append(file, buf, n) != LOGFS_OK)
+				return fprintf(stderr, "%s: image full\n", image), 1;
+		fclose(fp);
+		Tool_save(image);
+		return 0;
+	}
+	if (strcmp(cmd, "get") == 0)
+	{
+		if (LogFS_open(argv[3], &file) != LOGFS_OK)
+			return fprintf(stderr, "%s: not found\n", argv[3]), 1;
+		if (!(fp = fopen(argv[4], "wb")))
+			return perror(argv[4]), 1;
+		for (offset = 0; (got = LogFS_read(file, offset, buf, sizeof(buf))) > 0; offset += got)
+			fwrite(buf, 1, got, fp);
+		fclose(fp);
+		return 0;
+	}
+	return 2;
+}
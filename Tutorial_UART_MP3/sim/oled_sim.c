@@ -0,0 +1,395 @@
+/*
+ * @file oled_sim.c
+ * @brief Host-side simulator for the OLED driver
+ * @details Builds oled_spi_V0.2.c on Linux against a stub SPI (see oled_sim_hw.h) and
+ *          decodes the command/data byte stream into a virtual SH1106 or SSD1306 panel.
+ *          Every drawing operation in the script below dumps the visible 128x64 frame
+ *          as a PBM, is compared against a golden image, and reports its SPI byte count,
+ *          so that rendering changes can be checked for both correctness and cost.
+ *
+ *          Build and run from the project root:
+ *              gcc -std=gnu11 -D__MSPM0G3507__ -Wall -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast -Wno-missing-braces \
+ *                  -include sim/oled_sim_hw.h -ICore/inc -IDriver -IDriver/CMSIS/Core/Include \
+ *                  -o oled_sim sim/oled_sim.c Core/src/oled_spi_V0.2.c Core/src/OLEDConsole.c
+ *              ./oled_sim -g sim/golden/sh1106                (compare; exit status is the number of mismatches)
+ *              ./oled_sim -c ssd1306 -g sim/golden/ssd1306
+ *              ./oled_sim -g sim/golden/sh1106 -u             (record golden images from a known-good driver)
+ *
+ *          The committed golden images were recorded from the original driver; a frame may
+ *          only be re-recorded with a change that explains the difference.
+ *
+ *          Options: -c sh1106|ssd1306  panel controller (default sh1106)
+ *                   -o <dir>           where the frames are dumped (default: current directory)
+ *                   -g <dir>           golden image directory
+ *                   -u                 overwrite the golden images instead of comparing
+ * @author Ldk, InnoLegend team.
+ */
+#include "oled_spi_V0.2.h"
+#include "oledpicture.h"
+#include "OLEDConsole.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_WIDTH 128
+#define SIM_HEIGHT 64
+#define SIM_PAGES 8
+#define SIM_SPI_HZ 8000000 // SPI_OLED bit rate set by SysConfig
+
+/**
+ * @brief State of the virtual panel
+ * @details The RAM is sized for the SH1106 (132 columns); the SSD1306 uses the first 128.
+ */
+typedef struct
+{
+	uint8_t ram[SIM_PAGES][132];
+	uint8_t columns;     // RAM columns of the controller
+	uint8_t colOffset;   // first RAM column shown on the glass
+	uint8_t isSH1106;
+	uint8_t page, column;
+	uint8_t startLine, displayOffset;
+	uint8_t segRemap, comRemap;
+	uint8_t inverse, entireOn, displayOn;
+	uint8_t dc;          // level of the DC line, 1 = data
+	uint8_t cmd[8];      // command bytes collected so far
+	uint8_t cmdLen, cmdNeed;
+	uint32_t cmdBytes, dataBytes;
+} OLEDSim_Panel;
+
+static OLEDSim_Panel gPanel;
+static uint32_t gSimIrqMask;
+
+void SPI_OLED_INST_IRQHandler(void);
+
+/**
+ * @brief Number of argument bytes following a command opcode
+ * @param op The command opcode
+ * @return Argument count for the selected controller
+ */
+static uint8_t OLEDSim_argCount(uint8_t op)
+{
+	switch (op)
+	{
+	case 0x81: case 0xA8: case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+		return 1;
+	}
+	if (gPanel.isSH1106)
+		return op == 0xAD ? 1 : 0;
+	switch (op)
+	{
+	case 0x20: case 0x8D:
+		return 1;
+	case 0x21: case 0x22: case 0xA3:
+		return 2;
+	case 0x29: case 0x2A:
+		return 5;
+	case 0x26: case 0x27:
+		return 6;
+	}
+	return 0;
+}
+
+/**
+ * @brief Apply a complete command (opcode plus arguments) to the panel
+ */
+static void OLEDSim_execute(const uint8_t *c)
+{
+	uint8_t op = c[0];
+	if (op <= 0x0F)
+		gPanel.column = (gPanel.column & 0xF0) | op;
+	else if (op <= 0x1F)
+		gPanel.column = (gPanel.column & 0x0F) | ((op & 0x0F) << 4);
+	else if (op >= 0x40 && op <= 0x7F)
+		gPanel.startLine = op & 0x3F;
+	else if (op >= 0xB0 && op <= 0xB7)
+		gPanel.page = op & 0x07;
+	else switch (op)
+	{
+	case 0xA0: case 0xA1: gPanel.segRemap = op & 1; break;
+	case 0xC0: case 0xC8: gPanel.comRemap = (op >> 3) & 1; break;
+	case 0xA4: case 0xA5: gPanel.entireOn = op & 1; break;
+	case 0xA6: case 0xA7: gPanel.inverse = op & 1; break;
+	case 0xAE: case 0xAF: gPanel.displayOn = op & 1; break;
+	case 0xD3: gPanel.displayOffset = c[1] & 0x3F; break;
+	default: break; // analog settings (contrast, clocks, pump) do not affect the image
+	}
+}
+
+void OLEDSim_gpio(uint32_t pins, uint8_t level)
+{
+	if (pins & OLED_DC_PIN)
+		gPanel.dc = level;
+}
+
+void OLEDSim_spiWrite(uint8_t data)
+{
+	if (gPanel.dc)
+	{
+		gPanel.dataBytes++;
+		if (gPanel.column < gPanel.columns)
+			gPanel.ram[gPanel.page][gPanel.column] = data;
+		gPanel.column = (gPanel.column + 1) % gPanel.columns;
+		return;
+	}
+	gPanel.cmdBytes++;
+	if (gPanel.cmdLen == 0)
+		gPanel.cmdNeed = 1 + OLEDSim_argCount(data);
+	gPanel.cmd[gPanel.cmdLen++] = data;
+	if (gPanel.cmdLen == gPanel.cmdNeed)
+	{
+		OLEDSim_execute(gPanel.cmd);
+		gPanel.cmdLen = 0;
+	}
+}
+
+void OLEDSim_irqMask(uint32_t set, uint32_t clear)
+{
+	gSimIrqMask = (gSimIrqMask | set) & ~clear;
+}
+
+DL_SPI_IIDX OLEDSim_pendingIrq(void)
+{
+	if (gSimIrqMask & DL_SPI_INTERRUPT_TX)
+		return DL_SPI_IIDX_TX;
+	return DL_SPI_IIDX_IDLE;
+}
+
+void OLEDSim_wfi(void)
+{
+	if (gSimIrqMask & (DL_SPI_INTERRUPT_TX | DL_SPI_INTERRUPT_IDLE))
+		SPI_OLED_INST_IRQHandler();
+}
+
+/**
+ * @brief Read one pixel as seen on the glass
+ * @details A1/C8 (the setting used by OLED_Init) is the upright orientation of the module.
+ */
+static uint8_t OLEDSim_pixel(uint8_t x, uint8_t y)
+{
+	uint8_t col, line, lit;
+	if (!gPanel.displayOn)
+		return 0;
+	if (gPanel.entireOn)
+		return 1;
+	col = gPanel.segRemap ? x + gPanel.colOffset : gPanel.columns - 1 - (x + gPanel.colOffset);
+	if (!gPanel.comRemap)
+		y = SIM_HEIGHT - 1 - y;
+	line = (y + gPanel.startLine + gPanel.displayOffset) & 0x3F;
+	lit = (gPanel.ram[line >> 3][col] >> (line & 7)) & 1;
+	return lit ^ gPanel.inverse;
+}
+
+/**
+ * @brief Render the visible frame into a P1 PBM image
+ * @return Length of the image text
+ */
+static int OLEDSim_frame(char *buf)
+{
+	int len = sprintf(buf, "P1\n%d %d\n", SIM_WIDTH, SIM_HEIGHT);
+	uint8_t x, y;
+	for (y = 0; y < SIM_HEIGHT; y++)
+	{
+		for (x = 0; x < SIM_WIDTH; x++)
+			buf[len++] = OLEDSim_pixel(x, y) ? '1' : '0';
+		buf[len++] = '\n';
+	}
+	return len;
+}
+
+/**
+ * @brief Count differing pixels between a frame and a golden PBM
+ * @return Number of differing pixels, or -1 if the golden image is missing
+ */
+static int OLEDSim_compare(const char *frame, const char *path)
+{
+	static char golden[SIM_WIDTH * SIM_HEIGHT * 2 + 64];
+	FILE *f = fopen(path, "r");
+	int n, i, j, diff = 0;
+	if (!f)
+		return -1;
+	n = fread(golden, 1, sizeof(golden) - 1, f);
+	fclose(f);
+	golden[n] = '\0';
+	// Skip the two header lines of both images, then compare the pixel digits
+	frame = strchr(strchr(frame, '\n') + 1, '\n') + 1;
+	for (i = 0, j = 0; i < 2 && golden[j]; j++)
+		if (golden[j] == '\n')
+			i++;
+	for (; *frame; frame++)
+	{
+		if (*frame != '0' && *frame != '1')
+			continue;
+		while (golden[j] && golden[j] != '0' && golden[j] != '1')
+			j++;
+		if (golden[j] != *frame)
+			diff++;
+		if (golden[j])
+			j++;
+	}
+	return diff;
+}
+
+/* Drawing operations exercised by the simulator; the panel state carries over
+ * from one step to the next just like on the real screen. */
+static void Step_init() { OLED_Init(); }
+static void Step_clear() { OLED_Clear(); }
+static void Step_string() { OLED_ShowString(0, 0, "Hello MSPM0!"); OLED_ShowString(0, 2, "0123456789:;<=>?"); }
+static void Step_number() { OLED_ShowNum(0, 4, 2024, 4, 12); OLED_ShowSignedNum(48, 4, -37, 3, 12); }
+static void Step_chinese() { OLED_ShowCHinese(0, 6, 0); OLED_ShowCHinese(16, 6, 1); }
+static void Step_rle() { OLED_Clear(); OLED_DrawRLE(9, 0, 119, 8, Genshin_RLE); }
+static void Step_bmp()
+{
+	// Same picture through the uncompressed path: the frame must match the rle step
+	static u8 raw[110 * 8];
+	OLED_RLE_Decode(Genshin_RLE, raw, sizeof(raw));
+	OLED_Clear();
+	OLED_DrawBMP(9, 0, 119, 8, raw);
+}
+static void Step_shapes()
+{
+	OLED_Clear();
+	OLED_DrawLine(0, 0, 127, 63, 1);
+	OLED_DrawCircle(64, 32, 20);
+	OLED_Refresh();
+}
+static void Step_present()
+{
+	// Frame N+1 is drawn while frame N is still on the wire; only changed pages are sent
+	OLED_ClearBuffer();
+	OLED_DrawLine(0, 8, 127, 8, 1);
+	OLED_Present();
+	OLED_DrawCircle(64, 40, 12);
+	OLED_Present();
+	OLED_WaitFlush();
+}
+static void Step_text()
+{
+	// Text into the back buffer with the rest of the frame (as Spectrum and Pitch draw), clipped at the right edge
+	OLED_ClearBuffer();
+	OLED_DrawString(0, 0, "64 440Hz");
+	OLED_DrawString(0, 2, "M6#  +12c");
+	OLED_DrawString(104, 4, "clipped");
+	OLED_DrawLine(0, 63, 127, 40, 1);
+	OLED_Present();
+	OLED_WaitFlush();
+}
+static void Step_console()
+{
+	char line[24];
+	int i;
+	OLEDConsole_init();
+	for (i = 0; i < 12; i++)
+	{
+		sprintf(line, "log line %d\n", i);
+		OLEDConsole_puts(line);
+	}
+	OLEDConsole_puts("Password:12345");
+}
+static void Step_console_line() { OLEDConsole_puts("\nnext"); }
+static void Step_console_back() { OLEDConsole_scroll(3); }
+static void Step_console_close() { OLEDConsole_close(); }
+static void Step_invert() { OLED_ColorTurn(1); }
+static void Step_rotate() { OLED_ColorTurn(0); OLED_DisplayTurn(1); }
+
+static const struct
+{
+	const char *name;
+	void (*run)();
+} gSteps[] = {
+	{"init", Step_init},
+	{"string", Step_string},
+	{"number", Step_number},
+	{"chinese", Step_chinese},
+	{"rle", Step_rle},
+	{"bmp", Step_bmp},
+	{"shapes", Step_shapes},
+	{"present", Step_present},
+	{"text", Step_text},
+	{"console", Step_console},
+	{"console_line", Step_console_line},
+	{"console_back", Step_console_back},
+	{"console_close", Step_console_close},
+	{"invert", Step_invert},
+	{"rotate", Step_rotate},
+	{"clear", Step_clear},
+};
+
+int main(int argc, char *argv[])
+{
+	static char frame[SIM_WIDTH * SIM_HEIGHT * 2 + 64];
+	const char *outDir = ".", *goldenDir = NULL;
+	int update = 0, failed = 0, i, len, diff;
+	char path[256];
+	FILE *f;
+
+	gPanel.isSH1106 = 1;
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			gPanel.isSH1106 = strcmp(argv[++i], "ssd1306") != 0;
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outDir = argv[++i];
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+			goldenDir = argv[++i];
+		else if (!strcmp(argv[i], "-u"))
+			update = 1;
+		else
+		{
+			fprintf(stderr, "usage: %s [-c sh1106|ssd1306] [-o dir] [-g golden_dir [-u]]\n", argv[0]);
+			return 2;
+		}
+	}
+	gPanel.columns = gPanel.isSH1106 ? 132 : 128;
+	gPanel.colOffset = gPanel.isSH1106 ? 2 : 0;
+	gPanel.dc = 1;
+
+	printf("%-8s %6s %6s %6s %9s  %s\n", "step", "cmd", "data", "total", "wire", "golden");
+	for (i = 0; i < (int)(sizeof(gSteps) / sizeof(gSteps[0])); i++)
+	{
+		gPanel.cmdBytes = gPanel.dataBytes = 0;
+		gSteps[i].run();
+		len = OLEDSim_frame(frame);
+		frame[len] = '\0';
+
+		snprintf(path, sizeof(path), "%s/%02d_%s.pbm", outDir, i, gSteps[i].name);
+		if ((f = fopen(path, "w")) != NULL)
+		{
+			fwrite(frame, 1, len, f);
+			fclose(f);
+		}
+
+		printf("%-8s %6u %6u %6u %7.1fus  ", gSteps[i].name, gPanel.cmdBytes, gPanel.dataBytes,
+			gPanel.cmdBytes + gPanel.dataBytes, (gPanel.cmdBytes + gPanel.dataBytes) * 8e6 / SIM_SPI_HZ);
+		if (!goldenDir)
+		{
+			printf("-\n");
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s.pbm", goldenDir, gSteps[i].name);
+		if (update)
+		{
+			if ((f = fopen(path, "w")) == NULL)
+			{
+				printf("cannot write %s\n", path);
+				failed++;
+				continue;
+			}
+			fwrite(frame, 1, len, f);
+			fclose(f);
+			printf("updated\n");
+			continue;
+		}
+		diff = OLEDSim_compare(frame, path);
+		if (diff == 0)
+			printf("ok\n");
+		else
+		{
+			failed++;
+			if (diff < 0)
+				printf("missing %s\n", path);
+			else
+				printf("%d pixels differ\n", diff);
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,51 @@
+/*
+ * @file oled_sim_hw.h
+ * @brief Host stand-in for the SPI/GPIO calls made by the OLED driver
+ * @details Force-included (gcc -include) ahead of every source of the simulator build.
+ *          The real ti_msp_dl_config.h is pulled in first so that its include guard
+ *          keeps the driverlib inline functions intact; the calls used by
+ *          oled_spi_V0.2.c are then redirected to the virtual panel in oled_sim.c.
+ * @author Ldk, InnoLegend team.
+ */
+#ifndef __OLED_SIM_HW_H
+#define __OLED_SIM_HW_H
+
+#include "ti_msp_dl_config.h"
+
+void OLEDSim_spiWrite(uint8_t data);
+void OLEDSim_gpio(uint32_t pins, uint8_t level);
+void OLEDSim_irqMask(uint32_t set, uint32_t clear);
+DL_SPI_IIDX OLEDSim_pendingIrq(void);
+void OLEDSim_wfi(void);
+
+#undef DL_SPI_transmitData8
+#undef DL_SPI_isBusy
+#undef DL_GPIO_setPins
+#undef DL_GPIO_clearPins
+#undef delay_cycles
+#undef DL_SPI_isTXFIFOFull
+#undef DL_SPI_enableInterrupt
+#undef DL_SPI_disableInterrupt
+#undef DL_SPI_clearInterruptStatus
+#undef DL_SPI_getPendingInterrupt
+#undef NVIC_EnableIRQ
+#undef __WFI
+
+#define DL_SPI_transmitData8(spi, data) OLEDSim_spiWrite(data)
+#define DL_SPI_isBusy(spi) false
+#define DL_GPIO_setPins(gpio, pins) OLEDSim_gpio(pins, 1)
+#define DL_GPIO_clearPins(gpio, pins) OLEDSim_gpio(pins, 0)
+#define delay_cycles(cycles) ((void)0)
+
+// The SPI finishes every transfer instantly; its interrupt runs whenever the driver sleeps in WFI
+#define DL_SPI_isTXFIFOFull(spi) false
+#define DL_SPI_enableInterrupt(spi, mask) OLEDSim_irqMask(mask, 0)
+#define DL_SPI_disableInterrupt(spi, mask) OLEDSim_irqMask(0, mask)
+#define DL_SPI_clearInterruptStatus(spi, mask) ((void)0)
+#define DL_SPI_getPendingInterrupt(spi) OLEDSim_pendingIrq()
+#define NVIC_EnableIRQ(irq) ((void)0)
+#define __disable_irq() ((void)0)
+#define __enable_irq() ((void)0)
+#define __WFI() OLEDSim_wfi()
+
+#endif
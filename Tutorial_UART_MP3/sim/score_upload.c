@@ -0,0 +1,462 @@
+/*
+ * @file score_upload.c
+ * @brief Host side of the score upload (ScoreStore.h), and a loopback test of both sides
+ * @details Upload a score to the board over its UART (1 Mbaud, 8N1), then play it with "play ID":
+ *              ./score_upload DEVICE ID SCORE
+ *          SCORE is a text file of notes, one "Hz ms" per line (Hz 0 = rest, # starts a comment);
+ *          each note becomes a struct MusicNote with the timer period Cal_Frq / Hz.
+ *          The host sends "upload ID", waits for the ready ACK, then keeps up to SCORE_WINDOW
+ *          data frames in flight. A repeated ACK (a frame lost or damaged) or no ACK for
+ *          HOST_TIMEOUT_MS makes it go back to the first unACKed frame.
+ *
+ *          The loopback test runs ScoreStore.c, LogFS.c and FlashCache.c against the simulated SPI
+ *          flash, on a simulated line that damages or drops bytes both ways at a given rate. Time
+ *          is counted in byte times at 1 Mbaud. Each upload must store the exact notes, which are
+ *          checked through ScoreStore_play; the line efficiency (score bytes / bytes sent) is printed.
+ *              ./score_upload loop [notes, default 4000] [errors per million bytes, default 100] [seed, default 1]
+ *          The exit code is the number of failed checks. Up to 1000 errors per million bytes the
+ *          uploads must go through; far above that the host may give up (HOST_RETRIES).
+ *
+ *          Build from the project root:
+ *              gcc -O2 -std=gnu11 -D__MSPM0G3507__ -Wall -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast \
+ *                  -Isim -ICore/inc -IDriver -IDriver/CMSIS/Core/Include \
+ *                  -DSCORE_STORE_PUTC=ScoreLine_mcuPutc -o score_upload sim/score_upload.c sim/spiflash_sim.c \
+ *                  Core/src/ScoreStore.c Core/src/LogFS.c Core/src/FlashCache.c Core/src/MathUtil.c \
+ *                  Driver/ti/driverlib/dl_mathacl.c
+ * @author Ldk, InnoLegend team.
+ */
+#include "ScoreStore.h"
+#include "LogFS.h"
+#include "MusicPlayer.h"
+#include "spiflash_sim.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_TIMEOUT_MS 200			//No ACK this long: resend from the first unACKed frame;
+#define HOST_READY_MS 1000			//Wait for the ready ACK after the command line;
+#define HOST_RETRIES 8				//Time-outs in a row before giving up;
+#define HOST_NOTES_MAX 65536
+#define LOOP_FLASH (256 * 1024)		//Simulated SPI flash;
+#define LOOP_BYTE_US 10				//1 Mbaud, 8N1;
+#define LOOP_POLL_BYTES 37			//Bytes received between ScoreStore_poll calls, so the ring fills a bit;
+#define LOOP_ACK_MAX 4096
+
+static struct MusicNote Host_Notes[HOST_NOTES_MAX];
+static uint32_t Host_NoteCount = 0;
+static uint32_t Host_Sent = 0;			//Bytes sent, frames and command line;
+static uint32_t Host_Resent = 0;		//Data frames sent more than once;
+static uint32_t Host_Rewinds = 0;
+
+//Line: the serial port, or the loopback to the code of the board;
+static int Host_Fd = -1;
+static uint8_t Loop = 0;
+static uint64_t Loop_Us = 0;			//Simulated time;
+static uint32_t Loop_ErrorRate = 0;		//Per million bytes;
+static uint32_t Loop_Errors = 0;
+static uint8_t Loop_Ack[LOOP_ACK_MAX];	//Bytes from the board waiting for the host;
+static uint32_t Loop_AckHead = 0, Loop_AckTail = 0;
+static uint32_t Loop_RxCount = 0;
+static struct MusicNote Loop_Played[HOST_NOTES_MAX];
+static uint32_t Loop_PlayedCount = 0;
+static uint32_t Loop_Failed = 0;
+
+uint32_t SysTime_getMs(){ return Loop_Us / 1000; }
+
+static uint32_t Host_ms(void)
+{
+	struct timespec ts;
+	if (Loop)
+		return Loop_Us / 1000;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief A byte the line damages or drops, or -1 if it gets through
+ */
+static int Loop_error(uint8_t byte)
+{
+	if (Loop_ErrorRate == 0 || (uint32_t)rand() % 1000000 >= Loop_ErrorRate)
+		return -1;
+	++Loop_Errors;
+	return rand() & 1 ? 256 : byte ^ (1 << rand() % 8);	//256: dropped;
+}
+
+//playMusic of the board: record the notes ScoreStore_play hands over;
+void playMusic(struct MusicNote Score[], uint16_t ScoreLength)
+{
+	if (Loop_PlayedCount + ScoreLength > HOST_NOTES_MAX)
+		return;
+	memcpy(Loop_Played + Loop_PlayedCount, Score, ScoreLength * sizeof(struct MusicNote));
+	Loop_PlayedCount += ScoreLength;
+}
+
+//SCORE_STORE_PUTC of the board: its ACK bytes go back to the host;
+void ScoreLine_mcuPutc(uint8_t c)
+{
+	int e = Loop_error(c);
+	if (e == 256 || Loop_AckHead - Loop_AckTail == LOOP_ACK_MAX)
+		return;
+	Loop_Ack[Loop_AckHead++ % LOOP_ACK_MAX] = e < 0 ? c : e;
+}
+
+/**
+ * @brief What the board's UART interrupt and main loop do with a received byte
+ */
+static void Loop_deliver(uint8_t c)
+{
+	int e = Loop_error(c);
+	static char line[64];
+	static uint32_t lineLen = 0;
+	Loop_Us += LOOP_BYTE_US;
+	if (e == 256)
+		return;
+	c = e < 0 ? c : e;
+	if (ScoreStore_receiving())
+	{
+		ScoreStore_rx(c);
+		if (++Loop_RxCount % LOOP_POLL_BYTES == 0)
+			ScoreStore_poll();
+		return;
+	}
+	//Command line: only "upload N" is of interest here;
+	if (c != '\n')
+	{
+		if (lineLen < sizeof(line) - 1)
+			line[lineLen++] = c;
+		return;
+	}
+	line[lineLen] = 0;
+	lineLen = 0;
+	if (strncmp(line, "upload ", 7) == 0)
+		ScoreStore_begin(atoi(line + 7));
+}
+
+static void Host_send(const uint8_t *p, uint32_t len)
+{
+	Host_Sent += len;
+	if (Loop)
+	{
+		while (len--)
+			Loop_deliver(*p++);
+		return;
+	}
+	while (len)
+	{
+		ssize_t n = write(Host_Fd, p, len);
+		if (n <= 0)
+		{
+			perror("write");
+			exit(1);
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief A byte from the board, or -1 after timeoutMs without one
+ */
+static int Host_recv(uint32_t timeoutMs)
+{
+	uint32_t c;
+	if (Loop)
+	{
+		//The board catches up while the host waits;
+		for (c = 0; Loop_AckTail == Loop_AckHead; c++)
+		{
+			if (ScoreStore_receiving())
+				ScoreStore_poll();
+			if (Loop_AckTail != Loop_AckHead)
+				break;
+			if (c == timeoutMs)
+				return -1;
+			Loop_Us += 1000;
+		}
+		return Loop_Ack[Loop_AckTail++ % LOOP_ACK_MAX];
+	}
+	fd_set set;
+	struct timeval tv = {timeoutMs / 1000, timeoutMs % 1000 * 1000};
+	FD_ZERO(&set);
+	FD_SET(Host_Fd, &set);
+	uint8_t byte;
+	if (select(Host_Fd + 1, &set, 0, 0, &tv) <= 0 || read(Host_Fd, &byte, 1) != 1)
+		return -1;
+	return byte;
+}
+
+static uint16_t Host_crc(const uint8_t *p, uint16_t len)
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t bit;
+	while (len--)
+	{
+		crc ^= (uint16_t)*p++ << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static void Host_frame(uint8_t type, uint16_t seq, const void *payload, uint8_t len)
+{
+	uint8_t f[SCORE_FRAME_HEADER + SCORE_CHUNK_MAX + 2] = {SCORE_FRAME_SYNC0, SCORE_FRAME_SYNC1, type, seq & 0xFF, seq >> 8, len};
+	uint16_t crc;
+	memcpy(f + SCORE_FRAME_HEADER, payload, len);
+	crc = Host_crc(f + 2, SCORE_FRAME_HEADER - 2 + len);
+	f[SCORE_FRAME_HEADER + len] = crc & 0xFF;
+	f[SCORE_FRAME_HEADER + len + 1] = crc >> 8;
+	Host_send(f, SCORE_FRAME_HEADER + len + 2);
+}
+
+/**
+ * @brief Wait for an ACK frame
+ * @return Its seq, or -1 after timeoutMs (bytes of a frame cut short are kept for the next call)
+ */
+static int Host_ack(uint8_t *status, uint32_t timeoutMs)
+{
+	static uint8_t f[SCORE_FRAME_HEADER + 1 + 2];
+	static uint32_t len = 0;
+	uint32_t start = Host_ms();
+	int c;
+	while ((c = Host_recv(timeoutMs - (Host_ms() - start < timeoutMs ? Host_ms() - start : timeoutMs))) >= 0)
+	{
+		f[len++] = c;
+		if ((len == 1 && c != SCORE_FRAME_SYNC0) || (len == 3 && c != SCORE_FRAME_ACK) || (len == 6 && c != 1))
+			len = 0;
+		else if (len == 2 && c != SCORE_FRAME_SYNC1)
+			len = c == SCORE_FRAME_SYNC0;
+		else if (len == sizeof(f))
+		{
+			len = 0;
+			if ((f[7] | f[8] << 8) == Host_crc(f + 2, 5))
+			{
+				*status = f[6];
+				return f[3] | f[4] << 8;
+			}
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Upload Host_Notes as score id
+ * @return SCORE_DONE or SCORE_FAILED
+ */
+static uint8_t Host_upload(uint16_t id)
+{
+	const uint8_t *data = (const uint8_t *)Host_Notes;
+	uint32_t total = Host_NoteCount * SCORE_NOTE_BYTES;
+	uint32_t frames = (total + SCORE_CHUNK_MAX - 1) / SCORE_CHUNK_MAX, base = 0, next = 0, high = 0, retries = 0, progressMs;
+	uint8_t status, rewound = 0;
+	char line[32];
+	int seq;
+	if (frames == 0 || frames > 0xFFFF)
+		return SCORE_FAILED;
+	//The leading newline ends any line the command line holds; if the board got a damaged
+	//command, it sends nothing, if it lost the ready ACK, it repeats it;
+	sprintf(line, "\nupload %u\n", id);
+	for (retries = 0, seq = -1; seq != 0 && retries <= HOST_RETRIES; retries++)
+	{
+		Host_send((const uint8_t *)line, strlen(line));
+		do
+			seq = Host_ack(&status, HOST_READY_MS);
+		while (seq > 0);
+	}
+	if (seq != 0 || status != SCORE_OK)
+	{
+		printf("No ready ACK%s\n", seq == 0 ? " (bad ID, or the SPI flash is missing or full)" : "");
+		return SCORE_FAILED;
+	}
+	retries = 0;
+	progressMs = Host_ms();
+	while (base < frames)
+	{
+		while (next < frames && next < base + SCORE_WINDOW)
+		{
+			uint32_t len = total - next * SCORE_CHUNK_MAX < SCORE_CHUNK_MAX ? total - next * SCORE_CHUNK_MAX : SCORE_CHUNK_MAX;
+			if (next < high)
+				++Host_Resent;
+			Host_frame(SCORE_FRAME_DATA, next, data + next * SCORE_CHUNK_MAX, len);
+			if (++next > high)
+				high = next;
+		}
+		seq = Host_ack(&status, HOST_TIMEOUT_MS);
+		if (seq >= 0 && status == SCORE_FAILED)
+			return SCORE_FAILED;
+		if (seq >= 0 && (uint32_t)seq > base && (uint32_t)seq <= next)
+			base = seq, rewound = 0, retries = 0, progressMs = Host_ms();
+		else if (seq >= 0 && (uint32_t)seq == base && !rewound)
+			next = base, rewound = 1, ++Host_Rewinds;	//Frame base lost: the board drops all after it;
+		else if (Host_ms() - progressMs >= HOST_TIMEOUT_MS)
+		{
+			//No ACK, or only repeats of base after the frames resent were lost too;
+			if (++retries > HOST_RETRIES)
+				return SCORE_FAILED;
+			next = base;
+			rewound = 1;
+			progressMs = Host_ms();
+			++Host_Rewinds;
+		}
+	}
+	for (retries = 0; retries <= HOST_RETRIES; retries++)
+	{
+		Host_frame(SCORE_FRAME_END, frames, &total, 4);
+		while ((seq = Host_ack(&status, HOST_TIMEOUT_MS)) >= 0)
+			if (status == SCORE_DONE || status == SCORE_FAILED)
+				return status;
+	}
+	return SCORE_FAILED;
+}
+
+/**
+ * @brief Read a score text file into Host_Notes
+ */
+static int Host_load(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	char line[128];
+	unsigned hz, ms;
+	uint32_t n = 0;
+	if (!fp)
+	{
+		perror(path);
+		return -1;
+	}
+	Host_NoteCount = 0;
+	while (fgets(line, sizeof(line), fp))
+	{
+		++n;
+		if (line[strspn(line, " \t\r\n")] == '#' || line[strspn(line, " \t\r\n")] == 0)
+			continue;
+		if (sscanf(line, "%u %u", &hz, &ms) != 2 || (hz && (Cal_Frq / hz == 0 || Cal_Frq / hz > 0xFFFF))
+			|| ms > 0xFFFF || Host_NoteCount == HOST_NOTES_MAX)
+		{
+			fprintf(stderr, "%s:%u: bad note (\"Hz ms\", Hz 0 or %u..%u)\n", path, n, Cal_Frq / 0xFFFF + 1, Cal_Frq);
+			fclose(fp);
+			return -1;
+		}
+		Host_Notes[Host_NoteCount].Frq = hz ? Cal_Frq / hz : 0;
+		Host_Notes[Host_NoteCount++].length = ms;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int Host_open(const char *dev)
+{
+	struct termios tio;
+	Host_Fd = open(dev, O_RDWR | O_NOCTTY);
+	if (Host_Fd < 0 || tcgetattr(Host_Fd, &tio))
+	{
+		perror(dev);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, B1000000);
+	cfsetospeed(&tio, B1000000);
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	if (tcsetattr(Host_Fd, TCSANOW, &tio))
+	{
+		perror(dev);
+		return -1;
+	}
+	tcflush(Host_Fd, TCIOFLUSH);
+	return 0;
+}
+
+static void Loop_check(uint8_t ok, const char *what)
+{
+	if (ok)
+		return;
+	++Loop_Failed;
+	printf("FAILED: %s\n", what);
+}
+
+/**
+ * @brief Upload a score of random notes as id, check it plays back the same, print the line figures
+ */
+static void Loop_upload(uint16_t id, uint32_t notes)
+{
+	uint32_t i, start = Host_ms(), sent = Host_Sent, resent = Host_Resent, rewinds = Host_Rewinds, ms;
+	uint8_t status;
+	Host_NoteCount = notes;
+	for (i = 0; i < notes; i++)
+	{
+		Host_Notes[i].Frq = rand() % 8 ? Cal_Frq / (200 + rand() % 3000) : 0;
+		Host_Notes[i].length = 20 + rand() % 400;
+	}
+	status = Host_upload(id);
+	ms = Host_ms() - start;
+	Loop_check(status == SCORE_DONE, "upload not acknowledged DONE");
+	Loop_PlayedCount = 0;
+	Loop_check(ScoreStore_play(id) == SCORE_OK, "stored score not found");
+	Loop_check(Loop_PlayedCount == notes && memcmp(Loop_Played, Host_Notes, notes * SCORE_NOTE_BYTES) == 0,
+		"played notes differ from the uploaded ones");
+	printf("score%u: %u bytes, %u sent (%u%% efficiency), %u frames resent, %u rewinds, %u ms, %u KB/s\n",
+		id, notes * SCORE_NOTE_BYTES, Host_Sent - sent, (uint32_t)(100ull * notes * SCORE_NOTE_BYTES / (Host_Sent - sent)),
+		Host_Resent - resent, Host_Rewinds - rewinds, ms, ms ? notes * SCORE_NOTE_BYTES * 1000 / 1024 / ms : 0);
+}
+
+static int Loop_run(uint32_t notes, uint32_t errorRate, uint32_t seed)
+{
+	uint8_t file, count = 0;
+	Loop = 1;
+	Loop_ErrorRate = errorRate;
+	srand(seed);
+	SPIFlashSim_init(LOOP_FLASH);
+	if (LogFS_mount(0, LOOP_FLASH) != LOGFS_OK)
+		return 1;
+	Loop_upload(7, notes);
+	Loop_upload(8, notes / 3 + 1);
+	Loop_upload(7, notes / 2 + 1);		//Replaces the first score 7;
+	for (file = 0; file < LOGFS_FILES; file++)
+		count += LogFS_name(file) != 0;
+	Loop_check(count == 2, "a replaced score left its file behind");
+	Loop_check(LogFS_open("score7", &file) == LOGFS_OK
+		&& LogFS_size(file) == (notes / 2 + 1) * SCORE_NOTE_BYTES + 8, "score7 was not replaced");
+
+	//Cut short: no END frame, the board gives up and the score is not kept;
+	Host_NoteCount = 64;
+	Host_send((const uint8_t *)"upload 9\n", 9);
+	Host_frame(SCORE_FRAME_DATA, 0, Host_Notes, SCORE_CHUNK_MAX);
+	while (ScoreStore_receiving() && Loop_Us < (uint64_t)Host_ms() * 1000 + SCORE_TIMEOUT_MS * 2000)
+	{
+		ScoreStore_poll();
+		Loop_Us += 1000;
+	}
+	Loop_check(!ScoreStore_receiving(), "an upload cut short did not time out");
+	Loop_check(ScoreStore_play(9) == SCORE_NOT_FOUND, "an upload cut short can be played");
+	Loop_check(ScoreStore_play(6) == SCORE_NOT_FOUND, "a missing score can be played");
+
+	printf("%u line errors; board: %u frames stored, %u bad, %u bytes lost\n",
+		Loop_Errors, gScoreFrames, gScoreBadFrames, gScoreRxOverflow);
+	printf("%u failed checks\n", Loop_Failed);
+	return Loop_Failed > 255 ? 255 : Loop_Failed;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t status;
+	if (argc >= 2 && strcmp(argv[1], "loop") == 0)
+		return Loop_run(argc > 2 ? strtoul(argv[2], 0, 0) : 4000, argc > 3 ? strtoul(argv[3], 0, 0) : 100,
+			argc > 4 ? strtoul(argv[4], 0, 0) : 1);
+	if (argc != 4)
+	{
+		fprintf(stderr, "usage: %s DEVICE ID SCORE | loop [notes] [errors per million bytes] [seed]\n", argv[0]);
+		return 2;
+	}
+	if (Host_load(argv[3]) || Host_open(argv[1]))
+		return 1;
+	status = Host_upload(atoi(argv[2]));
+	printf("%s: %u notes, %u bytes sent, %u frames resent\n", status == SCORE_DONE ? "Stored" : "Failed",
+		Host_NoteCount, Host_Sent, Host_Resent);
+	return status != SCORE_DONE;
+}
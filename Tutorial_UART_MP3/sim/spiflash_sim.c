@@ -0,0 +1,152 @@
+/*
+ * @file spiflash_sim.c
+ * @brief Simulated SPI NOR flash for the host builds of the code above SPIFlash.h
+ * @details See spiflash_sim.h. A program cut by the power clears only some of its bits, a cut
+ *          erase sets only some bits of the sector; then the caller's
+ *          setjmp(gSPIFlashSimPowerFail) returns 1, as a reset would restart the code.
+ * @author Ldk, InnoLegend team.
+ */
+#include "spiflash_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct SPIFlashInfo gSPIFlash = {0};
+uint32_t gSPIFlashReadBytes = 0;
+uint32_t gSPIFlashProgramBytes = 0;
+uint32_t gSPIFlashErases = 0;
+uint32_t gSPIFlashBusyPolls = 0;
+uint32_t gSPIFlashBusWaits = 0;
+
+uint8_t *gSPIFlashSim = 0;
+uint32_t gSPIFlashSimSteps = 0;
+uint32_t gSPIFlashSimCutAt = 0;
+jmp_buf gSPIFlashSimPowerFail;
+
+/**
+ * @brief Allocate an erased array of size bytes (a multiple of SPI_FLASH_SECTOR) and clear the counters
+ */
+void SPIFlashSim_init(uint32_t size)
+{
+	free(gSPIFlashSim);
+	gSPIFlashSim = malloc(size);
+	if (!gSPIFlashSim)
+	{
+		perror("spiflash_sim");
+		exit(1);
+	}
+	memset(gSPIFlashSim, 0xFF, size);
+	gSPIFlash.manufacturer = 0xEF;
+	gSPIFlash.type = 0x40;
+	for (gSPIFlash.capacity = 0; ((uint32_t)1 << gSPIFlash.capacity) < size; gSPIFlash.capacity++);
+	gSPIFlash.size = size;
+	gSPIFlashReadBytes = gSPIFlashProgramBytes = gSPIFlashErases = 0;
+	gSPIFlashSimSteps = gSPIFlashSimCutAt = 0;
+}
+
+/**
+ * @brief Fail the power a number of steps from now
+ * @param steps 1 = during the next page program or erase, 0 = never
+ */
+void SPIFlashSim_cut(uint32_t steps)
+{
+	gSPIFlashSimCutAt = steps ? gSPIFlashSimSteps + steps : 0;
+}
+
+static uint8_t SPIFlashSim_step(void)
+{
+	if (++gSPIFlashSimSteps != gSPIFlashSimCutAt)
+		return 0;
+	gSPIFlashSimCutAt = 0;
+	return 1;
+}
+
+uint8_t SPIFlash_init()
+{
+	return gSPIFlash.size ? SPI_FLASH_OK : SPI_FLASH_NONE;
+}
+
+uint8_t SPIFlash_readStart(uint32_t addr, void *buf, uint32_t len)
+{
+	if (gSPIFlash.size == 0)
+		return SPI_FLASH_NONE;
+	if (addr > gSPIFlash.size || len > gSPIFlash.size - addr)
+		return SPI_FLASH_INVALID;
+	memcpy(buf, gSPIFlashSim + addr, len);
+	gSPIFlashReadBytes += len;
+	return SPI_FLASH_OK;
+}
+
+uint8_t SPIFlash_readBusy()
+{
+	return 0;
+}
+
+uint8_t SPIFlash_read(uint32_t addr, void *buf, uint32_t len)
+{
+	return SPIFlash_readStart(addr, buf, len);
+}
+
+uint8_t SPIFlash_program(uint32_t addr, const void *data, uint16_t len)
+{
+	const uint8_t *src = data;
+	uint32_t i;
+	if (gSPIFlash.size == 0)
+		return SPI_FLASH_NONE;
+	if (addr > gSPIFlash.size || len > gSPIFlash.size - addr
+		|| (addr + len - 1) / SPI_FLASH_PAGE - addr / SPI_FLASH_PAGE >= SPI_FLASH_QUEUE)
+		return SPI_FLASH_INVALID;
+	for (i = 0; i < len; i++)
+	{
+		if (i == 0 || (addr + i) % SPI_FLASH_PAGE == 0)
+			if (SPIFlashSim_step())
+			{
+				//Cut off mid-page: each bit to be cleared may or may not be;
+				for (; i < len && (i == 0 || (addr + i) % SPI_FLASH_PAGE); i++)
+					gSPIFlashSim[addr + i] &= src[i] | rand();
+				longjmp(gSPIFlashSimPowerFail, 1);
+			}
+		gSPIFlashSim[addr + i] &= src[i];
+	}
+	gSPIFlashProgramBytes += len;
+	return SPI_FLASH_OK;
+}
+
+uint8_t SPIFlash_erase(uint32_t addr)
+{
+	uint32_t i;
+	if (gSPIFlash.size == 0)
+		return SPI_FLASH_NONE;
+	if (addr >= gSPIFlash.size || addr % SPI_FLASH_SECTOR)
+		return SPI_FLASH_INVALID;
+	++gSPIFlashErases;
+	if (SPIFlashSim_step())
+	{
+		//Cut off mid-erase: some bits are back to 1, the others keep their old value;
+		for (i = 0; i < SPI_FLASH_SECTOR; i++)
+			gSPIFlashSim[addr + i] |= rand();
+		longjmp(gSPIFlashSimPowerFail, 1);
+	}
+	memset(gSPIFlashSim + addr, 0xFF, SPI_FLASH_SECTOR);
+	return SPI_FLASH_OK;
+}
+
+uint8_t SPIFlash_poll()
+{
+	return 1;
+}
+
+void SPIFlash_sync()
+{
+}
+
+void SPIFlash_bench(uint32_t addr, uint32_t len)
+{
+}
+
+void SPIFlash_report()
+{
+	printf("SPIFlash: %lu KB; %lu bytes read, %lu programmed, %lu sectors erased\n",
+		(unsigned long)(gSPIFlash.size / 1024), (unsigned long)gSPIFlashReadBytes,
+		(unsigned long)gSPIFlashProgramBytes, (unsigned long)gSPIFlashErases);
+}
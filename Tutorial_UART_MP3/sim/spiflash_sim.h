@@ -0,0 +1,25 @@
+/*
+ * @file spiflash_sim.h
+ * @brief Host stand-in for the SPI NOR flash driver (SPIFlash.h)
+ * @details spiflash_sim.c implements the SPIFlash calls on a RAM array, so the code above the
+ *          driver (LogFS.c) builds and runs on Linux unchanged. Programs can only clear bits,
+ *          an erase sets a 4 KB sector back to 0xFF; both complete at once, in call order, as
+ *          the driver's queue would. Each page program and each erase is one step; with
+ *          SPIFlashSim_cut the power fails during a given step, as in flash_sim.c.
+ * @author Ldk, InnoLegend team.
+ */
+#ifndef __SPIFLASH_SIM_H
+#define __SPIFLASH_SIM_H
+
+#include "SPIFlash.h"
+#include <setjmp.h>
+
+extern uint8_t *gSPIFlashSim;			//The array, gSPIFlash.size bytes;
+extern uint32_t gSPIFlashSimSteps;		//Page programs and erases so far;
+extern uint32_t gSPIFlashSimCutAt;		//Power fails during this step, 0 = never;
+extern jmp_buf gSPIFlashSimPowerFail;	//Where the power failure returns to;
+
+void SPIFlashSim_init(uint32_t size);
+void SPIFlashSim_cut(uint32_t steps);
+
+#endif